@@ -49,6 +49,7 @@ if(CONFIG_CHERRYUSB_DEVICE)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usbd_core.c)
     if(CONFIG_CHERRYUSB_DEVICE_CDC_ACM)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/cdc/usbd_cdc_acm.c)
+    set(CONFIG_CHERRYRB 1)
     endif()
     if(CONFIG_CHERRYUSB_DEVICE_HID)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/hid/usbd_hid.c)
@@ -73,6 +74,9 @@ if(CONFIG_CHERRYUSB_DEVICE)
     endif()
     if(CONFIG_CHERRYUSB_DEVICE_DFU)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/dfu/usbd_dfu.c)
+        if(CONFIG_CHERRYUSB_DEVICE_DFU_IMAGE)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/dfu/dfu_image.c)
+        endif()
     endif()
     if(CONFIG_CHERRYUSB_DEVICE_ADB)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/adb/usbd_adb.c)
@@ -164,6 +168,7 @@ if(CONFIG_CHERRYUSB_HOST)
     endif()
     if(CONFIG_CHERRYUSB_HOST_AUDIO)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/audio/usbh_audio.c)
+    set(CONFIG_CHERRYRB 1)
     endif()
     if(CONFIG_CHERRYUSB_HOST_BLUETOOTH)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/wireless/usbh_bluetooth.c)
@@ -220,6 +225,11 @@ if(CONFIG_CHERRYUSB_HOST)
     if(CONFIG_CHERRYUSB_HOST_PL2303)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/serial/usbh_pl2303.c)
     endif()
+    if(CONFIG_CHERRYUSB_HOST_CDC_ACM OR CONFIG_CHERRYUSB_HOST_CH34X OR CONFIG_CHERRYUSB_HOST_CP210X OR
+       CONFIG_CHERRYUSB_HOST_FTDI OR CONFIG_CHERRYUSB_HOST_PL2303)
+    list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/serial/usbh_serial_engine.c)
+    set(CONFIG_CHERRYRB 1)
+    endif()
     if(CONFIG_CHERRYUSB_HOST_BL616)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/wifi/usbh_bl616.c)
     endif()
@@ -296,6 +306,14 @@ if(DEFINED CONFIG_CHERRYUSB_OSAL)
     endif()
 endif()
 
+if(CONFIG_CHERRYUSB_LOG_DEFERRED)
+list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/common/usb_log.c)
+endif()
+
+if(CONFIG_CHERRYUSB_TRACE)
+list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/common/usb_trace.c)
+endif()
+
 if(CONFIG_CHERRYRB)
 list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/third_party/cherryrb/chry_ringbuffer.c)
 list(APPEND cherryusb_incs ${CMAKE_CURRENT_LIST_DIR}/third_party/cherryrb)
@@ -17,6 +17,45 @@
 /* Enable print with color */
 #define CONFIG_USB_PRINTF_COLOR_ENABLE
 
+/* Record log into ring and print it later with usb_log_deferred_flush, for irq and timing sensitive debug */
+// #define CONFIG_USB_LOG_DEFERRED
+
+#ifdef CONFIG_USB_LOG_DEFERRED
+/* records per core, must be power of 2 */
+#ifndef CONFIG_USB_LOG_DEFERRED_DEPTH
+#define CONFIG_USB_LOG_DEFERRED_DEPTH 64
+#endif
+
+#ifndef CONFIG_USB_LOG_DEFERRED_CORES
+#define CONFIG_USB_LOG_DEFERRED_CORES 1
+#endif
+
+/* bytes per record to keep copies of %s args */
+#ifndef CONFIG_USB_LOG_DEFERRED_STR_SIZE
+#define CONFIG_USB_LOG_DEFERRED_STR_SIZE 32
+#endif
+#endif
+
+/* Trace endpoint latency, irq duration and transfer counters, dump with usb_trace_dump or lsusb -T */
+// #define CONFIG_USB_TRACE
+
+#ifdef CONFIG_USB_TRACE
+/* endpoints traced, device and host endpoints share this table */
+#ifndef CONFIG_USB_TRACE_MAX_EPS
+#define CONFIG_USB_TRACE_MAX_EPS 32
+#endif
+
+/* timestamped events kept for csv export */
+#ifndef CONFIG_USB_TRACE_DEPTH
+#define CONFIG_USB_TRACE_DEPTH 128
+#endif
+
+/* tick rate of usb_trace_get_timestamp */
+#ifndef CONFIG_USB_TRACE_TIMESTAMP_HZ
+#define CONFIG_USB_TRACE_TIMESTAMP_HZ 1000000
+#endif
+#endif
+
 /* data align size when use dma or use dcache */
 #ifndef CONFIG_USB_ALIGN_SIZE
 #define CONFIG_USB_ALIGN_SIZE 4
@@ -45,6 +84,24 @@
 /* Check if the input descriptor is correct */
 // #define CONFIG_USBDEV_DESC_CHECK
 
+/* Descriptor index sizes, descriptors beyond these are still found by parsing the raw list */
+#ifndef CONFIG_USBDEV_DESC_INDEX_CONFIGS
+#define CONFIG_USBDEV_DESC_INDEX_CONFIGS 2
+#endif
+
+#ifndef CONFIG_USBDEV_DESC_INDEX_STRINGS
+#define CONFIG_USBDEV_DESC_INDEX_STRINGS 16
+#endif
+
+/* Interface alternate settings and endpoints of the active configuration */
+#ifndef CONFIG_USBDEV_DESC_INDEX_ALTS
+#define CONFIG_USBDEV_DESC_INDEX_ALTS 32
+#endif
+
+#ifndef CONFIG_USBDEV_DESC_INDEX_EPS
+#define CONFIG_USBDEV_DESC_INDEX_EPS 32
+#endif
+
 /* Enable test mode */
 // #define CONFIG_USBDEV_TEST_MODE
 
@@ -62,6 +119,22 @@
 #define CONFIG_USBDEV_EP0_STACKSIZE 2048
 #endif
 
+/* run endpoint callbacks selected with usbd_ep_set_dispatch in thread instead of isr */
+// #define CONFIG_USBDEV_EP_THREAD
+
+#ifndef CONFIG_USBDEV_EP_PRIO
+#define CONFIG_USBDEV_EP_PRIO 4
+#endif
+
+#ifndef CONFIG_USBDEV_EP_STACKSIZE
+#define CONFIG_USBDEV_EP_STACKSIZE 2048
+#endif
+
+/* completions queued between irq and thread, must be a power of 2 and at least 2 * CONFIG_USBDEV_EP_NUM */
+#ifndef CONFIG_USBDEV_EP_QUEUE_DEPTH
+#define CONFIG_USBDEV_EP_QUEUE_DEPTH 32
+#endif
+
 #ifndef CONFIG_USBDEV_MSC_MAX_LUN
 #define CONFIG_USBDEV_MSC_MAX_LUN 1
 #endif
@@ -96,6 +169,68 @@
 #define CONFIG_USBDEV_MSC_STACKSIZE 2048
 #endif
 
+/* program dfu blocks in while(1) while the next block is received, you should call usbd_dfu_polling in while(1) */
+// #define CONFIG_USBDEV_DFU_POLLING
+
+/* program dfu blocks in thread while the next block is received */
+// #define CONFIG_USBDEV_DFU_THREAD
+
+/* with polling or thread, erase the next sector while idle, only for sectors that end before this address (end of app region) */
+// #define CONFIG_USBDEV_DFU_ERASE_AHEAD_END 0x8100000
+
+#ifndef CONFIG_USBDEV_DFU_PRIO
+#define CONFIG_USBDEV_DFU_PRIO 4
+#endif
+
+#ifndef CONFIG_USBDEV_DFU_STACKSIZE
+#define CONFIG_USBDEV_DFU_STACKSIZE 2048
+#endif
+
+/* accept compressed images from uf2conv.py --image, decoded while programming,
+ * class/dfu/dfu_image.c is built with CONFIG_CHERRYUSB_DEVICE_DFU_IMAGE (cmake) or PKG_CHERRYUSB_DEVICE_DFU_IMAGE (scons)
+ */
+// #define CONFIG_USBDEV_DFU_IMAGE
+
+/* max decoded block size of an image, uses the same size of ram per bus */
+#ifndef CONFIG_USBDEV_DFU_IMAGE_BLOCK_SIZE
+#define CONFIG_USBDEV_DFU_IMAGE_BLOCK_SIZE 4096
+#endif
+
+/* buffered rx/tx stream on cdc acm bulk endpoints, needs cherryrb */
+// #define CONFIG_USBDEV_CDC_ACM_STREAM
+
+#ifndef CONFIG_USBDEV_CDC_ACM_MAX_STREAMS
+#define CONFIG_USBDEV_CDC_ACM_MAX_STREAMS 1
+#endif
+
+/* small writes wait this long to be merged, 0 means send at once */
+#ifndef CONFIG_USBDEV_CDC_ACM_FLUSH_MS
+#define CONFIG_USBDEV_CDC_ACM_FLUSH_MS 2
+#endif
+
+/* hid input report queues per bus and max depth of every queue */
+#ifndef CONFIG_USBDEV_HID_MAX_QUEUES
+#define CONFIG_USBDEV_HID_MAX_QUEUES 2
+#endif
+
+#ifndef CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH
+#define CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH 16
+#endif
+
+/* max frames owned by video stream queue */
+#ifndef CONFIG_USBDEV_VIDEO_MAX_FRAMES
+#define CONFIG_USBDEV_VIDEO_MAX_FRAMES 4
+#endif
+
+/* adb streams opened by host at the same time and max WRTE payload, payload must not exceed 256K */
+#ifndef CONFIG_USBDEV_ADB_MAX_STREAMS
+#define CONFIG_USBDEV_ADB_MAX_STREAMS 4
+#endif
+
+#ifndef CONFIG_USBDEV_ADB_MAX_PAYLOAD
+#define CONFIG_USBDEV_ADB_MAX_PAYLOAD (4 * 1024)
+#endif
+
 #ifndef CONFIG_USBDEV_RNDIS_RESP_BUFFER_SIZE
 #define CONFIG_USBDEV_RNDIS_RESP_BUFFER_SIZE 156
 #endif
@@ -130,8 +265,39 @@
 #define CONFIG_USBHOST_MAX_AUDIO_CLASS   1
 #define CONFIG_USBHOST_MAX_VIDEO_CLASS   1
 
+/* every network class instance owns its own rx/tx buffers and rx thread */
+#define CONFIG_USBHOST_MAX_CDC_ECM_CLASS 1
+#define CONFIG_USBHOST_MAX_CDC_NCM_CLASS 1
+#define CONFIG_USBHOST_MAX_RNDIS_CLASS   1
+#define CONFIG_USBHOST_MAX_RTL8152_CLASS 1
+#define CONFIG_USBHOST_MAX_ASIX_CLASS    1
+
 #define CONFIG_USBHOST_DEV_NAMELEN 16
 
+/* report descriptor bytes and parsed fields for every hid interface */
+#ifndef CONFIG_USBHOST_HID_REPORT_DESC_SIZE
+#define CONFIG_USBHOST_HID_REPORT_DESC_SIZE 256
+#endif
+
+#ifndef CONFIG_USBHOST_HID_MAX_FIELDS
+#define CONFIG_USBHOST_HID_MAX_FIELDS 32
+#endif
+
+/* usages of array items given one by one, such as keyboard and consumer control */
+#ifndef CONFIG_USBHOST_HID_MAX_USAGES
+#define CONFIG_USBHOST_HID_MAX_USAGES 64
+#endif
+
+/* outstanding iso in urbs for video stream */
+#ifndef CONFIG_USBHOST_VIDEO_MAX_URBS
+#define CONFIG_USBHOST_VIDEO_MAX_URBS 2
+#endif
+
+/* outstanding iso urbs for audio stream, more urbs means more latency */
+#ifndef CONFIG_USBHOST_AUDIO_MAX_URBS
+#define CONFIG_USBHOST_AUDIO_MAX_URBS 2
+#endif
+
 #ifndef CONFIG_USBHOST_PSC_PRIO
 #define CONFIG_USBHOST_PSC_PRIO 0
 #endif
@@ -188,7 +354,9 @@
 #ifndef CONFIG_USBHOST_ASIX_ETH_MAX_RX_SIZE
 #define CONFIG_USBHOST_ASIX_ETH_MAX_RX_SIZE (2048)
 #endif
-/* Because lwip do not support multi pbuf at a time, so increasing this variable has no performance improvement */
+/* Two tx buffers of this size are used, frames sent while one is on the bus are packed
+ * into the other one, so 4K ~ 16K saves a lot of usb transfers under load.
+ */
 #ifndef CONFIG_USBHOST_ASIX_ETH_MAX_TX_SIZE
 #define CONFIG_USBHOST_ASIX_ETH_MAX_TX_SIZE (2048)
 #endif
@@ -199,10 +367,18 @@
 #ifndef CONFIG_USBHOST_RTL8152_ETH_MAX_RX_SIZE
 #define CONFIG_USBHOST_RTL8152_ETH_MAX_RX_SIZE (2048)
 #endif
-/* Because lwip do not support multi pbuf at a time, so increasing this variable has no performance improvement */
+/* Two tx buffers of this size are used, frames sent while one is on the bus are aggregated
+ * into the other one, so 4K ~ 16K saves a lot of usb transfers under load.
+ */
 #ifndef CONFIG_USBHOST_RTL8152_ETH_MAX_TX_SIZE
 #define CONFIG_USBHOST_RTL8152_ETH_MAX_TX_SIZE (2048)
 #endif
+/* USB_RX_BUF_TH, rx aggregation timeout(high 16 bits) and threshold, bigger value means less usb transfers and more latency */
+// #define CONFIG_USBHOST_RTL8152_RX_BUF_TH 0x7a120180
+/* hardware fills tcp checksum, netif should stop generating it, udp is still generated by netif */
+// #define CONFIG_USBHOST_RTL8152_TX_CSUM
+/* report hardware rx checksum result, netif can skip checking verified frames */
+// #define CONFIG_USBHOST_RTL8152_RX_CSUM
 
 #define CONFIG_USBHOST_BLUETOOTH_HCI_H4
 // #define CONFIG_USBHOST_BLUETOOTH_HCI_LOG
@@ -214,6 +390,13 @@
 #define CONFIG_USBHOST_BLUETOOTH_RX_SIZE 2048
 #endif
 
+/* ================ USB OTG Configuration ================*/
+
+/* id/vbus debounce time, usbotg_trigger_role_change restarts a timer instead of switching at once, 0 to disable */
+#ifndef CONFIG_USBOTG_DEBOUNCE_MS
+#define CONFIG_USBOTG_DEBOUNCE_MS 0
+#endif
+
 /* ================ USB Device Port Configuration ================*/
 
 #ifndef CONFIG_USBDEV_MAX_BUS
@@ -5,22 +5,35 @@
  */
 #include "usbd_core.h"
 #include "usbd_adb.h"
+#include "usb_osal.h"
 
 #define ADB_OUT_EP_IDX        0
 #define ADB_IN_EP_IDX         1
 
 #define ADB_STATE_READ_MSG    0
 #define ADB_STATE_READ_DATA   1
-#define ADB_STATE_WRITE_MSG   2
-#define ADB_STATE_WRITE_DATA  3
-#define ADB_STATE_AWRITE_MSG  4
-#define ADB_STATE_AWRITE_DATA 5
+
+#define ADB_STATE_WRITE_IDLE  0
+#define ADB_STATE_WRITE_MSG   1
+#define ADB_STATE_WRITE_DATA  2
+
+#ifndef CONFIG_USBDEV_ADB_MAX_STREAMS
+#define CONFIG_USBDEV_ADB_MAX_STREAMS 4
+#endif
+
+#ifndef CONFIG_USBDEV_ADB_MAX_PAYLOAD
+#define CONFIG_USBDEV_ADB_MAX_PAYLOAD (4 * 1024)
+#endif
 
 #define MAX_PAYLOAD_V1        (4 * 1024)
 #define MAX_PAYLOAD_V2        (256 * 1024)
-#define MAX_PAYLOAD           MAX_PAYLOAD_V1
+#define MAX_PAYLOAD           CONFIG_USBDEV_ADB_MAX_PAYLOAD
 #define A_VERSION             0x01000000
 
+#if MAX_PAYLOAD > MAX_PAYLOAD_V2
+#error "CONFIG_USBDEV_ADB_MAX_PAYLOAD must not be larger than 256K"
+#endif
+
 #define A_SYNC                0x434e5953
 #define A_CNXN                0x4e584e43
 #define A_OPEN                0x4e45504f
@@ -29,6 +42,9 @@
 #define A_WRTE                0x45545257
 #define A_AUTH                0x48545541
 
+/* every stream has at most one OKAY and one CLSE waiting, plus refused OPENs */
+#define ADB_CTRL_QUEUE_SIZE   (2 * CONFIG_USBDEV_ADB_MAX_STREAMS + 2)
+
 struct adb_msg {
     uint32_t command;     /* command identifier constant (A_CNXN, ...) */
     uint32_t arg0;        /* first argument                            */
@@ -40,23 +56,44 @@ struct adb_msg {
 
 struct adb_packet {
     struct adb_msg msg;
-    uint8_t payload[MAX_PAYLOAD];
+    uint8_t payload[MAX_PAYLOAD + 1]; /* one more for OPEN destination terminator */
+};
+
+struct adb_ctrl_msg {
+    uint32_t command;
+    uint32_t arg0;
+    uint32_t arg1;
+};
+
+struct adb_stream {
+    uint32_t localid; /* 0 means unused */
+    uint32_t remoteid;
+    uint8_t service;  /* USBD_ADB_SERVICE_xxx of OPEN destination */
+    bool ready;       /* remote has acked our last WRTE */
+    bool tx_pending;  /* usbd_abd_write is not done yet */
+    const uint8_t *tx_data;
+    uint32_t tx_len;
 };
 
 struct usbd_adb {
-    uint8_t state;
     uint8_t common_state;
     uint8_t write_state;
-    bool writable;
-    uint32_t localid;
-    uint32_t shell_remoteid;
-    uint32_t file_remoteid;
-} adb_client;
-
-static struct usbd_endpoint adb_ep_data[2];
-
-USB_NOCACHE_RAM_SECTION struct adb_packet tx_packet;
-USB_NOCACHE_RAM_SECTION struct adb_packet rx_packet;
+    bool cnxn_pending;
+    uint8_t rr_index;
+    uint32_t max_payload;
+    uint32_t next_localid;
+    struct adb_stream streams[CONFIG_USBDEV_ADB_MAX_STREAMS];
+    struct adb_stream *tx_stream; /* owner of the WRTE on the bus */
+    bool tx_last;                 /* this WRTE completes the owner write */
+    struct adb_ctrl_msg ctrl[ADB_CTRL_QUEUE_SIZE];
+    uint8_t ctrl_head;
+    uint8_t ctrl_tail;
+} adb_client[CONFIG_USBDEV_MAX_BUS];
+
+static struct usbd_endpoint adb_ep_data[CONFIG_USBDEV_MAX_BUS][2];
+
+USB_NOCACHE_RAM_SECTION struct adb_packet tx_packet[CONFIG_USBDEV_MAX_BUS];
+USB_NOCACHE_RAM_SECTION struct adb_packet rx_packet[CONFIG_USBDEV_MAX_BUS];
 
 static inline uint32_t adb_packet_checksum(struct adb_packet *packet)
 {
@@ -70,171 +107,358 @@ static inline uint32_t adb_packet_checksum(struct adb_packet *packet)
     return sum;
 }
 
-static uint32_t usbd_adb_get_remoteid(uint32_t localid)
+static struct adb_stream *adb_find_stream(uint8_t busid, uint32_t localid)
 {
-    if (localid == ADB_SHELL_LOALID) {
-        return adb_client.shell_remoteid;
-    } else {
-        return adb_client.file_remoteid;
+    if (localid == 0) {
+        return NULL;
     }
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        if (adb_client[busid].streams[i].localid == localid) {
+            return &adb_client[busid].streams[i];
+        }
+    }
+    return NULL;
+}
+
+static struct adb_stream *adb_alloc_stream(uint8_t busid, uint32_t remoteid)
+{
+    struct adb_stream *stream;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        stream = &adb_client[busid].streams[i];
+        if (stream->localid == 0) {
+            memset(stream, 0, sizeof(struct adb_stream));
+            stream->localid = adb_client[busid].next_localid++;
+            if (adb_client[busid].next_localid == 0) {
+                adb_client[busid].next_localid = 1;
+            }
+            stream->remoteid = remoteid;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static void adb_free_stream(uint8_t busid, struct adb_stream *stream)
+{
+    if (adb_client[busid].tx_stream == stream) {
+        adb_client[busid].tx_stream = NULL;
+    }
+    memset(stream, 0, sizeof(struct adb_stream));
+}
+
+static void adb_queue_ctrl(uint8_t busid, uint32_t command, uint32_t arg0, uint32_t arg1)
+{
+    struct usbd_adb *adb = &adb_client[busid];
+    uint8_t next = (adb->ctrl_head + 1) % ADB_CTRL_QUEUE_SIZE;
+
+    if (next == adb->ctrl_tail) {
+        USB_LOG_ERR("adb ctrl queue full, drop cmd:%x\r\n", (unsigned int)command);
+        return;
+    }
+
+    adb->ctrl[adb->ctrl_head].command = command;
+    adb->ctrl[adb->ctrl_head].arg0 = arg0;
+    adb->ctrl[adb->ctrl_head].arg1 = arg1;
+    adb->ctrl_head = next;
+}
+
+static void adb_start_read_msg(uint8_t busid)
+{
+    adb_client[busid].common_state = ADB_STATE_READ_MSG;
+    usbd_ep_start_read(busid, adb_ep_data[busid][ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet[busid].msg, sizeof(struct adb_msg));
 }
 
-static void adb_send_msg(struct adb_packet *packet)
+static void adb_send_msg(uint8_t busid, struct adb_packet *packet)
 {
-    adb_client.common_state = ADB_STATE_WRITE_MSG;
+    adb_client[busid].write_state = ADB_STATE_WRITE_MSG;
 
     packet->msg.data_crc32 = adb_packet_checksum(packet);
     packet->msg.magic = packet->msg.command ^ 0xffffffff;
 
-    usbd_ep_start_write(0, adb_ep_data[ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
+    usbd_ep_start_write(busid, adb_ep_data[busid][ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
 }
 
-static void adb_send_okay(struct adb_packet *packet, uint32_t localid)
+/*
+ * Start next in transfer if in ep is idle, must be called without critical section held.
+ * Protocol replies go first, so the remote side never waits for our data. Then streams that
+ * have data and remote OKAY take turns, one WRTE each, so a bulk transfer can not starve shell.
+ * The in ep is taken in critical section, payload is copied after leaving it.
+ */
+static void adb_tx_kick(uint8_t busid)
 {
-    packet->msg.command = A_OKAY;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = usbd_adb_get_remoteid(localid);
-    packet->msg.data_length = 0;
+    const char *support_feature = "device::"
+                                  "ro.product.name=cherryadb;"
+                                  "ro.product.model=cherrysh;"
+                                  "ro.product.device=cherryadb;"
+                                  "features=cmd,shell_v1";
+    struct usbd_adb *adb = &adb_client[busid];
+    struct adb_packet *packet = &tx_packet[busid];
+    struct adb_stream *stream;
+    const uint8_t *data = NULL;
+    uint32_t len = 0;
+    uint8_t idx;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (adb->write_state != ADB_STATE_WRITE_IDLE) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+
+    if (adb->cnxn_pending) {
+        adb->cnxn_pending = false;
+
+        len = strlen(support_feature);
+        data = (const uint8_t *)support_feature;
+        packet->msg.command = A_CNXN;
+        packet->msg.arg0 = A_VERSION;
+        packet->msg.arg1 = MAX_PAYLOAD;
+    } else if (adb->ctrl_tail != adb->ctrl_head) {
+        packet->msg.command = adb->ctrl[adb->ctrl_tail].command;
+        packet->msg.arg0 = adb->ctrl[adb->ctrl_tail].arg0;
+        packet->msg.arg1 = adb->ctrl[adb->ctrl_tail].arg1;
+        adb->ctrl_tail = (adb->ctrl_tail + 1) % ADB_CTRL_QUEUE_SIZE;
+    } else {
+        for (uint8_t i = 1; i <= CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+            idx = (adb->rr_index + i) % CONFIG_USBDEV_ADB_MAX_STREAMS;
+            stream = &adb->streams[idx];
+
+            if ((stream->localid == 0) || !stream->ready || !stream->tx_pending) {
+                continue;
+            }
+
+            len = MIN(stream->tx_len, adb->max_payload);
+            data = stream->tx_data;
+
+            packet->msg.command = A_WRTE;
+            packet->msg.arg0 = stream->localid;
+            packet->msg.arg1 = stream->remoteid;
+
+            /* wait for OKAY before sending more on this stream */
+            stream->ready = false;
+            stream->tx_data += len;
+            stream->tx_len -= len;
+
+            adb->rr_index = idx;
+            adb->tx_stream = stream;
+            adb->tx_last = (stream->tx_len == 0);
+            break;
+        }
+
+        if (data == NULL) {
+            usb_osal_leave_critical_section(flags);
+            return;
+        }
+    }
+
+    /* tx_packet is ours until in transfer completes, user data is kept until write done */
+    adb->write_state = ADB_STATE_WRITE_MSG;
+    usb_osal_leave_critical_section(flags);
 
-    adb_send_msg(&tx_packet);
+    packet->msg.data_length = len;
+    if (len) {
+        memcpy(packet->payload, data, len);
+    }
+    adb_send_msg(busid, packet);
 }
 
-static void adb_send_close(struct adb_packet *packet, uint32_t localid, uint32_t remoteid)
+/* Drop all streams because host or bus is gone, report them to user */
+static void adb_reset_streams(uint8_t busid)
 {
-    packet->msg.command = A_CLSE;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = remoteid;
-    packet->msg.data_length = 0;
+    struct adb_stream *stream;
+    uint32_t localid;
+    bool tx_pending;
+    size_t flags;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        stream = &adb_client[busid].streams[i];
+
+        flags = usb_osal_enter_critical_section();
+        localid = stream->localid;
+        tx_pending = stream->tx_pending;
+        if (localid) {
+            adb_free_stream(busid, stream);
+        }
+        usb_osal_leave_critical_section(flags);
+
+        if (localid) {
+            if (tx_pending) {
+                usbd_adb_notify_write_done(busid, localid);
+            }
+            usbd_adb_notify_close(busid, localid);
+        }
+    }
+}
+
+static void adb_handle_packet(uint8_t busid)
+{
+    struct usbd_adb *adb = &adb_client[busid];
+    struct adb_packet *packet = &rx_packet[busid];
+    struct adb_stream *stream;
+    uint32_t localid = 0;
+    bool tx_pending = false;
+    size_t flags;
+
+    switch (packet->msg.command) {
+        case A_CNXN: /* CONNECT(version, maxdata, "system-id-string") */
+            adb_reset_streams(busid);
+
+            flags = usb_osal_enter_critical_section();
+            adb->ctrl_head = 0;
+            adb->ctrl_tail = 0;
+            adb->max_payload = MIN(packet->msg.arg1, MAX_PAYLOAD);
+            adb->cnxn_pending = true;
+            usb_osal_leave_critical_section(flags);
+            adb_tx_kick(busid);
+            break;
+        case A_OPEN: /* OPEN(local-id, 0, "destination") */
+            packet->payload[packet->msg.data_length] = '\0';
+
+            flags = usb_osal_enter_critical_section();
+            stream = adb_alloc_stream(busid, packet->msg.arg0);
+            if (stream) {
+                localid = stream->localid;
+                stream->service = usbd_adb_service_type((const char *)packet->payload);
+            }
+            usb_osal_leave_critical_section(flags);
+
+            if (stream && usbd_adb_notify_open(busid, localid, (const char *)packet->payload)) {
+                flags = usb_osal_enter_critical_section();
+                stream->ready = true;
+                adb_queue_ctrl(busid, A_OKAY, localid, packet->msg.arg0);
+                usb_osal_leave_critical_section(flags);
+                adb_tx_kick(busid);
+
+                USB_LOG_INFO("Open %s, localid:%x remoteid:%x\r\n", (const char *)packet->payload,
+                             (unsigned int)localid, (unsigned int)packet->msg.arg0);
+            } else {
+                flags = usb_osal_enter_critical_section();
+                if (stream) {
+                    adb_free_stream(busid, stream);
+                }
+                adb_queue_ctrl(busid, A_CLSE, 0, packet->msg.arg0);
+                usb_osal_leave_critical_section(flags);
+                adb_tx_kick(busid);
+
+                USB_LOG_WRN("Refuse %s, remoteid:%x\r\n", (const char *)packet->payload, (unsigned int)packet->msg.arg0);
+            }
+            break;
+        case A_OKAY: /* READY(local-id, remote-id, "") */
+            flags = usb_osal_enter_critical_section();
+            stream = adb_find_stream(busid, packet->msg.arg1);
+            if (stream) {
+                stream->ready = true;
+            }
+            usb_osal_leave_critical_section(flags);
+            adb_tx_kick(busid);
+            break;
+        case A_CLSE: /* CLOSE(local-id, remote-id, "") */
+            flags = usb_osal_enter_critical_section();
+            stream = adb_find_stream(busid, packet->msg.arg1);
+            if (stream) {
+                localid = stream->localid;
+                tx_pending = stream->tx_pending;
+                adb_free_stream(busid, stream);
+            }
+            usb_osal_leave_critical_section(flags);
 
-    adb_send_msg(&tx_packet);
+            if (localid) {
+                if (tx_pending) {
+                    usbd_adb_notify_write_done(busid, localid);
+                }
+                usbd_adb_notify_close(busid, localid);
+                USB_LOG_INFO("Close localid:%x remoteid:%x\r\n", (unsigned int)localid, (unsigned int)packet->msg.arg0);
+            }
+            break;
+        case A_WRTE: /* WRITE(local-id, remote-id, "data") */
+            stream = adb_find_stream(busid, packet->msg.arg1);
+            if (stream && (stream->remoteid == packet->msg.arg0)) {
+                /* data is consumed before OKAY, so remote can never overrun reader */
+                usbd_adb_notify_read(busid, packet->msg.arg1, packet->payload, packet->msg.data_length);
+
+                flags = usb_osal_enter_critical_section();
+                adb_queue_ctrl(busid, A_OKAY, packet->msg.arg1, packet->msg.arg0);
+                usb_osal_leave_critical_section(flags);
+                adb_tx_kick(busid);
+            } else {
+                flags = usb_osal_enter_critical_section();
+                adb_queue_ctrl(busid, A_CLSE, 0, packet->msg.arg0);
+                usb_osal_leave_critical_section(flags);
+                adb_tx_kick(busid);
+            }
+            break;
+        case A_SYNC:
+        case A_AUTH:
+        default:
+            break;
+    }
 }
 
 void usbd_adb_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
     (void)ep;
 
-    if (adb_client.common_state == ADB_STATE_READ_MSG) {
+    if (adb_client[busid].common_state == ADB_STATE_READ_MSG) {
         if (nbytes != sizeof(struct adb_msg)) {
-            USB_LOG_ERR("invalid adb msg size:%d\r\n", nbytes);
+            USB_LOG_ERR("invalid adb msg size:%d\r\n", (unsigned int)nbytes);
+            adb_start_read_msg(busid);
             return;
         }
 
         USB_LOG_DBG("command:%x arg0:%x arg1:%x len:%d\r\n",
-                     rx_packet.msg.command,
-                     rx_packet.msg.arg0,
-                     rx_packet.msg.arg1,
-                     rx_packet.msg.data_length);
-
-        if (rx_packet.msg.data_length) {
-            /* setup next out ep read transfer */
-            adb_client.common_state = ADB_STATE_READ_DATA;
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, rx_packet.payload, rx_packet.msg.data_length);
-        } else {
-            if (rx_packet.msg.command == A_CLSE) {
-                adb_client.writable = false;
-                usbd_adb_notify_write_done();
-                USB_LOG_INFO("Close remoteid:%x\r\n", rx_packet.msg.arg0);
-            }
-            adb_client.common_state = ADB_STATE_READ_MSG;
-            /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
+                    rx_packet[busid].msg.command,
+                    rx_packet[busid].msg.arg0,
+                    rx_packet[busid].msg.arg1,
+                    rx_packet[busid].msg.data_length);
+
+        if (rx_packet[busid].msg.data_length > MAX_PAYLOAD) {
+            USB_LOG_ERR("adb payload too long:%d\r\n", (unsigned int)rx_packet[busid].msg.data_length);
+            adb_start_read_msg(busid);
+            return;
         }
-    } else if (adb_client.common_state == ADB_STATE_READ_DATA) {
-        switch (rx_packet.msg.command) {
-            case A_SYNC:
-
-                break;
-            case A_CNXN: /* CONNECT(version, maxdata, "system-id-string") */
-                char *support_feature = "device::"
-                                        "ro.product.name=cherryadb;"
-                                        "ro.product.model=cherrysh;"
-                                        "ro.product.device=cherryadb;"
-                                        "features=cmd,shell_v1";
-
-                tx_packet.msg.command = A_CNXN;
-                tx_packet.msg.arg0 = A_VERSION;
-                tx_packet.msg.arg1 = MAX_PAYLOAD;
-                tx_packet.msg.data_length = strlen(support_feature);
-                memcpy(tx_packet.payload, support_feature, strlen(support_feature));
-
-                adb_send_msg(&tx_packet);
-
-                adb_client.writable = false;
-                break;
-            case A_OPEN: /* OPEN(local-id, 0, "destination") */
-                rx_packet.payload[rx_packet.msg.data_length] = '\0';
-
-                if (strncmp((const char *)rx_packet.payload, "shell:", 6) == 0) {
-                    adb_client.localid = ADB_SHELL_LOALID;
-                    adb_client.shell_remoteid = rx_packet.msg.arg0;
-                    adb_send_okay(&tx_packet, ADB_SHELL_LOALID);
-
-                    USB_LOG_INFO("Open shell service, remoteid:%x\r\n", rx_packet.msg.arg0);
-                } else if (strncmp((const char *)rx_packet.payload, "sync:", 5) == 0) {
-                    adb_client.localid = ADB_FILE_LOALID;
-                    adb_client.file_remoteid = rx_packet.msg.arg0;
-                    adb_send_okay(&tx_packet, ADB_FILE_LOALID);
-                    USB_LOG_INFO("Open file service, remoteid:%x\r\n", rx_packet.msg.arg0);
-                }
-                break;
-            case A_OKAY:
-
-                break;
-            case A_CLSE:
-
-                break;
-            case A_WRTE: /* WRITE(local-id, remote-id, "data") */
-                if ((rx_packet.msg.arg0 == adb_client.shell_remoteid) && (rx_packet.msg.arg1 == ADB_SHELL_LOALID)) {
-                    adb_send_okay(&tx_packet, rx_packet.msg.arg1);
-                } else if ((rx_packet.msg.arg0 == adb_client.file_remoteid) && (rx_packet.msg.arg1 == ADB_FILE_LOALID)) {
-                    adb_send_okay(&tx_packet, rx_packet.msg.arg1);
-                } else {
-                    adb_send_close(&tx_packet, 0, rx_packet.msg.arg0);
-                }
-                break;
-            case A_AUTH:
-
-                break;
 
-            default:
-                break;
+        if (rx_packet[busid].msg.data_length) {
+            /* setup next out ep read transfer */
+            adb_client[busid].common_state = ADB_STATE_READ_DATA;
+            usbd_ep_start_read(busid, adb_ep_data[busid][ADB_OUT_EP_IDX].ep_addr, rx_packet[busid].payload, rx_packet[busid].msg.data_length);
+            return;
         }
     }
+
+    adb_handle_packet(busid);
+    /* rx no longer waits for our tx, read next message right away */
+    adb_start_read_msg(busid);
 }
 
 void usbd_adb_bulk_in(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    struct usbd_adb *adb = &adb_client[busid];
+    uint32_t localid = 0;
+    size_t flags;
+
     (void)ep;
     (void)nbytes;
 
-    if (adb_client.common_state == ADB_STATE_WRITE_MSG) {
-        if (tx_packet.msg.data_length) {
-            adb_client.common_state = ADB_STATE_WRITE_DATA;
-            usbd_ep_start_write(busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, tx_packet.payload, tx_packet.msg.data_length);
-        } else {
-            if (rx_packet.msg.command == A_WRTE) {
-                adb_client.writable = true;
-                if (adb_client.localid == ADB_SHELL_LOALID) {
-                    usbd_adb_notify_shell_read(rx_packet.payload, rx_packet.msg.data_length);
-                } else {
-                }
-            }
-            adb_client.common_state = ADB_STATE_READ_MSG;
-            /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
-        }
-    } else if (adb_client.common_state == ADB_STATE_WRITE_DATA) {
-        adb_client.common_state = ADB_STATE_READ_MSG;
-        /* setup first out ep read transfer */
-        usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
-    } else if (adb_client.write_state == ADB_STATE_AWRITE_MSG) {
-        if (tx_packet.msg.data_length) {
-            adb_client.write_state = ADB_STATE_AWRITE_DATA;
-            usbd_ep_start_write(busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, tx_packet.payload, tx_packet.msg.data_length);
-        } else {
-        }
-    } else if (adb_client.write_state == ADB_STATE_AWRITE_DATA) {
-        usbd_adb_notify_write_done();
+    if ((adb->write_state == ADB_STATE_WRITE_MSG) && tx_packet[busid].msg.data_length) {
+        adb->write_state = ADB_STATE_WRITE_DATA;
+        usbd_ep_start_write(busid, adb_ep_data[busid][ADB_IN_EP_IDX].ep_addr, tx_packet[busid].payload, tx_packet[busid].msg.data_length);
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (adb->tx_stream && adb->tx_last) {
+        adb->tx_stream->tx_pending = false;
+        localid = adb->tx_stream->localid;
+    }
+    adb->tx_stream = NULL;
+    adb->write_state = ADB_STATE_WRITE_IDLE;
+    usb_osal_leave_critical_section(flags);
+    adb_tx_kick(busid);
+
+    if (localid) {
+        usbd_adb_notify_write_done(busid, localid);
     }
 }
 
@@ -248,11 +472,16 @@ void adb_notify_handler(uint8_t busid, uint8_t event, void *arg)
         case USBD_EVENT_DEINIT:
             break;
         case USBD_EVENT_RESET:
+            adb_reset_streams(busid);
+            adb_client[busid].ctrl_head = 0;
+            adb_client[busid].ctrl_tail = 0;
+            adb_client[busid].cnxn_pending = false;
+            adb_client[busid].write_state = ADB_STATE_WRITE_IDLE;
+            adb_client[busid].max_payload = MAX_PAYLOAD_V1;
             break;
         case USBD_EVENT_CONFIGURED:
-            adb_client.common_state = ADB_STATE_READ_MSG;
             /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
+            adb_start_read_msg(busid);
             break;
 
         default:
@@ -262,49 +491,129 @@ void adb_notify_handler(uint8_t busid, uint8_t event, void *arg)
 
 struct usbd_interface *usbd_adb_init_intf(uint8_t busid, struct usbd_interface *intf, uint8_t in_ep, uint8_t out_ep)
 {
-    (void)busid;
-
     intf->class_interface_handler = NULL;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
     intf->notify_handler = adb_notify_handler;
 
-    adb_ep_data[ADB_OUT_EP_IDX].ep_addr = out_ep;
-    adb_ep_data[ADB_OUT_EP_IDX].ep_cb = usbd_adb_bulk_out;
-    adb_ep_data[ADB_IN_EP_IDX].ep_addr = in_ep;
-    adb_ep_data[ADB_IN_EP_IDX].ep_cb = usbd_adb_bulk_in;
+    adb_ep_data[busid][ADB_OUT_EP_IDX].ep_addr = out_ep;
+    adb_ep_data[busid][ADB_OUT_EP_IDX].ep_cb = usbd_adb_bulk_out;
+    adb_ep_data[busid][ADB_IN_EP_IDX].ep_addr = in_ep;
+    adb_ep_data[busid][ADB_IN_EP_IDX].ep_cb = usbd_adb_bulk_in;
+
+    usbd_add_endpoint(busid, &adb_ep_data[busid][ADB_OUT_EP_IDX]);
+    usbd_add_endpoint(busid, &adb_ep_data[busid][ADB_IN_EP_IDX]);
 
-    usbd_add_endpoint(busid, &adb_ep_data[ADB_OUT_EP_IDX]);
-    usbd_add_endpoint(busid, &adb_ep_data[ADB_IN_EP_IDX]);
+    memset(&adb_client[busid], 0, sizeof(struct usbd_adb));
+    adb_client[busid].max_payload = MAX_PAYLOAD_V1;
+    adb_client[busid].next_localid = 1;
 
     return intf;
 }
 
-bool usbd_adb_can_write(void)
+bool usbd_adb_can_write(uint8_t busid, uint32_t localid)
 {
-    return adb_client.writable;
+    struct adb_stream *stream;
+    bool ret;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    stream = adb_find_stream(busid, localid);
+    ret = stream && !stream->tx_pending;
+    usb_osal_leave_critical_section(flags);
+
+    return ret;
 }
 
-int usbd_abd_write(uint32_t localid, const uint8_t *data, uint32_t len)
+uint8_t usbd_adb_service_type(const char *service)
 {
-    struct adb_packet *packet;
+    if (strncmp(service, "shell:", 6) == 0) {
+        return USBD_ADB_SERVICE_SHELL;
+    } else if (strncmp(service, "sync:", 5) == 0) {
+        return USBD_ADB_SERVICE_SYNC;
+    } else if (strncmp(service, "tcp:", 4) == 0) {
+        return USBD_ADB_SERVICE_FORWARD;
+    }
+    return USBD_ADB_SERVICE_OTHER;
+}
 
-    packet = &tx_packet;
-    packet->msg.command = A_WRTE;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = usbd_adb_get_remoteid(localid);
-    packet->msg.data_length = len;
-    memcpy(packet->payload, data, len);
+uint8_t usbd_adb_get_service(uint8_t busid, uint32_t localid)
+{
+    struct adb_stream *stream;
+    uint8_t service = USBD_ADB_SERVICE_OTHER;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    stream = adb_find_stream(busid, localid);
+    if (stream) {
+        service = stream->service;
+    }
+    usb_osal_leave_critical_section(flags);
 
-    packet->msg.data_crc32 = adb_packet_checksum(packet);
-    packet->msg.magic = packet->msg.command ^ 0xffffffff;
+    return service;
+}
+
+uint32_t usbd_adb_get_max_payload(uint8_t busid)
+{
+    return adb_client[busid].max_payload;
+}
+
+int usbd_abd_write(uint8_t busid, uint32_t localid, const uint8_t *data, uint32_t len)
+{
+    struct adb_stream *stream;
+    size_t flags;
+
+    if ((data == NULL) || (len == 0)) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    stream = adb_find_stream(busid, localid);
+    if (stream == NULL) {
+        usb_osal_leave_critical_section(flags);
+        return -USB_ERR_NOTCONN;
+    }
+
+    if (stream->tx_pending) {
+        usb_osal_leave_critical_section(flags);
+        return -USB_ERR_BUSY;
+    }
+
+    stream->tx_data = data;
+    stream->tx_len = len;
+    stream->tx_pending = true;
+    usb_osal_leave_critical_section(flags);
+    adb_tx_kick(busid);
 
-    adb_client.write_state = ADB_STATE_AWRITE_MSG;
-    usbd_ep_start_write(0, adb_ep_data[ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
     return 0;
 }
 
-void usbd_adb_close(uint32_t localid)
+void usbd_adb_close(uint8_t busid, uint32_t localid)
 {
-    adb_send_close(&tx_packet, 0, usbd_adb_get_remoteid(localid));
-}
\ No newline at end of file
+    struct adb_stream *stream;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    stream = adb_find_stream(busid, localid);
+    if (stream) {
+        adb_queue_ctrl(busid, A_CLSE, stream->localid, stream->remoteid);
+        adb_free_stream(busid, stream);
+    }
+    usb_osal_leave_critical_section(flags);
+    adb_tx_kick(busid);
+}
+
+__WEAK bool usbd_adb_notify_open(uint8_t busid, uint32_t localid, const char *service)
+{
+    (void)busid;
+    (void)localid;
+
+    /* shell, file sync (adb push/pull) and adb forward, user routes reads by usbd_adb_get_service */
+    return usbd_adb_service_type(service) != USBD_ADB_SERVICE_OTHER;
+}
+
+__WEAK void usbd_adb_notify_close(uint8_t busid, uint32_t localid)
+{
+    (void)busid;
+    (void)localid;
+}
@@ -8,9 +8,6 @@
 
 #include <stdint.h>
 
-#define ADB_SHELL_LOALID     0x01
-#define ADB_FILE_LOALID      0x02
-
 // clang-format off
 #define ADB_DESCRIPTOR_INIT(bFirstInterface, in_ep, out_ep, wMaxPacketSize)                   \
     USB_INTERFACE_DESCRIPTOR_INIT(bFirstInterface, 0x00, 0x02, 0xff, 0x42, 0x01, 0x02), \
@@ -18,18 +15,33 @@
     USB_ENDPOINT_DESCRIPTOR_INIT(out_ep, 0x02, wMaxPacketSize, 0x00)
 // clang-format on
 
+/* service of a stream, from OPEN destination prefix */
+#define USBD_ADB_SERVICE_SHELL   0 /* "shell:" */
+#define USBD_ADB_SERVICE_SYNC    1 /* "sync:", adb push/pull */
+#define USBD_ADB_SERVICE_FORWARD 2 /* "tcp:", adb forward */
+#define USBD_ADB_SERVICE_OTHER   3
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct usbd_interface *usbd_adb_init_intf(uint8_t busid, struct usbd_interface *intf, uint8_t in_ep, uint8_t out_ep);
 
-void usbd_adb_notify_shell_read(uint8_t *data, uint32_t len);
-void usbd_adb_notify_file_read(uint8_t *data, uint32_t len);
-void usbd_adb_notify_write_done(void);
-bool usbd_adb_can_write(void);
-int usbd_abd_write(uint32_t localid, const uint8_t *data, uint32_t len);
-void usbd_adb_close(uint32_t localid);
+/* Host opens a service, return true to accept it on stream localid, default accepts shell, sync and forward */
+bool usbd_adb_notify_open(uint8_t busid, uint32_t localid, const char *service);
+/* Stream is closed by host or bus reset */
+void usbd_adb_notify_close(uint8_t busid, uint32_t localid);
+/* Data is only valid in callback, host gets OKAY after it returns */
+void usbd_adb_notify_read(uint8_t busid, uint32_t localid, uint8_t *data, uint32_t len);
+void usbd_adb_notify_write_done(uint8_t busid, uint32_t localid);
+
+bool usbd_adb_can_write(uint8_t busid, uint32_t localid);
+uint32_t usbd_adb_get_max_payload(uint8_t busid);
+uint8_t usbd_adb_service_type(const char *service);
+uint8_t usbd_adb_get_service(uint8_t busid, uint32_t localid);
+/* data must be kept until usbd_adb_notify_write_done, it is split into max payload WRTEs */
+int usbd_abd_write(uint8_t busid, uint32_t localid, const uint8_t *data, uint32_t len);
+void usbd_adb_close(uint8_t busid, uint32_t localid);
 
 #ifdef __cplusplus
 }
@@ -55,6 +55,8 @@ int usbh_audio_open(struct usbh_audio *audio_class, const char *name, uint32_t s
 {
     struct usb_setup_packet *setup;
     struct usb_endpoint_descriptor *ep_desc;
+    struct usb_endpoint_descriptor *fb_desc;
+    struct usbh_audio_as_msg *as_msg = NULL;
     uint8_t mult;
     uint16_t mps;
     int ret;
@@ -66,12 +68,11 @@ int usbh_audio_open(struct usbh_audio *audio_class, const char *name, uint32_t s
     }
     setup = audio_class->hport->setup;
 
-    if (audio_class->is_opened) {
-        return 0;
-    }
-
     for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
         if (strcmp(name, audio_class->as_msg_table[i].stream_name) == 0) {
+            if (audio_class->as_msg_table[i].is_opened) {
+                return 0;
+            }
             intf = audio_class->as_msg_table[i].stream_intf;
             for (uint8_t j = 1; j < audio_class->as_msg_table[i].num_of_altsetting; j++) {
                 if (audio_class->as_msg_table[i].as_format[j].bBitResolution == bitresolution) {
@@ -81,6 +82,7 @@ int usbh_audio_open(struct usbh_audio *audio_class, const char *name, uint32_t s
                         memcpy(&freq, &audio_class->as_msg_table[i].as_format[j].tSamFreq[3 * k], 3);
                         if (freq == samp_freq) {
                             altsetting = j;
+                            as_msg = &audio_class->as_msg_table[i];
                             goto freq_found;
                         }
                     }
@@ -127,9 +129,23 @@ freq_found:
     } else {
         audio_class->isoout_mps = mps * (mult + 1);
         USBH_EP_INIT(audio_class->isoout, ep_desc);
+
+        /* asynchronous sink reports its rate through the feedback endpoint */
+        audio_class->isofb = NULL;
+        if (audio_class->hport->config.intf[intf].altsetting[altsetting].intf_desc.bNumEndpoints > 1) {
+            fb_desc = &audio_class->hport->config.intf[intf].altsetting[altsetting].ep[1].ep_desc;
+            if ((fb_desc->bEndpointAddress & 0x80) &&
+                (USB_GET_ENDPOINT_TYPE(fb_desc->bmAttributes) == USB_ENDPOINT_TYPE_ISOCHRONOUS) &&
+                ((fb_desc->bmAttributes & USB_ENDPOINT_USAGE_MASK) == USB_ENDPOINT_USAGE_FEEDBACK)) {
+                USBH_EP_INIT(audio_class->isofb, fb_desc);
+            }
+        }
     }
 
     USB_LOG_INFO("Open audio stream :%s, altsetting: %u\r\n", name, altsetting);
+    as_msg->cur_altsetting = altsetting;
+    as_msg->cur_samp_freq = samp_freq;
+    as_msg->is_opened = true;
     audio_class->is_opened = true;
     return ret;
 }
@@ -138,6 +154,7 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
 {
     struct usb_setup_packet *setup;
     struct usb_endpoint_descriptor *ep_desc;
+    struct usbh_audio_as_msg *as_msg = NULL;
     int ret;
     uint8_t intf = 0xff;
     uint8_t altsetting = 1;
@@ -150,6 +167,7 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
     for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
         if (strcmp(name, audio_class->as_msg_table[i].stream_name) == 0) {
             intf = audio_class->as_msg_table[i].stream_intf;
+            as_msg = &audio_class->as_msg_table[i];
         }
     }
 
@@ -157,6 +175,11 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
         return -USB_ERR_NODEV;
     }
 
+    if (as_msg->is_opened) {
+        usbh_audio_stream_stop(audio_class, name);
+        altsetting = as_msg->cur_altsetting;
+    }
+
     setup->bmRequestType = USB_REQUEST_DIR_OUT | USB_REQUEST_STANDARD | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = USB_REQUEST_SET_INTERFACE;
     setup->wValue = 0;
@@ -168,7 +191,13 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
         return ret;
     }
     USB_LOG_INFO("Close audio stream :%s\r\n", name);
+    as_msg->is_opened = false;
     audio_class->is_opened = false;
+    for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
+        if (audio_class->as_msg_table[i].is_opened) {
+            audio_class->is_opened = true;
+        }
+    }
 
     ep_desc = &audio_class->hport->config.intf[intf].altsetting[altsetting].ep[0].ep_desc;
     if (ep_desc->bEndpointAddress & 0x80) {
@@ -179,6 +208,7 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
         if (audio_class->isoout) {
             audio_class->isoout = NULL;
         }
+        audio_class->isofb = NULL;
     }
 
     return ret;
@@ -344,6 +374,424 @@ int usbh_audio_set_mute(struct usbh_audio *audio_class, const char *name, uint8_
     return ret;
 }
 
+static struct usbh_audio_stream *usbh_audio_stream_get(struct usbh_audio *audio_class, const char *name, struct usbh_audio_as_msg **as_msg)
+{
+    struct usb_endpoint_descriptor *ep_desc;
+
+    for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
+        if (strcmp(name, audio_class->as_msg_table[i].stream_name) == 0) {
+            if (!audio_class->as_msg_table[i].is_opened) {
+                return NULL;
+            }
+            *as_msg = &audio_class->as_msg_table[i];
+            ep_desc = &audio_class->hport->config.intf[(*as_msg)->stream_intf].altsetting[(*as_msg)->cur_altsetting].ep[0].ep_desc;
+            if (ep_desc->bEndpointAddress & 0x80) {
+                return &audio_class->stream_in;
+            } else {
+                return &audio_class->stream_out;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void usbh_audio_stream_release(struct usbh_audio_stream *stream)
+{
+    stream->running = false;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_MAX_URBS; i++) {
+        if (stream->urb[i]) {
+            usbh_kill_urb(stream->urb[i]);
+            usb_osal_free(stream->urb[i]);
+            stream->urb[i] = NULL;
+        }
+    }
+
+    if (stream->fb_urb) {
+        usbh_kill_urb(stream->fb_urb);
+        usb_osal_free(stream->fb_urb);
+        stream->fb_urb = NULL;
+    }
+}
+
+static inline bool usbh_audio_rate_valid(struct usbh_audio_stream *stream, uint32_t rate)
+{
+    /* accept +-12.5% deviation from nominal rate */
+    return (rate > (stream->nominal_rate - (stream->nominal_rate >> 3))) &&
+           (rate < (stream->nominal_rate + (stream->nominal_rate >> 3)));
+}
+
+static void usbh_audio_stream_fill(struct usbh_audio_stream *stream, struct usbh_urb *urb)
+{
+    uint32_t samples;
+    uint32_t bytes;
+    uint32_t used;
+    uint8_t *buf;
+
+    for (uint32_t i = 0; i < urb->num_of_iso_packets; i++) {
+        /* fractional accumulator gives 44/45 pattern for 44.1khz */
+        stream->rate_acc += stream->rate;
+        samples = stream->rate_acc >> 16;
+        stream->rate_acc &= 0xffff;
+
+        bytes = samples * stream->frame_bytes;
+        if (bytes > stream->mps) {
+            bytes = stream->mps - (stream->mps % stream->frame_bytes);
+        }
+
+        buf = urb->iso_packet[i].transfer_buffer;
+        used = chry_ringbuffer_get_used(&stream->pcm_rb);
+        used -= used % stream->frame_bytes;
+        if (used >= bytes) {
+            chry_ringbuffer_read(&stream->pcm_rb, buf, bytes);
+        } else {
+            chry_ringbuffer_read(&stream->pcm_rb, buf, used);
+            memset(&buf[used], 0, bytes - used);
+            stream->stats.underruns++;
+        }
+
+        urb->iso_packet[i].transfer_buffer_length = bytes;
+        urb->iso_packet[i].actual_length = 0;
+        urb->iso_packet[i].errorcode = 0;
+    }
+}
+
+static void usbh_audio_stream_out_callback(void *arg, int nbytes)
+{
+    struct usbh_audio_stream *stream = (struct usbh_audio_stream *)arg;
+    struct usbh_urb *urb;
+
+    /* urbs on one endpoint complete in submit order */
+    urb = stream->urb[stream->urb_idx];
+    stream->urb_idx = (stream->urb_idx + 1) % stream->num_of_urbs;
+
+    if (!stream->running || (nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NODEV)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < urb->num_of_iso_packets; i++) {
+        if (urb->iso_packet[i].errorcode) {
+            stream->stats.errors++;
+        }
+    }
+    stream->stats.packets += urb->num_of_iso_packets;
+
+    usbh_audio_stream_fill(stream, urb);
+    urb->actual_length = 0;
+    urb->errorcode = 0;
+    usbh_submit_urb(urb);
+}
+
+static void usbh_audio_stream_in_callback(void *arg, int nbytes)
+{
+    struct usbh_audio_stream *stream = (struct usbh_audio_stream *)arg;
+    struct usbh_audio_stream *out = &stream->audio_class->stream_out;
+    struct usbh_urb *urb;
+    uint32_t len;
+
+    urb = stream->urb[stream->urb_idx];
+    stream->urb_idx = (stream->urb_idx + 1) % stream->num_of_urbs;
+
+    if (!stream->running || (nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NODEV)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < urb->num_of_iso_packets; i++) {
+        if (urb->iso_packet[i].errorcode) {
+            stream->stats.errors++;
+            continue;
+        }
+
+        len = urb->iso_packet[i].actual_length;
+        len -= len % stream->frame_bytes;
+        if (len == 0) {
+            continue;
+        }
+
+        if (chry_ringbuffer_get_free(&stream->pcm_rb) >= len) {
+            chry_ringbuffer_write(&stream->pcm_rb, urb->iso_packet[i].transfer_buffer, len);
+        } else {
+            stream->stats.overruns++;
+        }
+
+        /* implicit feedback: async sink without feedback endpoint follows capture rate */
+        if (out->running && out->implicit_fb && (out->nominal_rate == stream->nominal_rate)) {
+            uint32_t rate = (out->rate * 7 + ((len / stream->frame_bytes) << 16)) >> 3;
+
+            if (usbh_audio_rate_valid(out, rate)) {
+                out->rate = rate;
+            }
+        }
+    }
+    stream->stats.packets += urb->num_of_iso_packets;
+
+    urb->actual_length = 0;
+    urb->errorcode = 0;
+    usbh_submit_urb(urb);
+}
+
+static void usbh_audio_stream_fb_callback(void *arg, int nbytes)
+{
+    struct usbh_audio_stream *stream = (struct usbh_audio_stream *)arg;
+    struct usbh_urb *urb = stream->fb_urb;
+    uint8_t *buf = stream->fb_buf;
+    uint32_t rate;
+
+    if (!stream->running || (nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NODEV)) {
+        return;
+    }
+
+    if ((urb->iso_packet[0].errorcode == 0) && (urb->iso_packet[0].actual_length >= 3)) {
+        if ((stream->audio_class->hport->speed == USB_SPEED_HIGH) && (urb->iso_packet[0].actual_length >= 4)) {
+            /* 16.16 samples per microframe */
+            rate = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+        } else {
+            /* 10.14 samples per frame */
+            rate = (buf[0] | (buf[1] << 8) | (buf[2] << 16)) << 2;
+        }
+        rate *= stream->packet_interval;
+
+        /* some high speed devices still report 10.14 */
+        if (!usbh_audio_rate_valid(stream, rate) && usbh_audio_rate_valid(stream, rate << 2)) {
+            rate <<= 2;
+        }
+
+        if (usbh_audio_rate_valid(stream, rate)) {
+            stream->rate = rate;
+        } else {
+            stream->stats.errors++;
+        }
+    }
+
+    urb->iso_packet[0].actual_length = 0;
+    urb->iso_packet[0].errorcode = 0;
+    urb->actual_length = 0;
+    urb->errorcode = 0;
+    usbh_submit_urb(urb);
+}
+
+static struct usbh_urb *usbh_audio_stream_urb_alloc(struct usbh_audio_stream *stream,
+                                                     struct usb_endpoint_descriptor *ep,
+                                                     uint8_t *buf,
+                                                     uint32_t packet_size,
+                                                     uint32_t num_of_packets,
+                                                     usbh_complete_callback_t complete)
+{
+    struct usbh_urb *urb;
+
+    urb = usb_osal_malloc(sizeof(struct usbh_urb) + num_of_packets * sizeof(struct usbh_iso_frame_packet));
+    if (urb == NULL) {
+        return NULL;
+    }
+    memset(urb, 0, sizeof(struct usbh_urb) + num_of_packets * sizeof(struct usbh_iso_frame_packet));
+#if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
+    urb->iso_packet = (struct usbh_iso_frame_packet *)(urb + 1);
+#endif
+    urb->hport = stream->audio_class->hport;
+    urb->ep = ep;
+    urb->transfer_buffer = buf;
+    urb->transfer_buffer_length = num_of_packets * packet_size;
+    urb->interval = USBH_GET_URB_INTERVAL(ep->bInterval, stream->audio_class->hport->speed);
+    urb->num_of_iso_packets = num_of_packets;
+    urb->complete = complete;
+    urb->arg = stream;
+    for (uint32_t i = 0; i < num_of_packets; i++) {
+        urb->iso_packet[i].transfer_buffer = &buf[i * packet_size];
+        urb->iso_packet[i].transfer_buffer_length = packet_size;
+    }
+    return urb;
+}
+
+int usbh_audio_stream_start(struct usbh_audio *audio_class, const char *name, uint8_t *pcm_pool, uint32_t pcm_size, uint8_t *xfer_buf, uint32_t xfer_bufsize)
+{
+    struct usbh_audio_stream *stream;
+    struct usbh_audio_as_msg *as_msg = NULL;
+    struct usb_endpoint_descriptor *ep;
+    uint32_t packets_per_second;
+    uint32_t offset = 0;
+    uint32_t urb_bufsize;
+    uint32_t num_of_packets;
+    int ret;
+
+    if (!audio_class || !audio_class->hport || !pcm_pool || !xfer_buf) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = usbh_audio_stream_get(audio_class, name, &as_msg);
+    if (stream == NULL) {
+        return -USB_ERR_NODEV;
+    }
+    if (stream->running) {
+        return -USB_ERR_BUSY;
+    }
+
+    if (chry_ringbuffer_init(&stream->pcm_rb, pcm_pool, pcm_size) < 0) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (stream == &audio_class->stream_in) {
+        ep = audio_class->isoin;
+        stream->mps = audio_class->isoin_mps;
+        stream->fbep = NULL;
+    } else {
+        ep = audio_class->isoout;
+        stream->mps = audio_class->isoout_mps;
+        stream->fbep = audio_class->isofb;
+    }
+
+    stream->audio_class = audio_class;
+    stream->ep = ep;
+    stream->frame_bytes = as_msg->as_format[as_msg->cur_altsetting].bNrChannels * as_msg->as_format[as_msg->cur_altsetting].bSubframeSize;
+    if ((stream->frame_bytes == 0) || (stream->mps < stream->frame_bytes) || (ep->bInterval == 0) || (ep->bInterval > 16)) {
+        return -USB_ERR_INVAL;
+    }
+
+    /* bInterval of iso endpoint is 2^(bInterval-1) frames or microframes */
+    stream->packet_interval = 1 << (ep->bInterval - 1);
+    packets_per_second = ((audio_class->hport->speed == USB_SPEED_HIGH) ? 8000 : 1000) / stream->packet_interval;
+    if (packets_per_second == 0) {
+        return -USB_ERR_INVAL;
+    }
+    stream->nominal_rate = ((as_msg->cur_samp_freq / packets_per_second) << 16) +
+                           ((((as_msg->cur_samp_freq % packets_per_second) << 16) + (packets_per_second >> 1)) / packets_per_second);
+    stream->rate = stream->nominal_rate;
+    stream->rate_acc = 0;
+    stream->implicit_fb = (stream == &audio_class->stream_out) && !stream->fbep &&
+                          ((ep->bmAttributes & USB_ENDPOINT_SYNC_MASK) == USB_ENDPOINT_SYNC_ASYNCHRONOUS);
+    stream->urb_idx = 0;
+    stream->num_of_urbs = CONFIG_USBHOST_AUDIO_MAX_URBS;
+    memset(&stream->stats, 0, sizeof(struct usbh_audio_stream_stats));
+
+    if (stream->fbep) {
+        stream->fb_buf = xfer_buf;
+        offset = USB_ALIGN_UP(4, CONFIG_USB_ALIGN_SIZE);
+    }
+
+    if (xfer_bufsize <= offset) {
+        return -USB_ERR_NOMEM;
+    }
+    urb_bufsize = (xfer_bufsize - offset) / stream->num_of_urbs;
+    num_of_packets = urb_bufsize / stream->mps;
+    if (num_of_packets == 0) {
+        return -USB_ERR_NOMEM;
+    }
+    urb_bufsize = num_of_packets * stream->mps;
+
+    for (uint8_t i = 0; i < stream->num_of_urbs; i++) {
+        stream->urb[i] = usbh_audio_stream_urb_alloc(stream, ep, &xfer_buf[offset + i * urb_bufsize], stream->mps, num_of_packets,
+                                                     (stream == &audio_class->stream_in) ? usbh_audio_stream_in_callback : usbh_audio_stream_out_callback);
+        if (stream->urb[i] == NULL) {
+            ret = -USB_ERR_NOMEM;
+            goto errout;
+        }
+        if (stream == &audio_class->stream_out) {
+            /* prime out urbs with pcm data or silence */
+            usbh_audio_stream_fill(stream, stream->urb[i]);
+        }
+    }
+
+    if (stream->fbep) {
+        stream->fb_urb = usbh_audio_stream_urb_alloc(stream, stream->fbep, stream->fb_buf, 4, 1, usbh_audio_stream_fb_callback);
+        if (stream->fb_urb == NULL) {
+            ret = -USB_ERR_NOMEM;
+            goto errout;
+        }
+    }
+
+    stream->running = true;
+    for (uint8_t i = 0; i < stream->num_of_urbs; i++) {
+        ret = usbh_submit_urb(stream->urb[i]);
+        if (ret < 0) {
+            goto errout;
+        }
+    }
+
+    if (stream->fb_urb) {
+        ret = usbh_submit_urb(stream->fb_urb);
+        if (ret < 0) {
+            goto errout;
+        }
+    }
+
+    USB_LOG_INFO("Start audio stream :%s, %u urbs, %u packets per urb\r\n", name, stream->num_of_urbs, (unsigned int)num_of_packets);
+    return 0;
+
+errout:
+    usbh_audio_stream_release(stream);
+    return ret;
+}
+
+int usbh_audio_stream_stop(struct usbh_audio *audio_class, const char *name)
+{
+    struct usbh_audio_stream *stream;
+    struct usbh_audio_as_msg *as_msg = NULL;
+
+    if (!audio_class || !audio_class->hport) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = usbh_audio_stream_get(audio_class, name, &as_msg);
+    if (stream == NULL) {
+        return -USB_ERR_NODEV;
+    }
+
+    usbh_audio_stream_release(stream);
+    return 0;
+}
+
+uint32_t usbh_audio_stream_write(struct usbh_audio *audio_class, const uint8_t *pcm, uint32_t len)
+{
+    struct usbh_audio_stream *stream = &audio_class->stream_out;
+    uint32_t free;
+
+    if (!stream->running) {
+        return 0;
+    }
+
+    /* keep whole audio frames in ring */
+    free = chry_ringbuffer_get_free(&stream->pcm_rb);
+    free -= free % stream->frame_bytes;
+    if (len > free) {
+        len = free;
+    }
+    len -= len % stream->frame_bytes;
+
+    return chry_ringbuffer_write(&stream->pcm_rb, (void *)pcm, len);
+}
+
+uint32_t usbh_audio_stream_read(struct usbh_audio *audio_class, uint8_t *pcm, uint32_t len)
+{
+    struct usbh_audio_stream *stream = &audio_class->stream_in;
+
+    if (!stream->running) {
+        return 0;
+    }
+
+    return chry_ringbuffer_read(&stream->pcm_rb, pcm, len);
+}
+
+int usbh_audio_stream_get_stats(struct usbh_audio *audio_class, const char *name, struct usbh_audio_stream_stats *stats)
+{
+    struct usbh_audio_stream *stream;
+    struct usbh_audio_as_msg *as_msg = NULL;
+    size_t flags;
+
+    if (!audio_class || !audio_class->hport || !stats) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = usbh_audio_stream_get(audio_class, name, &as_msg);
+    if (stream == NULL) {
+        return -USB_ERR_NODEV;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stats, &stream->stats, sizeof(struct usbh_audio_stream_stats));
+    stats->rate = stream->rate;
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
 void usbh_audio_list_module(struct usbh_audio *audio_class)
 {
     USB_LOG_INFO("============= Audio module information ===================\r\n");
@@ -588,9 +1036,11 @@ static int usbh_audio_ctrl_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
     if (audio_class) {
         if (audio_class->isoin) {
+            usbh_audio_stream_release(&audio_class->stream_in);
         }
 
         if (audio_class->isoout) {
+            usbh_audio_stream_release(&audio_class->stream_out);
         }
 
         if (hport->config.intf[intf].devname[0] != '\0') {
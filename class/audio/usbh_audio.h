@@ -7,11 +7,17 @@
 #define USBH_AUDIO_H
 
 #include "usb_audio.h"
+#include "chry_ringbuffer.h"
 
 #ifndef CONFIG_USBHOST_AUDIO_MAX_STREAMS
 #define CONFIG_USBHOST_AUDIO_MAX_STREAMS 3
 #endif
 
+/* outstanding iso urbs for every audio stream */
+#ifndef CONFIG_USBHOST_AUDIO_MAX_URBS
+#define CONFIG_USBHOST_AUDIO_MAX_URBS 2
+#endif
+
 struct usbh_audio_ac_msg {
     struct audio_cs_if_ac_input_terminal_descriptor ac_input;
     struct audio_cs_if_ac_feature_unit_descriptor ac_feature_unit;
@@ -31,14 +37,49 @@ struct usbh_audio_as_msg {
     uint16_t volume_res;
     uint16_t volume_cur;
     bool mute;
+    bool is_opened;
+    uint8_t cur_altsetting;
+    uint32_t cur_samp_freq;
     struct audio_cs_if_as_general_descriptor as_general;
     struct audio_cs_if_as_format_type_descriptor as_format[CONFIG_USBHOST_MAX_INTF_ALTSETTINGS];
 };
 
+struct usbh_audio_stream_stats {
+    uint32_t packets;   /* iso packets transferred */
+    uint32_t underruns; /* out packets padded with silence because pcm ring is empty */
+    uint32_t overruns;  /* in packets dropped because pcm ring is full */
+    uint32_t errors;    /* iso packets with error */
+    uint32_t rate;      /* current samples per packet, 16.16 */
+};
+
+struct usbh_audio;
+
+struct usbh_audio_stream {
+    struct usbh_audio *audio_class;
+    struct usb_endpoint_descriptor *ep;
+    struct usb_endpoint_descriptor *fbep; /* explicit feedback endpoint for async sink */
+    bool running;
+    bool implicit_fb;
+    uint8_t frame_bytes; /* bytes of one audio frame, channels * subframe size */
+    uint8_t num_of_urbs;
+    uint8_t urb_idx;
+    uint16_t mps;
+    uint16_t packet_interval; /* frames or microframes per packet */
+    uint32_t nominal_rate;    /* samples per packet, 16.16 */
+    uint32_t rate;            /* samples per packet, 16.16 */
+    uint32_t rate_acc;
+    chry_ringbuffer_t pcm_rb;
+    struct usbh_urb *urb[CONFIG_USBHOST_AUDIO_MAX_URBS];
+    struct usbh_urb *fb_urb;
+    uint8_t *fb_buf;
+    struct usbh_audio_stream_stats stats;
+};
+
 struct usbh_audio {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *isoin;  /* ISO IN endpoint */
     struct usb_endpoint_descriptor *isoout; /* ISO OUT endpoint */
+    struct usb_endpoint_descriptor *isofb;  /* ISO IN feedback endpoint */
 
     uint8_t ctrl_intf; /* interface number */
     uint8_t minor;
@@ -49,6 +90,8 @@ struct usbh_audio {
     uint8_t bInCollection;
     uint8_t stream_intf_num;
     struct usbh_audio_as_msg as_msg_table[CONFIG_USBHOST_AUDIO_MAX_STREAMS];
+    struct usbh_audio_stream stream_in;
+    struct usbh_audio_stream stream_out;
 
     void *user_data;
 };
@@ -62,6 +105,13 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name);
 int usbh_audio_set_volume(struct usbh_audio *audio_class, const char *name, uint8_t ch, int volume_db);
 int usbh_audio_set_mute(struct usbh_audio *audio_class, const char *name, uint8_t ch, bool mute);
 
+/* pcm_size must be power of 2, xfer_buf is used for iso packets and feedback */
+int usbh_audio_stream_start(struct usbh_audio *audio_class, const char *name, uint8_t *pcm_pool, uint32_t pcm_size, uint8_t *xfer_buf, uint32_t xfer_bufsize);
+int usbh_audio_stream_stop(struct usbh_audio *audio_class, const char *name);
+uint32_t usbh_audio_stream_write(struct usbh_audio *audio_class, const uint8_t *pcm, uint32_t len);
+uint32_t usbh_audio_stream_read(struct usbh_audio *audio_class, uint8_t *pcm, uint32_t len);
+int usbh_audio_stream_get_stats(struct usbh_audio *audio_class, const char *name, struct usbh_audio_stream_stats *stats);
+
 void usbh_audio_run(struct usbh_audio *audio_class);
 void usbh_audio_stop(struct usbh_audio *audio_class);
 
@@ -5,6 +5,34 @@
  */
 #include "usbd_core.h"
 #include "usbd_cdc_acm.h"
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+#include "usb_osal.h"
+#include "chry_ringbuffer.h"
+
+struct usbd_cdc_acm_stream {
+    uint8_t busid;
+    uint8_t out_ep;
+    uint8_t in_ep;
+    volatile bool rx_busy;
+    volatile bool tx_busy;
+    volatile bool flush_pending;
+    uint32_t rx_xfer_size;
+    uint32_t tx_xfer_size;
+    uint8_t *rx_buf;
+    uint8_t *tx_buf;
+    chry_ringbuffer_t rx_rb;
+    chry_ringbuffer_t tx_rb;
+    struct usb_osal_timer *flush_timer;
+    struct usbd_cdc_acm_stream_stats stats;
+};
+
+struct usbd_cdc_acm_priv {
+    struct usbd_cdc_acm_stream stream[CONFIG_USBDEV_CDC_ACM_MAX_STREAMS];
+} g_usbd_cdc_acm[CONFIG_USBDEV_MAX_BUS];
+
+static void usbd_cdc_acm_stream_reset(uint8_t busid);
+static void usbd_cdc_acm_stream_rx_arm(struct usbd_cdc_acm_stream *stream);
+#endif
 
 const char *stop_name[] = { "1", "1.5", "2" };
 const char *parity_name[] = { "N", "O", "E", "M", "S" };
@@ -83,6 +111,30 @@ static int cdc_acm_class_interface_request_handler(uint8_t busid, struct usb_set
     return 0;
 }
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+static void cdc_acm_notify_handler(uint8_t busid, uint8_t event, void *arg)
+{
+    (void)arg;
+
+    /* both cdc acm interfaces get the event, handlers must be reentrant */
+    switch (event) {
+        case USBD_EVENT_RESET:
+            usbd_cdc_acm_stream_reset(busid);
+            break;
+        case USBD_EVENT_CONFIGURED:
+            for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_MAX_STREAMS; i++) {
+                if (g_usbd_cdc_acm[busid].stream[i].rx_buf) {
+                    usbd_cdc_acm_stream_rx_arm(&g_usbd_cdc_acm[busid].stream[i]);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+#endif
+
 struct usbd_interface *usbd_cdc_acm_init_intf(uint8_t busid, struct usbd_interface *intf)
 {
     (void)busid;
@@ -90,11 +142,308 @@ struct usbd_interface *usbd_cdc_acm_init_intf(uint8_t busid, struct usbd_interfa
     intf->class_interface_handler = cdc_acm_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+    intf->notify_handler = cdc_acm_notify_handler;
+#else
     intf->notify_handler = NULL;
+#endif
 
     return intf;
 }
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+static struct usbd_cdc_acm_stream *usbd_cdc_acm_stream_find(uint8_t busid, uint8_t ep)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_MAX_STREAMS; i++) {
+        stream = &g_usbd_cdc_acm[busid].stream[i];
+        if (stream->rx_buf && ((stream->out_ep == ep) || (stream->in_ep == ep))) {
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static void usbd_cdc_acm_stream_reset(uint8_t busid)
+{
+    struct usbd_cdc_acm_stream *stream;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_MAX_STREAMS; i++) {
+        stream = &g_usbd_cdc_acm[busid].stream[i];
+        if (stream->rx_buf) {
+            stream->rx_busy = false;
+            stream->tx_busy = false;
+            chry_ringbuffer_reset(&stream->rx_rb);
+            chry_ringbuffer_reset(&stream->tx_rb);
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+}
+
+/* out transfer is armed only when ring can take it, host is naked otherwise */
+static void usbd_cdc_acm_stream_rx_arm(struct usbd_cdc_acm_stream *stream)
+{
+    uint16_t mps;
+    uint32_t len;
+    size_t flags;
+
+    if (!usb_device_is_configured(stream->busid)) {
+        return;
+    }
+
+    mps = usbd_get_ep_mps(stream->busid, stream->out_ep);
+    if (mps == 0) {
+        return;
+    }
+    len = stream->rx_xfer_size - (stream->rx_xfer_size % mps);
+
+    flags = usb_osal_enter_critical_section();
+    if (!stream->rx_busy && (len > 0)) {
+        if (chry_ringbuffer_get_free(&stream->rx_rb) >= len) {
+            stream->rx_busy = true;
+            usbd_ep_start_read(stream->busid, stream->out_ep, stream->rx_buf, len);
+        } else {
+            stream->stats.rx_throttled++;
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+}
+
+/* must be called with critical section held */
+static void usbd_cdc_acm_stream_tx_kick(struct usbd_cdc_acm_stream *stream, bool flush)
+{
+    uint32_t used;
+    uint32_t len;
+
+    if (stream->tx_busy || !usb_device_is_configured(stream->busid)) {
+        return;
+    }
+
+    used = chry_ringbuffer_get_used(&stream->tx_rb);
+    if ((used == 0) || (!flush && (used < stream->tx_xfer_size))) {
+        return;
+    }
+
+    len = chry_ringbuffer_read(&stream->tx_rb, stream->tx_buf, stream->tx_xfer_size);
+    stream->tx_busy = true;
+    usbd_ep_start_write(stream->busid, stream->in_ep, stream->tx_buf, len);
+}
+
+static void usbd_cdc_acm_stream_flush_timeout(void *argument)
+{
+    struct usbd_cdc_acm_stream *stream = (struct usbd_cdc_acm_stream *)argument;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    stream->flush_pending = false;
+    usbd_cdc_acm_stream_tx_kick(stream, true);
+    usb_osal_leave_critical_section(flags);
+}
+
+int usbd_cdc_acm_stream_init(uint8_t busid, uint8_t out_ep, uint8_t in_ep,
+                             uint8_t *rx_pool, uint32_t rx_size, uint8_t *tx_pool, uint32_t tx_size,
+                             uint8_t *xfer_buf, uint32_t xfer_bufsize)
+{
+    struct usbd_cdc_acm_stream *stream;
+    uint32_t xfer_size;
+
+    if (!rx_pool || !tx_pool || !xfer_buf) {
+        return -USB_ERR_INVAL;
+    }
+
+    /* half for out and half for in, keep both aligned */
+    xfer_size = (xfer_bufsize / 2) & ~(CONFIG_USB_ALIGN_SIZE - 1);
+    if ((xfer_size < 64) || (xfer_size > rx_size)) {
+        return -USB_ERR_NOMEM;
+    }
+
+    stream = usbd_cdc_acm_stream_find(busid, in_ep);
+    if (stream == NULL) {
+        for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_MAX_STREAMS; i++) {
+            if (g_usbd_cdc_acm[busid].stream[i].rx_buf == NULL) {
+                stream = &g_usbd_cdc_acm[busid].stream[i];
+                break;
+            }
+        }
+    }
+    if (stream == NULL) {
+        return -USB_ERR_NOMEM;
+    }
+
+    if ((chry_ringbuffer_init(&stream->rx_rb, rx_pool, rx_size) < 0) ||
+        (chry_ringbuffer_init(&stream->tx_rb, tx_pool, tx_size) < 0)) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream->busid = busid;
+    stream->out_ep = out_ep;
+    stream->in_ep = in_ep;
+    stream->rx_busy = false;
+    stream->tx_busy = false;
+    stream->flush_pending = false;
+    stream->rx_xfer_size = xfer_size;
+    stream->tx_xfer_size = xfer_size;
+    stream->rx_buf = xfer_buf;
+    stream->tx_buf = &xfer_buf[xfer_size];
+    memset(&stream->stats, 0, sizeof(struct usbd_cdc_acm_stream_stats));
+
+#if CONFIG_USBDEV_CDC_ACM_FLUSH_MS > 0
+    if (stream->flush_timer == NULL) {
+        stream->flush_timer = usb_osal_timer_create("cdc_flush", CONFIG_USBDEV_CDC_ACM_FLUSH_MS, usbd_cdc_acm_stream_flush_timeout, stream, false);
+    }
+#endif
+    return 0;
+}
+
+uint32_t usbd_cdc_acm_stream_read(uint8_t busid, uint8_t ep, uint8_t *buf, uint32_t len)
+{
+    struct usbd_cdc_acm_stream *stream;
+    uint32_t nbytes;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if ((stream == NULL) || !buf) {
+        return 0;
+    }
+
+    nbytes = chry_ringbuffer_read(&stream->rx_rb, buf, len);
+    if (nbytes && !stream->rx_busy) {
+        usbd_cdc_acm_stream_rx_arm(stream);
+    }
+    return nbytes;
+}
+
+uint32_t usbd_cdc_acm_stream_write(uint8_t busid, uint8_t ep, const uint8_t *buf, uint32_t len)
+{
+    struct usbd_cdc_acm_stream *stream;
+    uint32_t nbytes;
+    bool start_timer = false;
+    size_t flags;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if ((stream == NULL) || !buf || !usb_device_is_configured(busid)) {
+        return 0;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    nbytes = chry_ringbuffer_write(&stream->tx_rb, (void *)buf, len);
+    usbd_cdc_acm_stream_tx_kick(stream, stream->flush_timer == NULL);
+    if (stream->flush_timer && !stream->tx_busy && !stream->flush_pending && chry_ringbuffer_get_used(&stream->tx_rb)) {
+        stream->flush_pending = true;
+        start_timer = true;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (start_timer) {
+        usb_osal_timer_start(stream->flush_timer);
+    }
+    return nbytes;
+}
+
+void usbd_cdc_acm_stream_flush(uint8_t busid, uint8_t ep)
+{
+    struct usbd_cdc_acm_stream *stream;
+    size_t flags;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if (stream == NULL) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    usbd_cdc_acm_stream_tx_kick(stream, true);
+    usb_osal_leave_critical_section(flags);
+}
+
+uint32_t usbd_cdc_acm_stream_rx_available(uint8_t busid, uint8_t ep)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if (stream == NULL) {
+        return 0;
+    }
+    return chry_ringbuffer_get_used(&stream->rx_rb);
+}
+
+uint32_t usbd_cdc_acm_stream_tx_free(uint8_t busid, uint8_t ep)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if (stream == NULL) {
+        return 0;
+    }
+    return chry_ringbuffer_get_free(&stream->tx_rb);
+}
+
+int usbd_cdc_acm_stream_get_stats(uint8_t busid, uint8_t ep, struct usbd_cdc_acm_stream_stats *stats)
+{
+    struct usbd_cdc_acm_stream *stream;
+    size_t flags;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if ((stream == NULL) || !stats) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stats, &stream->stats, sizeof(struct usbd_cdc_acm_stream_stats));
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
+void usbd_cdc_acm_stream_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if (stream == NULL) {
+        return;
+    }
+
+    /* space is checked before arming, so whole transfer fits */
+    chry_ringbuffer_write(&stream->rx_rb, stream->rx_buf, nbytes);
+    stream->stats.rx_bytes += nbytes;
+    stream->stats.rx_xfers++;
+    stream->rx_busy = false;
+    usbd_cdc_acm_stream_rx_arm(stream);
+}
+
+void usbd_cdc_acm_stream_bulk_in(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_cdc_acm_stream *stream;
+    uint16_t mps;
+    size_t flags;
+
+    stream = usbd_cdc_acm_stream_find(busid, ep);
+    if (stream == NULL) {
+        return;
+    }
+
+    mps = usbd_get_ep_mps(busid, ep);
+
+    flags = usb_osal_enter_critical_section();
+    if (nbytes) {
+        stream->stats.tx_bytes += nbytes;
+        stream->stats.tx_xfers++;
+    }
+
+    /* transfer ends on packet boundary and nothing follows, terminate it with zlp */
+    if (nbytes && mps && ((nbytes % mps) == 0) && (chry_ringbuffer_get_used(&stream->tx_rb) == 0)) {
+        stream->stats.tx_zlps++;
+        usbd_ep_start_write(busid, ep, NULL, 0);
+    } else {
+        stream->tx_busy = false;
+        /* data queued during last transfer has already waited, send it now */
+        usbd_cdc_acm_stream_tx_kick(stream, true);
+    }
+    usb_osal_leave_critical_section(flags);
+}
+#endif
+
 __WEAK void usbd_cdc_acm_set_line_coding(uint8_t busid, uint8_t intf, struct cdc_line_coding *line_coding)
 {
     (void)busid;
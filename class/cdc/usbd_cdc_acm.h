@@ -8,6 +8,25 @@
 
 #include "usb_cdc.h"
 
+/* streams per bus, used when CONFIG_USBDEV_CDC_ACM_STREAM is enabled */
+#ifndef CONFIG_USBDEV_CDC_ACM_MAX_STREAMS
+#define CONFIG_USBDEV_CDC_ACM_MAX_STREAMS 1
+#endif
+
+/* small writes wait this long to be merged with following ones, 0 means send at once */
+#ifndef CONFIG_USBDEV_CDC_ACM_FLUSH_MS
+#define CONFIG_USBDEV_CDC_ACM_FLUSH_MS 2
+#endif
+
+struct usbd_cdc_acm_stream_stats {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t rx_xfers;
+    uint32_t tx_xfers;
+    uint32_t tx_zlps;
+    uint32_t rx_throttled; /* out transfers held back until reader frees ring space */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -22,6 +41,21 @@ void usbd_cdc_acm_set_dtr(uint8_t busid, uint8_t intf, bool dtr);
 void usbd_cdc_acm_set_rts(uint8_t busid, uint8_t intf, bool rts);
 void usbd_cdc_acm_send_break(uint8_t busid, uint8_t intf);
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+/* Stream api, set usbd_cdc_acm_stream_bulk_out and usbd_cdc_acm_stream_bulk_in as ep callback */
+int usbd_cdc_acm_stream_init(uint8_t busid, uint8_t out_ep, uint8_t in_ep,
+                             uint8_t *rx_pool, uint32_t rx_size, uint8_t *tx_pool, uint32_t tx_size,
+                             uint8_t *xfer_buf, uint32_t xfer_bufsize);
+uint32_t usbd_cdc_acm_stream_read(uint8_t busid, uint8_t ep, uint8_t *buf, uint32_t len);
+uint32_t usbd_cdc_acm_stream_write(uint8_t busid, uint8_t ep, const uint8_t *buf, uint32_t len);
+void usbd_cdc_acm_stream_flush(uint8_t busid, uint8_t ep);
+uint32_t usbd_cdc_acm_stream_rx_available(uint8_t busid, uint8_t ep);
+uint32_t usbd_cdc_acm_stream_tx_free(uint8_t busid, uint8_t ep);
+int usbd_cdc_acm_stream_get_stats(uint8_t busid, uint8_t ep, struct usbd_cdc_acm_stream_stats *stats);
+void usbd_cdc_acm_stream_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes);
+void usbd_cdc_acm_stream_bulk_in(uint8_t busid, uint8_t ep, uint32_t nbytes);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,26 +14,25 @@
 #define CONFIG_CDC_ECM_ETH_MAX_SEGSZE 1536U
 
 /* Describe EndPoints configuration */
-static struct usbd_endpoint cdc_ecm_ep_data[3];
+static struct usbd_endpoint cdc_ecm_ep_data[CONFIG_USBDEV_MAX_BUS][3];
 
 #ifdef CONFIG_USBDEV_CDC_ECM_USING_LWIP
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_rx_buffer[CONFIG_CDC_ECM_ETH_MAX_SEGSZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_tx_buffer[CONFIG_CDC_ECM_ETH_MAX_SEGSZE];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_rx_buffer[CONFIG_USBDEV_MAX_BUS][CONFIG_CDC_ECM_ETH_MAX_SEGSZE];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_tx_buffer[CONFIG_USBDEV_MAX_BUS][CONFIG_CDC_ECM_ETH_MAX_SEGSZE];
 #endif
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_notify_buf[16];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_notify_buf[CONFIG_USBDEV_MAX_BUS][USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
-volatile uint32_t g_cdc_ecm_rx_data_length = 0;
-volatile uint32_t g_cdc_ecm_tx_data_length = 0;
+struct usbd_cdc_ecm_priv {
+    volatile uint32_t rx_data_length;
+    volatile uint32_t tx_data_length;
+    volatile uint8_t current_net_status;
+    volatile uint8_t cmd_intf;
+    uint32_t connect_speed_table[2];
+} g_usbd_cdc_ecm[CONFIG_USBDEV_MAX_BUS];
 
-static volatile uint8_t g_current_net_status = 0;
-static volatile uint8_t g_cmd_intf = 0;
-
-static uint32_t g_connect_speed_table[2] = { CDC_ECM_CONNECT_SPEED_UPSTREAM,
-                                             CDC_ECM_CONNECT_SPEED_DOWNSTREAM };
-
-void usbd_cdc_ecm_send_notify(uint8_t notifycode, uint8_t value, uint32_t *speed)
+void usbd_cdc_ecm_send_notify(uint8_t busid, uint8_t notifycode, uint8_t value, uint32_t *speed)
 {
-    struct cdc_eth_notification *notify = (struct cdc_eth_notification *)g_cdc_ecm_notify_buf;
+    struct cdc_eth_notification *notify = (struct cdc_eth_notification *)g_cdc_ecm_notify_buf[busid];
     uint8_t bytes2send = 0;
 
     notify->bmRequestType = CDC_ECM_BMREQUEST_TYPE_ECM;
@@ -42,7 +41,7 @@ void usbd_cdc_ecm_send_notify(uint8_t notifycode, uint8_t value, uint32_t *speed
     switch (notifycode) {
         case CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION:
             notify->wValue = value;
-            notify->wIndex = g_cmd_intf;
+            notify->wIndex = g_usbd_cdc_ecm[busid].cmd_intf;
             notify->wLength = 0U;
 
             for (uint8_t i = 0U; i < 8U; i++) {
@@ -52,7 +51,7 @@ void usbd_cdc_ecm_send_notify(uint8_t notifycode, uint8_t value, uint32_t *speed
             break;
         case CDC_ECM_NOTIFY_CODE_RESPONSE_AVAILABLE:
             notify->wValue = 0U;
-            notify->wIndex = g_cmd_intf;
+            notify->wIndex = g_usbd_cdc_ecm[busid].cmd_intf;
             notify->wLength = 0U;
             for (uint8_t i = 0U; i < 8U; i++) {
                 notify->data[i] = 0U;
@@ -61,7 +60,7 @@ void usbd_cdc_ecm_send_notify(uint8_t notifycode, uint8_t value, uint32_t *speed
             break;
         case CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE:
             notify->wValue = 0U;
-            notify->wIndex = g_cmd_intf;
+            notify->wIndex = g_usbd_cdc_ecm[busid].cmd_intf;
             notify->wLength = 0x0008U;
             bytes2send = 16U;
 
@@ -72,9 +71,9 @@ void usbd_cdc_ecm_send_notify(uint8_t notifycode, uint8_t value, uint32_t *speed
             break;
     }
 
-    if (usb_device_is_configured(0)) {
+    if (usb_device_is_configured(busid)) {
         if (bytes2send) {
-            usbd_ep_start_write(0, cdc_ecm_ep_data[CDC_ECM_INT_EP_IDX].ep_addr, g_cdc_ecm_notify_buf, bytes2send);
+            usbd_ep_start_write(busid, cdc_ecm_ep_data[busid][CDC_ECM_INT_EP_IDX].ep_addr, g_cdc_ecm_notify_buf[busid], bytes2send);
         }
     }
 }
@@ -85,11 +84,10 @@ static int cdc_ecm_class_interface_request_handler(uint8_t busid, struct usb_set
                 "bRequest 0x%02x\r\n",
                 setup->bRequest);
 
-    (void)busid;
     (void)data;
     (void)len;
 
-    g_cmd_intf = LO_BYTE(setup->wIndex);
+    g_usbd_cdc_ecm[busid].cmd_intf = LO_BYTE(setup->wIndex);
 
     switch (setup->bRequest) {
         case CDC_REQUEST_SET_ETHERNET_PACKET_FILTER:
@@ -100,9 +98,9 @@ static int cdc_ecm_class_interface_request_handler(uint8_t busid, struct usb_set
              * bit4 Multicast
             */
 #ifdef CONFIG_USBDEV_CDC_ECM_USING_LWIP
-            g_connect_speed_table[0] = 100000000; /* 100 Mbps */
-            g_connect_speed_table[1] = 100000000; /* 100 Mbps */
-            usbd_cdc_ecm_set_connect(true, g_connect_speed_table);
+            g_usbd_cdc_ecm[busid].connect_speed_table[0] = 100000000; /* 100 Mbps */
+            g_usbd_cdc_ecm[busid].connect_speed_table[1] = 100000000; /* 100 Mbps */
+            usbd_cdc_ecm_set_connect(busid, true, g_usbd_cdc_ecm[busid].connect_speed_table);
 #endif
             break;
         default:
@@ -115,18 +113,17 @@ static int cdc_ecm_class_interface_request_handler(uint8_t busid, struct usb_set
 
 void cdc_ecm_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
-    (void)busid;
     (void)arg;
 
     switch (event) {
         case USBD_EVENT_RESET:
-            g_current_net_status = 0;
-            g_cdc_ecm_rx_data_length = 0;
-            g_cdc_ecm_tx_data_length = 0;
+            g_usbd_cdc_ecm[busid].current_net_status = 0;
+            g_usbd_cdc_ecm[busid].rx_data_length = 0;
+            g_usbd_cdc_ecm[busid].tx_data_length = 0;
             break;
         case USBD_EVENT_CONFIGURED:
 #ifdef CONFIG_USBDEV_CDC_ECM_USING_LWIP
-            usbd_cdc_ecm_start_read(g_cdc_ecm_rx_buffer, CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
+            usbd_cdc_ecm_start_read(busid, g_cdc_ecm_rx_buffer[busid], CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
 #endif
             break;
 
@@ -137,148 +134,151 @@ void cdc_ecm_notify_handler(uint8_t busid, uint8_t event, void *arg)
 
 void cdc_ecm_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
-    (void)busid;
+    (void)ep;
 
-    g_cdc_ecm_rx_data_length = nbytes;
-    usbd_cdc_ecm_data_recv_done(g_cdc_ecm_rx_data_length);
+    g_usbd_cdc_ecm[busid].rx_data_length = nbytes;
+    usbd_cdc_ecm_data_recv_done(busid, nbytes);
 }
 
 void cdc_ecm_bulk_in(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
-    (void)busid;
-
-    if ((nbytes % usbd_get_ep_mps(0, ep)) == 0 && nbytes) {
+    if ((nbytes % usbd_get_ep_mps(busid, ep)) == 0 && nbytes) {
         /* send zlp */
-        usbd_ep_start_write(0, ep, NULL, 0);
+        usbd_ep_start_write(busid, ep, NULL, 0);
     } else {
-        usbd_cdc_ecm_data_send_done(g_cdc_ecm_tx_data_length);
-        g_cdc_ecm_tx_data_length = 0;
+        usbd_cdc_ecm_data_send_done(busid, g_usbd_cdc_ecm[busid].tx_data_length);
+        g_usbd_cdc_ecm[busid].tx_data_length = 0;
     }
 }
 
 void cdc_ecm_int_in(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
-    (void)busid;
     (void)ep;
     (void)nbytes;
 
-    if (g_current_net_status == 2) {
-        g_current_net_status = 3;
-        usbd_cdc_ecm_send_notify(CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE, 0, g_connect_speed_table);
+    if (g_usbd_cdc_ecm[busid].current_net_status == 2) {
+        g_usbd_cdc_ecm[busid].current_net_status = 3;
+        usbd_cdc_ecm_send_notify(busid, CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE, 0, g_usbd_cdc_ecm[busid].connect_speed_table);
     } else {
-        g_current_net_status = 0;
+        g_usbd_cdc_ecm[busid].current_net_status = 0;
     }
 }
 
-int usbd_cdc_ecm_start_write(uint8_t *buf, uint32_t len)
+int usbd_cdc_ecm_start_write(uint8_t busid, uint8_t *buf, uint32_t len)
 {
-    if (!usb_device_is_configured(0)) {
+    if (!usb_device_is_configured(busid)) {
         return -USB_ERR_NODEV;
     }
 
-    if (g_cdc_ecm_tx_data_length > 0) {
+    if (g_usbd_cdc_ecm[busid].tx_data_length > 0) {
         return -USB_ERR_BUSY;
     }
 
-    g_cdc_ecm_tx_data_length = len;
+    g_usbd_cdc_ecm[busid].tx_data_length = len;
 
-    USB_LOG_DBG("txlen:%d\r\n", g_cdc_ecm_tx_data_length);
-    return usbd_ep_start_write(0, cdc_ecm_ep_data[CDC_ECM_IN_EP_IDX].ep_addr, buf, len);
+    USB_LOG_DBG("txlen:%d\r\n", g_usbd_cdc_ecm[busid].tx_data_length);
+    return usbd_ep_start_write(busid, cdc_ecm_ep_data[busid][CDC_ECM_IN_EP_IDX].ep_addr, buf, len);
 }
 
-int usbd_cdc_ecm_start_read(uint8_t *buf, uint32_t len)
+int usbd_cdc_ecm_start_read(uint8_t busid, uint8_t *buf, uint32_t len)
 {
-    if (!usb_device_is_configured(0)) {
+    if (!usb_device_is_configured(busid)) {
         return -USB_ERR_NODEV;
     }
 
-    g_cdc_ecm_rx_data_length = 0;
-    return usbd_ep_start_read(0, cdc_ecm_ep_data[CDC_ECM_OUT_EP_IDX].ep_addr, buf, len);
+    g_usbd_cdc_ecm[busid].rx_data_length = 0;
+    return usbd_ep_start_read(busid, cdc_ecm_ep_data[busid][CDC_ECM_OUT_EP_IDX].ep_addr, buf, len);
 }
 
 #ifdef CONFIG_USBDEV_CDC_ECM_USING_LWIP
-struct pbuf *usbd_cdc_ecm_eth_rx(void)
+struct pbuf *usbd_cdc_ecm_eth_rx(uint8_t busid)
 {
     struct pbuf *p;
+    uint32_t rx_data_length = g_usbd_cdc_ecm[busid].rx_data_length;
 
-    if (g_cdc_ecm_rx_data_length == 0) {
+    if (rx_data_length == 0) {
         return NULL;
     }
-    p = pbuf_alloc(PBUF_RAW, g_cdc_ecm_rx_data_length, PBUF_POOL);
+    p = pbuf_alloc(PBUF_RAW, rx_data_length, PBUF_POOL);
     if (p == NULL) {
-        usbd_cdc_ecm_start_read(g_cdc_ecm_rx_buffer, CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
+        usbd_cdc_ecm_start_read(busid, g_cdc_ecm_rx_buffer[busid], CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
         return NULL;
     }
-    usb_memcpy(p->payload, (uint8_t *)g_cdc_ecm_rx_buffer, g_cdc_ecm_rx_data_length);
-    p->len = g_cdc_ecm_rx_data_length;
+    usb_memcpy(p->payload, (uint8_t *)g_cdc_ecm_rx_buffer[busid], rx_data_length);
+    p->len = rx_data_length;
 
-    USB_LOG_DBG("rxlen:%d\r\n", g_cdc_ecm_rx_data_length);
-    usbd_cdc_ecm_start_read(g_cdc_ecm_rx_buffer, CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
+    USB_LOG_DBG("rxlen:%d\r\n", rx_data_length);
+    usbd_cdc_ecm_start_read(busid, g_cdc_ecm_rx_buffer[busid], CONFIG_CDC_ECM_ETH_MAX_SEGSZE);
     return p;
 }
 
-int usbd_cdc_ecm_eth_tx(struct pbuf *p)
+int usbd_cdc_ecm_eth_tx(uint8_t busid, struct pbuf *p)
 {
     struct pbuf *q;
     uint8_t *buffer;
 
-    if (g_cdc_ecm_tx_data_length > 0) {
+    if (g_usbd_cdc_ecm[busid].tx_data_length > 0) {
         return -USB_ERR_BUSY;
     }
 
-    if (p->tot_len > sizeof(g_cdc_ecm_tx_buffer)) {
-        p->tot_len = sizeof(g_cdc_ecm_tx_buffer);
+    if (p->tot_len > CONFIG_CDC_ECM_ETH_MAX_SEGSZE) {
+        p->tot_len = CONFIG_CDC_ECM_ETH_MAX_SEGSZE;
     }
 
-    buffer = g_cdc_ecm_tx_buffer;
+    buffer = g_cdc_ecm_tx_buffer[busid];
     for (q = p; q != NULL; q = q->next) {
         usb_memcpy(buffer, q->payload, q->len);
         buffer += q->len;
     }
 
-    return usbd_cdc_ecm_start_write(g_cdc_ecm_tx_buffer, p->tot_len);
+    return usbd_cdc_ecm_start_write(busid, g_cdc_ecm_tx_buffer[busid], p->tot_len);
 }
 #endif
 
-struct usbd_interface *usbd_cdc_ecm_init_intf(struct usbd_interface *intf, const uint8_t int_ep, const uint8_t out_ep, const uint8_t in_ep)
+struct usbd_interface *usbd_cdc_ecm_init_intf(uint8_t busid, struct usbd_interface *intf, const uint8_t int_ep, const uint8_t out_ep, const uint8_t in_ep)
 {
     intf->class_interface_handler = cdc_ecm_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
     intf->notify_handler = cdc_ecm_notify_handler;
 
-    cdc_ecm_ep_data[CDC_ECM_OUT_EP_IDX].ep_addr = out_ep;
-    cdc_ecm_ep_data[CDC_ECM_OUT_EP_IDX].ep_cb = cdc_ecm_bulk_out;
-    cdc_ecm_ep_data[CDC_ECM_IN_EP_IDX].ep_addr = in_ep;
-    cdc_ecm_ep_data[CDC_ECM_IN_EP_IDX].ep_cb = cdc_ecm_bulk_in;
-    cdc_ecm_ep_data[CDC_ECM_INT_EP_IDX].ep_addr = int_ep;
-    cdc_ecm_ep_data[CDC_ECM_INT_EP_IDX].ep_cb = cdc_ecm_int_in;
+    g_usbd_cdc_ecm[busid].connect_speed_table[0] = CDC_ECM_CONNECT_SPEED_UPSTREAM;
+    g_usbd_cdc_ecm[busid].connect_speed_table[1] = CDC_ECM_CONNECT_SPEED_DOWNSTREAM;
 
-    usbd_add_endpoint(0, &cdc_ecm_ep_data[CDC_ECM_OUT_EP_IDX]);
-    usbd_add_endpoint(0, &cdc_ecm_ep_data[CDC_ECM_IN_EP_IDX]);
-    usbd_add_endpoint(0, &cdc_ecm_ep_data[CDC_ECM_INT_EP_IDX]);
+    cdc_ecm_ep_data[busid][CDC_ECM_OUT_EP_IDX].ep_addr = out_ep;
+    cdc_ecm_ep_data[busid][CDC_ECM_OUT_EP_IDX].ep_cb = cdc_ecm_bulk_out;
+    cdc_ecm_ep_data[busid][CDC_ECM_IN_EP_IDX].ep_addr = in_ep;
+    cdc_ecm_ep_data[busid][CDC_ECM_IN_EP_IDX].ep_cb = cdc_ecm_bulk_in;
+    cdc_ecm_ep_data[busid][CDC_ECM_INT_EP_IDX].ep_addr = int_ep;
+    cdc_ecm_ep_data[busid][CDC_ECM_INT_EP_IDX].ep_cb = cdc_ecm_int_in;
+
+    usbd_add_endpoint(busid, &cdc_ecm_ep_data[busid][CDC_ECM_OUT_EP_IDX]);
+    usbd_add_endpoint(busid, &cdc_ecm_ep_data[busid][CDC_ECM_IN_EP_IDX]);
+    usbd_add_endpoint(busid, &cdc_ecm_ep_data[busid][CDC_ECM_INT_EP_IDX]);
 
     return intf;
 }
 
-void usbd_cdc_ecm_set_connect(bool connect, uint32_t speed[2])
+void usbd_cdc_ecm_set_connect(uint8_t busid, bool connect, uint32_t speed[2])
 {
     if (connect) {
-        g_current_net_status = 2;
-        memcpy(g_connect_speed_table, speed, 8);
-        usbd_cdc_ecm_send_notify(CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION, CDC_ECM_NET_CONNECTED, NULL);
+        g_usbd_cdc_ecm[busid].current_net_status = 2;
+        memcpy(g_usbd_cdc_ecm[busid].connect_speed_table, speed, 8);
+        usbd_cdc_ecm_send_notify(busid, CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION, CDC_ECM_NET_CONNECTED, NULL);
     } else {
-        g_current_net_status = 1;
-        usbd_cdc_ecm_send_notify(CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION, CDC_ECM_NET_DISCONNECTED, NULL);
+        g_usbd_cdc_ecm[busid].current_net_status = 1;
+        usbd_cdc_ecm_send_notify(busid, CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION, CDC_ECM_NET_DISCONNECTED, NULL);
     }
 }
 
-__WEAK void usbd_cdc_ecm_data_recv_done(uint32_t len)
+__WEAK void usbd_cdc_ecm_data_recv_done(uint8_t busid, uint32_t len)
 {
+    (void)busid;
     (void)len;
 }
 
-__WEAK void usbd_cdc_ecm_data_send_done(uint32_t len)
+__WEAK void usbd_cdc_ecm_data_send_done(uint8_t busid, uint32_t len)
 {
+    (void)busid;
     (void)len;
 }
@@ -10,7 +10,7 @@
 #define USB_DBG_TAG "usbh_cdc_ecm"
 #include "usb_log.h"
 
-#define DEV_FORMAT "/dev/cdc_ether"
+#define DEV_FORMAT "/dev/cdc_ether%d"
 
 /* general descriptor field offsets */
 #define DESC_bLength            0 /** Length offset */
@@ -24,13 +24,37 @@
 #define CONFIG_USBHOST_CDC_ECM_PKT_FILTER   0x000C
 #define CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE 1514U
 
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_rx_buffer[CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_tx_buffer[CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_inttx_buffer[16];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_rx_buffer[CONFIG_USBHOST_MAX_CDC_ECM_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_tx_buffer[CONFIG_USBHOST_MAX_CDC_ECM_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_inttx_buffer[CONFIG_USBHOST_MAX_CDC_ECM_CLASS][USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
-static struct usbh_cdc_ecm g_cdc_ecm_class;
+static struct usbh_cdc_ecm g_cdc_ecm_class[CONFIG_USBHOST_MAX_CDC_ECM_CLASS];
+static uint32_t g_devinuse = 0;
 
-struct usb_osal_timer *usbh_cdc_ecm_link_timer_handle;
+static struct usbh_cdc_ecm *usbh_cdc_ecm_class_alloc(void)
+{
+    uint8_t devno;
+
+    for (devno = 0; devno < CONFIG_USBHOST_MAX_CDC_ECM_CLASS; devno++) {
+        if ((g_devinuse & (1U << devno)) == 0) {
+            g_devinuse |= (1U << devno);
+            memset(&g_cdc_ecm_class[devno], 0, sizeof(struct usbh_cdc_ecm));
+            g_cdc_ecm_class[devno].minor = devno;
+            return &g_cdc_ecm_class[devno];
+        }
+    }
+    return NULL;
+}
+
+static void usbh_cdc_ecm_class_free(struct usbh_cdc_ecm *cdc_ecm_class)
+{
+    uint8_t devno = cdc_ecm_class->minor;
+
+    if (devno < 32) {
+        g_devinuse &= ~(1U << devno);
+    }
+    memset(cdc_ecm_class, 0, sizeof(struct usbh_cdc_ecm));
+}
 
 static int usbh_cdc_ecm_set_eth_packet_filter(struct usbh_cdc_ecm *cdc_ecm_class, uint16_t filter_value)
 {
@@ -52,35 +76,36 @@ static int usbh_cdc_ecm_set_eth_packet_filter(struct usbh_cdc_ecm *cdc_ecm_class
 
 int usbh_cdc_ecm_get_connect_status(struct usbh_cdc_ecm *cdc_ecm_class)
 {
+    uint8_t *inttx_buffer = g_cdc_ecm_inttx_buffer[cdc_ecm_class->minor];
     int ret;
 
-    usbh_int_urb_fill(&cdc_ecm_class->intin_urb, cdc_ecm_class->hport, cdc_ecm_class->intin, g_cdc_ecm_inttx_buffer, 16, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    usbh_int_urb_fill(&cdc_ecm_class->intin_urb, cdc_ecm_class->hport, cdc_ecm_class->intin, inttx_buffer, 16, USB_OSAL_WAITING_FOREVER, NULL, NULL);
     ret = usbh_submit_urb(&cdc_ecm_class->intin_urb);
     if (ret < 0) {
         return ret;
     }
 
-    if (g_cdc_ecm_inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION) {
-        if (g_cdc_ecm_inttx_buffer[2] == CDC_ECM_NET_CONNECTED) {
+    if (inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION) {
+        if (inttx_buffer[2] == CDC_ECM_NET_CONNECTED) {
             cdc_ecm_class->connect_status = true;
         } else {
             cdc_ecm_class->connect_status = false;
         }
-    } else if (g_cdc_ecm_inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE) {
-        memcpy(cdc_ecm_class->speed, &g_cdc_ecm_inttx_buffer[8], 8);
+    } else if (inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE) {
+        memcpy(cdc_ecm_class->speed, &inttx_buffer[8], 8);
     }
     return 0;
 }
 
 static void usbh_cdc_ecm_link_timer(void *arg)
 {
-    int prev_status = g_cdc_ecm_class.connect_status;
-    int ret = usbh_cdc_ecm_get_connect_status(&g_cdc_ecm_class);
+    struct usbh_cdc_ecm *cdc_ecm_class = (struct usbh_cdc_ecm *)arg;
+    int prev_status = cdc_ecm_class->connect_status;
+    int ret = usbh_cdc_ecm_get_connect_status(cdc_ecm_class);
     if (ret < 0) {
         return;
     }
-    struct usbh_cdc_ecm *cdc_ecm_class = &g_cdc_ecm_class;
-    if (g_cdc_ecm_class.connect_status != prev_status) {
+    if (cdc_ecm_class->connect_status != prev_status) {
         usbh_cdc_ecm_set_link_status(cdc_ecm_class);
     }
 }
@@ -95,9 +120,11 @@ static int usbh_cdc_ecm_connect(struct usbh_hubport *hport, uint8_t intf)
     uint8_t cur_iface = 0xff;
     uint8_t mac_str_idx = 0xff;
 
-    struct usbh_cdc_ecm *cdc_ecm_class = &g_cdc_ecm_class;
-
-    memset(cdc_ecm_class, 0, sizeof(struct usbh_cdc_ecm));
+    struct usbh_cdc_ecm *cdc_ecm_class = usbh_cdc_ecm_class_alloc();
+    if (cdc_ecm_class == NULL) {
+        USB_LOG_ERR("Fail to alloc cdc_ecm_class\r\n");
+        return -USB_ERR_NOMEM;
+    }
 
     cdc_ecm_class->hport = hport;
     cdc_ecm_class->ctrl_intf = intf;
@@ -208,9 +235,9 @@ get_mac:
     }
     USB_LOG_INFO("Set CDC ECM packet filter:%04x\r\n", CONFIG_USBHOST_CDC_ECM_PKT_FILTER);
 
-    strncpy(hport->config.intf[intf].devname, DEV_FORMAT, CONFIG_USBHOST_DEV_NAMELEN);
+    snprintf(hport->config.intf[intf].devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_ecm_class->minor);
 
-    usbh_cdc_ecm_link_timer_handle = usb_osal_timer_create("usbh_cdc_ecm_link_timer", 1000, usbh_cdc_ecm_link_timer, NULL, true);
+    cdc_ecm_class->link_timer = usb_osal_timer_create("usbh_cdc_ecm_link_timer", 1000, usbh_cdc_ecm_link_timer, cdc_ecm_class, true);
 
     USB_LOG_INFO("Register CDC ECM Class:%s\r\n", hport->config.intf[intf].devname);
 
@@ -237,8 +264,8 @@ static int usbh_cdc_ecm_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_kill_urb(&cdc_ecm_class->intin_urb);
         }
 
-        if (usbh_cdc_ecm_link_timer_handle) {
-            usb_osal_timer_delete(usbh_cdc_ecm_link_timer_handle);
+        if (cdc_ecm_class->link_timer) {
+            usb_osal_timer_delete(cdc_ecm_class->link_timer);
         }
 
         if (hport->config.intf[intf].devname[0] != '\0') {
@@ -246,7 +273,7 @@ static int usbh_cdc_ecm_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_cdc_ecm_stop(cdc_ecm_class);
         }
 
-        memset(cdc_ecm_class, 0, sizeof(struct usbh_cdc_ecm));
+        usbh_cdc_ecm_class_free(cdc_ecm_class);
     }
 
     return ret;
@@ -254,20 +281,27 @@ static int usbh_cdc_ecm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
 void usbh_cdc_ecm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
+    struct usbh_cdc_ecm *cdc_ecm_class = (struct usbh_cdc_ecm *)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+    char devname[CONFIG_USBHOST_DEV_NAMELEN];
+    uint8_t *rx_buffer;
     uint32_t g_cdc_ecm_rx_length;
     int ret;
-    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
-    USB_LOG_INFO("Create cdc ecm rx thread\r\n");
+
+    /* class may be freed and memset by disconnect, keep what we need to find it again */
+    snprintf(devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_ecm_class->minor);
+    rx_buffer = g_cdc_ecm_rx_buffer[cdc_ecm_class->minor];
+
+    USB_LOG_INFO("Create cdc ecm rx thread:%s\r\n", devname);
     // clang-format off
 find_class:
     // clang-format on
-    g_cdc_ecm_class.connect_status = false;
-    if (usbh_find_class_instance("/dev/cdc_ether") == NULL) {
+    if (usbh_find_class_instance(devname) != cdc_ecm_class) {
         goto delete;
     }
+    cdc_ecm_class->connect_status = false;
 
-    while (g_cdc_ecm_class.connect_status == false) {
-        ret = usbh_cdc_ecm_get_connect_status(&g_cdc_ecm_class);
+    while (cdc_ecm_class->connect_status == false) {
+        ret = usbh_cdc_ecm_get_connect_status(cdc_ecm_class);
         if (ret < 0) {
             usb_osal_msleep(100);
             goto find_class;
@@ -275,30 +309,29 @@ find_class:
         usb_osal_msleep(128);
     }
 
-    struct usbh_cdc_ecm *cdc_ecm_class = &g_cdc_ecm_class;
     usbh_cdc_ecm_set_link_status(cdc_ecm_class);
-    usb_osal_timer_start(usbh_cdc_ecm_link_timer_handle);
+    usb_osal_timer_start(cdc_ecm_class->link_timer);
 
     g_cdc_ecm_rx_length = 0;
     while (1) {
-        usbh_bulk_urb_fill(&g_cdc_ecm_class.bulkin_urb, g_cdc_ecm_class.hport, g_cdc_ecm_class.bulkin, g_cdc_ecm_rx_buffer, CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_cdc_ecm_class.bulkin_urb);
+        usbh_bulk_urb_fill(&cdc_ecm_class->bulkin_urb, cdc_ecm_class->hport, cdc_ecm_class->bulkin, rx_buffer, CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        ret = usbh_submit_urb(&cdc_ecm_class->bulkin_urb);
         if (ret < 0) {
             goto find_class;
         }
 
-        g_cdc_ecm_rx_length = g_cdc_ecm_class.bulkin_urb.actual_length;
+        g_cdc_ecm_rx_length = cdc_ecm_class->bulkin_urb.actual_length;
 
         /* A transfer is complete because last packet is a short packet.
-         * Short packet is not zero, match g_cdc_ecm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ecm_class.bulkin->wMaxPacketSize).
-         * Short packet is zero, check if g_cdc_ecm_class.bulkin_urb.actual_length < transfer_size, for example transfer is complete with size is 512 < 1514.
+         * Short packet is not zero, match g_cdc_ecm_rx_length % USB_GET_MAXPACKETSIZE(cdc_ecm_class->bulkin->wMaxPacketSize).
+         * Short packet is zero, check if cdc_ecm_class->bulkin_urb.actual_length < transfer_size, for example transfer is complete with size is 512 < 1514.
          * This case is always true
         */
-        if (g_cdc_ecm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ecm_class.bulkin->wMaxPacketSize) ||
-            (g_cdc_ecm_class.bulkin_urb.actual_length < CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE)) {
+        if (g_cdc_ecm_rx_length % USB_GET_MAXPACKETSIZE(cdc_ecm_class->bulkin->wMaxPacketSize) ||
+            (cdc_ecm_class->bulkin_urb.actual_length < CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE)) {
             USB_LOG_DBG("rxlen:%d\r\n", g_cdc_ecm_rx_length);
 
-            usbh_cdc_ecm_eth_input(g_cdc_ecm_rx_buffer, g_cdc_ecm_rx_length);
+            usbh_cdc_ecm_eth_input(cdc_ecm_class, rx_buffer, g_cdc_ecm_rx_length);
 
             g_cdc_ecm_rx_length = 0;
         } else {
@@ -307,26 +340,26 @@ find_class:
     }
     // clang-format off
 delete:
-    USB_LOG_INFO("Delete cdc ecm rx thread\r\n");
+    USB_LOG_INFO("Delete cdc ecm rx thread:%s\r\n", devname);
     usb_osal_thread_delete(NULL);
     // clang-format on
 }
 
-uint8_t *usbh_cdc_ecm_get_eth_txbuf(void)
+uint8_t *usbh_cdc_ecm_get_eth_txbuf(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    return g_cdc_ecm_tx_buffer;
+    return g_cdc_ecm_tx_buffer[cdc_ecm_class->minor];
 }
 
-int usbh_cdc_ecm_eth_output(uint32_t buflen)
+int usbh_cdc_ecm_eth_output(struct usbh_cdc_ecm *cdc_ecm_class, uint32_t buflen)
 {
-    if (g_cdc_ecm_class.connect_status == false) {
+    if (cdc_ecm_class->connect_status == false) {
         return -USB_ERR_NOTCONN;
     }
 
     USB_LOG_DBG("txlen:%d\r\n", buflen);
 
-    usbh_bulk_urb_fill(&g_cdc_ecm_class.bulkout_urb, g_cdc_ecm_class.hport, g_cdc_ecm_class.bulkout, g_cdc_ecm_tx_buffer, buflen, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-    return usbh_submit_urb(&g_cdc_ecm_class.bulkout_urb);
+    usbh_bulk_urb_fill(&cdc_ecm_class->bulkout_urb, cdc_ecm_class->hport, cdc_ecm_class->bulkout, g_cdc_ecm_tx_buffer[cdc_ecm_class->minor], buflen, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    return usbh_submit_urb(&cdc_ecm_class->bulkout_urb);
 }
 
 __WEAK void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
@@ -8,6 +8,10 @@
 
 #include "usb_cdc.h"
 
+#ifndef CONFIG_USBHOST_MAX_CDC_ECM_CLASS
+#define CONFIG_USBHOST_MAX_CDC_ECM_CLASS 1
+#endif
+
 struct usbh_cdc_ecm {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *bulkin;  /* Bulk IN endpoint */
@@ -25,6 +29,7 @@ struct usbh_cdc_ecm {
     bool connect_status;
     uint16_t max_segment_size;
     uint32_t speed[2];
+    struct usb_osal_timer *link_timer;
 
     void *user_data;
 };
@@ -39,9 +44,9 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class);
 void usbh_cdc_ecm_stop(struct usbh_cdc_ecm *cdc_ecm_class);
 void usbh_cdc_ecm_set_link_status(struct usbh_cdc_ecm *cdc_ecm_class);
 
-uint8_t *usbh_cdc_ecm_get_eth_txbuf(void);
-int usbh_cdc_ecm_eth_output(uint32_t buflen);
-void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen);
+uint8_t *usbh_cdc_ecm_get_eth_txbuf(struct usbh_cdc_ecm *cdc_ecm_class);
+int usbh_cdc_ecm_eth_output(struct usbh_cdc_ecm *cdc_ecm_class, uint32_t buflen);
+void usbh_cdc_ecm_eth_input(struct usbh_cdc_ecm *cdc_ecm_class, uint8_t *buf, uint32_t buflen);
 void usbh_cdc_ecm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
 #ifdef __cplusplus
@@ -10,7 +10,7 @@
 #define USB_DBG_TAG "usbh_cdc_ncm"
 #include "usb_log.h"
 
-#define DEV_FORMAT "/dev/cdc_ncm"
+#define DEV_FORMAT "/dev/cdc_ncm%d"
 
 /* general descriptor field offsets */
 #define DESC_bLength            0 /** Length offset */
@@ -23,13 +23,39 @@
 
 #define CONFIG_USBHOST_CDC_NCM_ETH_MAX_SEGSZE 1514U
 
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_rx_buffer[CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_tx_buffer[CONFIG_USBHOST_CDC_NCM_ETH_MAX_TX_SIZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_inttx_buffer[16];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_rx_buffer[CONFIG_USBHOST_MAX_CDC_NCM_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_tx_buffer[CONFIG_USBHOST_MAX_CDC_NCM_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_CDC_NCM_ETH_MAX_TX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_inttx_buffer[CONFIG_USBHOST_MAX_CDC_NCM_CLASS][USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_buf[32];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_buf[CONFIG_USBHOST_MAX_CDC_NCM_CLASS][USB_ALIGN_UP(32, CONFIG_USB_ALIGN_SIZE)];
 
-static struct usbh_cdc_ncm g_cdc_ncm_class;
+static struct usbh_cdc_ncm g_cdc_ncm_class[CONFIG_USBHOST_MAX_CDC_NCM_CLASS];
+static uint32_t g_devinuse = 0;
+
+static struct usbh_cdc_ncm *usbh_cdc_ncm_class_alloc(void)
+{
+    uint8_t devno;
+
+    for (devno = 0; devno < CONFIG_USBHOST_MAX_CDC_NCM_CLASS; devno++) {
+        if ((g_devinuse & (1U << devno)) == 0) {
+            g_devinuse |= (1U << devno);
+            memset(&g_cdc_ncm_class[devno], 0, sizeof(struct usbh_cdc_ncm));
+            g_cdc_ncm_class[devno].minor = devno;
+            return &g_cdc_ncm_class[devno];
+        }
+    }
+    return NULL;
+}
+
+static void usbh_cdc_ncm_class_free(struct usbh_cdc_ncm *cdc_ncm_class)
+{
+    uint8_t devno = cdc_ncm_class->minor;
+
+    if (devno < 32) {
+        g_devinuse &= ~(1U << devno);
+    }
+    memset(cdc_ncm_class, 0, sizeof(struct usbh_cdc_ncm));
+}
 
 static int usbh_cdc_ncm_get_ntb_parameters(struct usbh_cdc_ncm *cdc_ncm_class, struct cdc_ncm_ntb_parameters *param)
 {
@@ -47,12 +73,12 @@ static int usbh_cdc_ncm_get_ntb_parameters(struct usbh_cdc_ncm *cdc_ncm_class, s
     setup->wIndex = cdc_ncm_class->ctrl_intf;
     setup->wLength = 28;
 
-    ret = usbh_control_transfer(cdc_ncm_class->hport, setup, g_cdc_ncm_buf);
+    ret = usbh_control_transfer(cdc_ncm_class->hport, setup, g_cdc_ncm_buf[cdc_ncm_class->minor]);
     if (ret < 8) {
         return ret;
     }
 
-    memcpy((uint8_t *)param, g_cdc_ncm_buf, ret - 8);
+    memcpy((uint8_t *)param, g_cdc_ncm_buf[cdc_ncm_class->minor], ret - 8);
     return 0;
 }
 
@@ -79,20 +105,20 @@ int usbh_cdc_ncm_get_connect_status(struct usbh_cdc_ncm *cdc_ncm_class)
 {
     int ret;
 
-    usbh_int_urb_fill(&cdc_ncm_class->intin_urb, cdc_ncm_class->hport, cdc_ncm_class->intin, g_cdc_ncm_inttx_buffer, 16, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    usbh_int_urb_fill(&cdc_ncm_class->intin_urb, cdc_ncm_class->hport, cdc_ncm_class->intin, g_cdc_ncm_inttx_buffer[cdc_ncm_class->minor], 16, USB_OSAL_WAITING_FOREVER, NULL, NULL);
     ret = usbh_submit_urb(&cdc_ncm_class->intin_urb);
     if (ret < 0) {
         return ret;
     }
 
-    if (g_cdc_ncm_inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION) {
-        if (g_cdc_ncm_inttx_buffer[2] == CDC_ECM_NET_CONNECTED) {
+    if (g_cdc_ncm_inttx_buffer[cdc_ncm_class->minor][1] == CDC_ECM_NOTIFY_CODE_NETWORK_CONNECTION) {
+        if (g_cdc_ncm_inttx_buffer[cdc_ncm_class->minor][2] == CDC_ECM_NET_CONNECTED) {
             cdc_ncm_class->connect_status = true;
         } else {
             cdc_ncm_class->connect_status = false;
         }
-    } else if (g_cdc_ncm_inttx_buffer[1] == CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE) {
-        memcpy(cdc_ncm_class->speed, &g_cdc_ncm_inttx_buffer[8], 8);
+    } else if (g_cdc_ncm_inttx_buffer[cdc_ncm_class->minor][1] == CDC_ECM_NOTIFY_CODE_CONNECTION_SPEED_CHANGE) {
+        memcpy(cdc_ncm_class->speed, &g_cdc_ncm_inttx_buffer[cdc_ncm_class->minor][8], 8);
     }
     return 0;
 }
@@ -107,9 +133,11 @@ static int usbh_cdc_ncm_connect(struct usbh_hubport *hport, uint8_t intf)
     uint8_t cur_iface = 0xff;
     uint8_t mac_str_idx = 0xff;
 
-    struct usbh_cdc_ncm *cdc_ncm_class = &g_cdc_ncm_class;
-
-    memset(cdc_ncm_class, 0, sizeof(struct usbh_cdc_ncm));
+    struct usbh_cdc_ncm *cdc_ncm_class = usbh_cdc_ncm_class_alloc();
+    if (cdc_ncm_class == NULL) {
+        USB_LOG_ERR("Fail to alloc cdc_ncm_class\r\n");
+        return -USB_ERR_NOMEM;
+    }
 
     cdc_ncm_class->hport = hport;
     cdc_ncm_class->ctrl_intf = intf;
@@ -211,7 +239,7 @@ get_mac:
         }
     }
 
-    strncpy(hport->config.intf[intf].devname, DEV_FORMAT, CONFIG_USBHOST_DEV_NAMELEN);
+    snprintf(hport->config.intf[intf].devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_ncm_class->minor);
 
     USB_LOG_INFO("Register CDC NCM Class:%s\r\n", hport->config.intf[intf].devname);
 
@@ -243,7 +271,7 @@ static int usbh_cdc_ncm_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_cdc_ncm_stop(cdc_ncm_class);
         }
 
-        memset(cdc_ncm_class, 0, sizeof(struct usbh_cdc_ncm));
+        usbh_cdc_ncm_class_free(cdc_ncm_class);
     }
 
     return ret;
@@ -251,6 +279,9 @@ static int usbh_cdc_ncm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
 void usbh_cdc_ncm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
+    struct usbh_cdc_ncm *cdc_ncm_class = (struct usbh_cdc_ncm *)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+    char devname[CONFIG_USBHOST_DEV_NAMELEN];
+    uint8_t *rx_buffer;
     uint32_t g_cdc_ncm_rx_length;
     int ret;
 #if CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE <= (16 * 1024)
@@ -259,18 +290,21 @@ void usbh_cdc_ncm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
     uint32_t transfer_size = (16 * 1024);
 #endif
 
-    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
-    USB_LOG_INFO("Create cdc ncm rx thread\r\n");
+    /* class may be freed by disconnect, keep what we need to find it again */
+    snprintf(devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_ncm_class->minor);
+    rx_buffer = g_cdc_ncm_rx_buffer[cdc_ncm_class->minor];
+
+    USB_LOG_INFO("Create cdc ncm rx thread:%s\r\n", devname);
     // clang-format off
 find_class:
     // clang-format on
-    g_cdc_ncm_class.connect_status = false;
-    if (usbh_find_class_instance("/dev/cdc_ncm") == NULL) {
+    if (usbh_find_class_instance(devname) != cdc_ncm_class) {
         goto delete;
     }
+    cdc_ncm_class->connect_status = false;
 
-    while (g_cdc_ncm_class.connect_status == false) {
-        ret = usbh_cdc_ncm_get_connect_status(&g_cdc_ncm_class);
+    while (cdc_ncm_class->connect_status == false) {
+        ret = usbh_cdc_ncm_get_connect_status(cdc_ncm_class);
         if (ret < 0) {
             usb_osal_msleep(100);
             goto find_class;
@@ -279,23 +313,23 @@ find_class:
 
     g_cdc_ncm_rx_length = 0;
     while (1) {
-        usbh_bulk_urb_fill(&g_cdc_ncm_class.bulkin_urb, g_cdc_ncm_class.hport, g_cdc_ncm_class.bulkin, &g_cdc_ncm_rx_buffer[g_cdc_ncm_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_cdc_ncm_class.bulkin_urb);
+        usbh_bulk_urb_fill(&cdc_ncm_class->bulkin_urb, cdc_ncm_class->hport, cdc_ncm_class->bulkin, &rx_buffer[g_cdc_ncm_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        ret = usbh_submit_urb(&cdc_ncm_class->bulkin_urb);
         if (ret < 0) {
             goto find_class;
         }
 
-        g_cdc_ncm_rx_length += g_cdc_ncm_class.bulkin_urb.actual_length;
+        g_cdc_ncm_rx_length += cdc_ncm_class->bulkin_urb.actual_length;
 
         /* A transfer is complete because last packet is a short packet.
-         * Short packet is not zero, match g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ncm_class.bulkin->wMaxPacketSize).
-         * Short packet is zero, check if g_cdc_ncm_class.bulkin_urb.actual_length < transfer_size, for example transfer is complete with size is 1024 < 2048.
+         * Short packet is not zero, match g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(cdc_ncm_class->bulkin->wMaxPacketSize).
+         * Short packet is zero, check if cdc_ncm_class->bulkin_urb.actual_length < transfer_size, for example transfer is complete with size is 1024 < 2048.
         */
-        if ((g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ncm_class.bulkin->wMaxPacketSize)) ||
-            (g_cdc_ncm_class.bulkin_urb.actual_length < transfer_size)) {
+        if ((g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(cdc_ncm_class->bulkin->wMaxPacketSize)) ||
+            (cdc_ncm_class->bulkin_urb.actual_length < transfer_size)) {
             USB_LOG_DBG("rxlen:%d\r\n", g_cdc_ncm_rx_length);
 
-            struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&g_cdc_ncm_rx_buffer[0];
+            struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&rx_buffer[0];
             if ((nth16->dwSignature != CDC_NCM_NTH16_SIGNATURE) ||
                 (nth16->wHeaderLength != 12) ||
                 (nth16->wBlockLength != g_cdc_ncm_rx_length)) {
@@ -304,7 +338,7 @@ find_class:
                 continue;
             }
 
-            struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&g_cdc_ncm_rx_buffer[nth16->wNdpIndex];
+            struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&rx_buffer[nth16->wNdpIndex];
             if ((ndp16->dwSignature != CDC_NCM_NDP16_SIGNATURE_NCM0) && (ndp16->dwSignature != CDC_NCM_NDP16_SIGNATURE_NCM1)) {
                 USB_LOG_ERR("invalid rx ndp16\r\n");
                 g_cdc_ncm_rx_length = 0;
@@ -315,12 +349,12 @@ find_class:
 
             USB_LOG_DBG("datagram num:%02x\r\n", datagram_num);
             for (uint16_t i = 0; i < datagram_num; i++) {
-                struct cdc_ncm_ndp16_datagram *ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_rx_buffer[nth16->wNdpIndex + 8 + 4 * i];
+                struct cdc_ncm_ndp16_datagram *ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&rx_buffer[nth16->wNdpIndex + 8 + 4 * i];
                 if (ndp16_datagram->wDatagramIndex && ndp16_datagram->wDatagramLength) {
                     USB_LOG_DBG("ndp16_datagram index:%02x, length:%02x\r\n", ndp16_datagram->wDatagramIndex, ndp16_datagram->wDatagramLength);
 
-                    uint8_t *buf = (uint8_t *)&g_cdc_ncm_rx_buffer[ndp16_datagram->wDatagramIndex];
-                    usbh_cdc_ncm_eth_input(buf, ndp16_datagram->wDatagramLength);
+                    uint8_t *buf = (uint8_t *)&rx_buffer[ndp16_datagram->wDatagramIndex];
+                    usbh_cdc_ncm_eth_input(cdc_ncm_class, buf, ndp16_datagram->wDatagramLength);
                 }
             }
 
@@ -339,50 +373,50 @@ find_class:
     }
     // clang-format off
 delete:
-    USB_LOG_INFO("Delete cdc ncm rx thread\r\n");
+    USB_LOG_INFO("Delete cdc ncm rx thread:%s\r\n", devname);
     usb_osal_thread_delete(NULL);
     // clang-format on
 }
 
-uint8_t *usbh_cdc_ncm_get_eth_txbuf(void)
+uint8_t *usbh_cdc_ncm_get_eth_txbuf(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    return &g_cdc_ncm_tx_buffer[16];
+    return &g_cdc_ncm_tx_buffer[cdc_ncm_class->minor][16];
 }
 
-int usbh_cdc_ncm_eth_output(uint32_t buflen)
+int usbh_cdc_ncm_eth_output(struct usbh_cdc_ncm *cdc_ncm_class, uint32_t buflen)
 {
     struct cdc_ncm_ndp16_datagram *ndp16_datagram;
 
-    if (g_cdc_ncm_class.connect_status == false) {
+    if (cdc_ncm_class->connect_status == false) {
         return -USB_ERR_NOTCONN;
     }
 
-    struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&g_cdc_ncm_tx_buffer[0];
+    struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&g_cdc_ncm_tx_buffer[cdc_ncm_class->minor][0];
 
     nth16->dwSignature = CDC_NCM_NTH16_SIGNATURE;
     nth16->wHeaderLength = 12;
-    nth16->wSequence = g_cdc_ncm_class.bulkout_sequence++;
+    nth16->wSequence = cdc_ncm_class->bulkout_sequence++;
     nth16->wBlockLength = 16 + 16 + USB_ALIGN_UP(buflen, 4);
     nth16->wNdpIndex = 16 + USB_ALIGN_UP(buflen, 4);
 
-    struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&g_cdc_ncm_tx_buffer[nth16->wNdpIndex];
+    struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&g_cdc_ncm_tx_buffer[cdc_ncm_class->minor][nth16->wNdpIndex];
 
     ndp16->dwSignature = CDC_NCM_NDP16_SIGNATURE_NCM0;
     ndp16->wLength = 16;
     ndp16->wNextNdpIndex = 0;
 
-    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_tx_buffer[nth16->wNdpIndex + 8 + 4 * 0];
+    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_tx_buffer[cdc_ncm_class->minor][nth16->wNdpIndex + 8 + 4 * 0];
     ndp16_datagram->wDatagramIndex = 16;
     ndp16_datagram->wDatagramLength = buflen;
 
-    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_tx_buffer[nth16->wNdpIndex + 8 + 4 * 1];
+    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_tx_buffer[cdc_ncm_class->minor][nth16->wNdpIndex + 8 + 4 * 1];
     ndp16_datagram->wDatagramIndex = 0;
     ndp16_datagram->wDatagramLength = 0;
 
     USB_LOG_DBG("txlen:%d\r\n", nth16->wBlockLength);
 
-    usbh_bulk_urb_fill(&g_cdc_ncm_class.bulkout_urb, g_cdc_ncm_class.hport, g_cdc_ncm_class.bulkout, g_cdc_ncm_tx_buffer, nth16->wBlockLength, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-    return usbh_submit_urb(&g_cdc_ncm_class.bulkout_urb);
+    usbh_bulk_urb_fill(&cdc_ncm_class->bulkout_urb, cdc_ncm_class->hport, cdc_ncm_class->bulkout, g_cdc_ncm_tx_buffer[cdc_ncm_class->minor], nth16->wBlockLength, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    return usbh_submit_urb(&cdc_ncm_class->bulkout_urb);
 }
 
 __WEAK void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
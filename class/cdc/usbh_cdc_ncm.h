@@ -8,6 +8,10 @@
 
 #include "usb_cdc.h"
 
+#ifndef CONFIG_USBHOST_MAX_CDC_NCM_CLASS
+#define CONFIG_USBHOST_MAX_CDC_NCM_CLASS 1
+#endif
+
 struct usbh_cdc_ncm {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *bulkin;  /* Bulk IN endpoint */
@@ -42,9 +46,9 @@ int usbh_cdc_ncm_get_connect_status(struct usbh_cdc_ncm *cdc_ncm_class);
 void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class);
 void usbh_cdc_ncm_stop(struct usbh_cdc_ncm *cdc_ncm_class);
 
-uint8_t *usbh_cdc_ncm_get_eth_txbuf(void);
-int usbh_cdc_ncm_eth_output(uint32_t buflen);
-void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen);
+uint8_t *usbh_cdc_ncm_get_eth_txbuf(struct usbh_cdc_ncm *cdc_ncm_class);
+int usbh_cdc_ncm_eth_output(struct usbh_cdc_ncm *cdc_ncm_class, uint32_t buflen);
+void usbh_cdc_ncm_eth_input(struct usbh_cdc_ncm *cdc_ncm_class, uint8_t *buf, uint32_t buflen);
 void usbh_cdc_ncm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
 #ifdef __cplusplus
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2024, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stddef.h>
+#include <string.h>
+#include "usb_config.h"
+#include "usb_errno.h"
+#include "dfu_image.h"
+
+#undef USB_DBG_TAG
+#define USB_DBG_TAG "dfu_image"
+#include "usb_log.h"
+
+enum {
+    DFU_IMAGE_HEADER = 0,
+    DFU_IMAGE_BLOCK,
+    DFU_IMAGE_STORED,
+    DFU_IMAGE_TOKEN,
+    DFU_IMAGE_LITERAL_LEN,
+    DFU_IMAGE_LITERAL,
+    DFU_IMAGE_OFFSET,
+    DFU_IMAGE_MATCH_LEN,
+    DFU_IMAGE_DONE,
+    DFU_IMAGE_ERROR,
+};
+
+#define DFU_IMAGE_MIN_MATCH 4
+
+/* nibble table keeps the code small and is still 4 times faster than bitwise */
+static const uint32_t dfu_image_crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t dfu_image_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ dfu_image_crc_table[crc & 0x0f];
+        crc = (crc >> 4) ^ dfu_image_crc_table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+bool dfu_image_probe(const uint8_t *data, uint32_t len)
+{
+    if (len < 4) {
+        return false;
+    }
+    return (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24)) == DFU_IMAGE_MAGIC;
+}
+
+void dfu_image_init(struct dfu_image *image, uint8_t *window, uint32_t window_size, dfu_image_write_t write, void *arg)
+{
+    memset(image, 0, sizeof(struct dfu_image));
+    image->window = window;
+    image->window_size = window_size;
+    image->write = write;
+    image->arg = arg;
+    image->state = DFU_IMAGE_HEADER;
+}
+
+static int dfu_image_check_header(struct dfu_image *image)
+{
+    struct dfu_image_header *header = &image->header;
+
+    if ((header->magic != DFU_IMAGE_MAGIC) || (header->version != DFU_IMAGE_VERSION)) {
+        USB_LOG_ERR("Unsupported image %08x version %u\r\n", (unsigned int)header->magic, header->version);
+        return -USB_ERR_NOTSUPP;
+    }
+
+    if (dfu_image_crc32(0, (const uint8_t *)header, offsetof(struct dfu_image_header, header_crc)) != header->header_crc) {
+        USB_LOG_ERR("Image header crc error\r\n");
+        return -USB_ERR_INVAL;
+    }
+
+    if ((header->flags & ~DFU_IMAGE_FLAG_LZ4) || (header->block_size > image->window_size)) {
+        USB_LOG_ERR("Image flags %04x block size %u not supported\r\n", header->flags, (unsigned int)header->block_size);
+        return -USB_ERR_NOTSUPP;
+    }
+
+    image->payload_left = header->payload_size;
+    return 0;
+}
+
+static int dfu_image_flush(struct dfu_image *image)
+{
+    int ret;
+
+    if ((image->out_offset + image->out_pos) > image->header.image_size) {
+        return -USB_ERR_RANGE;
+    }
+
+    ret = image->write(image->arg, image->out_offset, image->window, image->out_pos);
+    if (ret < 0) {
+        return ret;
+    }
+
+    image->crc = dfu_image_crc32(image->crc, image->window, image->out_pos);
+    image->out_offset += image->out_pos;
+    image->out_pos = 0;
+
+    image->state = image->payload_left ? DFU_IMAGE_BLOCK : DFU_IMAGE_DONE;
+    return 0;
+}
+
+static int dfu_image_match(struct dfu_image *image)
+{
+    uint8_t *dst;
+    const uint8_t *src;
+    uint32_t n = image->len + DFU_IMAGE_MIN_MATCH;
+
+    if ((image->offset == 0) || (image->offset > image->out_pos) ||
+        (n > (image->header.block_size - image->out_pos))) {
+        return -USB_ERR_INVAL;
+    }
+
+    /* overlapped copy repeats the last offset bytes */
+    dst = image->window + image->out_pos;
+    src = dst - image->offset;
+    image->out_pos += n;
+    while (n--) {
+        *dst++ = *src++;
+    }
+
+    image->state = DFU_IMAGE_TOKEN;
+    return 0;
+}
+
+int dfu_image_feed(struct dfu_image *image, const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+    uint8_t b;
+    int ret = 0;
+
+    while (len && (ret == 0)) {
+        switch (image->state) {
+            case DFU_IMAGE_HEADER:
+                n = MIN(len, sizeof(struct dfu_image_header) - image->pos);
+                memcpy((uint8_t *)&image->header + image->pos, data, n);
+                image->pos += n;
+                data += n;
+                len -= n;
+                if (image->pos == sizeof(struct dfu_image_header)) {
+                    image->pos = 0;
+                    ret = dfu_image_check_header(image);
+                    image->state = image->payload_left ? DFU_IMAGE_BLOCK : DFU_IMAGE_DONE;
+                }
+                continue;
+
+            case DFU_IMAGE_STORED:
+            case DFU_IMAGE_LITERAL:
+                n = MIN(len, (image->state == DFU_IMAGE_STORED) ? image->block_left : image->len);
+                if (n > image->block_left) {
+                    ret = -USB_ERR_INVAL;
+                    break;
+                }
+                if (n > (image->header.block_size - image->out_pos)) {
+                    ret = -USB_ERR_INVAL;
+                    break;
+                }
+                memcpy(image->window + image->out_pos, data, n);
+                image->out_pos += n;
+                image->block_left -= n;
+                data += n;
+                len -= n;
+
+                if (image->state == DFU_IMAGE_LITERAL) {
+                    image->len -= n;
+                    if (image->len) {
+                        continue;
+                    }
+                    /* last sequence of a block only has literals */
+                    image->offset = 0;
+                    image->pos = 0;
+                    image->state = DFU_IMAGE_OFFSET;
+                }
+                if (image->block_left == 0) {
+                    ret = dfu_image_flush(image);
+                }
+                continue;
+
+            case DFU_IMAGE_DONE:
+                /* padding after the last block */
+                return 0;
+
+            case DFU_IMAGE_ERROR:
+                return -USB_ERR_INVAL;
+
+            default:
+                break;
+        }
+
+        /* states below consume one byte */
+        if (ret < 0) {
+            break;
+        }
+
+        b = *data++;
+        len--;
+
+        if (image->state == DFU_IMAGE_BLOCK) {
+            image->len |= (uint32_t)b << (8 * image->pos);
+            image->payload_left--;
+            if (++image->pos < 4) {
+                continue;
+            }
+            image->pos = 0;
+            image->block_left = image->len & ~DFU_IMAGE_BLOCK_STORED;
+            if ((image->block_left == 0) || (image->block_left > image->payload_left) ||
+                (!(image->header.flags & DFU_IMAGE_FLAG_LZ4) && !(image->len & DFU_IMAGE_BLOCK_STORED))) {
+                ret = -USB_ERR_INVAL;
+                break;
+            }
+            image->payload_left -= image->block_left;
+            image->state = (image->len & DFU_IMAGE_BLOCK_STORED) ? DFU_IMAGE_STORED : DFU_IMAGE_TOKEN;
+            image->len = 0;
+            continue;
+        }
+
+        if (image->block_left == 0) {
+            ret = -USB_ERR_INVAL;
+            break;
+        }
+        image->block_left--;
+
+        switch (image->state) {
+            case DFU_IMAGE_TOKEN:
+                image->token = b;
+                image->len = b >> 4;
+                if (image->len == 15) {
+                    image->state = DFU_IMAGE_LITERAL_LEN;
+                } else if (image->len) {
+                    image->state = DFU_IMAGE_LITERAL;
+                } else {
+                    image->offset = 0;
+                    image->pos = 0;
+                    image->state = DFU_IMAGE_OFFSET;
+                }
+                break;
+
+            case DFU_IMAGE_LITERAL_LEN:
+                image->len += b;
+                if (b != 255) {
+                    image->state = DFU_IMAGE_LITERAL;
+                }
+                break;
+
+            case DFU_IMAGE_OFFSET:
+                image->offset |= (uint32_t)b << (8 * image->pos);
+                if (++image->pos < 2) {
+                    break;
+                }
+                image->pos = 0;
+                image->len = image->token & 0x0f;
+                if (image->len == 15) {
+                    image->state = DFU_IMAGE_MATCH_LEN;
+                } else {
+                    ret = dfu_image_match(image);
+                }
+                break;
+
+            case DFU_IMAGE_MATCH_LEN:
+                image->len += b;
+                if (b != 255) {
+                    ret = dfu_image_match(image);
+                }
+                break;
+
+            default:
+                ret = -USB_ERR_INVAL;
+                break;
+        }
+
+        if ((ret == 0) && (image->state == DFU_IMAGE_TOKEN) && (image->block_left == 0)) {
+            ret = dfu_image_flush(image);
+        }
+    }
+
+    if (ret < 0) {
+        USB_LOG_ERR("Image decode error %d at offset %u\r\n", ret, (unsigned int)(image->out_offset + image->out_pos));
+        image->state = DFU_IMAGE_ERROR;
+    }
+    return ret;
+}
+
+int dfu_image_finish(struct dfu_image *image)
+{
+    if ((image->state != DFU_IMAGE_DONE) || (image->out_offset != image->header.image_size)) {
+        USB_LOG_ERR("Image incomplete, %u of %u bytes\r\n", (unsigned int)image->out_offset, (unsigned int)image->header.image_size);
+        return -USB_ERR_INVAL;
+    }
+
+    if (image->crc != image->header.image_crc) {
+        USB_LOG_ERR("Image crc %08x expect %08x\r\n", (unsigned int)image->crc, (unsigned int)image->header.image_crc);
+        return -USB_ERR_IO;
+    }
+    return 0;
+}
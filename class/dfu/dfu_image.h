@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef DFU_IMAGE_H
+#define DFU_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "usb_util.h"
+
+/*
+ * Firmware image stream, produced by tools/uf2/uf2conv.py --compress:
+ *
+ *   struct dfu_image_header
+ *   block: uint32_t length | DFU_IMAGE_BLOCK_STORED, followed by length bytes
+ *   block ...
+ *
+ * Every block decodes to at most block_size bytes and does not reference data
+ * of other blocks, so the decoder only needs block_size bytes of ram.
+ */
+#define DFU_IMAGE_MAGIC   0x57465543 /* "CUFW" */
+#define DFU_IMAGE_VERSION 1
+
+#define DFU_IMAGE_FLAG_LZ4 0x0001 /* blocks are lz4 block format */
+
+#define DFU_IMAGE_BLOCK_STORED 0x80000000U /* block is not compressed */
+
+struct dfu_image_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t block_size;   /* max decoded size of one block */
+    uint32_t image_size;   /* decoded size */
+    uint32_t payload_size; /* size of all blocks after the header */
+    uint32_t image_crc;    /* crc32 of decoded image */
+    uint32_t header_crc;   /* crc32 of the fields above */
+} __PACKED;
+
+/* Called with decoded data in order, offset is relative to image start */
+typedef int (*dfu_image_write_t)(void *arg, uint32_t offset, const uint8_t *data, uint32_t len);
+
+struct dfu_image {
+    struct dfu_image_header header;
+    dfu_image_write_t write;
+    void *arg;
+    uint8_t *window;
+    uint32_t window_size;
+
+    uint32_t state;
+    uint32_t payload_left; /* bytes left after header */
+    uint32_t block_left;   /* bytes left in current block */
+    uint32_t out_pos;      /* decoded bytes in window */
+    uint32_t out_offset;   /* decoded bytes written */
+    uint32_t len;          /* pending literal or match length, block header */
+    uint32_t offset;
+    uint32_t crc;
+    uint8_t pos;
+    uint8_t token;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Check if data starts with an image header */
+bool dfu_image_probe(const uint8_t *data, uint32_t len);
+
+void dfu_image_init(struct dfu_image *image, uint8_t *window, uint32_t window_size, dfu_image_write_t write, void *arg);
+/* Feed stream data in order, data after the last block is ignored */
+int dfu_image_feed(struct dfu_image *image, const uint8_t *data, uint32_t len);
+/* Check that the whole image is decoded and crc matches */
+int dfu_image_finish(struct dfu_image *image);
+
+uint32_t dfu_image_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_IMAGE_H */
@@ -5,6 +5,12 @@
  */
 #include "usbd_core.h"
 #include "usbd_dfu.h"
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+#include "usb_osal.h"
+#endif
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+#include "dfu_image.h"
+#endif
 
 /** Modify the following three parameters according to different platforms */
 #ifndef USBD_DFU_XFER_SIZE
@@ -15,6 +21,7 @@
 #define USBD_DFU_APP_DEFAULT_ADD 0x8004000
 #endif
 
+/* Initial estimate in ms, replaced by measured time when dfu_get_timestamp_ms is implemented */
 #ifndef FLASH_PROGRAM_TIME
 #define FLASH_PROGRAM_TIME 50
 #endif
@@ -23,12 +30,46 @@
 #define FLASH_ERASE_TIME 50
 #endif
 
-struct usbd_dfu_priv {
-    struct dfu_info info;
+#ifndef CONFIG_USBDEV_DFU_PRIO
+#define CONFIG_USBDEV_DFU_PRIO 4
+#endif
+
+#ifndef CONFIG_USBDEV_DFU_STACKSIZE
+#define CONFIG_USBDEV_DFU_STACKSIZE 2048
+#endif
+
+#ifndef CONFIG_USBDEV_DFU_IMAGE_BLOCK_SIZE
+#define CONFIG_USBDEV_DFU_IMAGE_BLOCK_SIZE 4096
+#endif
+
+#if defined(CONFIG_USBDEV_DFU_THREAD) || defined(CONFIG_USBDEV_DFU_POLLING)
+#define DFU_BACKGROUND
+#ifdef CONFIG_USBDEV_DFU_ERASE_AHEAD_END
+#define DFU_ERASE_AHEAD
+#endif
+#define DFU_JOB_NUM 2 /* receive next block while the other one is programmed */
+#else
+#define DFU_JOB_NUM 1 /* programmed in the next getstatus */
+#endif
+
+#define DFU_JOB_WRITE 0
+#define DFU_JOB_ERASE 1
+#define DFU_JOB_IMAGE_START 2 /* first block of a compressed image, addr is flash base */
+#define DFU_JOB_IMAGE       3 /* next block of a compressed image */
+
+struct usbd_dfu_job {
     union {
         uint32_t d32[USBD_DFU_XFER_SIZE / 4U];
         uint8_t d8[USBD_DFU_XFER_SIZE];
     } buffer;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t poll_timeout;
+    uint8_t type;
+};
+
+struct usbd_dfu_priv {
+    struct dfu_info info;
 
     uint32_t wblock_num;
     uint32_t wlength;
@@ -39,132 +80,403 @@ struct usbd_dfu_priv {
     uint8_t ReservedForAlign[2];
     uint8_t dev_state;
     uint8_t manif_state;
-    uint8_t firmwar_flag;
-} g_usbd_dfu;
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+    bool image_mode;     /* download started with an image header */
+    uint32_t image_next; /* expected wblock_num of the next image block */
+#endif
+} g_usbd_dfu[CONFIG_USBDEV_MAX_BUS];
+
+/* Flash jobs queued by ep0 and run by the worker, kept across bus reset */
+static struct usbd_dfu_worker {
+    struct usbd_dfu_job job[DFU_JOB_NUM];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t busy_start;   /* timestamp of the running flash operation */
+    volatile uint32_t busy_timeout; /* estimate of the running flash operation, 0 when idle */
+    volatile bool busy_job;         /* running operation is job[tail] */
+    volatile uint8_t error;         /* bStatus of a failed job */
+    uint32_t program_time;
+    uint32_t erase_time;
+    /* erased and not yet written flash, only known with dfu_get_flash_sector */
+    uint32_t erased_start;
+    uint32_t erased_end;
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+    struct dfu_image image;
+    uint32_t image_base;
+    uint8_t image_status; /* bStatus of a failed flash operation during decode */
+    uint8_t image_window[CONFIG_USBDEV_DFU_IMAGE_BLOCK_SIZE];
+#endif
+#ifdef CONFIG_USBDEV_DFU_THREAD
+    usb_osal_sem_t sem;
+    usb_osal_thread_t thread;
+#endif
+} g_usbd_dfu_worker[CONFIG_USBDEV_MAX_BUS];
 
-static void dfu_reset(void)
+static void dfu_reset(uint8_t busid)
 {
-    memset(&g_usbd_dfu, 0, sizeof(g_usbd_dfu));
+    memset(&g_usbd_dfu[busid], 0, sizeof(g_usbd_dfu[busid]));
+
+    g_usbd_dfu[busid].alt_setting = 0U;
+    g_usbd_dfu[busid].data_ptr = USBD_DFU_APP_DEFAULT_ADD;
+    g_usbd_dfu[busid].wblock_num = 0U;
+    g_usbd_dfu[busid].wlength = 0U;
+
+    g_usbd_dfu[busid].manif_state = DFU_MANIFEST_COMPLETE;
+    g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
+
+    g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_OK;
+    g_usbd_dfu[busid].dev_status[1] = 0U;
+    g_usbd_dfu[busid].dev_status[2] = 0U;
+    g_usbd_dfu[busid].dev_status[3] = 0U;
+    g_usbd_dfu[busid].dev_status[4] = DFU_STATE_DFU_IDLE;
+    g_usbd_dfu[busid].dev_status[5] = 0U;
+
+    g_usbd_dfu_worker[busid].error = DFU_STATUS_OK;
+    if (g_usbd_dfu_worker[busid].program_time == 0) {
+        g_usbd_dfu_worker[busid].program_time = FLASH_PROGRAM_TIME;
+        g_usbd_dfu_worker[busid].erase_time = FLASH_ERASE_TIME;
+    }
+}
 
-    g_usbd_dfu.alt_setting = 0U;
-    g_usbd_dfu.data_ptr = USBD_DFU_APP_DEFAULT_ADD;
-    g_usbd_dfu.wblock_num = 0U;
-    g_usbd_dfu.wlength = 0U;
+static void dfu_set_status(uint8_t busid, uint8_t state, uint32_t poll_timeout)
+{
+    g_usbd_dfu[busid].dev_state = state;
 
-    g_usbd_dfu.manif_state = DFU_MANIFEST_COMPLETE;
-    g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
+    g_usbd_dfu[busid].dev_status[1] = (uint8_t)poll_timeout;
+    g_usbd_dfu[busid].dev_status[2] = (uint8_t)(poll_timeout >> 8);
+    g_usbd_dfu[busid].dev_status[3] = (uint8_t)(poll_timeout >> 16);
+    g_usbd_dfu[busid].dev_status[4] = state;
+}
+
+static bool dfu_job_full(uint8_t busid)
+{
+    return (g_usbd_dfu_worker[busid].head - g_usbd_dfu_worker[busid].tail) >= DFU_JOB_NUM;
+}
 
-    g_usbd_dfu.dev_status[0] = DFU_STATUS_OK;
-    g_usbd_dfu.dev_status[1] = 0U;
-    g_usbd_dfu.dev_status[2] = 0U;
-    g_usbd_dfu.dev_status[3] = 0U;
-    g_usbd_dfu.dev_status[4] = DFU_STATE_DFU_IDLE;
-    g_usbd_dfu.dev_status[5] = 0U;
+static bool dfu_job_idle(uint8_t busid)
+{
+    return (g_usbd_dfu_worker[busid].head == g_usbd_dfu_worker[busid].tail) && (g_usbd_dfu_worker[busid].busy_timeout == 0);
 }
 
-static uint16_t dfu_getstatus(uint32_t add, uint8_t cmd, uint8_t *buffer)
+/* Estimated ms until the running operation and the next n queued jobs are done */
+static uint32_t dfu_poll_timeout(uint8_t busid, uint32_t n)
 {
-    switch (cmd) {
-        case DFU_MEDIA_PROGRAM:
-            buffer[1] = (uint8_t)FLASH_PROGRAM_TIME;
-            buffer[2] = (uint8_t)(FLASH_PROGRAM_TIME << 8);
-            buffer[3] = 0;
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint32_t head = worker->head;
+    uint32_t tail = worker->tail;
+    uint32_t busy_timeout = worker->busy_timeout;
+    uint32_t timeout = 0;
+    uint32_t elapsed;
+
+    if (busy_timeout) {
+        elapsed = dfu_get_timestamp_ms() - worker->busy_start;
+        timeout = (busy_timeout > elapsed) ? (busy_timeout - elapsed) : 1;
+        if (worker->busy_job && (tail != head)) {
+            tail++;
+            n--;
+        }
+    }
+
+    while ((tail != head) && n) {
+        timeout += worker->job[tail % DFU_JOB_NUM].poll_timeout;
+        tail++;
+        n--;
+    }
+
+    return MAX(timeout, 1);
+}
+
+static void dfu_job_push(uint8_t busid, uint8_t type, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    struct usbd_dfu_job *job = &worker->job[worker->head % DFU_JOB_NUM];
+
+    job->type = type;
+    job->addr = addr;
+    job->len = len;
+    job->poll_timeout = (type == DFU_JOB_ERASE) ? worker->erase_time : worker->program_time;
+    if (len) {
+        memcpy(job->buffer.d8, data, len);
+    }
+    worker->head++;
+
+#ifdef CONFIG_USBDEV_DFU_THREAD
+    usb_osal_sem_give(worker->sem);
+#endif
+}
+
+/* Follow slower flash at once and faster flash gradually */
+static void dfu_update_time(uint32_t *estimate, uint32_t elapsed)
+{
+    if (elapsed == 0) {
+        return;
+    }
+
+    if (elapsed >= *estimate) {
+        *estimate = elapsed;
+    } else {
+        *estimate = (*estimate * 3 + elapsed + 3) / 4;
+    }
+}
+
+static int dfu_erase_sector(uint8_t busid, uint32_t addr)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint32_t start;
+    uint32_t size;
+    uint32_t ts;
+    int ret;
+
+    USB_LOG_DBG("Erase start add %08x \r\n", addr);
+
+    ts = dfu_get_timestamp_ms();
+    ret = dfu_erase_flash(addr);
+    dfu_update_time(&worker->erase_time, dfu_get_timestamp_ms() - ts);
+
+    if ((ret == 0) && (dfu_get_flash_sector(addr, &start, &size) == 0)) {
+        if ((start == worker->erased_end) && (worker->erased_end != worker->erased_start)) {
+            worker->erased_end = start + size;
+        } else {
+            worker->erased_start = start;
+            worker->erased_end = start + size;
+        }
+    }
+    return ret;
+}
+
+static bool dfu_is_erased(uint8_t busid, uint32_t addr)
+{
+    return (addr >= g_usbd_dfu_worker[busid].erased_start) && (addr < g_usbd_dfu_worker[busid].erased_end);
+}
+
+static uint8_t dfu_flash_program(uint8_t busid, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint32_t end;
+    uint32_t start;
+    uint32_t size;
+    uint32_t ts;
+    uint8_t status = DFU_STATUS_OK;
+
+    /* erase sectors not covered by host erase or erase ahead, when the sector layout is known */
+    end = addr + len;
+    while (addr < end) {
+        if (dfu_is_erased(busid, addr)) {
+            addr = MIN(end, g_usbd_dfu_worker[busid].erased_end);
+        } else if (dfu_get_flash_sector(addr, &start, &size) == 0) {
+            if (dfu_erase_sector(busid, start) != 0) {
+                return DFU_STATUS_ERR_ERASE;
+            }
+        } else {
             break;
+        }
+    }
 
-        case DFU_MEDIA_ERASE:
-            buffer[1] = (uint8_t)FLASH_ERASE_TIME;
-            buffer[2] = (uint8_t)(FLASH_ERASE_TIME << 8);
-            buffer[3] = 0;
-        default:
+    addr = end - len;
+    USB_LOG_DBG("Write start add %08x length %d\r\n", addr, len);
+
+    ts = dfu_get_timestamp_ms();
+    if (dfu_write_flash((uint8_t *)data, (uint8_t *)addr, len) != 0) {
+        status = DFU_STATUS_ERR_WRITE;
+    }
+    dfu_update_time(&worker->program_time, dfu_get_timestamp_ms() - ts);
+
+    if ((end > worker->erased_start) && (end <= worker->erased_end)) {
+        worker->erased_start = end;
+    }
+    return status;
+}
+
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+static int dfu_image_output(void *arg, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint8_t busid = (uint8_t)(uintptr_t)arg;
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+
+    worker->image_status = dfu_flash_program(busid, worker->image_base + offset, data, len);
+    return (worker->image_status == DFU_STATUS_OK) ? 0 : -USB_ERR_IO;
+}
 
+static uint8_t dfu_image_run(uint8_t busid, struct usbd_dfu_job *job)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+
+    if (job->type == DFU_JOB_IMAGE_START) {
+        dfu_image_init(&worker->image, worker->image_window, sizeof(worker->image_window),
+                       dfu_image_output, (void *)(uintptr_t)busid);
+        worker->image_base = job->addr;
+    }
+
+    worker->image_status = DFU_STATUS_OK;
+    if (dfu_image_feed(&worker->image, job->buffer.d8, job->len) < 0) {
+        return (worker->image_status != DFU_STATUS_OK) ? worker->image_status : DFU_STATUS_ERR_FILE;
+    }
+    return DFU_STATUS_OK;
+}
+#endif
+
+static uint8_t dfu_job_run(uint8_t busid, struct usbd_dfu_job *job)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint8_t status = DFU_STATUS_OK;
+
+    worker->busy_start = dfu_get_timestamp_ms();
+    worker->busy_job = true;
+    worker->busy_timeout = job->poll_timeout;
+
+    if (job->type == DFU_JOB_ERASE) {
+        /* already erased ahead */
+        if (!dfu_is_erased(busid, job->addr) && (dfu_erase_sector(busid, job->addr) != 0)) {
+            status = DFU_STATUS_ERR_ERASE;
+        }
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+    } else if (job->type != DFU_JOB_WRITE) {
+        status = dfu_image_run(busid, job);
+#endif
+    } else {
+        status = dfu_flash_program(busid, job->addr, job->buffer.d8, job->len);
+    }
+
+    worker->busy_timeout = 0;
+    worker->busy_job = false;
+    return status;
+}
+
+#ifdef DFU_ERASE_AHEAD
+/* Erase the next sector while the host sends blocks for the current one, never past the app region */
+static bool dfu_erase_ahead(uint8_t busid)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint32_t start;
+    uint32_t size;
+
+    if ((worker->erased_end == 0) ||
+        ((worker->erased_end - worker->erased_start) >= (USBD_DFU_XFER_SIZE * DFU_JOB_NUM))) {
+        return false;
+    }
+
+    if (dfu_get_flash_sector(worker->erased_end, &start, &size) != 0) {
+        return false;
+    }
+
+    if ((start + size) > CONFIG_USBDEV_DFU_ERASE_AHEAD_END) {
+        return false;
+    }
+
+    worker->busy_start = dfu_get_timestamp_ms();
+    worker->busy_timeout = worker->erase_time;
+
+    if (dfu_erase_sector(busid, start) != 0) {
+        /* leave it to the write */
+        worker->erased_end = 0;
+    }
+
+    worker->busy_timeout = 0;
+    return true;
+}
+#endif
+
+static void dfu_worker_process(uint8_t busid)
+{
+    struct usbd_dfu_worker *worker = &g_usbd_dfu_worker[busid];
+    uint8_t status;
+
+    while (1) {
+        if (worker->tail != worker->head) {
+            status = dfu_job_run(busid, &worker->job[worker->tail % DFU_JOB_NUM]);
+            if (status != DFU_STATUS_OK) {
+                USB_LOG_ERR("dfu flash job error %02x\r\n", status);
+                worker->error = status;
+                /* drop queued blocks, host has to restart the download */
+                worker->tail = worker->head;
+            } else {
+                worker->tail++;
+            }
+#ifdef DFU_ERASE_AHEAD
+        } else if (dfu_erase_ahead(busid)) {
+#endif
+        } else {
             break;
+        }
     }
-    return (0);
 }
 
-static void dfu_request_detach(void)
+static void dfu_request_detach(uint8_t busid)
 {
-    if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_IDLE) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_SYNC) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_IDLE) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_MANIFEST_SYNC) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
+    if ((g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_IDLE) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_SYNC) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_IDLE) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_MANIFEST_SYNC) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
         /* Update the state machine */
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
-        g_usbd_dfu.dev_status[0] = DFU_STATUS_OK;
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U; /*bwPollTimeout=0ms*/
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
-        g_usbd_dfu.dev_status[5] = 0U; /*iString*/
-        g_usbd_dfu.wblock_num = 0U;
-        g_usbd_dfu.wlength = 0U;
+        g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
+        g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_OK;
+        g_usbd_dfu[busid].dev_status[1] = 0U;
+        g_usbd_dfu[busid].dev_status[2] = 0U;
+        g_usbd_dfu[busid].dev_status[3] = 0U; /*bwPollTimeout=0ms*/
+        g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
+        g_usbd_dfu[busid].dev_status[5] = 0U; /*iString*/
+        g_usbd_dfu[busid].wblock_num = 0U;
+        g_usbd_dfu[busid].wlength = 0U;
     }
 }
 
-static void dfu_request_upload(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
+static void dfu_request_upload(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     struct usb_setup_packet *req = setup;
     uint32_t addr;
-    uint8_t *phaddr;
     /* Data setup request */
     if (req->wLength > 0U) {
-        if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_IDLE) || (g_usbd_dfu.dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
+        if ((g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_IDLE) || (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
             /* Update the global length and block number */
-            g_usbd_dfu.wblock_num = req->wValue;
-            g_usbd_dfu.wlength = MIN(req->wLength, USBD_DFU_XFER_SIZE);
+            g_usbd_dfu[busid].wblock_num = req->wValue;
+            g_usbd_dfu[busid].wlength = MIN(req->wLength, USBD_DFU_XFER_SIZE);
 
             /* DFU Get Command */
-            if (g_usbd_dfu.wblock_num == 0U) {
+            if (g_usbd_dfu[busid].wblock_num == 0U) {
                 /* Update the state machine */
-                g_usbd_dfu.dev_state = (g_usbd_dfu.wlength > 3U) ? DFU_STATE_DFU_IDLE : DFU_STATE_DFU_UPLOAD_IDLE;
+                g_usbd_dfu[busid].dev_state = (g_usbd_dfu[busid].wlength > 3U) ? DFU_STATE_DFU_IDLE : DFU_STATE_DFU_UPLOAD_IDLE;
 
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+                g_usbd_dfu[busid].dev_status[1] = 0U;
+                g_usbd_dfu[busid].dev_status[2] = 0U;
+                g_usbd_dfu[busid].dev_status[3] = 0U;
+                g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
 
-                /* Store the values of all supported commands */
-                g_usbd_dfu.buffer.d8[0] = DFU_CMD_GETCOMMANDS;
-                g_usbd_dfu.buffer.d8[1] = DFU_CMD_SETADDRESSPOINTER;
-                g_usbd_dfu.buffer.d8[2] = DFU_CMD_ERASE;
-
-                /* Send the status data over EP0 */
-                memcpy(*data, g_usbd_dfu.buffer.d8, 3);
+                /* Send the values of all supported commands over EP0 */
+                (*data)[0] = DFU_CMD_GETCOMMANDS;
+                (*data)[1] = DFU_CMD_SETADDRESSPOINTER;
+                (*data)[2] = DFU_CMD_ERASE;
                 *len = 3;
-            } else if (g_usbd_dfu.wblock_num > 1U) {
-                g_usbd_dfu.dev_state = DFU_STATE_DFU_UPLOAD_IDLE;
-
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            } else if (g_usbd_dfu[busid].wblock_num > 1U) {
+                g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_UPLOAD_IDLE;
 
-                addr = ((g_usbd_dfu.wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu.data_ptr;
+                g_usbd_dfu[busid].dev_status[1] = 0U;
+                g_usbd_dfu[busid].dev_status[2] = 0U;
+                g_usbd_dfu[busid].dev_status[3] = 0U;
+                g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
 
-                /* Return the physical address where data are stored */
-                phaddr = dfu_read_flash((uint8_t *)addr, g_usbd_dfu.buffer.d8, g_usbd_dfu.wlength);
+                addr = ((g_usbd_dfu[busid].wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu[busid].data_ptr;
 
-                /* Send the status data over EP0 */
-                memcpy(*data, g_usbd_dfu.buffer.d8, g_usbd_dfu.wlength);
-                *len = g_usbd_dfu.wlength;
+                /* Read flash into EP0 buffer, it is not shared with pending download blocks */
+                dfu_read_flash((uint8_t *)addr, *data, g_usbd_dfu[busid].wlength);
+                *len = g_usbd_dfu[busid].wlength;
             } else /* unsupported g_usbd_dfu.wblock_num */
             {
-                g_usbd_dfu.dev_state = DFU_STATUS_ERR_STALLEDPKT;
+                g_usbd_dfu[busid].dev_state = DFU_STATUS_ERR_STALLEDPKT;
 
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+                g_usbd_dfu[busid].dev_status[1] = 0U;
+                g_usbd_dfu[busid].dev_status[2] = 0U;
+                g_usbd_dfu[busid].dev_status[3] = 0U;
+                g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
 
                 /* Call the error management function (command will be NAKed */
-                USB_LOG_ERR("Dfu_request_upload unsupported g_usbd_dfu.wblock_num\r\n");
+                USB_LOG_ERR("Dfu_request_upload unsupported g_usbd_dfu[busid].wblock_num\r\n");
             }
         }
         /* Unsupported state */
         else {
-            g_usbd_dfu.wlength = 0U;
-            g_usbd_dfu.wblock_num = 0U;
+            g_usbd_dfu[busid].wlength = 0U;
+            g_usbd_dfu[busid].wblock_num = 0U;
 
             /* Call the error management function (command will be NAKed */
             USB_LOG_ERR("Dfu_request_upload unsupported state\r\n");
@@ -172,33 +484,90 @@ static void dfu_request_upload(struct usb_setup_packet *setup, uint8_t **data, u
     }
     /* No Data setup request */
     else {
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
+        g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
 
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U;
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+        g_usbd_dfu[busid].dev_status[1] = 0U;
+        g_usbd_dfu[busid].dev_status[2] = 0U;
+        g_usbd_dfu[busid].dev_status[3] = 0U;
+        g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
     }
 }
 
-static void dfu_request_dnload(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
+/* Special commands only move the address pointer or queue an erase, flash work is done by the worker */
+static void dfu_dnload_command(uint8_t busid, const uint8_t *buf, uint32_t len)
+{
+    uint32_t addr;
+
+    if (len == 1U) {
+        if (buf[0] == DFU_CMD_GETCOMMANDS) {
+            /* Nothing to do */
+        }
+    } else if (len == 5U) {
+        addr = buf[1];
+        addr += (uint32_t)buf[2] << 8;
+        addr += (uint32_t)buf[3] << 16;
+        addr += (uint32_t)buf[4] << 24;
+
+        if (buf[0] == DFU_CMD_SETADDRESSPOINTER) {
+            g_usbd_dfu[busid].data_ptr = addr;
+        } else if (buf[0] == DFU_CMD_ERASE) {
+            g_usbd_dfu[busid].data_ptr = addr;
+            dfu_job_push(busid, DFU_JOB_ERASE, addr, NULL, 0);
+        } else {
+            USB_LOG_ERR("Unsupported dfu command %02x\r\n", buf[0]);
+        }
+    } else {
+        /* Reset the global length and block number */
+        g_usbd_dfu[busid].wlength = 0U;
+        g_usbd_dfu[busid].wblock_num = 0U;
+        /* Call the error management function (command will be NAKed) */
+        USB_LOG_ERR("Reset the global length and block number\r\n");
+    }
+}
+
+static void dfu_request_dnload(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     /* Data setup request */
     struct usb_setup_packet *req = setup;
+    uint32_t addr;
+
     if (req->wLength > 0U) {
-        if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_IDLE) || (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_IDLE)) {
+        if ((g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_IDLE) || (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_IDLE)) {
             /* Update the global length and block number */
-            g_usbd_dfu.wblock_num = req->wValue;
-            g_usbd_dfu.wlength = MIN(req->wLength, USBD_DFU_XFER_SIZE);
+            g_usbd_dfu[busid].wblock_num = req->wValue;
+            g_usbd_dfu[busid].wlength = MIN(req->wLength, USBD_DFU_XFER_SIZE);
 
             /* Update the state machine */
-            g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_SYNC;
-            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_DNLOAD_SYNC;
+            g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
+
+            /*!< Data has received complete, queue it for the flash worker */
+            if (g_usbd_dfu[busid].wblock_num == 0U) {
+                dfu_dnload_command(busid, *data, g_usbd_dfu[busid].wlength);
+            } else if (g_usbd_dfu[busid].wblock_num > 1U) {
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+                if (g_usbd_dfu[busid].wblock_num == 2U) {
+                    g_usbd_dfu[busid].image_mode = dfu_image_probe(*data, g_usbd_dfu[busid].wlength);
+                    g_usbd_dfu[busid].image_next = 2U;
+                }
 
-            /*!< Data has received complete */
-            memcpy((uint8_t *)g_usbd_dfu.buffer.d8, (uint8_t *)*data, g_usbd_dfu.wlength);
-            /*!< Set flag = 1 Write the firmware to the flash in the next dfu_request_getstatus */
-            g_usbd_dfu.firmwar_flag = 1;
+                if (g_usbd_dfu[busid].image_mode) {
+                    /* the decoder needs the stream in order, resent or skipped blocks are fatal */
+                    if (g_usbd_dfu[busid].wblock_num != g_usbd_dfu[busid].image_next) {
+                        USB_LOG_ERR("Image block %u out of order, expect %u\r\n",
+                                    (unsigned int)g_usbd_dfu[busid].wblock_num, (unsigned int)g_usbd_dfu[busid].image_next);
+                        g_usbd_dfu_worker[busid].error = DFU_STATUS_ERR_ADDRESS;
+                    } else {
+                        dfu_job_push(busid, (g_usbd_dfu[busid].image_next == 2U) ? DFU_JOB_IMAGE_START : DFU_JOB_IMAGE,
+                                     g_usbd_dfu[busid].data_ptr, *data, g_usbd_dfu[busid].wlength);
+                        g_usbd_dfu[busid].image_next++;
+                    }
+                    return;
+                }
+#endif
+                addr = ((g_usbd_dfu[busid].wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu[busid].data_ptr;
+                dfu_job_push(busid, DFU_JOB_WRITE, addr, *data, g_usbd_dfu[busid].wlength);
+            }
         }
         /* Unsupported state */
         else {
@@ -208,158 +577,115 @@ static void dfu_request_dnload(struct usb_setup_packet *setup, uint8_t **data, u
     /* 0 Data DNLOAD request */
     else {
         /* End of DNLOAD operation*/
-        if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_IDLE) || (g_usbd_dfu.dev_state == DFU_STATE_DFU_IDLE)) {
-            g_usbd_dfu.manif_state = DFU_MANIFEST_IN_PROGRESS;
-            g_usbd_dfu.dev_state = DFU_STATE_DFU_MANIFEST_SYNC;
-            g_usbd_dfu.dev_status[1] = 0U;
-            g_usbd_dfu.dev_status[2] = 0U;
-            g_usbd_dfu.dev_status[3] = 0U;
-            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+        if ((g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_IDLE) || (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_IDLE)) {
+            g_usbd_dfu[busid].manif_state = DFU_MANIFEST_IN_PROGRESS;
+            g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_MANIFEST_SYNC;
+            g_usbd_dfu[busid].dev_status[1] = 0U;
+            g_usbd_dfu[busid].dev_status[2] = 0U;
+            g_usbd_dfu[busid].dev_status[3] = 0U;
+            g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
         } else {
             /* Call the error management function (command will be NAKed */
-            USB_LOG_ERR("Dfu_request_dnload End of DNLOAD operation but dev_state %02x \r\n", g_usbd_dfu.dev_state);
+            USB_LOG_ERR("Dfu_request_dnload End of DNLOAD operation but dev_state %02x \r\n", g_usbd_dfu[busid].dev_state);
         }
     }
 }
 
-static int8_t dfu_getstatus_special_handler(void)
+static void dfu_request_getstatus(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
-    uint32_t addr;
-    if (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_BUSY) {
-        /* Decode the Special Command */
-        if (g_usbd_dfu.wblock_num == 0U) {
-            if (g_usbd_dfu.wlength == 1U) {
-                if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_GETCOMMANDS) {
-                    /* Nothing to do */
-                }
-            } else if (g_usbd_dfu.wlength == 5U) {
-                if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_SETADDRESSPOINTER) {
-                    g_usbd_dfu.data_ptr = g_usbd_dfu.buffer.d8[1];
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[2] << 8;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[3] << 16;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[4] << 24;
-                } else if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_ERASE) {
-                    g_usbd_dfu.data_ptr = g_usbd_dfu.buffer.d8[1];
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[2] << 8;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[3] << 16;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[4] << 24;
-
-                    USB_LOG_DBG("Erase start add %08x \r\n", g_usbd_dfu.data_ptr);
-                    /*!< Erase */
-                    dfu_erase_flash(g_usbd_dfu.data_ptr);
-                } else {
-                    return -1;
-                }
-            } else {
-                /* Reset the global length and block number */
-                g_usbd_dfu.wlength = 0U;
-                g_usbd_dfu.wblock_num = 0U;
-                /* Call the error management function (command will be NAKed) */
-                USB_LOG_ERR("Reset the global length and block number\r\n");
-            }
+    /*!< A queued block failed to program */
+    if (g_usbd_dfu_worker[busid].error != DFU_STATUS_OK) {
+        g_usbd_dfu[busid].dev_status[0] = g_usbd_dfu_worker[busid].error;
+        g_usbd_dfu_worker[busid].error = DFU_STATUS_OK;
+        dfu_set_status(busid, DFU_STATE_DFU_ERROR, 0);
+    }
+
+    /*!< Manifest only after all queued blocks are programmed */
+    if (g_usbd_dfu[busid].manif_state == DFU_MANIFEST_IN_PROGRESS &&
+        g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_MANIFEST_SYNC) {
+        if (!dfu_job_idle(busid)) {
+            dfu_set_status(busid, DFU_STATE_DFU_MANIFEST_SYNC, dfu_poll_timeout(busid, DFU_JOB_NUM));
+            memcpy(*data, g_usbd_dfu[busid].dev_status, 6);
+            *len = 6;
+            return;
         }
-        /* Regular Download Command */
-        else {
-            if (g_usbd_dfu.wblock_num > 1U) {
-                /* Decode the required address */
-                addr = ((g_usbd_dfu.wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu.data_ptr;
-
-                /* Perform the write operation */
-                /* Write flash */
-                USB_LOG_DBG("Write start add %08x length %d\r\n", addr, g_usbd_dfu.wlength);
-                dfu_write_flash(g_usbd_dfu.buffer.d8, (uint8_t *)addr, g_usbd_dfu.wlength);
+        dfu_set_status(busid, DFU_STATE_DFU_MANIFEST_SYNC, 0);
+
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+        /*!< Do not leave with a truncated or corrupted image */
+        if (g_usbd_dfu[busid].image_mode) {
+            g_usbd_dfu[busid].image_mode = false;
+            if (dfu_image_finish(&g_usbd_dfu_worker[busid].image) < 0) {
+                g_usbd_dfu[busid].manif_state = DFU_MANIFEST_COMPLETE;
+                g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_ERR_VERIFY;
+                dfu_set_status(busid, DFU_STATE_DFU_ERROR, 0);
+                memcpy(*data, g_usbd_dfu[busid].dev_status, 6);
+                *len = 6;
+                return;
             }
         }
-
-        /* Reset the global length and block number */
-        g_usbd_dfu.wlength = 0U;
-        g_usbd_dfu.wblock_num = 0U;
-
-        /* Update the state machine */
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_SYNC;
-
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U;
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+#endif
     }
-    return 0;
-}
 
-static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
-{
     /*!< Determine whether to leave DFU mode */
-    if (g_usbd_dfu.manif_state == DFU_MANIFEST_IN_PROGRESS &&
-        g_usbd_dfu.dev_state == DFU_STATE_DFU_MANIFEST_SYNC &&
-        g_usbd_dfu.dev_status[1] == 0U &&
-        g_usbd_dfu.dev_status[2] == 0U &&
-        g_usbd_dfu.dev_status[3] == 0U &&
-        g_usbd_dfu.dev_status[4] == g_usbd_dfu.dev_state) {
-        g_usbd_dfu.manif_state = DFU_MANIFEST_COMPLETE;
+    if (g_usbd_dfu[busid].manif_state == DFU_MANIFEST_IN_PROGRESS &&
+        g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_MANIFEST_SYNC &&
+        g_usbd_dfu[busid].dev_status[1] == 0U &&
+        g_usbd_dfu[busid].dev_status[2] == 0U &&
+        g_usbd_dfu[busid].dev_status[3] == 0U &&
+        g_usbd_dfu[busid].dev_status[4] == g_usbd_dfu[busid].dev_state) {
+        g_usbd_dfu[busid].manif_state = DFU_MANIFEST_COMPLETE;
 
         if ((0x0B & DFU_MANIFEST_MASK) != 0U) {
-            g_usbd_dfu.dev_state = DFU_STATE_DFU_MANIFEST_SYNC;
+            g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_MANIFEST_SYNC;
 
-            g_usbd_dfu.dev_status[1] = 0U;
-            g_usbd_dfu.dev_status[2] = 0U;
-            g_usbd_dfu.dev_status[3] = 0U;
-            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            g_usbd_dfu[busid].dev_status[1] = 0U;
+            g_usbd_dfu[busid].dev_status[2] = 0U;
+            g_usbd_dfu[busid].dev_status[3] = 0U;
+            g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
             return;
         } else {
-            g_usbd_dfu.dev_state = DFU_STATE_DFU_MANIFEST_WAIT_RESET;
+            g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_MANIFEST_WAIT_RESET;
 
-            g_usbd_dfu.dev_status[1] = 0U;
-            g_usbd_dfu.dev_status[2] = 0U;
-            g_usbd_dfu.dev_status[3] = 0U;
-            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            g_usbd_dfu[busid].dev_status[1] = 0U;
+            g_usbd_dfu[busid].dev_status[2] = 0U;
+            g_usbd_dfu[busid].dev_status[3] = 0U;
+            g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
             /* Generate system reset to allow jumping to the user code */
             dfu_leave();
         }
     }
 
-    switch (g_usbd_dfu.dev_state) {
+    switch (g_usbd_dfu[busid].dev_state) {
         case DFU_STATE_DFU_DNLOAD_SYNC:
-            if (g_usbd_dfu.wlength != 0U) {
-                g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_BUSY;
-
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
-
-                if ((g_usbd_dfu.wblock_num == 0U) && (g_usbd_dfu.buffer.d8[0] == DFU_CMD_ERASE)) {
-                    dfu_getstatus(g_usbd_dfu.data_ptr, DFU_MEDIA_ERASE, g_usbd_dfu.dev_status);
-                } else {
-                    dfu_getstatus(g_usbd_dfu.data_ptr, DFU_MEDIA_PROGRAM, g_usbd_dfu.dev_status);
-                }
-            } else /* (g_usbd_dfu.wlength==0)*/
-            {
-                g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_IDLE;
-
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+        case DFU_STATE_DFU_DNLOAD_BUSY:
+            if (dfu_job_full(busid)) {
+                /* no free buffer for the next block, poll again when the oldest one is programmed */
+                dfu_set_status(busid, DFU_STATE_DFU_DNLOAD_BUSY, dfu_poll_timeout(busid, 1));
+            } else {
+                g_usbd_dfu[busid].wlength = 0U;
+                g_usbd_dfu[busid].wblock_num = 0U;
+                dfu_set_status(busid, DFU_STATE_DFU_DNLOAD_IDLE, 0);
             }
             break;
 
         case DFU_STATE_DFU_MANIFEST_SYNC:
-            if (g_usbd_dfu.manif_state == DFU_MANIFEST_IN_PROGRESS) {
-                g_usbd_dfu.dev_state = DFU_STATE_DFU_MANIFEST;
+            if (g_usbd_dfu[busid].manif_state == DFU_MANIFEST_IN_PROGRESS) {
+                g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_MANIFEST;
 
-                g_usbd_dfu.dev_status[1] = 1U; /*bwPollTimeout = 1ms*/
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+                g_usbd_dfu[busid].dev_status[1] = 1U; /*bwPollTimeout = 1ms*/
+                g_usbd_dfu[busid].dev_status[2] = 0U;
+                g_usbd_dfu[busid].dev_status[3] = 0U;
+                g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
             } else {
-                if ((g_usbd_dfu.manif_state == DFU_MANIFEST_COMPLETE) &&
+                if ((g_usbd_dfu[busid].manif_state == DFU_MANIFEST_COMPLETE) &&
                     ((0x0B & DFU_MANIFEST_MASK) != 0U)) {
-                    g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
+                    g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
 
-                    g_usbd_dfu.dev_status[1] = 0U;
-                    g_usbd_dfu.dev_status[2] = 0U;
-                    g_usbd_dfu.dev_status[3] = 0U;
-                    g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+                    g_usbd_dfu[busid].dev_status[1] = 0U;
+                    g_usbd_dfu[busid].dev_status[2] = 0U;
+                    g_usbd_dfu[busid].dev_status[3] = 0U;
+                    g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
                 }
             }
             break;
@@ -369,62 +695,65 @@ static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data
     }
 
     /* Send the status data over EP0 */
-    memcpy(*data, g_usbd_dfu.dev_status, 6);
+    memcpy(*data, g_usbd_dfu[busid].dev_status, 6);
     *len = 6;
 
-    if (g_usbd_dfu.firmwar_flag == 1) {
-        if (dfu_getstatus_special_handler() != 0) {
-            USB_LOG_ERR("dfu_getstatus_special_handler error \r\n");
-        }
-        g_usbd_dfu.firmwar_flag = 0;
-    }
+#ifndef DFU_BACKGROUND
+    /* Program after the status with bwPollTimeout is prepared */
+    dfu_worker_process(busid);
+#endif
 }
 
-static void dfu_request_clrstatus(void)
+static void dfu_request_clrstatus(uint8_t busid)
 {
-    if (g_usbd_dfu.dev_state == DFU_STATE_DFU_ERROR) {
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
-        g_usbd_dfu.dev_status[0] = DFU_STATUS_OK; /* bStatus */
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U;                     /* bwPollTimeout=0ms */
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state; /* bState */
-        g_usbd_dfu.dev_status[5] = 0U;                     /* iString */
+    g_usbd_dfu_worker[busid].error = DFU_STATUS_OK;
+#ifdef CONFIG_USBDEV_DFU_IMAGE
+    g_usbd_dfu[busid].image_mode = false;
+#endif
+
+    if (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_ERROR) {
+        g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
+        g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_OK; /* bStatus */
+        g_usbd_dfu[busid].dev_status[1] = 0U;
+        g_usbd_dfu[busid].dev_status[2] = 0U;
+        g_usbd_dfu[busid].dev_status[3] = 0U;                     /* bwPollTimeout=0ms */
+        g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state; /* bState */
+        g_usbd_dfu[busid].dev_status[5] = 0U;                     /* iString */
     } else {
         /* State Error */
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_ERROR;
-        g_usbd_dfu.dev_status[0] = DFU_STATUS_ERR_UNKNOWN; /* bStatus */
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U;                     /* bwPollTimeout=0ms */
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state; /* bState */
-        g_usbd_dfu.dev_status[5] = 0U;                     /* iString */
+        g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_ERROR;
+        g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_ERR_UNKNOWN; /* bStatus */
+        g_usbd_dfu[busid].dev_status[1] = 0U;
+        g_usbd_dfu[busid].dev_status[2] = 0U;
+        g_usbd_dfu[busid].dev_status[3] = 0U;                     /* bwPollTimeout=0ms */
+        g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state; /* bState */
+        g_usbd_dfu[busid].dev_status[5] = 0U;                     /* iString */
     }
 }
 
-static void dfu_request_getstate(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
+static void dfu_request_getstate(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     /* Return the current state of the DFU interface */
-    (*data)[0] = g_usbd_dfu.dev_state;
+    (*data)[0] = g_usbd_dfu[busid].dev_state;
     *len = 1;
 }
 
-void dfu_request_abort(void)
+static void dfu_request_abort(uint8_t busid)
 {
-    if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_IDLE) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_SYNC) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_IDLE) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_MANIFEST_SYNC) ||
-        (g_usbd_dfu.dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
-        g_usbd_dfu.dev_status[0] = DFU_STATUS_OK;
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U; /* bwPollTimeout=0ms */
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
-        g_usbd_dfu.dev_status[5] = 0U; /* iString */
-        g_usbd_dfu.wblock_num = 0U;
-        g_usbd_dfu.wlength = 0U;
+    if ((g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_IDLE) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_SYNC) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_DNLOAD_IDLE) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_MANIFEST_SYNC) ||
+        (g_usbd_dfu[busid].dev_state == DFU_STATE_DFU_UPLOAD_IDLE)) {
+        g_usbd_dfu[busid].dev_state = DFU_STATE_DFU_IDLE;
+        g_usbd_dfu[busid].dev_status[0] = DFU_STATUS_OK;
+        g_usbd_dfu[busid].dev_status[1] = 0U;
+        g_usbd_dfu[busid].dev_status[2] = 0U;
+        g_usbd_dfu[busid].dev_status[3] = 0U; /* bwPollTimeout=0ms */
+        g_usbd_dfu[busid].dev_status[4] = g_usbd_dfu[busid].dev_state;
+        g_usbd_dfu[busid].dev_status[5] = 0U; /* iString */
+        g_usbd_dfu[busid].wblock_num = 0U;
+        g_usbd_dfu[busid].wlength = 0U;
     }
 }
 
@@ -436,25 +765,25 @@ static int dfu_class_interface_request_handler(uint8_t busid, struct usb_setup_p
 
     switch (setup->bRequest) {
         case DFU_REQUEST_DETACH:
-            dfu_request_detach();
+            dfu_request_detach(busid);
             break;
         case DFU_REQUEST_DNLOAD:
-            dfu_request_dnload(setup, data, len);
+            dfu_request_dnload(busid, setup, data, len);
             break;
         case DFU_REQUEST_UPLOAD:
-            dfu_request_upload(setup, data, len);
+            dfu_request_upload(busid, setup, data, len);
             break;
         case DFU_REQUEST_GETSTATUS:
-            dfu_request_getstatus(setup, data, len);
+            dfu_request_getstatus(busid, setup, data, len);
             break;
         case DFU_REQUEST_CLRSTATUS:
-            dfu_request_clrstatus();
+            dfu_request_clrstatus(busid);
             break;
         case DFU_REQUEST_GETSTATE:
-            dfu_request_getstate(setup, data, len);
+            dfu_request_getstate(busid, setup, data, len);
             break;
         case DFU_REQUEST_ABORT:
-            dfu_request_abort();
+            dfu_request_abort(busid);
             break;
         default:
             USB_LOG_WRN("Unhandled DFU Class bRequest 0x%02x\r\n", setup->bRequest);
@@ -464,19 +793,65 @@ static int dfu_class_interface_request_handler(uint8_t busid, struct usb_setup_p
     return 0;
 }
 
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+static void usbdev_dfu_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    int ret;
+    uint8_t busid = (uint8_t)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+
+    while (1) {
+        ret = usb_osal_sem_take(g_usbd_dfu_worker[busid].sem, USB_OSAL_WAITING_FOREVER);
+        if (ret < 0) {
+            continue;
+        }
+        dfu_worker_process(busid);
+    }
+}
+#elif defined(CONFIG_USBDEV_DFU_POLLING)
+void usbd_dfu_polling(uint8_t busid)
+{
+    dfu_worker_process(busid);
+}
+#endif
+
 static void dfu_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
     switch (event) {
+        case USBD_EVENT_INIT:
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+            g_usbd_dfu_worker[busid].sem = usb_osal_sem_create(0);
+            if (g_usbd_dfu_worker[busid].sem == NULL) {
+                USB_LOG_ERR("No memory to alloc for g_usbd_dfu_worker[busid].sem\r\n");
+            }
+            g_usbd_dfu_worker[busid].thread = usb_osal_thread_create("usbd_dfu", CONFIG_USBDEV_DFU_STACKSIZE, CONFIG_USBDEV_DFU_PRIO, usbdev_dfu_thread, (void *)(uint32_t)busid);
+            if (g_usbd_dfu_worker[busid].thread == NULL) {
+                USB_LOG_ERR("No memory to alloc for g_usbd_dfu_worker[busid].thread\r\n");
+            }
+#endif
+            break;
+        case USBD_EVENT_DEINIT:
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+            if (g_usbd_dfu_worker[busid].thread) {
+                usb_osal_thread_delete(g_usbd_dfu_worker[busid].thread);
+            }
+            if (g_usbd_dfu_worker[busid].sem) {
+                usb_osal_sem_delete(g_usbd_dfu_worker[busid].sem);
+            }
+#endif
+            memset(&g_usbd_dfu_worker[busid], 0, sizeof(g_usbd_dfu_worker[busid]));
+            break;
         case USBD_EVENT_RESET:
-            dfu_reset();
+            dfu_reset(busid);
             break;
         default:
             break;
     }
 }
 
-struct usbd_interface *usbd_dfu_init_intf(struct usbd_interface *intf)
+struct usbd_interface *usbd_dfu_init_intf(uint8_t busid, struct usbd_interface *intf)
 {
+    (void)busid;
+
     intf->class_interface_handler = dfu_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
@@ -503,3 +878,13 @@ __WEAK uint16_t dfu_erase_flash(uint32_t add)
 __WEAK void dfu_leave(void)
 {
 }
+
+__WEAK int dfu_get_flash_sector(uint32_t addr, uint32_t *start, uint32_t *size)
+{
+    return -1;
+}
+
+__WEAK uint32_t dfu_get_timestamp_ms(void)
+{
+    return 0;
+}
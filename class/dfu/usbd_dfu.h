@@ -13,13 +13,23 @@ extern "C" {
 #endif
 
 /* Init dfu interface driver */
-struct usbd_interface *usbd_dfu_init_intf(struct usbd_interface *intf);
+struct usbd_interface *usbd_dfu_init_intf(uint8_t busid, struct usbd_interface *intf);
 
 /* Interface functions that need to be implemented by the user */
 uint8_t *dfu_read_flash(uint8_t *src, uint8_t *dest, uint32_t len);
 uint16_t dfu_write_flash(uint8_t *src, uint8_t *dest, uint32_t len);
 uint16_t dfu_erase_flash(uint32_t add);
 void dfu_leave(void);
+
+/* Optional: return 0 with the sector containing addr when dfu may erase all of it,
+ * enables erase before write and erase ahead of the next sector */
+int dfu_get_flash_sector(uint32_t addr, uint32_t *start, uint32_t *size);
+/* Optional: millisecond tick, bwPollTimeout is then derived from measured erase and program time */
+uint32_t dfu_get_timestamp_ms(void);
+
+#ifdef CONFIG_USBDEV_DFU_POLLING
+void usbd_dfu_polling(uint8_t busid);
+#endif
 #ifdef __cplusplus
 }
 #endif
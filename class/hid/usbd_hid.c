@@ -5,6 +5,28 @@
  */
 #include "usbd_core.h"
 #include "usbd_hid.h"
+#include "usb_osal.h"
+
+struct usbd_hid_report_queue {
+    uint8_t *pool;
+    uint8_t ep;
+    uint8_t flags;
+    uint8_t depth;
+    uint8_t head; /* next free slot */
+    uint8_t tail; /* oldest slot, it is in flight when busy */
+    uint8_t num;  /* used slots, including the one in flight */
+    volatile bool busy;
+    uint16_t report_size;
+    uint16_t stride;
+    uint16_t len[CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH];
+    uint32_t seq[CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH];
+    uint32_t tx_count;
+    struct usbd_hid_queue_stats stats;
+};
+
+struct usbd_hid_priv {
+    struct usbd_hid_report_queue queue[CONFIG_USBDEV_HID_MAX_QUEUES];
+} g_usbd_hid[CONFIG_USBDEV_MAX_BUS];
 
 static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
@@ -48,6 +70,28 @@ static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_p
     return 0;
 }
 
+static void hid_notify_handler(uint8_t busid, uint8_t event, void *arg)
+{
+    struct usbd_hid_report_queue *queue;
+
+    (void)arg;
+
+    switch (event) {
+        case USBD_EVENT_RESET:
+            for (uint8_t i = 0; i < CONFIG_USBDEV_HID_MAX_QUEUES; i++) {
+                queue = &g_usbd_hid[busid].queue[i];
+                queue->head = 0;
+                queue->tail = 0;
+                queue->num = 0;
+                queue->busy = false;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
 struct usbd_interface *usbd_hid_init_intf(uint8_t busid, struct usbd_interface *intf, const uint8_t *desc, uint32_t desc_len)
 {
     (void)busid;
@@ -55,13 +99,162 @@ struct usbd_interface *usbd_hid_init_intf(uint8_t busid, struct usbd_interface *
     intf->class_interface_handler = hid_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
-    intf->notify_handler = NULL;
+    intf->notify_handler = hid_notify_handler;
 
     intf->hid_report_descriptor = desc;
     intf->hid_report_descriptor_len = desc_len;
     return intf;
 }
 
+static struct usbd_hid_report_queue *usbd_hid_report_queue_find(uint8_t busid, uint8_t ep)
+{
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_MAX_QUEUES; i++) {
+        if (g_usbd_hid[busid].queue[i].pool && (g_usbd_hid[busid].queue[i].ep == ep)) {
+            return &g_usbd_hid[busid].queue[i];
+        }
+    }
+    return NULL;
+}
+
+static void usbd_hid_report_queue_kick(uint8_t busid, struct usbd_hid_report_queue *queue)
+{
+    if (queue->busy || (queue->num == 0)) {
+        return;
+    }
+
+    queue->busy = true;
+    usbd_ep_start_write(busid, queue->ep, &queue->pool[queue->tail * queue->stride], queue->len[queue->tail]);
+}
+
+int usbd_hid_report_queue_init(uint8_t busid, uint8_t ep, uint8_t *pool, uint16_t report_size, uint8_t depth, uint8_t flags)
+{
+    struct usbd_hid_report_queue *queue;
+
+    if (!pool || (report_size == 0) || (depth == 0) || (depth > CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH)) {
+        return -USB_ERR_INVAL;
+    }
+
+    queue = usbd_hid_report_queue_find(busid, ep);
+    if (queue == NULL) {
+        for (uint8_t i = 0; i < CONFIG_USBDEV_HID_MAX_QUEUES; i++) {
+            if (g_usbd_hid[busid].queue[i].pool == NULL) {
+                queue = &g_usbd_hid[busid].queue[i];
+                break;
+            }
+        }
+    }
+    if (queue == NULL) {
+        return -USB_ERR_NOMEM;
+    }
+
+    memset(queue, 0, sizeof(struct usbd_hid_report_queue));
+    queue->pool = pool;
+    queue->ep = ep;
+    queue->flags = flags;
+    queue->depth = depth;
+    queue->report_size = report_size;
+    queue->stride = USB_ALIGN_UP(report_size, CONFIG_USB_ALIGN_SIZE);
+    return 0;
+}
+
+int usbd_hid_report_send(uint8_t busid, uint8_t ep, const uint8_t *report, uint32_t len)
+{
+    struct usbd_hid_report_queue *queue;
+    uint8_t slot = 0xff;
+    uint8_t idx;
+    size_t flags;
+
+    queue = usbd_hid_report_queue_find(busid, ep);
+    if (queue == NULL) {
+        return -USB_ERR_NODEV;
+    }
+    if (!report || (len == 0) || (len > queue->report_size)) {
+        return -USB_ERR_INVAL;
+    }
+    if (!usb_device_is_configured(busid)) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    flags = usb_osal_enter_critical_section();
+
+    if (queue->flags & USBD_HID_QUEUE_COALESCE) {
+        /* latest wins, never touch the report in flight */
+        for (uint8_t i = queue->busy ? 1 : 0; i < queue->num; i++) {
+            idx = (queue->tail + i) % queue->depth;
+            if (!(queue->flags & USBD_HID_QUEUE_REPORT_ID) || (queue->pool[idx * queue->stride] == report[0])) {
+                slot = idx;
+                queue->stats.coalesced++;
+                break;
+            }
+        }
+    }
+
+    if (slot == 0xff) {
+        if (queue->num >= queue->depth) {
+            queue->stats.overflows++;
+            usb_osal_leave_critical_section(flags);
+            return -USB_ERR_NOMEM;
+        }
+        slot = queue->head;
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->num++;
+    }
+
+    memcpy(&queue->pool[slot * queue->stride], report, len);
+    queue->len[slot] = len;
+    queue->seq[slot] = queue->tx_count;
+
+    usbd_hid_report_queue_kick(busid, queue);
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
+void usbd_hid_report_queue_ep_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_hid_report_queue *queue;
+    uint32_t latency;
+    size_t flags;
+
+    (void)nbytes;
+
+    queue = usbd_hid_report_queue_find(busid, ep);
+    if (queue == NULL) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (queue->busy) {
+        latency = queue->tx_count - queue->seq[queue->tail];
+        queue->stats.sent++;
+        queue->stats.total_latency += latency;
+        if (latency > queue->stats.max_latency) {
+            queue->stats.max_latency = latency;
+        }
+        queue->tx_count++;
+        queue->tail = (queue->tail + 1) % queue->depth;
+        queue->num--;
+        queue->busy = false;
+    }
+    usbd_hid_report_queue_kick(busid, queue);
+    usb_osal_leave_critical_section(flags);
+}
+
+int usbd_hid_report_queue_get_stats(uint8_t busid, uint8_t ep, struct usbd_hid_queue_stats *stats)
+{
+    struct usbd_hid_report_queue *queue;
+    size_t flags;
+
+    queue = usbd_hid_report_queue_find(busid, ep);
+    if ((queue == NULL) || !stats) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stats, &queue->stats, sizeof(struct usbd_hid_queue_stats));
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
 /*
  * Appendix G: HID Request Support Requirements
  *
@@ -8,6 +8,29 @@
 
 #include "usb_hid.h"
 
+/* input report queues for every bus */
+#ifndef CONFIG_USBDEV_HID_MAX_QUEUES
+#define CONFIG_USBDEV_HID_MAX_QUEUES 2
+#endif
+
+#ifndef CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH
+#define CONFIG_USBDEV_HID_MAX_QUEUE_DEPTH 16
+#endif
+
+#define USBD_HID_QUEUE_COALESCE  (1 << 0) /* pending report with the same report id is replaced by the latest one */
+#define USBD_HID_QUEUE_REPORT_ID (1 << 1) /* first byte of every report is report id */
+
+/* pool must be placed in nocache ram and aligned */
+#define USBD_HID_QUEUE_POOL_SIZE(report_size, depth) (USB_ALIGN_UP(report_size, CONFIG_USB_ALIGN_SIZE) * (depth))
+
+struct usbd_hid_queue_stats {
+    uint32_t sent;          /* reports transferred */
+    uint32_t coalesced;     /* pending reports replaced by newer ones */
+    uint32_t overflows;     /* reports rejected because queue is full */
+    uint32_t max_latency;   /* max reports sent ahead of one report, in polling intervals */
+    uint32_t total_latency; /* sum of latency, divide by sent for average */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +50,12 @@ void usbd_hid_set_report(uint8_t busid, uint8_t intf, uint8_t report_id, uint8_t
 void usbd_hid_set_idle(uint8_t busid, uint8_t intf, uint8_t report_id, uint8_t duration);
 void usbd_hid_set_protocol(uint8_t busid, uint8_t intf, uint8_t protocol);
 
+/* Input report queue api, set usbd_hid_report_queue_ep_callback as in ep callback */
+int usbd_hid_report_queue_init(uint8_t busid, uint8_t ep, uint8_t *pool, uint16_t report_size, uint8_t depth, uint8_t flags);
+int usbd_hid_report_send(uint8_t busid, uint8_t ep, const uint8_t *report, uint32_t len);
+void usbd_hid_report_queue_ep_callback(uint8_t busid, uint8_t ep, uint32_t nbytes);
+int usbd_hid_report_queue_get_stats(uint8_t busid, uint8_t ep, struct usbd_hid_queue_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,7 +20,7 @@
 #define INTF_DESC_bInterfaceNumber  2 /** Interface number offset */
 #define INTF_DESC_bAlternateSetting 3 /** Alternate setting offset */
 
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hid_buf[CONFIG_USBHOST_MAX_HID_CLASS][USB_ALIGN_UP(64, CONFIG_USB_ALIGN_SIZE)];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hid_buf[CONFIG_USBHOST_MAX_HID_CLASS][USB_ALIGN_UP(MAX(64, CONFIG_USBHOST_HID_REPORT_DESC_SIZE), CONFIG_USB_ALIGN_SIZE)];
 
 static struct usbh_hid g_hid_class[CONFIG_USBHOST_MAX_HID_CLASS];
 static uint32_t g_devinuse = 0;
@@ -170,6 +170,432 @@ int usbh_hid_get_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t
     return ret;
 }
 
+#define HID_PARSER_MAX_USAGES  16
+#define HID_PARSER_MAX_REPORTS 16
+#define HID_PARSER_STACK_DEPTH 4
+
+struct usbh_hid_parser_global {
+    uint16_t usage_page;
+    uint8_t report_id;
+    uint8_t report_size;
+    uint16_t report_count;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t logical_max_raw;
+};
+
+struct usbh_hid_parser_report {
+    uint8_t report_id;
+    uint8_t report_type;
+    uint16_t bit_offset;
+};
+
+struct usbh_hid_parser {
+    struct usbh_hid_parser_global global;
+    struct usbh_hid_parser_global stack[HID_PARSER_STACK_DEPTH];
+    uint8_t stack_depth;
+    uint8_t num_of_usages;
+    uint8_t num_of_reports;
+    uint32_t usage[HID_PARSER_MAX_USAGES]; /* usage page in upper 16 bits when given as extended usage */
+    uint32_t usage_min;
+    uint32_t usage_max;
+    bool usage_range;
+    struct usbh_hid_parser_report reports[HID_PARSER_MAX_REPORTS];
+};
+
+static uint32_t usbh_hid_get_bits(const uint8_t *buf, uint32_t bitpos, uint8_t size)
+{
+    uint32_t value = 0;
+    uint32_t byte = bitpos >> 3;
+    uint8_t bit = bitpos & 0x07;
+    uint8_t shift = 0;
+    uint8_t take;
+
+    while (size) {
+        take = MIN(8 - bit, size);
+        value |= (uint32_t)((buf[byte] >> bit) & ((1U << take) - 1)) << shift;
+        shift += take;
+        size -= take;
+        byte++;
+        bit = 0;
+    }
+    return value;
+}
+
+static inline int32_t usbh_hid_field_value(const struct usbh_hid_field *field, const uint8_t *buf, uint32_t bitpos)
+{
+    uint32_t value = usbh_hid_get_bits(buf, bitpos, field->report_size);
+
+    if ((field->logical_min < 0) && (field->report_size < 32) && (value & (1U << (field->report_size - 1)))) {
+        value |= ~((1U << field->report_size) - 1);
+    }
+    return (int32_t)value;
+}
+
+static uint16_t *usbh_hid_parser_get_offset(struct usbh_hid_parser *parser, uint8_t report_id, uint8_t report_type)
+{
+    for (uint8_t i = 0; i < parser->num_of_reports; i++) {
+        if ((parser->reports[i].report_id == report_id) && (parser->reports[i].report_type == report_type)) {
+            return &parser->reports[i].bit_offset;
+        }
+    }
+
+    if (parser->num_of_reports >= HID_PARSER_MAX_REPORTS) {
+        return NULL;
+    }
+    parser->reports[parser->num_of_reports].report_id = report_id;
+    parser->reports[parser->num_of_reports].report_type = report_type;
+    parser->reports[parser->num_of_reports].bit_offset = 0;
+    return &parser->reports[parser->num_of_reports++].bit_offset;
+}
+
+static struct usbh_hid_field *usbh_hid_parser_new_field(struct usbh_hid *hid_class, struct usbh_hid_parser *parser,
+                                                        uint8_t report_type, uint8_t flags, uint32_t usage, uint16_t bit_offset)
+{
+    struct usbh_hid_field *field;
+
+    if (hid_class->num_of_fields >= CONFIG_USBHOST_HID_MAX_FIELDS) {
+        return NULL;
+    }
+
+    field = &hid_class->fields[hid_class->num_of_fields++];
+    field->usage_page = (usage >> 16) ? (usage >> 16) : parser->global.usage_page;
+    field->usage_min = usage & 0xffff;
+    field->usage_max = usage & 0xffff;
+    field->usage_list = 0;
+    field->num_of_usages = 0;
+    field->bit_offset = bit_offset;
+    field->report_count = 0;
+    field->report_size = parser->global.report_size;
+    field->report_id = parser->global.report_id;
+    field->report_type = report_type;
+    field->flags = flags;
+    field->logical_min = parser->global.logical_min;
+    /* logical maximum is unsigned when logical minimum is not negative */
+    if ((parser->global.logical_min >= 0) && (parser->global.logical_max < parser->global.logical_min)) {
+        field->logical_max = (int32_t)parser->global.logical_max_raw;
+    } else {
+        field->logical_max = parser->global.logical_max;
+    }
+    return field;
+}
+
+static int usbh_hid_parser_add_main(struct usbh_hid *hid_class, struct usbh_hid_parser *parser, uint8_t report_type, uint8_t flags)
+{
+    struct usbh_hid_field *field = NULL;
+    uint16_t *offset;
+    uint16_t count = parser->global.report_count;
+    uint8_t size = parser->global.report_size;
+    uint32_t usage;
+
+    offset = usbh_hid_parser_get_offset(parser, parser->global.report_id, report_type);
+    if (offset == NULL) {
+        return -USB_ERR_NOMEM;
+    }
+
+    if ((flags & HID_MAIN_ITEM_CONSTANT) || (size == 0) || (size > 32) || (count == 0)) {
+        *offset += size * count;
+        return 0;
+    }
+
+    if (!(flags & HID_MAIN_ITEM_VARIABLE)) {
+        /* array: every element carries an index into usage minimum..maximum or into the usage list */
+        if (parser->usage_range) {
+            field = usbh_hid_parser_new_field(hid_class, parser, report_type, flags, parser->usage_min, *offset);
+            if (field) {
+                field->usage_max = parser->usage_max & 0xffff;
+            }
+        } else if (parser->num_of_usages) {
+            if ((hid_class->num_of_usages + parser->num_of_usages) > CONFIG_USBHOST_HID_MAX_USAGES) {
+                return -USB_ERR_NOMEM;
+            }
+            field = usbh_hid_parser_new_field(hid_class, parser, report_type, flags, parser->usage[0], *offset);
+            if (field) {
+                field->usage_list = hid_class->num_of_usages;
+                field->num_of_usages = parser->num_of_usages;
+                for (uint8_t i = 0; i < parser->num_of_usages; i++) {
+                    hid_class->usages[hid_class->num_of_usages++] = parser->usage[i] & 0xffff;
+                }
+            }
+        } else {
+            field = usbh_hid_parser_new_field(hid_class, parser, report_type, flags, 0, *offset);
+        }
+        if (field == NULL) {
+            return -USB_ERR_NOMEM;
+        }
+        field->report_count = count;
+    } else if (parser->usage_range) {
+        field = usbh_hid_parser_new_field(hid_class, parser, report_type, flags, parser->usage_min, *offset);
+        if (field == NULL) {
+            return -USB_ERR_NOMEM;
+        }
+        field->usage_max = parser->usage_max & 0xffff;
+        field->report_count = count;
+    } else {
+        /* variable with usage list: merge consecutive usages, last usage repeats for remaining elements */
+        for (uint16_t i = 0; i < count; i++) {
+            usage = parser->num_of_usages ? parser->usage[MIN(i, parser->num_of_usages - 1)] : 0;
+
+            if (field && (i < parser->num_of_usages) && ((usage & 0xffff) == (uint32_t)(field->usage_max + 1)) &&
+                (((usage >> 16) == 0) || ((usage >> 16) == field->usage_page))) {
+                field->usage_max++;
+            } else if (!field || (i < parser->num_of_usages)) {
+                field = usbh_hid_parser_new_field(hid_class, parser, report_type, flags, usage, *offset + i * size);
+                if (field == NULL) {
+                    return -USB_ERR_NOMEM;
+                }
+            }
+            field->report_count++;
+        }
+    }
+
+    *offset += size * count;
+    return 0;
+}
+
+int usbh_hid_parse_report_descriptor(struct usbh_hid *hid_class, const uint8_t *desc, uint32_t desc_len)
+{
+    struct usbh_hid_parser parser;
+    const uint8_t *p = desc;
+    const uint8_t *end = desc + desc_len;
+    uint8_t prefix;
+    uint8_t size;
+    uint32_t udata;
+    int32_t sdata;
+    int ret = 0;
+
+    if (!hid_class || !desc) {
+        return -USB_ERR_INVAL;
+    }
+
+    memset(&parser, 0, sizeof(struct usbh_hid_parser));
+    hid_class->num_of_fields = 0;
+    hid_class->num_of_usages = 0;
+    hid_class->report_id_used = false;
+
+    while (p < end) {
+        prefix = *p++;
+
+        if (prefix == 0xfe) {
+            /* long item, skip data */
+            if ((end - p) < 2) {
+                break;
+            }
+            p += 2 + p[0];
+            continue;
+        }
+
+        size = prefix & HID_REPORT_ITEM_SIZE_MASK;
+        if (size == HID_REPORT_ITEM_SIZE_4) {
+            size = 4;
+        }
+        if ((uint32_t)(end - p) < size) {
+            break;
+        }
+
+        udata = 0;
+        for (uint8_t i = 0; i < size; i++) {
+            udata |= (uint32_t)p[i] << (8 * i);
+        }
+        if ((size > 0) && (size < 4) && (udata & (1U << (8 * size - 1)))) {
+            sdata = (int32_t)(udata | ~((1U << (8 * size)) - 1));
+        } else {
+            sdata = (int32_t)udata;
+        }
+        p += size;
+
+        switch (prefix & ~HID_REPORT_ITEM_SIZE_MASK) {
+            case HID_MAIN_ITEM_INPUT_PREFIX:
+            case HID_MAIN_ITEM_OUTPUT_PREFIX:
+            case HID_MAIN_ITEM_FEATURE_PREFIX:
+                ret = usbh_hid_parser_add_main(hid_class, &parser,
+                                               ((prefix & ~HID_REPORT_ITEM_SIZE_MASK) == HID_MAIN_ITEM_INPUT_PREFIX) ? HID_REPORT_INPUT :
+                                               ((prefix & ~HID_REPORT_ITEM_SIZE_MASK) == HID_MAIN_ITEM_OUTPUT_PREFIX) ? HID_REPORT_OUTPUT :
+                                                                                                                          HID_REPORT_FEATURE,
+                                               udata & 0xff);
+                if (ret < 0) {
+                    USB_LOG_WRN("HID report descriptor has too many fields or usages\r\n");
+                    /* no half built map is left for decode */
+                    hid_class->num_of_fields = 0;
+                    hid_class->num_of_usages = 0;
+                    return ret;
+                }
+                parser.num_of_usages = 0;
+                parser.usage_range = false;
+                break;
+            case HID_MAIN_ITEM_COLLECTION_PREFIX:
+            case HID_MAIN_ITEM_ENDCOLLECTION_PREFIX:
+                parser.num_of_usages = 0;
+                parser.usage_range = false;
+                break;
+            case HID_GLOBAL_ITEM_USAGEPAGE_PREFIX:
+                parser.global.usage_page = udata;
+                break;
+            case HID_GLOBAL_ITEM_LOGICALMIN_PREFIX:
+                parser.global.logical_min = sdata;
+                break;
+            case HID_GLOBAL_ITEM_LOGICALMAX_PREFIX:
+                parser.global.logical_max = sdata;
+                parser.global.logical_max_raw = udata;
+                break;
+            case HID_GLOBAL_ITEM_REPORTSIZE_PREFIX:
+                parser.global.report_size = udata;
+                break;
+            case HID_GLOBAL_ITEM_REPORTID_PREFIX:
+                parser.global.report_id = udata;
+                hid_class->report_id_used = true;
+                break;
+            case HID_GLOBAL_ITEM_REPORTCOUNT_PREFIX:
+                parser.global.report_count = udata;
+                break;
+            case HID_GLOBAL_ITEM_PUSH_PREFIX:
+                if (parser.stack_depth < HID_PARSER_STACK_DEPTH) {
+                    memcpy(&parser.stack[parser.stack_depth++], &parser.global, sizeof(struct usbh_hid_parser_global));
+                }
+                break;
+            case HID_GLOBAL_ITEM_POP_PREFIX:
+                if (parser.stack_depth) {
+                    memcpy(&parser.global, &parser.stack[--parser.stack_depth], sizeof(struct usbh_hid_parser_global));
+                }
+                break;
+            case HID_LOCAL_ITEM_USAGE_PREFIX:
+                if (parser.num_of_usages < HID_PARSER_MAX_USAGES) {
+                    parser.usage[parser.num_of_usages++] = (size == 4) ? udata : (udata & 0xffff);
+                }
+                break;
+            case HID_LOCAL_ITEM_USAGEMIN_PREFIX:
+                parser.usage_min = (size == 4) ? udata : (udata & 0xffff);
+                parser.usage_range = true;
+                break;
+            case HID_LOCAL_ITEM_USAGEMAX_PREFIX:
+                parser.usage_max = (size == 4) ? udata : (udata & 0xffff);
+                parser.usage_range = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return hid_class->num_of_fields;
+}
+
+int usbh_hid_decode_report(struct usbh_hid *hid_class, const uint8_t *report, uint32_t len, struct usbh_hid_event *events, uint32_t max_events)
+{
+    const struct usbh_hid_field *field;
+    uint8_t report_id = 0;
+    uint32_t bitpos;
+    uint32_t num = 0;
+    int32_t value;
+    uint32_t usage;
+
+    if (!hid_class || !report || !events) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (hid_class->report_id_used) {
+        if (len < 1) {
+            return -USB_ERR_INVAL;
+        }
+        report_id = report[0];
+        report++;
+        len--;
+    }
+
+    for (uint8_t i = 0; i < hid_class->num_of_fields; i++) {
+        field = &hid_class->fields[i];
+        if ((field->report_type != HID_REPORT_INPUT) || (field->report_id != report_id)) {
+            continue;
+        }
+
+        for (uint16_t j = 0; j < field->report_count; j++) {
+            bitpos = field->bit_offset + j * field->report_size;
+            if ((bitpos + field->report_size) > (len * 8)) {
+                break;
+            }
+
+            value = usbh_hid_field_value(field, report, bitpos);
+
+            if (field->flags & HID_MAIN_ITEM_VARIABLE) {
+                /* only asserted bits of bitmaps, such as nkro keys and buttons */
+                if ((field->report_size == 1) && (value == 0)) {
+                    continue;
+                }
+                usage = MIN(field->usage_min + j, field->usage_max);
+            } else {
+                /* array index out of logical range is null state */
+                if ((value < field->logical_min) || (value > field->logical_max)) {
+                    continue;
+                }
+                if (field->num_of_usages) {
+                    if ((uint32_t)(value - field->logical_min) >= field->num_of_usages) {
+                        continue;
+                    }
+                    usage = hid_class->usages[field->usage_list + (value - field->logical_min)];
+                } else {
+                    usage = field->usage_min + (value - field->logical_min);
+                    if (usage > field->usage_max) {
+                        continue;
+                    }
+                }
+                if (usage == 0) {
+                    continue;
+                }
+                value = 1;
+            }
+
+            if (num >= max_events) {
+                return num;
+            }
+            events[num].usage_page = field->usage_page;
+            events[num].usage = usage;
+            events[num].value = value;
+            events[num].report_id = report_id;
+            events[num].flags = field->flags;
+            num++;
+        }
+    }
+
+    return num;
+}
+
+int usbh_hid_get_usage_value(struct usbh_hid *hid_class, const uint8_t *report, uint32_t len, uint16_t usage_page, uint16_t usage, int32_t *value)
+{
+    const struct usbh_hid_field *field;
+    uint8_t report_id = 0;
+    uint32_t bitpos;
+
+    if (!hid_class || !report || !value) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (hid_class->report_id_used) {
+        if (len < 1) {
+            return -USB_ERR_INVAL;
+        }
+        report_id = report[0];
+        report++;
+        len--;
+    }
+
+    for (uint8_t i = 0; i < hid_class->num_of_fields; i++) {
+        field = &hid_class->fields[i];
+        if ((field->report_type != HID_REPORT_INPUT) || (field->report_id != report_id) ||
+            !(field->flags & HID_MAIN_ITEM_VARIABLE) || (field->usage_page != usage_page) ||
+            (usage < field->usage_min) || (usage > field->usage_max)) {
+            continue;
+        }
+
+        bitpos = field->bit_offset + (usage - field->usage_min) * field->report_size;
+        if ((bitpos + field->report_size) > (len * 8)) {
+            return -USB_ERR_RANGE;
+        }
+        *value = usbh_hid_field_value(field, report, bitpos);
+        return 0;
+    }
+
+    return -USB_ERR_NODEV;
+}
+
 int usbh_hid_connect(struct usbh_hubport *hport, uint8_t intf)
 {
     struct usb_endpoint_descriptor *ep_desc;
@@ -236,12 +662,18 @@ found:
         USB_LOG_WRN("Do not support set idle\r\n");
     }
 
-    /* We read report desc but do nothing (because of too much memory usage for parsing report desc, parsed by users) */
     ret = usbh_hid_get_report_descriptor(hid_class, g_hid_buf[hid_class->minor], MIN(sizeof(g_hid_buf[hid_class->minor]), hid_class->report_size));
     if (ret < 0) {
         return ret;
     }
 
+    /* build field map once, reports are decoded with it later */
+    if (hid_class->report_size > sizeof(g_hid_buf[hid_class->minor])) {
+        USB_LOG_WRN("HID report descriptor is larger than %u, skip parsing\r\n", (unsigned int)sizeof(g_hid_buf[hid_class->minor]));
+    } else if (usbh_hid_parse_report_descriptor(hid_class, g_hid_buf[hid_class->minor], ret) < 0) {
+        USB_LOG_WRN("Fail to parse HID report descriptor\r\n");
+    }
+
     for (uint8_t i = 0; i < hport->config.intf[intf].altsetting[0].intf_desc.bNumEndpoints; i++) {
         ep_desc = &hport->config.intf[intf].altsetting[0].ep[i].ep_desc;
         if (ep_desc->bEndpointAddress & 0x80) {
@@ -8,6 +8,44 @@
 
 #include "usb_hid.h"
 
+/* report descriptor bytes read at connect time for parsing */
+#ifndef CONFIG_USBHOST_HID_REPORT_DESC_SIZE
+#define CONFIG_USBHOST_HID_REPORT_DESC_SIZE 256
+#endif
+
+/* parsed report fields per hid interface */
+#ifndef CONFIG_USBHOST_HID_MAX_FIELDS
+#define CONFIG_USBHOST_HID_MAX_FIELDS 32
+#endif
+
+#ifndef CONFIG_USBHOST_HID_MAX_USAGES
+#define CONFIG_USBHOST_HID_MAX_USAGES 64
+#endif
+
+struct usbh_hid_field {
+    uint16_t usage_page;
+    uint16_t usage_min; /* usage of first element for variable, usage minimum for array */
+    uint16_t usage_max;
+    uint16_t usage_list;     /* first of array usages in usbh_hid usages */
+    uint16_t num_of_usages;  /* array usages given one by one, 0 means usage_min..usage_max */
+    uint16_t bit_offset; /* offset behind report id */
+    uint16_t report_count;
+    uint8_t report_size; /* bits of every element */
+    uint8_t report_id;
+    uint8_t report_type; /* HID_REPORT_INPUT, HID_REPORT_OUTPUT or HID_REPORT_FEATURE */
+    uint8_t flags;       /* main item data, HID_MAIN_ITEM_VARIABLE, HID_MAIN_ITEM_RELATIVE ... */
+    int32_t logical_min;
+    int32_t logical_max;
+};
+
+struct usbh_hid_event {
+    uint16_t usage_page;
+    uint16_t usage;
+    int32_t value;
+    uint8_t report_id;
+    uint8_t flags;
+};
+
 struct usbh_hid {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *intin;  /* INTR IN endpoint */
@@ -21,6 +59,12 @@ struct usbh_hid {
     uint8_t intf; /* interface number */
     uint8_t minor;
 
+    bool report_id_used;
+    uint8_t num_of_fields;
+    struct usbh_hid_field fields[CONFIG_USBHOST_HID_MAX_FIELDS];
+    uint16_t num_of_usages;
+    uint16_t usages[CONFIG_USBHOST_HID_MAX_USAGES];
+
     void *user_data;
 };
 
@@ -34,6 +78,10 @@ int usbh_hid_get_idle(struct usbh_hid *hid_class, uint8_t *buffer);
 int usbh_hid_set_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t report_id, uint8_t *buffer, uint32_t buflen);
 int usbh_hid_get_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t report_id, uint8_t *buffer, uint32_t buflen);
 
+int usbh_hid_parse_report_descriptor(struct usbh_hid *hid_class, const uint8_t *desc, uint32_t desc_len);
+int usbh_hid_decode_report(struct usbh_hid *hid_class, const uint8_t *report, uint32_t len, struct usbh_hid_event *events, uint32_t max_events);
+int usbh_hid_get_usage_value(struct usbh_hid *hid_class, const uint8_t *report, uint32_t len, uint16_t usage_page, uint16_t usage, int32_t *value);
+
 void usbh_hid_run(struct usbh_hid *hid_class);
 void usbh_hid_stop(struct usbh_hid *hid_class);
 
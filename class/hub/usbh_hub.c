@@ -19,6 +19,10 @@
 
 #define EXTHUB_FIRST_INDEX 2
 
+/* hub_mq carries hub pointers, these requests are run by the hub thread as well */
+#define HUB_REQUEST_STOP  ((uintptr_t)1)
+#define HUB_REQUEST_START ((uintptr_t)2)
+
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hub_buf[CONFIG_USBHOST_MAX_BUS][USB_ALIGN_UP(32, CONFIG_USB_ALIGN_SIZE)];
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hub_intbuf[CONFIG_USBHOST_MAX_BUS][CONFIG_USBHOST_MAX_EXTHUBS + 1][USB_ALIGN_UP(1, CONFIG_USB_ALIGN_SIZE)];
 
@@ -648,6 +652,19 @@ static void usbh_hub_events(struct usbh_hub *hub)
     }
 }
 
+static void usbh_hub_release_ports(struct usbh_bus *bus)
+{
+    struct usbh_hubport *hport;
+    struct usbh_hub *hub;
+
+    hub = &bus->hcd.roothub;
+    for (uint8_t port = 0; port < hub->nports; port++) {
+        hport = &hub->child[port];
+
+        usbh_hubport_release(hport);
+    }
+}
+
 static void usbh_hub_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
     struct usbh_hub *hub;
@@ -661,8 +678,34 @@ static void usbh_hub_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
         if (ret < 0) {
             continue;
         }
-        usbh_hub_events(hub);
+
+        if ((uintptr_t)hub == HUB_REQUEST_STOP) {
+            usbh_hub_release_ports(bus);
+            usb_hc_deinit(bus);
+            bus->stopped = true;
+            usb_osal_sem_give(bus->hub_sem);
+        } else if ((uintptr_t)hub == HUB_REQUEST_START) {
+            bus->stopped = false;
+            usb_hc_init(bus);
+            usb_osal_sem_give(bus->hub_sem);
+        } else if (!bus->stopped) {
+            /* port changes queued before stop are dropped */
+            usbh_hub_events(hub);
+        }
+    }
+}
+
+static int usbh_hub_request(struct usbh_bus *bus, uintptr_t request)
+{
+    int ret;
+
+    ret = usb_osal_mq_send(bus->hub_mq, request);
+    if (ret < 0) {
+        return ret;
     }
+
+    /* wait for enumeration in progress to finish, the hub thread owns the controller */
+    return usb_osal_sem_take(bus->hub_sem, USB_OSAL_WAITING_FOREVER);
 }
 
 void usbh_hub_thread_wakeup(struct usbh_hub *hub)
@@ -691,6 +734,12 @@ int usbh_hub_initialize(struct usbh_bus *bus)
         return -1;
     }
 
+    bus->hub_sem = usb_osal_sem_create(0);
+    if (bus->hub_sem == NULL) {
+        USB_LOG_ERR("Failed to create hub sem\r\n");
+        return -1;
+    }
+
     snprintf(thread_name, 32, "usbh_hub%u", bus->busid);
     bus->hub_thread = usb_osal_thread_create(thread_name, CONFIG_USBHOST_PSC_STACKSIZE, CONFIG_USBHOST_PSC_PRIO, usbh_hub_thread, bus);
     if (bus->hub_thread == NULL) {
@@ -702,29 +751,41 @@ int usbh_hub_initialize(struct usbh_bus *bus)
 
 int usbh_hub_deinitialize(struct usbh_bus *bus)
 {
-    struct usbh_hubport *hport;
-    struct usbh_hub *hub;
     size_t flags;
 
     flags = usb_osal_enter_critical_section();
 
-    hub = &bus->hcd.roothub;
-    for (uint8_t port = 0; port < hub->nports; port++) {
-        hport = &hub->child[port];
+    usbh_hub_release_ports(bus);
 
-        usbh_hubport_release(hport);
+    if (!bus->stopped) {
+        usb_hc_deinit(bus);
     }
 
-    usb_hc_deinit(bus);
-
     usb_osal_leave_critical_section(flags);
 
     usb_osal_mq_delete(bus->hub_mq);
     usb_osal_thread_delete(bus->hub_thread);
+    usb_osal_sem_delete(bus->hub_sem);
 
     return 0;
 }
 
+int usbh_hub_stop(struct usbh_bus *bus)
+{
+    if (bus->stopped) {
+        return 0;
+    }
+    return usbh_hub_request(bus, HUB_REQUEST_STOP);
+}
+
+int usbh_hub_start(struct usbh_bus *bus)
+{
+    if (!bus->stopped) {
+        return 0;
+    }
+    return usbh_hub_request(bus, HUB_REQUEST_START);
+}
+
 #if CONFIG_USBHOST_MAX_EXTHUBS > 0
 const struct usbh_class_driver hub_class_driver = {
     .driver_name = "hub",
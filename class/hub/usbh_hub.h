@@ -21,6 +21,9 @@ void usbh_hub_thread_wakeup(struct usbh_hub *hub);
 
 int usbh_hub_initialize(struct usbh_bus *bus);
 int usbh_hub_deinitialize(struct usbh_bus *bus);
+/* stop or restart the host controller, hub thread and class drivers are kept */
+int usbh_hub_stop(struct usbh_bus *bus);
+int usbh_hub_start(struct usbh_bus *bus);
 
 #ifdef __cplusplus
 }
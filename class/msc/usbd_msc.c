@@ -52,10 +52,12 @@ USB_NOCACHE_RAM_SECTION struct usbd_msc_priv {
     usb_osal_mq_t usbd_msc_mq;
     usb_osal_thread_t usbd_msc_thread;
     uint32_t nbytes;
+    volatile bool write_busy; /* sector write returned -USB_ERR_BUSY, block_buffer is written again */
 #elif defined(CONFIG_USBDEV_MSC_POLLING)
     chry_ringbuffer_t msc_rb;
     uint8_t msc_rb_pool[2];
     uint32_t nbytes;
+    volatile bool write_busy; /* sector write returned -USB_ERR_BUSY, block_buffer is written again */
 #endif
 } g_usbd_msc[CONFIG_USBDEV_MAX_BUS];
 
@@ -72,6 +74,9 @@ static void usbd_msc_reset(uint8_t busid)
 {
     g_usbd_msc[busid].stage = MSC_READ_CBW;
     g_usbd_msc[busid].readonly = false;
+#if defined(CONFIG_USBDEV_MSC_THREAD) || defined(CONFIG_USBDEV_MSC_POLLING)
+    g_usbd_msc[busid].write_busy = false;
+#endif
 }
 
 static int msc_storage_class_interface_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
@@ -725,10 +730,24 @@ static bool SCSI_processRead(uint8_t busid)
 static bool SCSI_processWrite(uint8_t busid, uint32_t nbytes)
 {
     uint32_t data_len = 0;
+    int ret;
     USB_LOG_DBG("write lba:%d\r\n", g_usbd_msc[busid].start_sector);
 
-    if (usbd_msc_sector_write(busid, g_usbd_msc[busid].cbw.bLUN, g_usbd_msc[busid].start_sector, g_usbd_msc[busid].block_buffer, nbytes) != 0) {
-        SCSI_SetSenseData(busid, SCSI_KCQHE_WRITEFAULT);
+    ret = usbd_msc_sector_write(busid, g_usbd_msc[busid].cbw.bLUN, g_usbd_msc[busid].start_sector, g_usbd_msc[busid].block_buffer, nbytes);
+#if defined(CONFIG_USBDEV_MSC_THREAD) || defined(CONFIG_USBDEV_MSC_POLLING)
+    /* out ep is not armed again, so host is nak'ed until the same data is written again */
+    g_usbd_msc[busid].write_busy = (ret == -USB_ERR_BUSY);
+    if (ret == -USB_ERR_BUSY) {
+        return true;
+    }
+#endif
+    if (ret != 0) {
+        /* busy here means we are in usb isr and cannot wait, not ready makes host retry the command */
+        SCSI_SetSenseData(busid, (ret == -USB_ERR_BUSY) ? SCSI_KCQNR_BECOMINGREADY : SCSI_KCQHE_WRITEFAULT);
+        /* host still has data of this command, end the data stage before the csw */
+        if ((nbytes / g_usbd_msc[busid].scsi_blk_size[g_usbd_msc[busid].cbw.bLUN]) < g_usbd_msc[busid].nsectors) {
+            usbd_ep_set_stall(busid, mass_ep_data[busid][MSD_OUT_EP_IDX].ep_addr);
+        }
         return false;
     }
 
@@ -918,9 +937,12 @@ static void usbdev_msc_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
     uint8_t busid = (uint8_t)CONFIG_USB_OSAL_THREAD_GET_ARGV;
 
     while (1) {
-        ret = usb_osal_mq_recv(g_usbd_msc[busid].usbd_msc_mq, (uintptr_t *)&event, USB_OSAL_WAITING_FOREVER);
+        ret = usb_osal_mq_recv(g_usbd_msc[busid].usbd_msc_mq, (uintptr_t *)&event, g_usbd_msc[busid].write_busy ? 1 : USB_OSAL_WAITING_FOREVER);
         if (ret < 0) {
-            continue;
+            if (!g_usbd_msc[busid].write_busy) {
+                continue;
+            }
+            event = MSC_DATA_OUT;
         }
         USB_LOG_DBG("event:%d\r\n", event);
         if (event == MSC_DATA_OUT) {
@@ -940,18 +962,23 @@ void usbd_msc_polling(uint8_t busid)
 {
     uint8_t event;
 
-    if (chry_ringbuffer_read_byte(&g_usbd_msc[busid].msc_rb, &event)) {
-        USB_LOG_DBG("event:%d\r\n", event);
-        if (event == MSC_DATA_OUT) {
-            if (SCSI_processWrite(busid, g_usbd_msc[busid].nbytes) == false) {
-                usbd_msc_send_csw(busid, CSW_STATUS_CMD_FAILED); /* send fail status to host,and the host will retry*/
-            }
-        } else if (event == MSC_DATA_IN) {
-            if (SCSI_processRead(busid) == false) {
-                usbd_msc_send_csw(busid, CSW_STATUS_CMD_FAILED); /* send fail status to host,and the host will retry*/
-            }
-        } else {
+    if (!chry_ringbuffer_read_byte(&g_usbd_msc[busid].msc_rb, &event)) {
+        if (!g_usbd_msc[busid].write_busy) {
+            return;
         }
+        event = MSC_DATA_OUT;
+    }
+
+    USB_LOG_DBG("event:%d\r\n", event);
+    if (event == MSC_DATA_OUT) {
+        if (SCSI_processWrite(busid, g_usbd_msc[busid].nbytes) == false) {
+            usbd_msc_send_csw(busid, CSW_STATUS_CMD_FAILED); /* send fail status to host,and the host will retry*/
+        }
+    } else if (event == MSC_DATA_IN) {
+        if (SCSI_processRead(busid) == false) {
+            usbd_msc_send_csw(busid, CSW_STATUS_CMD_FAILED); /* send fail status to host,and the host will retry*/
+        }
+    } else {
     }
 }
 #endif
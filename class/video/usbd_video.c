@@ -5,6 +5,7 @@
  */
 #include "usbd_core.h"
 #include "usbd_video.h"
+#include "usb_osal.h"
 
 struct video_entity_info {
     uint8_t bDescriptorSubtype;
@@ -32,8 +33,26 @@ struct usbd_video_priv {
     uint32_t stream_offset;
     uint8_t stream_frameid;
     uint32_t stream_headerlen;
+    uint32_t stream_pts;
+    uint8_t stream_header_flags;
+    uint8_t stream_ep;
+    bool queue_enable;
+    bool zero_copy;
+    uint8_t tx_idx; /* ep buf in flight, 0xff means idle */
+    uint8_t fill_idx;
+    struct usbd_video_frame *cur_frame;
+    struct usbd_video_frame *ready_queue[CONFIG_USBDEV_VIDEO_MAX_FRAMES];
+    uint8_t ready_head;
+    uint8_t ready_tail;
+    uint8_t ready_num;
+    struct usbd_video_frame *done_queue[CONFIG_USBDEV_VIDEO_MAX_FRAMES];
+    uint8_t done_head;
+    uint8_t done_tail;
+    uint8_t done_num;
 } g_usbd_video[CONFIG_USBDEV_MAX_BUS];
 
+#define USBD_VIDEO_TX_IDLE 0xff
+
 static int usbd_video_control_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     uint8_t control_selector = (uint8_t)(setup->wValue >> 8);
@@ -691,12 +710,43 @@ static int video_class_interface_request_handler(uint8_t busid, struct usb_setup
     return -1;
 }
 
+static void usbd_video_stream_queue_reset(uint8_t busid)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+
+    /* give all pending frames back to the application */
+    if (g_usbd_video[busid].cur_frame) {
+        g_usbd_video[busid].done_queue[g_usbd_video[busid].done_head] = g_usbd_video[busid].cur_frame;
+        g_usbd_video[busid].done_head = (g_usbd_video[busid].done_head + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+        g_usbd_video[busid].done_num++;
+        g_usbd_video[busid].cur_frame = NULL;
+    }
+    while (g_usbd_video[busid].ready_num) {
+        g_usbd_video[busid].done_queue[g_usbd_video[busid].done_head] = g_usbd_video[busid].ready_queue[g_usbd_video[busid].ready_tail];
+        g_usbd_video[busid].done_head = (g_usbd_video[busid].done_head + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+        g_usbd_video[busid].done_num++;
+        g_usbd_video[busid].ready_tail = (g_usbd_video[busid].ready_tail + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+        g_usbd_video[busid].ready_num--;
+    }
+
+    g_usbd_video[busid].ep_buf0_ready = false;
+    g_usbd_video[busid].ep_buf1_ready = false;
+    g_usbd_video[busid].tx_idx = USBD_VIDEO_TX_IDLE;
+    g_usbd_video[busid].fill_idx = 0;
+    g_usbd_video[busid].ep_buf_idx = 0;
+
+    usb_osal_leave_critical_section(flags);
+}
+
 static void video_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
     switch (event) {
         case USBD_EVENT_RESET:
             g_usbd_video[busid].error_code = 0;
             g_usbd_video[busid].power_mode = 0;
+            usbd_video_stream_queue_reset(busid);
             break;
 
         case USBD_EVENT_SET_INTERFACE: {
@@ -704,6 +754,7 @@ static void video_notify_handler(uint8_t busid, uint8_t event, void *arg)
             if (intf->bAlternateSetting == 1) {
                 usbd_video_open(busid, intf->bInterfaceNumber);
             } else {
+                usbd_video_stream_queue_reset(busid);
                 usbd_video_close(busid, intf->bInterfaceNumber);
             }
         }
@@ -754,24 +805,57 @@ static void usbd_video_probe_and_commit_controls_init(uint8_t busid, uint32_t dw
 
     g_usbd_video[busid].stream_frameid = 0;
     g_usbd_video[busid].stream_headerlen = 2;
+    g_usbd_video[busid].stream_header_flags = 0;
+    g_usbd_video[busid].tx_idx = USBD_VIDEO_TX_IDLE;
+}
+
+__WEAK void usbd_video_get_scr(uint8_t busid, uint32_t *stc, uint16_t *sof)
+{
+    (void)busid;
+
+    *stc = 0;
+    *sof = 0;
+}
+
+static void usbd_video_fill_payload_header(uint8_t busid, uint8_t *header, bool eof)
+{
+    uint32_t offset = 2;
+    uint32_t stc;
+    uint16_t sof;
+
+    header[0] = g_usbd_video[busid].stream_headerlen;
+    header[1] = 0x80 | g_usbd_video[busid].stream_header_flags | g_usbd_video[busid].stream_frameid;
+    if (eof) {
+        header[1] |= 0x02;
+    }
+
+    if (g_usbd_video[busid].stream_header_flags & USBD_VIDEO_HEADER_PTS) {
+        header[offset + 0] = (uint8_t)(g_usbd_video[busid].stream_pts);
+        header[offset + 1] = (uint8_t)(g_usbd_video[busid].stream_pts >> 8);
+        header[offset + 2] = (uint8_t)(g_usbd_video[busid].stream_pts >> 16);
+        header[offset + 3] = (uint8_t)(g_usbd_video[busid].stream_pts >> 24);
+        offset += 4;
+    }
+
+    if (g_usbd_video[busid].stream_header_flags & USBD_VIDEO_HEADER_SCR) {
+        usbd_video_get_scr(busid, &stc, &sof);
+        header[offset + 0] = (uint8_t)(stc);
+        header[offset + 1] = (uint8_t)(stc >> 8);
+        header[offset + 2] = (uint8_t)(stc >> 16);
+        header[offset + 3] = (uint8_t)(stc >> 24);
+        header[offset + 4] = (uint8_t)(sof);
+        header[offset + 5] = (uint8_t)(sof >> 8) & 0x07;
+    }
 }
 
 static uint32_t usbd_video_prepare_ep_buf_data(uint8_t busid, uint32_t remain, uint8_t *ep_buf)
 {
-    struct video_payload_header *header;
     uint32_t len;
     uint32_t offset;
 
     len = MIN(remain, (g_usbd_video[busid].probe.dwMaxPayloadTransferSize - g_usbd_video[busid].stream_headerlen) * g_usbd_video[busid].max_packets);
     offset = 0;
     while (len > 0) {
-        header = (struct video_payload_header *)&ep_buf[offset];
-        header->bHeaderLength = g_usbd_video[busid].stream_headerlen;
-        header->headerInfoUnion.bmheaderInfo = 0;
-        header->headerInfoUnion.headerInfoBits.endOfHeader = 1;
-        header->headerInfoUnion.headerInfoBits.endOfFrame = 0;
-        header->headerInfoUnion.headerInfoBits.frameIdentifier = g_usbd_video[busid].stream_frameid;
-
         uint32_t len2 = MIN(len, g_usbd_video[busid].probe.dwMaxPayloadTransferSize - g_usbd_video[busid].stream_headerlen);
 
         usb_memcpy(&ep_buf[offset + g_usbd_video[busid].stream_headerlen],
@@ -780,11 +864,9 @@ static uint32_t usbd_video_prepare_ep_buf_data(uint8_t busid, uint32_t remain, u
 
         g_usbd_video[busid].stream_offset += len2;
         len -= len2;
-        offset += (len2 + g_usbd_video[busid].stream_headerlen);
 
-        if (g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len) {
-            header->headerInfoUnion.headerInfoBits.endOfFrame = 1;
-        }
+        usbd_video_fill_payload_header(busid, &ep_buf[offset], g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len);
+        offset += (len2 + g_usbd_video[busid].stream_headerlen);
     }
 
     return offset;
@@ -815,10 +897,171 @@ struct usbd_interface *usbd_video_init_intf(uint8_t busid,
     return intf;
 }
 
+static bool usbd_video_stream_frame_next(uint8_t busid)
+{
+    struct usbd_video_frame *frame;
+
+    if (g_usbd_video[busid].cur_frame) {
+        return true;
+    }
+    if (g_usbd_video[busid].ready_num == 0) {
+        return false;
+    }
+
+    frame = g_usbd_video[busid].ready_queue[g_usbd_video[busid].ready_tail];
+    g_usbd_video[busid].ready_tail = (g_usbd_video[busid].ready_tail + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+    g_usbd_video[busid].ready_num--;
+
+    g_usbd_video[busid].cur_frame = frame;
+    g_usbd_video[busid].stream_buf = frame->buf;
+    g_usbd_video[busid].stream_len = frame->len;
+    g_usbd_video[busid].stream_offset = 0;
+    g_usbd_video[busid].stream_pts = frame->pts;
+    return true;
+}
+
+static void usbd_video_stream_frame_done(uint8_t busid)
+{
+    g_usbd_video[busid].done_queue[g_usbd_video[busid].done_head] = g_usbd_video[busid].cur_frame;
+    g_usbd_video[busid].done_head = (g_usbd_video[busid].done_head + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+    g_usbd_video[busid].done_num++;
+    g_usbd_video[busid].cur_frame = NULL;
+    g_usbd_video[busid].stream_frameid ^= 1;
+}
+
+static void usbd_video_stream_copy_start(uint8_t busid)
+{
+    uint8_t idx = g_usbd_video[busid].ep_buf_idx;
+
+    if (g_usbd_video[busid].tx_idx != USBD_VIDEO_TX_IDLE) {
+        return;
+    }
+
+    if ((idx == 0) && g_usbd_video[busid].ep_buf0_ready) {
+        g_usbd_video[busid].ep_buf0_ready = false;
+        g_usbd_video[busid].tx_idx = 0;
+        g_usbd_video[busid].ep_buf_idx = 1;
+        usbd_ep_start_write(busid, g_usbd_video[busid].stream_ep, g_usbd_video[busid].ep_buf0, g_usbd_video[busid].ep_buf0_len);
+    } else if ((idx == 1) && g_usbd_video[busid].ep_buf1_ready) {
+        g_usbd_video[busid].ep_buf1_ready = false;
+        g_usbd_video[busid].tx_idx = 1;
+        g_usbd_video[busid].ep_buf_idx = 0;
+        usbd_ep_start_write(busid, g_usbd_video[busid].stream_ep, g_usbd_video[busid].ep_buf1, g_usbd_video[busid].ep_buf1_len);
+    }
+}
+
+static void usbd_video_stream_copy_fill(uint8_t busid)
+{
+    uint8_t idx;
+
+    while (1) {
+        idx = g_usbd_video[busid].fill_idx;
+        if ((idx == g_usbd_video[busid].tx_idx) ||
+            ((idx == 0) && g_usbd_video[busid].ep_buf0_ready) ||
+            ((idx == 1) && g_usbd_video[busid].ep_buf1_ready)) {
+            break;
+        }
+        if (!usbd_video_stream_frame_next(busid)) {
+            break;
+        }
+
+        if (idx == 0) {
+            g_usbd_video[busid].ep_buf0_len = usbd_video_prepare_ep_buf_data(busid, g_usbd_video[busid].stream_len - g_usbd_video[busid].stream_offset, g_usbd_video[busid].ep_buf0);
+            g_usbd_video[busid].ep_buf0_ready = true;
+        } else {
+            g_usbd_video[busid].ep_buf1_len = usbd_video_prepare_ep_buf_data(busid, g_usbd_video[busid].stream_len - g_usbd_video[busid].stream_offset, g_usbd_video[busid].ep_buf1);
+            g_usbd_video[busid].ep_buf1_ready = true;
+        }
+        g_usbd_video[busid].fill_idx ^= 1;
+
+        /* frame data has been copied, frame buffer can be reused right now */
+        if (g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len) {
+            usbd_video_stream_frame_done(busid);
+        }
+    }
+}
+
+static void usbd_video_stream_zero_copy_start(uint8_t busid)
+{
+    uint32_t payload_size;
+    uint32_t data_size;
+    uint32_t len;
+    uint32_t offset;
+    uint8_t *buf;
+
+    if (g_usbd_video[busid].tx_idx != USBD_VIDEO_TX_IDLE) {
+        return;
+    }
+    if (!usbd_video_stream_frame_next(busid)) {
+        return;
+    }
+
+    payload_size = g_usbd_video[busid].probe.dwMaxPayloadTransferSize;
+    data_size = payload_size - g_usbd_video[busid].stream_headerlen;
+
+    /* payloads are built in place, only headers are written */
+    buf = &g_usbd_video[busid].stream_buf[(g_usbd_video[busid].stream_offset / data_size) * payload_size];
+    offset = 0;
+    for (uint32_t i = 0; i < g_usbd_video[busid].max_packets; i++) {
+        if (g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len) {
+            break;
+        }
+        len = MIN(g_usbd_video[busid].stream_len - g_usbd_video[busid].stream_offset, data_size);
+        g_usbd_video[busid].stream_offset += len;
+
+        usbd_video_fill_payload_header(busid, &buf[offset], g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len);
+        offset += (len + g_usbd_video[busid].stream_headerlen);
+    }
+
+    g_usbd_video[busid].tx_idx = 0;
+    usbd_ep_start_write(busid, g_usbd_video[busid].stream_ep, buf, offset);
+}
+
+/* stream state is only driven here, must be called in critical section */
+static void usbd_video_stream_queue_kick(uint8_t busid)
+{
+    if (g_usbd_video[busid].zero_copy) {
+        usbd_video_stream_zero_copy_start(busid);
+    } else {
+        usbd_video_stream_copy_start(busid);
+        usbd_video_stream_copy_fill(busid);
+        usbd_video_stream_copy_start(busid);
+    }
+}
+
+static bool usbd_video_stream_queue_transfer(uint8_t busid)
+{
+    uint8_t done_num;
+    bool ret;
+    size_t flags;
+
+    /* completion may run in ep thread, so enqueue can not drive the stream at the same time */
+    flags = usb_osal_enter_critical_section();
+    done_num = g_usbd_video[busid].done_num;
+    g_usbd_video[busid].tx_idx = USBD_VIDEO_TX_IDLE;
+
+    if (g_usbd_video[busid].zero_copy && g_usbd_video[busid].cur_frame &&
+        (g_usbd_video[busid].stream_offset == g_usbd_video[busid].stream_len)) {
+        usbd_video_stream_frame_done(busid);
+    }
+
+    /* start next frame back to back */
+    usbd_video_stream_queue_kick(busid);
+
+    ret = (g_usbd_video[busid].done_num != done_num);
+    usb_osal_leave_critical_section(flags);
+
+    return ret;
+}
+
 bool usbd_video_stream_split_transfer(uint8_t busid, uint8_t ep)
 {
     uint32_t remain;
 
+    if (g_usbd_video[busid].queue_enable) {
+        return usbd_video_stream_queue_transfer(busid);
+    }
+
     if (g_usbd_video[busid].ep_buf1_ready && (g_usbd_video[busid].ep_buf_idx == 0)) {    /* callback: buf1 ready and buf0 was sent */
         g_usbd_video[busid].ep_buf0_ready = false;
         g_usbd_video[busid].ep_buf_idx = 1;
@@ -868,6 +1111,7 @@ int usbd_video_stream_start_write(uint8_t busid, uint8_t ep, uint8_t *ep_buf0, u
         return -1;
     }
 
+    g_usbd_video[busid].queue_enable = false;
     g_usbd_video[busid].ep_buf0 = ep_buf0;
     g_usbd_video[busid].ep_buf1 = ep_buf1;
     g_usbd_video[busid].ep_buf0_ready = false;
@@ -878,7 +1122,97 @@ int usbd_video_stream_start_write(uint8_t busid, uint8_t ep, uint8_t *ep_buf0, u
     g_usbd_video[busid].stream_buf = stream_buf;
     g_usbd_video[busid].stream_len = stream_len;
     g_usbd_video[busid].stream_offset = 0;
+    g_usbd_video[busid].stream_pts = 0;
 
     usbd_video_stream_split_transfer(busid, ep);
     return 0;
 }
+
+void usbd_video_stream_set_header(uint8_t busid, uint8_t flags, uint32_t dwClockFrequency)
+{
+    flags &= (USBD_VIDEO_HEADER_PTS | USBD_VIDEO_HEADER_SCR);
+
+    g_usbd_video[busid].stream_header_flags = flags;
+    g_usbd_video[busid].stream_headerlen = 2;
+    if (flags & USBD_VIDEO_HEADER_PTS) {
+        g_usbd_video[busid].stream_headerlen += 4;
+    }
+    if (flags & USBD_VIDEO_HEADER_SCR) {
+        g_usbd_video[busid].stream_headerlen += 6;
+    }
+
+    g_usbd_video[busid].probe.dwClockFrequency = dwClockFrequency;
+    g_usbd_video[busid].commit.dwClockFrequency = dwClockFrequency;
+}
+
+uint32_t usbd_video_stream_get_header_len(uint8_t busid)
+{
+    return g_usbd_video[busid].stream_headerlen;
+}
+
+int usbd_video_stream_queue_init(uint8_t busid, uint8_t ep, uint8_t *ep_buf0, uint8_t *ep_buf1, uint32_t ep_bufsize)
+{
+    uint32_t max_packets;
+
+    if ((ep_buf0 == NULL) != (ep_buf1 == NULL)) {
+        return -1;
+    }
+
+    max_packets = ep_bufsize / g_usbd_video[busid].probe.dwMaxPayloadTransferSize;
+    if (max_packets == 0) {
+        return -1;
+    }
+
+    usbd_video_stream_queue_reset(busid);
+
+    g_usbd_video[busid].stream_ep = ep;
+    g_usbd_video[busid].ep_buf0 = ep_buf0;
+    g_usbd_video[busid].ep_buf1 = ep_buf1;
+    g_usbd_video[busid].max_packets = max_packets;
+    g_usbd_video[busid].zero_copy = (ep_buf0 == NULL);
+    g_usbd_video[busid].queue_enable = true;
+    return 0;
+}
+
+int usbd_video_stream_enqueue(uint8_t busid, struct usbd_video_frame *frame)
+{
+    size_t flags;
+
+    if ((usb_device_is_configured(busid) == 0) || !g_usbd_video[busid].queue_enable || (frame->len == 0)) {
+        return -1;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    /* frames in ready queue, in transfer and in done queue are limited by CONFIG_USBDEV_VIDEO_MAX_FRAMES */
+    if ((g_usbd_video[busid].ready_num + g_usbd_video[busid].done_num + (g_usbd_video[busid].cur_frame ? 1 : 0)) >= CONFIG_USBDEV_VIDEO_MAX_FRAMES) {
+        usb_osal_leave_critical_section(flags);
+        return -1;
+    }
+    g_usbd_video[busid].ready_queue[g_usbd_video[busid].ready_head] = frame;
+    g_usbd_video[busid].ready_head = (g_usbd_video[busid].ready_head + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+    g_usbd_video[busid].ready_num++;
+
+    /* no transfer in flight, so no completion will pick up this frame. Kick in critical section,
+     * otherwise two enqueues or an enqueue and a completion can drive the stream together */
+    if (g_usbd_video[busid].tx_idx == USBD_VIDEO_TX_IDLE) {
+        usbd_video_stream_queue_kick(busid);
+    }
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
+struct usbd_video_frame *usbd_video_stream_dequeue(uint8_t busid)
+{
+    struct usbd_video_frame *frame = NULL;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (g_usbd_video[busid].done_num) {
+        frame = g_usbd_video[busid].done_queue[g_usbd_video[busid].done_tail];
+        g_usbd_video[busid].done_tail = (g_usbd_video[busid].done_tail + 1) % CONFIG_USBDEV_VIDEO_MAX_FRAMES;
+        g_usbd_video[busid].done_num--;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    return frame;
+}
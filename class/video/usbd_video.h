@@ -8,6 +8,25 @@
 
 #include "usb_video.h"
 
+#ifndef CONFIG_USBDEV_VIDEO_MAX_FRAMES
+#define CONFIG_USBDEV_VIDEO_MAX_FRAMES 4
+#endif
+
+/* payload header options, see usbd_video_stream_set_header */
+#define USBD_VIDEO_HEADER_PTS (1 << 2)
+#define USBD_VIDEO_HEADER_SCR (1 << 3)
+
+/* frame buffer size for zero copy stream, every payload slot reserves header_len bytes in front of data */
+#define USBD_VIDEO_ZEROCOPY_BUFSIZE(len, payload_size, header_len) \
+    ((len) + (((len) + (payload_size) - (header_len)-1) / ((payload_size) - (header_len))) * (header_len))
+
+struct usbd_video_frame {
+    uint8_t *buf;    /* frame data, in zero copy mode it is laid out as payload slots with reserved header */
+    uint32_t len;    /* frame data length, not including reserved header bytes */
+    uint32_t pts;    /* presentation time stamp, used when USBD_VIDEO_HEADER_PTS is enabled */
+    void *user_data;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,6 +43,15 @@ void usbd_video_close(uint8_t busid, uint8_t intf);
 bool usbd_video_stream_split_transfer(uint8_t busid, uint8_t ep);
 int usbd_video_stream_start_write(uint8_t busid, uint8_t ep, uint8_t *ep_buf0, uint8_t *ep_buf1, uint32_t ep_bufsize, uint8_t *stream_buf, uint32_t stream_len);
 
+/* Frame queue api, ep_buf0 and ep_buf1 are NULL means zero copy mode */
+void usbd_video_stream_set_header(uint8_t busid, uint8_t flags, uint32_t dwClockFrequency);
+uint32_t usbd_video_stream_get_header_len(uint8_t busid);
+int usbd_video_stream_queue_init(uint8_t busid, uint8_t ep, uint8_t *ep_buf0, uint8_t *ep_buf1, uint32_t ep_bufsize);
+int usbd_video_stream_enqueue(uint8_t busid, struct usbd_video_frame *frame);
+struct usbd_video_frame *usbd_video_stream_dequeue(uint8_t busid);
+
+void usbd_video_get_scr(uint8_t busid, uint32_t *stc, uint16_t *sof);
+
 #ifdef __cplusplus
 }
 #endif
@@ -260,7 +260,10 @@ int usbh_video_open(struct usbh_video *video_class,
     ep_desc = &video_class->hport->config.intf[video_class->data_intf].altsetting[altsetting].ep[0].ep_desc;
     mult = (ep_desc->wMaxPacketSize & USB_MAXPACKETSIZE_ADDITIONAL_TRANSCATION_MASK) >> USB_MAXPACKETSIZE_ADDITIONAL_TRANSCATION_SHIFT;
     mps = ep_desc->wMaxPacketSize & USB_MAXPACKETSIZE_MASK;
-    if (ep_desc->bEndpointAddress & 0x80) {
+    if (USB_GET_ENDPOINT_TYPE(ep_desc->bmAttributes) == USB_ENDPOINT_TYPE_BULK) {
+        video_class->bulkin_mps = mps;
+        USBH_EP_INIT(video_class->bulkin, ep_desc);
+    } else if (ep_desc->bEndpointAddress & 0x80) {
         video_class->isoin_mps = mps * (mult + 1);
         USBH_EP_INIT(video_class->isoin, ep_desc);
     } else {
@@ -271,6 +274,9 @@ int usbh_video_open(struct usbh_video *video_class,
     USB_LOG_INFO("Open video and select formatidx:%u, frameidx:%u, altsetting:%u\r\n", formatidx, frameidx, altsetting);
     video_class->is_opened = true;
     video_class->current_format = format_type;
+    video_class->stream.frame_format = format_type;
+    video_class->stream.width = wWidth;
+    video_class->stream.height = wHeight;
     return ret;
 
 errout:
@@ -290,6 +296,8 @@ int usbh_video_close(struct usbh_video *video_class)
 
     USB_LOG_INFO("Close video device\r\n");
 
+    usbh_video_stream_stop(video_class);
+
     video_class->is_opened = false;
 
     if (video_class->isoin) {
@@ -300,6 +308,10 @@ int usbh_video_close(struct usbh_video *video_class)
         video_class->isoout = NULL;
     }
 
+    if (video_class->bulkin) {
+        video_class->bulkin = NULL;
+    }
+
     setup->bmRequestType = USB_REQUEST_DIR_OUT | USB_REQUEST_STANDARD | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = USB_REQUEST_SET_INTERFACE;
     setup->wValue = 0;
@@ -313,6 +325,294 @@ int usbh_video_close(struct usbh_video *video_class)
     return ret;
 }
 
+static struct usbh_videoframe *usbh_video_frame_alloc(struct usbh_video *video_class)
+{
+    struct usbh_videostreaming *stream = &video_class->stream;
+
+    for (uint8_t i = 0; i < stream->num_of_frames; i++) {
+        if (stream->frame_freemask & (1U << i)) {
+            stream->frame_freemask &= ~(1U << i);
+            return &stream->frame_pool[i];
+        }
+    }
+    return NULL;
+}
+
+static void usbh_video_frame_done(struct usbh_video *video_class)
+{
+    struct usbh_videostreaming *stream = &video_class->stream;
+    struct usbh_videoframe *frame = stream->frame;
+
+    if (frame) {
+        if (stream->frame_error || (stream->bufoffset == 0)) {
+            stream->frame_freemask |= (1U << (frame - stream->frame_pool));
+            stream->stats.dropped_frames++;
+        } else {
+            frame->frame_format = stream->frame_format;
+            frame->frame_size = stream->bufoffset;
+            stream->stats.frames++;
+            stream->stats.bytes += stream->bufoffset;
+            if (stream->frame_complete) {
+                stream->frame_complete(video_class, frame);
+            } else {
+                stream->frame_freemask |= (1U << (frame - stream->frame_pool));
+            }
+        }
+    }
+
+    stream->frame = NULL;
+    stream->bufoffset = 0;
+    stream->frame_error = false;
+    stream->frame_skip = false;
+}
+
+static void usbh_video_stream_decode(struct usbh_video *video_class, uint8_t *buf, uint32_t len, int errorcode)
+{
+    struct usbh_videostreaming *stream = &video_class->stream;
+    uint8_t header_len;
+    uint8_t header_info;
+    uint8_t fid;
+    uint32_t data_len;
+
+    if ((errorcode < 0) || ((len > 0) && ((len < 2) || (buf[0] < 2) || (buf[0] > len)))) {
+        stream->stats.error_payloads++;
+        stream->frame_error = true;
+        return;
+    }
+    if (len == 0) {
+        return;
+    }
+
+    header_len = buf[0];
+    header_info = buf[1];
+    fid = header_info & USBH_VIDEO_HEADER_FID;
+    data_len = len - header_len;
+
+    /* stream starts in the middle of a frame, skip it until fid toggles or eof */
+    if (stream->last_fid == 0xff) {
+        stream->frame_skip = true;
+    }
+
+    /* fid toggles at frame start, some cameras never set eof */
+    if ((stream->frame || stream->frame_skip) && (fid != stream->last_fid) && (stream->last_fid != 0xff)) {
+        usbh_video_frame_done(video_class);
+    }
+    stream->last_fid = fid;
+
+    if (header_info & USBH_VIDEO_HEADER_ERR) {
+        stream->frame_error = true;
+    }
+
+    if ((stream->frame == NULL) && !stream->frame_skip && (data_len > 0)) {
+        stream->frame = usbh_video_frame_alloc(video_class);
+        if (stream->frame == NULL) {
+            stream->frame_skip = true;
+            stream->stats.dropped_frames++;
+        }
+        stream->bufoffset = 0;
+    }
+
+    if (stream->frame && (data_len > 0)) {
+        if ((stream->bufoffset + data_len) > stream->frame->frame_bufsize) {
+            stream->frame_error = true;
+        } else {
+            usb_memcpy(&stream->frame->frame_buf[stream->bufoffset], &buf[header_len], data_len);
+            stream->bufoffset += data_len;
+        }
+    }
+
+    if (header_info & USBH_VIDEO_HEADER_EOF) {
+        usbh_video_frame_done(video_class);
+    }
+}
+
+static void usbh_video_stream_callback(void *arg, int nbytes)
+{
+    struct usbh_video *video_class = (struct usbh_video *)arg;
+    struct usbh_videostreaming *stream = &video_class->stream;
+    struct usbh_urb *urb;
+
+    /* urbs on one endpoint complete in submit order */
+    urb = stream->urb[stream->urb_idx];
+    stream->urb_idx = (stream->urb_idx + 1) % stream->num_of_urbs;
+
+    if (!stream->running || (nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NODEV)) {
+        return;
+    }
+
+    if (urb->num_of_iso_packets) {
+        for (uint32_t i = 0; i < urb->num_of_iso_packets; i++) {
+            usbh_video_stream_decode(video_class,
+                                     urb->iso_packet[i].transfer_buffer,
+                                     urb->iso_packet[i].actual_length,
+                                     urb->iso_packet[i].errorcode);
+        }
+    } else if (nbytes != -USB_ERR_NAK) {
+        usbh_video_stream_decode(video_class, urb->transfer_buffer, nbytes > 0 ? nbytes : 0, nbytes < 0 ? nbytes : 0);
+    }
+
+    urb->actual_length = 0;
+    urb->errorcode = 0;
+    usbh_submit_urb(urb);
+}
+
+int usbh_video_stream_start(struct usbh_video *video_class,
+                            struct usbh_videoframe *frames,
+                            uint8_t num_of_frames,
+                            uint8_t *xfer_buf,
+                            uint32_t xfer_bufsize,
+                            usbh_video_frame_callback_t frame_complete)
+{
+    struct usbh_videostreaming *stream;
+    struct usbh_urb *urb;
+    uint32_t urb_bufsize;
+    uint32_t num_of_packets;
+    int ret;
+
+    if (!video_class || !video_class->hport || !video_class->is_opened) {
+        return -USB_ERR_INVAL;
+    }
+    if (!frames || (num_of_frames == 0) || (num_of_frames > 32)) {
+        return -USB_ERR_INVAL;
+    }
+    if (!video_class->isoin && !video_class->bulkin) {
+        return -USB_ERR_NODEV;
+    }
+
+    stream = &video_class->stream;
+    if (stream->running) {
+        return -USB_ERR_BUSY;
+    }
+
+    stream->frame_pool = frames;
+    stream->num_of_frames = num_of_frames;
+    stream->frame_freemask = (num_of_frames == 32) ? 0xffffffff : ((1U << num_of_frames) - 1);
+    stream->frame_complete = frame_complete;
+    stream->frame = NULL;
+    stream->bufoffset = 0;
+    stream->frame_error = false;
+    stream->frame_skip = false;
+    stream->last_fid = 0xff;
+    stream->urb_idx = 0;
+    memset(&stream->stats, 0, sizeof(struct usbh_video_stats));
+
+    if (video_class->isoin) {
+        stream->num_of_urbs = CONFIG_USBHOST_VIDEO_MAX_URBS;
+        urb_bufsize = xfer_bufsize / stream->num_of_urbs;
+        num_of_packets = urb_bufsize / video_class->isoin_mps;
+    } else {
+        /* one payload per bulk transfer, keep only one urb for data toggle */
+        stream->num_of_urbs = 1;
+        urb_bufsize = video_class->probe.dwMaxPayloadTransferSize;
+        if (urb_bufsize == 0) {
+            urb_bufsize = xfer_bufsize;
+        } else if (urb_bufsize > xfer_bufsize) {
+            /* a payload split into two transfers would be decoded as two payloads */
+            USB_LOG_ERR("xfer_bufsize %u is smaller than max payload %u\r\n", (unsigned int)xfer_bufsize, (unsigned int)urb_bufsize);
+            return -USB_ERR_NOMEM;
+        }
+        num_of_packets = 0;
+    }
+
+    if ((urb_bufsize == 0) || (video_class->isoin && (num_of_packets == 0))) {
+        return -USB_ERR_NOMEM;
+    }
+
+    for (uint8_t i = 0; i < stream->num_of_urbs; i++) {
+        urb = usb_osal_malloc(sizeof(struct usbh_urb) + num_of_packets * sizeof(struct usbh_iso_frame_packet));
+        if (urb == NULL) {
+            ret = -USB_ERR_NOMEM;
+            goto errout;
+        }
+        memset(urb, 0, sizeof(struct usbh_urb) + num_of_packets * sizeof(struct usbh_iso_frame_packet));
+        stream->urb[i] = urb;
+
+        if (video_class->isoin) {
+#if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
+            urb->iso_packet = (struct usbh_iso_frame_packet *)(urb + 1);
+#endif
+            urb->hport = video_class->hport;
+            urb->ep = video_class->isoin;
+            urb->transfer_buffer = &xfer_buf[i * urb_bufsize];
+            urb->transfer_buffer_length = num_of_packets * video_class->isoin_mps;
+            urb->interval = USBH_GET_URB_INTERVAL(video_class->isoin->bInterval, video_class->hport->speed);
+            urb->num_of_iso_packets = num_of_packets;
+            urb->complete = usbh_video_stream_callback;
+            urb->arg = video_class;
+            for (uint32_t j = 0; j < num_of_packets; j++) {
+                urb->iso_packet[j].transfer_buffer = &xfer_buf[i * urb_bufsize + j * video_class->isoin_mps];
+                urb->iso_packet[j].transfer_buffer_length = video_class->isoin_mps;
+            }
+        } else {
+            usbh_bulk_urb_fill(urb, video_class->hport, video_class->bulkin, xfer_buf, urb_bufsize, 0, usbh_video_stream_callback, video_class);
+        }
+    }
+
+    stream->running = true;
+    for (uint8_t i = 0; i < stream->num_of_urbs; i++) {
+        ret = usbh_submit_urb(stream->urb[i]);
+        if (ret < 0) {
+            goto errout;
+        }
+    }
+
+    USB_LOG_INFO("Start video stream with %u urbs, %u bytes per urb\r\n", stream->num_of_urbs, (unsigned int)urb_bufsize);
+    return 0;
+
+errout:
+    usbh_video_stream_stop(video_class);
+    return ret;
+}
+
+int usbh_video_stream_stop(struct usbh_video *video_class)
+{
+    struct usbh_videostreaming *stream;
+
+    if (!video_class) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = &video_class->stream;
+    stream->running = false;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_VIDEO_MAX_URBS; i++) {
+        if (stream->urb[i]) {
+            usbh_kill_urb(stream->urb[i]);
+            usb_osal_free(stream->urb[i]);
+            stream->urb[i] = NULL;
+        }
+    }
+
+    if (stream->frame) {
+        stream->frame_freemask |= (1U << (stream->frame - stream->frame_pool));
+        stream->frame = NULL;
+    }
+    return 0;
+}
+
+void usbh_video_frame_release(struct usbh_video *video_class, struct usbh_videoframe *frame)
+{
+    struct usbh_videostreaming *stream = &video_class->stream;
+    size_t flags;
+
+    if ((frame < stream->frame_pool) || (frame >= &stream->frame_pool[stream->num_of_frames])) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    stream->frame_freemask |= (1U << (frame - stream->frame_pool));
+    usb_osal_leave_critical_section(flags);
+}
+
+void usbh_video_stream_get_stats(struct usbh_video *video_class, struct usbh_video_stats *stats)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stats, &video_class->stream.stats, sizeof(struct usbh_video_stats));
+    usb_osal_leave_critical_section(flags);
+}
+
 void usbh_video_list_info(struct usbh_video *video_class)
 {
     struct usb_endpoint_descriptor *ep_desc;
@@ -476,11 +776,7 @@ static int usbh_video_ctrl_disconnect(struct usbh_hubport *hport, uint8_t intf)
     struct usbh_video *video_class = (struct usbh_video *)hport->config.intf[intf].priv;
 
     if (video_class) {
-        if (video_class->isoin) {
-        }
-
-        if (video_class->isoout) {
-        }
+        usbh_video_stream_stop(video_class);
 
         if (hport->config.intf[intf].devname[0] != '\0') {
             USB_LOG_INFO("Unregister Video Class:%s\r\n", hport->config.intf[intf].devname);
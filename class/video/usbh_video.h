@@ -11,6 +11,16 @@
 #define USBH_VIDEO_FORMAT_UNCOMPRESSED 0
 #define USBH_VIDEO_FORMAT_MJPEG        1
 
+/* outstanding iso in urbs, bulk mode always uses one urb */
+#ifndef CONFIG_USBHOST_VIDEO_MAX_URBS
+#define CONFIG_USBHOST_VIDEO_MAX_URBS 2
+#endif
+
+/* payload header bitmap */
+#define USBH_VIDEO_HEADER_FID 0x01
+#define USBH_VIDEO_HEADER_EOF 0x02
+#define USBH_VIDEO_HEADER_ERR 0x40
+
 struct usbh_video_resolution {
     uint16_t wWidth;
     uint16_t wHeight;
@@ -29,18 +39,41 @@ struct usbh_videoframe {
     uint32_t frame_size;
 };
 
+struct usbh_video_stats {
+    uint32_t frames;         /* frames delivered to application */
+    uint32_t dropped_frames; /* frames dropped because of error, overflow or no free frame buffer */
+    uint32_t error_payloads; /* payloads with transfer error or invalid header */
+    uint32_t bytes;          /* frame bytes delivered to application */
+};
+
+struct usbh_video;
+typedef void (*usbh_video_frame_callback_t)(struct usbh_video *video_class, struct usbh_videoframe *frame);
+
 struct usbh_videostreaming {
     struct usbh_videoframe *frame;
     uint32_t frame_format;
     uint32_t bufoffset;
     uint16_t width;
     uint16_t height;
+    bool running;
+    bool frame_error;
+    bool frame_skip;
+    uint8_t last_fid;
+    uint8_t num_of_frames;
+    uint8_t num_of_urbs;
+    uint8_t urb_idx;
+    uint32_t frame_freemask;
+    struct usbh_videoframe *frame_pool;
+    usbh_video_frame_callback_t frame_complete;
+    struct usbh_urb *urb[CONFIG_USBHOST_VIDEO_MAX_URBS];
+    struct usbh_video_stats stats;
 };
 
 struct usbh_video {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *isoin;  /* ISO IN endpoint */
     struct usb_endpoint_descriptor *isoout; /* ISO OUT endpoint */
+    struct usb_endpoint_descriptor *bulkin; /* Bulk IN endpoint */
 
     uint8_t ctrl_intf; /* interface number */
     uint8_t data_intf; /* interface number */
@@ -49,12 +82,14 @@ struct usbh_video {
     struct video_probe_and_commit_controls commit;
     uint16_t isoin_mps;
     uint16_t isoout_mps;
+    uint16_t bulkin_mps;
     bool is_opened;
     uint8_t current_format;
     uint16_t bcdVDC;
     uint8_t num_of_intf_altsettings;
     uint8_t num_of_formats;
     struct usbh_video_format format[3];
+    struct usbh_videostreaming stream;
 
     void *user_data;
 };
@@ -75,6 +110,20 @@ int usbh_video_close(struct usbh_video *video_class);
 
 void usbh_video_list_info(struct usbh_video *video_class);
 
+/*
+ * frame_complete is called in interrupt context, call usbh_video_frame_release when frame is consumed.
+ * For bulk, xfer_bufsize must be at least dwMaxPayloadTransferSize of the committed probe.
+ */
+int usbh_video_stream_start(struct usbh_video *video_class,
+                            struct usbh_videoframe *frames,
+                            uint8_t num_of_frames,
+                            uint8_t *xfer_buf,
+                            uint32_t xfer_bufsize,
+                            usbh_video_frame_callback_t frame_complete);
+int usbh_video_stream_stop(struct usbh_video *video_class);
+void usbh_video_frame_release(struct usbh_video *video_class, struct usbh_videoframe *frame);
+void usbh_video_stream_get_stats(struct usbh_video *video_class, struct usbh_video_stats *stats);
+
 void usbh_video_run(struct usbh_video *video_class);
 void usbh_video_stop(struct usbh_video *video_class);
 
@@ -14,14 +14,40 @@
 
 static struct usbh_bluetooth g_bluetooth_class;
 
+/* room in front of received data for the h4 packet indicator */
+#define USBH_BLUETOOTH_RX_HEADROOM CONFIG_USB_ALIGN_SIZE
+#define USBH_BLUETOOTH_RX_BUFSIZE  USB_ALIGN_UP(USBH_BLUETOOTH_RX_HEADROOM + CONFIG_USBHOST_BLUETOOTH_RX_SIZE, CONFIG_USB_ALIGN_SIZE)
+
 #ifdef CONFIG_USBHOST_BLUETOOTH_HCI_H4
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_tx_buf[1 + CONFIG_USBHOST_BLUETOOTH_TX_SIZE];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[1 + CONFIG_USBHOST_BLUETOOTH_RX_SIZE];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[USBH_BLUETOOTH_RX_BUFSIZE];
 #else
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_cmd_buf[1 + 256];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_evt_buf[1 + 256];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_evt_buf[USB_ALIGN_UP(USBH_BLUETOOTH_RX_HEADROOM + 256, CONFIG_USB_ALIGN_SIZE)];
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_tx_buf[1 + CONFIG_USBHOST_BLUETOOTH_TX_SIZE];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[1 + CONFIG_USBHOST_BLUETOOTH_RX_SIZE];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[USBH_BLUETOOTH_RX_BUFSIZE];
+#endif
+
+struct usbh_bluetooth_rx {
+    uint8_t type;         /* packet type of this pipe, USB_BLUETOOTH_HCI_NONE for h4 stream */
+    uint8_t *reasm;       /* packet split across urbs */
+    uint32_t reasm_size;
+    uint32_t reasm_len;
+};
+
+static uint8_t g_bluetooth_acl_reasm[1 + CONFIG_USBHOST_BLUETOOTH_RX_SIZE];
+static struct usbh_bluetooth_rx g_bluetooth_acl_rx = {
+    .reasm = g_bluetooth_acl_reasm,
+    .reasm_size = sizeof(g_bluetooth_acl_reasm),
+};
+
+#ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+static uint8_t g_bluetooth_evt_reasm[1 + 2 + 255];
+static struct usbh_bluetooth_rx g_bluetooth_evt_rx = {
+    .type = USB_BLUETOOTH_HCI_EVT,
+    .reasm = g_bluetooth_evt_reasm,
+    .reasm_size = sizeof(g_bluetooth_evt_reasm),
+};
 #endif
 
 static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
@@ -43,6 +69,12 @@ static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
 
     memset(bluetooth_class, 0, sizeof(struct usbh_bluetooth));
 
+    /* drop a packet left half received by last connection */
+    g_bluetooth_acl_rx.reasm_len = 0;
+#ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+    g_bluetooth_evt_rx.reasm_len = 0;
+#endif
+
     bluetooth_class->hport = hport;
     bluetooth_class->intf = intf;
 #ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
@@ -177,6 +209,150 @@ static int usbh_bluetooth_hci_bulk_out(uint8_t *buffer, uint32_t buflen)
     return ret;
 }
 
+static int usbh_bluetooth_hci_pkt_len(const uint8_t *pkt, uint32_t avail)
+{
+    uint32_t hdr_len;
+    uint32_t data_len;
+
+    if (avail < 1) {
+        return 0;
+    }
+
+    switch (pkt[0]) {
+        case USB_BLUETOOTH_HCI_CMD:
+        case USB_BLUETOOTH_HCI_SCO:
+            hdr_len = 4;
+            break;
+        case USB_BLUETOOTH_HCI_ACL:
+        case USB_BLUETOOTH_HCI_ISO:
+            hdr_len = 5;
+            break;
+        case USB_BLUETOOTH_HCI_EVT:
+            hdr_len = 3;
+            break;
+        default:
+            return -USB_ERR_INVAL;
+    }
+
+    if (avail < hdr_len) {
+        return 0;
+    }
+
+    switch (pkt[0]) {
+        case USB_BLUETOOTH_HCI_ACL:
+            data_len = pkt[3] | (pkt[4] << 8);
+            break;
+        case USB_BLUETOOTH_HCI_ISO:
+            data_len = (pkt[3] | (pkt[4] << 8)) & 0x3fff;
+            break;
+        case USB_BLUETOOTH_HCI_EVT:
+            data_len = pkt[2];
+            break;
+        default:
+            data_len = pkt[3];
+            break;
+    }
+
+    return hdr_len + data_len;
+}
+
+/*
+ * Split received data into hci packets. Complete packets are handed to upper layer
+ * from urb buffer directly, only packets crossing urb boundary are copied.
+ * data[-1] must be writable, it holds the packet indicator for typed pipes.
+ */
+static void usbh_bluetooth_hci_rx_process(struct usbh_bluetooth_rx *rx, uint8_t *data, uint32_t len)
+{
+    uint8_t *pkt;
+    uint8_t saved;
+    uint32_t hdr = rx->type ? 1 : 0;
+    uint32_t n;
+    int pkt_len;
+
+    while (len) {
+        if (rx->reasm_len == 0) {
+            pkt = data - hdr;
+            saved = pkt[0];
+            if (rx->type) {
+                pkt[0] = rx->type;
+            }
+
+            pkt_len = usbh_bluetooth_hci_pkt_len(pkt, len + hdr);
+            if ((pkt_len > 0) && ((uint32_t)pkt_len <= (len + hdr))) {
+                usbh_bluetooth_hci_dump(pkt, pkt_len);
+                usbh_bluetooth_hci_read_callback(pkt, pkt_len);
+                pkt[0] = saved;
+                data += pkt_len - hdr;
+                len -= pkt_len - hdr;
+                continue;
+            }
+            pkt[0] = saved;
+
+            if ((pkt_len < 0) || ((uint32_t)pkt_len > rx->reasm_size)) {
+                USB_LOG_ERR("Drop invalid hci packet, type %02x len %d\r\n", rx->type ? rx->type : data[0], pkt_len);
+                return;
+            }
+
+            /* packet continues in next urb */
+            if (rx->type) {
+                rx->reasm[0] = rx->type;
+                rx->reasm_len = 1;
+            }
+        }
+
+        pkt_len = usbh_bluetooth_hci_pkt_len(rx->reasm, rx->reasm_len);
+        if ((pkt_len < 0) || ((uint32_t)pkt_len > rx->reasm_size)) {
+            USB_LOG_ERR("Drop invalid hci packet, len %d\r\n", pkt_len);
+            rx->reasm_len = 0;
+            return;
+        }
+
+        /* copy header byte by byte until packet length is known */
+        n = pkt_len ? (pkt_len - rx->reasm_len) : 1;
+        n = MIN(n, len);
+        memcpy(&rx->reasm[rx->reasm_len], data, n);
+        rx->reasm_len += n;
+        data += n;
+        len -= n;
+
+        if (pkt_len && (rx->reasm_len == (uint32_t)pkt_len)) {
+            usbh_bluetooth_hci_dump(rx->reasm, pkt_len);
+            usbh_bluetooth_hci_read_callback(rx->reasm, pkt_len);
+            rx->reasm_len = 0;
+        }
+    }
+}
+
+/* one urb per pipe, see data toggle in urb docs. buf is behind USBH_BLUETOOTH_RX_HEADROOM */
+static void usbh_bluetooth_hci_rx_loop(struct usbh_bluetooth_rx *rx, struct usbh_urb *urb,
+                                       struct usb_endpoint_descriptor *ep, uint8_t *buf, uint32_t xfer_len)
+{
+    uint8_t retry = 0;
+    int ret;
+
+    while (1) {
+        if (USB_GET_ENDPOINT_TYPE(ep->bmAttributes) == USB_ENDPOINT_TYPE_INTERRUPT) {
+            usbh_int_urb_fill(urb, g_bluetooth_class.hport, ep, buf, xfer_len, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        } else {
+            usbh_bulk_urb_fill(urb, g_bluetooth_class.hport, ep, buf, xfer_len, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        }
+        ret = usbh_submit_urb(urb);
+        if ((ret == -USB_ERR_SHUTDOWN) || (ret == -USB_ERR_NODEV)) {
+            return;
+        } else if (ret == -USB_ERR_NAK) {
+            usb_osal_msleep(ep->bInterval);
+        } else if (ret < 0) {
+            retry++;
+            if (retry == 3) {
+                return;
+            }
+        } else {
+            retry = 0;
+            usbh_bluetooth_hci_rx_process(rx, urb->transfer_buffer, urb->actual_length);
+        }
+    }
+}
+
 #ifdef CONFIG_USBHOST_BLUETOOTH_HCI_H4
 int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 {
@@ -191,43 +367,14 @@ int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 
 void usbh_bluetooth_hci_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
+    USB_LOG_INFO("Create hc rx thread\r\n");
 
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.bulkin->wMaxPacketSize);
+    g_bluetooth_acl_rx.type = USB_BLUETOOTH_HCI_NONE;
+    usbh_bluetooth_hci_rx_loop(&g_bluetooth_acl_rx, &g_bluetooth_class.bulkin_urb, g_bluetooth_class.bulkin,
+                               &g_bluetooth_rx_buf[USBH_BLUETOOTH_RX_HEADROOM], CONFIG_USBHOST_BLUETOOTH_RX_SIZE);
 
-    USB_LOG_INFO("Create hc rx thread\r\n");
-    while (1) {
-        usbh_bulk_urb_fill(&g_bluetooth_class.bulkin_urb, g_bluetooth_class.hport, g_bluetooth_class.bulkin, &g_bluetooth_rx_buf[actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.bulkin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.bulkin_urb.actual_length;
-        if (g_bluetooth_class.bulkin_urb.actual_length != ep_mps) {
-            usbh_bluetooth_hci_dump(g_bluetooth_rx_buf, actual_len);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_rx_buf, actual_len);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
-    }
-    // clang-format off
-delete :
     USB_LOG_INFO("Delete hc acl rx thread\r\n");
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 
 #else
@@ -273,93 +420,26 @@ int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 
 void usbh_bluetooth_hci_evt_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint32_t interval;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
+    USB_LOG_INFO("Create hc event rx thread\r\n");
 
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.intin->wMaxPacketSize);
-    interval = g_bluetooth_class.intin->bInterval;
+    /* events are short, one interrupt urb stays armed and split events are reassembled */
+    usbh_bluetooth_hci_rx_loop(&g_bluetooth_evt_rx, &g_bluetooth_class.intin_urb, g_bluetooth_class.intin,
+                               &g_bluetooth_evt_buf[USBH_BLUETOOTH_RX_HEADROOM], USB_GET_MAXPACKETSIZE(g_bluetooth_class.intin->wMaxPacketSize));
 
-    USB_LOG_INFO("Create hc event rx thread\r\n");
-    while (1) {
-        usbh_int_urb_fill(&g_bluetooth_class.intin_urb, g_bluetooth_class.hport, g_bluetooth_class.intin, &g_bluetooth_evt_buf[1 + actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.intin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else if (ret == -USB_ERR_NAK) {
-                usb_osal_msleep(interval);
-                continue;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                usb_osal_msleep(interval);
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.intin_urb.actual_length;
-        if (g_bluetooth_class.intin_urb.actual_length != ep_mps) {
-            g_bluetooth_evt_buf[0] = USB_BLUETOOTH_HCI_EVT;
-            usbh_bluetooth_hci_dump(g_bluetooth_evt_buf, actual_len + 1);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_evt_buf, actual_len + 1);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
-        usb_osal_msleep(interval);
-    }
-    // clang-format off
-delete :
     USB_LOG_INFO("Delete hc event rx thread\r\n");
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 
 void usbh_bluetooth_hci_acl_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
+    USB_LOG_INFO("Create hc acl rx thread\r\n");
 
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.bulkin->wMaxPacketSize);
+    g_bluetooth_acl_rx.type = USB_BLUETOOTH_HCI_ACL;
+    usbh_bluetooth_hci_rx_loop(&g_bluetooth_acl_rx, &g_bluetooth_class.bulkin_urb, g_bluetooth_class.bulkin,
+                               &g_bluetooth_rx_buf[USBH_BLUETOOTH_RX_HEADROOM], CONFIG_USBHOST_BLUETOOTH_RX_SIZE);
 
-    USB_LOG_INFO("Create hc acl rx thread\r\n");
-    while (1) {
-        usbh_bulk_urb_fill(&g_bluetooth_class.bulkin_urb, g_bluetooth_class.hport, g_bluetooth_class.bulkin, &g_bluetooth_rx_buf[1 + actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.bulkin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.bulkin_urb.actual_length;
-        if (g_bluetooth_class.bulkin_urb.actual_length != ep_mps) {
-            g_bluetooth_rx_buf[0] = USB_BLUETOOTH_HCI_ACL;
-            usbh_bluetooth_hci_dump(g_bluetooth_rx_buf, actual_len + 1);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_rx_buf, actual_len + 1);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
-    }
-    // clang-format off
-delete :
     USB_LOG_INFO("Delete hc acl rx thread\r\n");
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 #endif
 
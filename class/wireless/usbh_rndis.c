@@ -11,18 +11,44 @@
 #define USB_DBG_TAG "usbh_rndis"
 #include "usb_log.h"
 
-#define DEV_FORMAT "/dev/rndis"
+#define DEV_FORMAT "/dev/rndis%d"
 
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_buf[512];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_buf[CONFIG_USBHOST_MAX_RNDIS_CLASS][USB_ALIGN_UP(512, CONFIG_USB_ALIGN_SIZE)];
 
 #define CONFIG_USBHOST_RNDIS_ETH_MAX_FRAME_SIZE 1514
 #define CONFIG_USBHOST_RNDIS_ETH_MSG_SIZE       (CONFIG_USBHOST_RNDIS_ETH_MAX_FRAME_SIZE + 44)
 
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_rx_buffer[CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE];
-static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_tx_buffer[CONFIG_USBHOST_RNDIS_ETH_MAX_TX_SIZE];
-// static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_inttx_buffer[16];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_rx_buffer[CONFIG_USBHOST_MAX_RNDIS_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_tx_buffer[CONFIG_USBHOST_MAX_RNDIS_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_RNDIS_ETH_MAX_TX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+// static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_inttx_buffer[CONFIG_USBHOST_MAX_RNDIS_CLASS][USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
-static struct usbh_rndis g_rndis_class;
+static struct usbh_rndis g_rndis_class[CONFIG_USBHOST_MAX_RNDIS_CLASS];
+static uint32_t g_devinuse = 0;
+
+static struct usbh_rndis *usbh_rndis_class_alloc(void)
+{
+    uint8_t devno;
+
+    for (devno = 0; devno < CONFIG_USBHOST_MAX_RNDIS_CLASS; devno++) {
+        if ((g_devinuse & (1U << devno)) == 0) {
+            g_devinuse |= (1U << devno);
+            memset(&g_rndis_class[devno], 0, sizeof(struct usbh_rndis));
+            g_rndis_class[devno].minor = devno;
+            return &g_rndis_class[devno];
+        }
+    }
+    return NULL;
+}
+
+static void usbh_rndis_class_free(struct usbh_rndis *rndis_class)
+{
+    uint8_t devno = rndis_class->minor;
+
+    if (devno < 32) {
+        g_devinuse &= ~(1U << devno);
+    }
+    memset(rndis_class, 0, sizeof(struct usbh_rndis));
+}
 
 static int usbh_rndis_get_notification(struct usbh_rndis *rndis_class)
 {
@@ -30,7 +56,7 @@ static int usbh_rndis_get_notification(struct usbh_rndis *rndis_class)
     // int ret;
     // struct usbh_urb *urb = &rndis_class->intin_urb;
 
-    // usbh_int_urb_fill(urb, rndis_class->hport, rndis_class->intin, g_rndis_inttx_buffer, rndis_class->intin->wMaxPacketSize, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    // usbh_int_urb_fill(urb, rndis_class->hport, rndis_class->intin, g_rndis_inttx_buffer[rndis_class->minor], rndis_class->intin->wMaxPacketSize, USB_OSAL_WAITING_FOREVER, NULL, NULL);
     // ret = usbh_submit_urb(urb);
     // if (ret == 0) {
     //     ret = urb->actual_length;
@@ -51,7 +77,7 @@ static int usbh_rndis_init_msg_transfer(struct usbh_rndis *rndis_class)
     }
     setup = rndis_class->hport->setup;
 
-    cmd = (rndis_initialize_msg_t *)g_rndis_buf;
+    cmd = (rndis_initialize_msg_t *)g_rndis_buf[rndis_class->minor];
 
     cmd->MessageType = REMOTE_NDIS_INITIALIZE_MSG;
     cmd->MessageLength = sizeof(rndis_initialize_msg_t);
@@ -74,13 +100,13 @@ static int usbh_rndis_init_msg_transfer(struct usbh_rndis *rndis_class)
 
     usbh_rndis_get_notification(rndis_class);
 
-    resp = (rndis_initialize_cmplt_t *)g_rndis_buf;
+    resp = (rndis_initialize_cmplt_t *)g_rndis_buf[rndis_class->minor];
 
     setup->bmRequestType = USB_REQUEST_DIR_IN | USB_REQUEST_CLASS | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = CDC_REQUEST_GET_ENCAPSULATED_RESPONSE;
     setup->wValue = 0;
     setup->wIndex = 0;
-    setup->wLength = sizeof(g_rndis_buf);
+    setup->wLength = sizeof(g_rndis_buf[0]);
 
     ret = usbh_control_transfer(rndis_class->hport, setup, (uint8_t *)resp);
     if (ret < 0) {
@@ -108,7 +134,7 @@ int usbh_rndis_query_msg_transfer(struct usbh_rndis *rndis_class, uint32_t oid,
     }
     setup = rndis_class->hport->setup;
 
-    cmd = (rndis_query_msg_t *)g_rndis_buf;
+    cmd = (rndis_query_msg_t *)g_rndis_buf[rndis_class->minor];
 
     cmd->MessageType = REMOTE_NDIS_QUERY_MSG;
     cmd->MessageLength = query_len + sizeof(rndis_query_msg_t);
@@ -132,13 +158,13 @@ int usbh_rndis_query_msg_transfer(struct usbh_rndis *rndis_class, uint32_t oid,
 
     usbh_rndis_get_notification(rndis_class);
 
-    resp = (rndis_query_cmplt_t *)g_rndis_buf;
+    resp = (rndis_query_cmplt_t *)g_rndis_buf[rndis_class->minor];
 
     setup->bmRequestType = USB_REQUEST_DIR_IN | USB_REQUEST_CLASS | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = CDC_REQUEST_GET_ENCAPSULATED_RESPONSE;
     setup->wValue = 0;
     setup->wIndex = 0;
-    setup->wLength = sizeof(g_rndis_buf);
+    setup->wLength = sizeof(g_rndis_buf[0]);
 
     ret = usbh_control_transfer(rndis_class->hport, setup, (uint8_t *)resp);
     if (ret < 0) {
@@ -164,7 +190,7 @@ static int usbh_rndis_set_msg_transfer(struct usbh_rndis *rndis_class, uint32_t
     }
     setup = rndis_class->hport->setup;
 
-    cmd = (rndis_set_msg_t *)g_rndis_buf;
+    cmd = (rndis_set_msg_t *)g_rndis_buf[rndis_class->minor];
 
     cmd->MessageType = REMOTE_NDIS_SET_MSG;
     cmd->MessageLength = info_len + sizeof(rndis_set_msg_t);
@@ -189,13 +215,13 @@ static int usbh_rndis_set_msg_transfer(struct usbh_rndis *rndis_class, uint32_t
 
     usbh_rndis_get_notification(rndis_class);
 
-    resp = (rndis_set_cmplt_t *)g_rndis_buf;
+    resp = (rndis_set_cmplt_t *)g_rndis_buf[rndis_class->minor];
 
     setup->bmRequestType = USB_REQUEST_DIR_IN | USB_REQUEST_CLASS | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = CDC_REQUEST_GET_ENCAPSULATED_RESPONSE;
     setup->wValue = 0;
     setup->wIndex = 0;
-    setup->wLength = sizeof(g_rndis_buf);
+    setup->wLength = sizeof(g_rndis_buf[0]);
 
     ret = usbh_control_transfer(rndis_class->hport, setup, (uint8_t *)resp);
     if (ret < 0) {
@@ -236,7 +262,7 @@ int usbh_rndis_keepalive(struct usbh_rndis *rndis_class)
     }
     setup = rndis_class->hport->setup;
 
-    cmd = (rndis_keepalive_msg_t *)g_rndis_buf;
+    cmd = (rndis_keepalive_msg_t *)g_rndis_buf[rndis_class->minor];
 
     cmd->MessageType = REMOTE_NDIS_KEEPALIVE_MSG;
     cmd->MessageLength = sizeof(rndis_keepalive_msg_t);
@@ -256,13 +282,13 @@ int usbh_rndis_keepalive(struct usbh_rndis *rndis_class)
 
     usbh_rndis_get_notification(rndis_class);
 
-    resp = (rndis_keepalive_cmplt_t *)g_rndis_buf;
+    resp = (rndis_keepalive_cmplt_t *)g_rndis_buf[rndis_class->minor];
 
     setup->bmRequestType = USB_REQUEST_DIR_IN | USB_REQUEST_CLASS | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = CDC_REQUEST_GET_ENCAPSULATED_RESPONSE;
     setup->wValue = 0;
     setup->wIndex = 0;
-    setup->wLength = sizeof(g_rndis_buf);
+    setup->wLength = sizeof(g_rndis_buf[0]);
 
     ret = usbh_control_transfer(rndis_class->hport, setup, (uint8_t *)resp);
     if (ret < 0) {
@@ -284,9 +310,11 @@ static int usbh_rndis_connect(struct usbh_hubport *hport, uint8_t intf)
     uint8_t tmp_buffer[512];
     uint8_t data[32];
 
-    struct usbh_rndis *rndis_class = &g_rndis_class;
-
-    memset(rndis_class, 0, sizeof(struct usbh_rndis));
+    struct usbh_rndis *rndis_class = usbh_rndis_class_alloc();
+    if (rndis_class == NULL) {
+        USB_LOG_ERR("Fail to alloc rndis_class\r\n");
+        return -USB_ERR_NOMEM;
+    }
 
     rndis_class->hport = hport;
     rndis_class->ctrl_intf = intf;
@@ -408,7 +436,7 @@ static int usbh_rndis_connect(struct usbh_hubport *hport, uint8_t intf)
                  rndis_class->mac[4],
                  rndis_class->mac[5]);
 
-    strncpy(hport->config.intf[intf].devname, DEV_FORMAT, CONFIG_USBHOST_DEV_NAMELEN);
+    snprintf(hport->config.intf[intf].devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, rndis_class->minor);
 
     USB_LOG_INFO("Register RNDIS Class:%s\r\n", hport->config.intf[intf].devname);
     usbh_rndis_run(rndis_class);
@@ -442,7 +470,7 @@ static int usbh_rndis_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_rndis_stop(rndis_class);
         }
 
-        memset(rndis_class, 0, sizeof(struct usbh_rndis));
+        usbh_rndis_class_free(rndis_class);
     }
 
     return ret;
@@ -450,6 +478,9 @@ static int usbh_rndis_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
 void usbh_rndis_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+    char devname[CONFIG_USBHOST_DEV_NAMELEN];
+    uint8_t *rx_buffer;
     uint32_t g_rndis_rx_length;
     int ret;
     uint32_t pmg_offset;
@@ -461,19 +492,21 @@ void usbh_rndis_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
     uint32_t transfer_size = (16 * 1024);
 #endif
 
-    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+    /* class may be freed by disconnect, keep what we need to find it again */
+    snprintf(devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, rndis_class->minor);
+    rx_buffer = g_rndis_rx_buffer[rndis_class->minor];
 
-    USB_LOG_INFO("Create rndis rx thread\r\n");
+    USB_LOG_INFO("Create rndis rx thread:%s\r\n", devname);
     // clang-format off
 find_class:
     // clang-format on
-    g_rndis_class.connect_status = false;
-    if (usbh_find_class_instance("/dev/rndis") == NULL) {
+    if (usbh_find_class_instance(devname) != rndis_class) {
         goto delete;
     }
+    rndis_class->connect_status = false;
 
-    while (g_rndis_class.connect_status == false) {
-        ret = usbh_rndis_get_connect_status(&g_rndis_class);
+    while (rndis_class->connect_status == false) {
+        ret = usbh_rndis_get_connect_status(rndis_class);
         if (ret < 0) {
             usb_osal_msleep(100);
             goto find_class;
@@ -483,19 +516,19 @@ find_class:
 
     g_rndis_rx_length = 0;
     while (1) {
-        usbh_bulk_urb_fill(&g_rndis_class.bulkin_urb, g_rndis_class.hport, g_rndis_class.bulkin, &g_rndis_rx_buffer[g_rndis_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_rndis_class.bulkin_urb);
+        usbh_bulk_urb_fill(&rndis_class->bulkin_urb, rndis_class->hport, rndis_class->bulkin, &rx_buffer[g_rndis_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        ret = usbh_submit_urb(&rndis_class->bulkin_urb);
         if (ret < 0) {
             goto find_class;
         }
 
-        g_rndis_rx_length += g_rndis_class.bulkin_urb.actual_length;
+        g_rndis_rx_length += rndis_class->bulkin_urb.actual_length;
 
         /* A transfer is complete because last packet is a short packet.
-         * Short packet is not zero, match g_rndis_rx_length % USB_GET_MAXPACKETSIZE(g_rndis_class.bulkin->wMaxPacketSize).
+         * Short packet is not zero, match g_rndis_rx_length % USB_GET_MAXPACKETSIZE(rndis_class->bulkin->wMaxPacketSize).
          * Short packet cannot be zero.
         */
-        if (g_rndis_rx_length % USB_GET_MAXPACKETSIZE(g_rndis_class.bulkin->wMaxPacketSize)) {
+        if (g_rndis_rx_length % USB_GET_MAXPACKETSIZE(rndis_class->bulkin->wMaxPacketSize)) {
             pmg_offset = 0;
 
             uint32_t total_len = g_rndis_rx_length;
@@ -503,7 +536,7 @@ find_class:
             while (g_rndis_rx_length > 0) {
                 USB_LOG_DBG("rxlen:%ld\r\n", g_rndis_rx_length);
 
-                pmsg = (rndis_data_packet_t *)(g_rndis_rx_buffer + pmg_offset);
+                pmsg = (rndis_data_packet_t *)(rx_buffer + pmg_offset);
 
                 /* Not word-aligned case */
                 if (pmg_offset & 0x3) {
@@ -512,9 +545,9 @@ find_class:
                 }
 
                 if (pmsg->MessageType == REMOTE_NDIS_PACKET_MSG) {
-                    uint8_t *buf = (uint8_t *)(g_rndis_rx_buffer + pmg_offset + sizeof(rndis_generic_msg_t) + pmsg->DataOffset);
+                    uint8_t *buf = (uint8_t *)(rx_buffer + pmg_offset + sizeof(rndis_generic_msg_t) + pmsg->DataOffset);
 
-                    usbh_rndis_eth_input(buf, pmsg->DataLength);
+                    usbh_rndis_eth_input(rndis_class, buf, pmsg->DataLength);
                     pmg_offset += pmsg->MessageLength;
                     g_rndis_rx_length -= pmsg->MessageLength;
 
@@ -543,26 +576,26 @@ find_class:
 
     // clang-format off
 delete:
-    USB_LOG_INFO("Delete rndis rx thread\r\n");
+    USB_LOG_INFO("Delete rndis rx thread:%s\r\n", devname);
     usb_osal_thread_delete(NULL);
     // clang-format on
 }
 
-uint8_t *usbh_rndis_get_eth_txbuf(void)
+uint8_t *usbh_rndis_get_eth_txbuf(struct usbh_rndis *rndis_class)
 {
-    return (g_rndis_tx_buffer + sizeof(rndis_data_packet_t));
+    return (g_rndis_tx_buffer[rndis_class->minor] + sizeof(rndis_data_packet_t));
 }
 
-int usbh_rndis_eth_output(uint32_t buflen)
+int usbh_rndis_eth_output(struct usbh_rndis *rndis_class, uint32_t buflen)
 {
     rndis_data_packet_t *hdr;
     uint32_t len;
 
-    if (g_rndis_class.connect_status == false) {
+    if (rndis_class->connect_status == false) {
         return -USB_ERR_NOTCONN;
     }
 
-    hdr = (rndis_data_packet_t *)g_rndis_tx_buffer;
+    hdr = (rndis_data_packet_t *)g_rndis_tx_buffer[rndis_class->minor];
     memset(hdr, 0, sizeof(rndis_data_packet_t));
 
     hdr->MessageType = REMOTE_NDIS_PACKET_MSG;
@@ -572,14 +605,14 @@ int usbh_rndis_eth_output(uint32_t buflen)
 
     len = hdr->MessageLength;
     /* if message length is the multiple of wMaxPacketSize, we should add a short packet to tell device transfer is over. */
-    if (!(len % g_rndis_class.bulkout->wMaxPacketSize)) {
+    if (!(len % rndis_class->bulkout->wMaxPacketSize)) {
         len += 1;
     }
 
     USB_LOG_DBG("txlen:%d\r\n", len);
 
-    usbh_bulk_urb_fill(&g_rndis_class.bulkout_urb, g_rndis_class.hport, g_rndis_class.bulkout, g_rndis_tx_buffer, len, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-    return usbh_submit_urb(&g_rndis_class.bulkout_urb);
+    usbh_bulk_urb_fill(&rndis_class->bulkout_urb, rndis_class->hport, rndis_class->bulkout, g_rndis_tx_buffer[rndis_class->minor], len, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+    return usbh_submit_urb(&rndis_class->bulkout_urb);
 }
 
 __WEAK void usbh_rndis_run(struct usbh_rndis *rndis_class)
@@ -8,6 +8,10 @@
 
 #include "usb_cdc.h"
 
+#ifndef CONFIG_USBHOST_MAX_RNDIS_CLASS
+#define CONFIG_USBHOST_MAX_RNDIS_CLASS 1
+#endif
+
 struct usbh_rndis {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *bulkin;  /* Bulk IN endpoint */
@@ -43,9 +47,9 @@ int usbh_rndis_keepalive(struct usbh_rndis *rndis_class);
 void usbh_rndis_run(struct usbh_rndis *rndis_class);
 void usbh_rndis_stop(struct usbh_rndis *rndis_class);
 
-uint8_t *usbh_rndis_get_eth_txbuf(void);
-int usbh_rndis_eth_output(uint32_t buflen);
-void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen);
+uint8_t *usbh_rndis_get_eth_txbuf(struct usbh_rndis *rndis_class);
+int usbh_rndis_eth_output(struct usbh_rndis *rndis_class, uint32_t buflen);
+void usbh_rndis_eth_input(struct usbh_rndis *rndis_class, uint8_t *buf, uint32_t buflen);
 void usbh_rndis_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
 #ifdef __cplusplus
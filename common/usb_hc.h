@@ -38,7 +38,7 @@ struct usbh_urb {
     void *hcpriv;
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *ep;
-    uint8_t data_toggle;
+    uint8_t data_toggle; /* kept per urb by ehci, dwc2 and musb, so only one bulk/intr urb per endpoint at a time */
     uint8_t interval;
     struct usb_setup_packet *setup;
     uint8_t *transfer_buffer;
@@ -51,6 +51,9 @@ struct usbh_urb {
     uint32_t start_frame;
     usbh_complete_callback_t complete;
     void *arg;
+#ifdef CONFIG_USB_TRACE
+    uint32_t trace_ts;
+#endif
 #if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
     struct usbh_iso_frame_packet *iso_packet;
 #else
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2024, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <string.h>
+#include "usb_config.h"
+#include "usb_util.h"
+#include "usb_log.h"
+
+#ifdef CONFIG_USB_LOG_DEFERRED
+
+#if (CONFIG_USB_LOG_DEFERRED_DEPTH & (CONFIG_USB_LOG_DEFERRED_DEPTH - 1))
+#error "CONFIG_USB_LOG_DEFERRED_DEPTH must be power of 2"
+#endif
+
+struct usb_log_ring {
+    uint32_t head; /* next write index, shared by all writers of this core */
+    uint32_t tail; /* next read index, only used by reader */
+    uint32_t dropped;
+    struct usb_log_record records[CONFIG_USB_LOG_DEFERRED_DEPTH];
+};
+
+static struct usb_log_ring g_usb_log_ring[CONFIG_USB_LOG_DEFERRED_CORES];
+
+#if defined(__GNUC__)
+#define usb_log_fetch_add(ptr)    __atomic_fetch_add(ptr, 1, __ATOMIC_RELAXED)
+#define usb_log_load(ptr)         __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define usb_log_store(ptr, val)   __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define usb_log_fence()           __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define usb_log_lock()            0
+#define usb_log_unlock(flags)     (void)(flags)
+#else
+/* no atomic builtins, fall back to a short critical section */
+#include "usb_osal.h"
+
+static inline uint32_t usb_log_fetch_add(uint32_t *ptr)
+{
+    size_t flags;
+    uint32_t val;
+
+    flags = usb_osal_enter_critical_section();
+    val = (*ptr)++;
+    usb_osal_leave_critical_section(flags);
+    return val;
+}
+
+#define usb_log_load(ptr)       (*(volatile uint32_t *)(ptr))
+#define usb_log_store(ptr, val) (*(volatile uint32_t *)(ptr) = (val))
+#define usb_log_fence()
+#define usb_log_lock()          usb_osal_enter_critical_section()
+#define usb_log_unlock(flags)   usb_osal_leave_critical_section(flags)
+#endif
+
+__WEAK uint32_t usb_log_get_timestamp(void)
+{
+    return 0;
+}
+
+__WEAK uint8_t usb_log_get_core_id(void)
+{
+    return 0;
+}
+
+/* Copy %s args into record, strings may be freed or reused before the record is printed */
+static void usb_log_copy_strings(struct usb_log_record *record, const char *fmt)
+{
+    const char *src;
+    uint32_t offset = 0;
+    uint32_t len;
+    uint8_t arg = 0;
+
+    record->str_mask = 0;
+
+    while (*fmt && (arg < record->nargs)) {
+        if (*fmt++ != '%') {
+            continue;
+        }
+        if (*fmt == '%') {
+            fmt++;
+            continue;
+        }
+
+        /* flags, width, precision and length, '*' takes one arg */
+        while (*fmt && !strchr("diouxXcspfFeEgGaAn", *fmt)) {
+            if (*fmt == '*') {
+                arg++;
+            }
+            fmt++;
+        }
+        if (*fmt == '\0') {
+            break;
+        }
+
+        if ((*fmt == 's') && (arg < record->nargs)) {
+            src = (const char *)record->args[arg];
+            if (src == NULL) {
+                src = "(null)";
+            }
+            len = 0;
+            if (offset < sizeof(record->str)) {
+                while (src[len] && (offset + len < sizeof(record->str) - 1)) {
+                    record->str[offset + len] = src[len];
+                    len++;
+                }
+                record->str[offset + len] = '\0';
+                record->args[arg] = offset;
+                offset += len + 1;
+            } else {
+                /* no room, print as empty string */
+                record->args[arg] = sizeof(record->str) - 1;
+            }
+            record->str_mask |= (1 << arg);
+        }
+        arg++;
+        fmt++;
+    }
+}
+
+void usb_log_deferred_write(const char *tag, char level, const char *fmt, const uintptr_t *args, uint8_t nargs)
+{
+    struct usb_log_ring *ring = &g_usb_log_ring[usb_log_get_core_id() % CONFIG_USB_LOG_DEFERRED_CORES];
+    struct usb_log_record *record;
+    uint32_t index;
+    size_t flags;
+
+    /* writers on the same core (thread and nested irqs) only race for the slot index */
+    index = usb_log_fetch_add(&ring->head);
+    record = &ring->records[index & (CONFIG_USB_LOG_DEFERRED_DEPTH - 1)];
+
+    flags = usb_log_lock();
+    usb_log_store(&record->seq, 0);
+    usb_log_fence();
+
+    record->timestamp = usb_log_get_timestamp();
+    record->tag = tag;
+    record->fmt = fmt;
+    record->level = level;
+    record->nargs = MIN(nargs, USB_LOG_DEFERRED_MAX_ARGS);
+    memcpy(record->args, args, record->nargs * sizeof(uintptr_t));
+    usb_log_copy_strings(record, fmt);
+
+    usb_log_store(&record->seq, index + 1);
+    usb_log_unlock(flags);
+}
+
+/* Read one record of core, return 1 if got one, 0 if ring is empty. Only one reader per core. */
+int usb_log_deferred_read(uint8_t core, struct usb_log_record *record)
+{
+    struct usb_log_ring *ring = &g_usb_log_ring[core % CONFIG_USB_LOG_DEFERRED_CORES];
+    struct usb_log_record *slot;
+    uint32_t head;
+    uint32_t seq;
+    size_t flags;
+
+    for (;;) {
+        head = usb_log_load(&ring->head);
+        if (ring->tail == head) {
+            return 0;
+        }
+
+        /* writers have lapped us, oldest records are gone */
+        if ((head - ring->tail) > CONFIG_USB_LOG_DEFERRED_DEPTH) {
+            ring->dropped += head - ring->tail - CONFIG_USB_LOG_DEFERRED_DEPTH;
+            ring->tail = head - CONFIG_USB_LOG_DEFERRED_DEPTH;
+        }
+
+        slot = &ring->records[ring->tail & (CONFIG_USB_LOG_DEFERRED_DEPTH - 1)];
+
+        flags = usb_log_lock();
+        seq = usb_log_load(&slot->seq);
+        if (seq == (ring->tail + 1)) {
+            memcpy(record, slot, sizeof(struct usb_log_record));
+            usb_log_fence();
+            /* slot is reused while copying */
+            if (usb_log_load(&slot->seq) != seq) {
+                seq = 0xffffffff;
+            }
+        }
+        usb_log_unlock(flags);
+
+        if (seq == (ring->tail + 1)) {
+            ring->tail++;
+            return 1;
+        } else if ((seq == 0) || ((int32_t)(seq - (ring->tail + 1)) < 0)) {
+            /* writer has got the slot but not finished yet */
+            return 0;
+        } else {
+            ring->dropped++;
+            ring->tail++;
+        }
+    }
+}
+
+void usb_log_deferred_print(const struct usb_log_record *record)
+{
+    const uintptr_t *a = record->args;
+    uintptr_t args[USB_LOG_DEFERRED_MAX_ARGS] = { 0 };
+
+    memcpy(args, a, record->nargs * sizeof(uintptr_t));
+    for (uint8_t i = 0; i < record->nargs; i++) {
+        if (record->str_mask & (1 << i)) {
+            args[i] = (uintptr_t)&record->str[args[i]];
+        }
+    }
+
+#ifdef CONFIG_USB_PRINTF_COLOR_ENABLE
+    switch (record->level) {
+        case 'E':
+            CONFIG_USB_PRINTF("\033[31m");
+            break;
+        case 'W':
+            CONFIG_USB_PRINTF("\033[33m");
+            break;
+        case 'I':
+            CONFIG_USB_PRINTF("\033[32m");
+            break;
+        default:
+            CONFIG_USB_PRINTF("\033[0m");
+            break;
+    }
+#endif
+    CONFIG_USB_PRINTF("[%u][%c/%s] ", (unsigned int)record->timestamp, record->level, record->tag);
+    CONFIG_USB_PRINTF(record->fmt, args[0], args[1], args[2], args[3], args[4], args[5],
+                      args[6], args[7], args[8], args[9], args[10], args[11]);
+#ifdef CONFIG_USB_PRINTF_COLOR_ENABLE
+    CONFIG_USB_PRINTF("\033[0m");
+#endif
+}
+
+/* Decode and print all pending records, call it from a low priority thread or idle loop */
+void usb_log_deferred_flush(void)
+{
+    struct usb_log_record record;
+    uint32_t dropped;
+
+    for (uint8_t core = 0; core < CONFIG_USB_LOG_DEFERRED_CORES; core++) {
+        dropped = g_usb_log_ring[core].dropped;
+
+        while (usb_log_deferred_read(core, &record)) {
+            if (g_usb_log_ring[core].dropped != dropped) {
+                CONFIG_USB_PRINTF("[usb log] core %u dropped %u records\r\n", (unsigned int)core, (unsigned int)(g_usb_log_ring[core].dropped - dropped));
+                dropped = g_usb_log_ring[core].dropped;
+            }
+            usb_log_deferred_print(&record);
+        }
+    }
+}
+
+uint32_t usb_log_deferred_get_dropped(uint8_t core)
+{
+    return g_usb_log_ring[core % CONFIG_USB_LOG_DEFERRED_CORES].dropped;
+}
+
+#endif
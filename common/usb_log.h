@@ -42,12 +42,92 @@
 #define _USB_DBG_LOG_X_END
 #endif
 
+#ifdef CONFIG_USB_LOG_DEFERRED
+#include <stdint.h>
+
+/*
+ * Deferred log: call site only stores format pointer, timestamp and raw args into a
+ * per-core ring, formatting is done later by usb_log_deferred_flush() in a low priority
+ * thread, or records are read out by usb_log_deferred_read() and decoded on host side.
+ * Format must be a constant string, %s args are copied into the record because they may be
+ * freed before flush, CONFIG_USB_LOG_DEFERRED_STR_SIZE bytes in total, longer ones are truncated.
+ * At most 12 args of word size.
+ */
+#ifndef CONFIG_USB_LOG_DEFERRED_DEPTH
+#define CONFIG_USB_LOG_DEFERRED_DEPTH 64
+#endif
+
+#ifndef CONFIG_USB_LOG_DEFERRED_CORES
+#define CONFIG_USB_LOG_DEFERRED_CORES 1
+#endif
+
+#ifndef CONFIG_USB_LOG_DEFERRED_STR_SIZE
+#define CONFIG_USB_LOG_DEFERRED_STR_SIZE 32
+#endif
+
+#define USB_LOG_DEFERRED_MAX_ARGS 12
+
+struct usb_log_record {
+    uint32_t seq; /* write index + 1, 0 when record is being written */
+    uint32_t timestamp;
+    const char *tag;
+    const char *fmt;
+    char level;
+    uint8_t nargs;
+    uint16_t str_mask; /* args that are offsets into str instead of values */
+    uintptr_t args[USB_LOG_DEFERRED_MAX_ARGS];
+    char str[CONFIG_USB_LOG_DEFERRED_STR_SIZE];
+};
+
+#define _USB_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, n, ...) n
+#define _USB_LOG_NARGS(...) _USB_LOG_NARGS_(0, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _USB_LOG_A0()
+#define _USB_LOG_A1(a)      (uintptr_t)(a)
+#define _USB_LOG_A2(a, ...) (uintptr_t)(a), _USB_LOG_A1(__VA_ARGS__)
+#define _USB_LOG_A3(a, ...) (uintptr_t)(a), _USB_LOG_A2(__VA_ARGS__)
+#define _USB_LOG_A4(a, ...) (uintptr_t)(a), _USB_LOG_A3(__VA_ARGS__)
+#define _USB_LOG_A5(a, ...) (uintptr_t)(a), _USB_LOG_A4(__VA_ARGS__)
+#define _USB_LOG_A6(a, ...) (uintptr_t)(a), _USB_LOG_A5(__VA_ARGS__)
+#define _USB_LOG_A7(a, ...) (uintptr_t)(a), _USB_LOG_A6(__VA_ARGS__)
+#define _USB_LOG_A8(a, ...) (uintptr_t)(a), _USB_LOG_A7(__VA_ARGS__)
+#define _USB_LOG_A9(a, ...)  (uintptr_t)(a), _USB_LOG_A8(__VA_ARGS__)
+#define _USB_LOG_A10(a, ...) (uintptr_t)(a), _USB_LOG_A9(__VA_ARGS__)
+#define _USB_LOG_A11(a, ...) (uintptr_t)(a), _USB_LOG_A10(__VA_ARGS__)
+#define _USB_LOG_A12(a, ...) (uintptr_t)(a), _USB_LOG_A11(__VA_ARGS__)
+#define _USB_LOG_CAT_(a, b) a##b
+#define _USB_LOG_CAT(a, b)  _USB_LOG_CAT_(a, b)
+#define _USB_LOG_ARGS(n, ...) _USB_LOG_CAT(_USB_LOG_A, n)(__VA_ARGS__)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_log_deferred_write(const char *tag, char level, const char *fmt, const uintptr_t *args, uint8_t nargs);
+int usb_log_deferred_read(uint8_t core, struct usb_log_record *record);
+void usb_log_deferred_print(const struct usb_log_record *record);
+void usb_log_deferred_flush(void);
+uint32_t usb_log_deferred_get_dropped(uint8_t core);
+
+uint32_t usb_log_get_timestamp(void);
+uint8_t usb_log_get_core_id(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define usb_dbg_log_line(lvl, color_n, fmt, ...)                                                           \
+    do {                                                                                                   \
+        const uintptr_t __usb_log_args[] = { 0, _USB_LOG_ARGS(_USB_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__) }; \
+        usb_log_deferred_write(USB_DBG_TAG, lvl[0], fmt, &__usb_log_args[1], _USB_LOG_NARGS(__VA_ARGS__));  \
+    } while (0)
+#else
 #define usb_dbg_log_line(lvl, color_n, fmt, ...) \
     do {                                         \
         _USB_DBG_LOG_HDR(lvl, color_n);          \
         CONFIG_USB_PRINTF(fmt, ##__VA_ARGS__);              \
         _USB_DBG_LOG_X_END;                      \
     } while (0)
+#endif
 
 #if (CONFIG_USB_DBG_LEVEL >= USB_DBG_LOG)
 #define USB_LOG_DBG(fmt, ...) usb_dbg_log_line("D", 0, fmt, ##__VA_ARGS__)
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2024, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <string.h>
+#include "usb_config.h"
+#include "usb_util.h"
+#include "usb_errno.h"
+#include "usb_log.h"
+#include "usb_osal.h"
+#include "usb_trace.h"
+
+#ifdef CONFIG_USB_TRACE
+
+struct usb_trace_ep {
+    uint8_t used;
+    uint8_t role;
+    uint8_t busid;
+    uint8_t addr; /* device address in host mode, 0 in device mode */
+    uint8_t ep;
+    uint32_t xfers;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t naks;
+    uint32_t pending_ts;
+    bool pending; /* pending_ts is set, not every port records a submit */
+    uint32_t first_ts;
+    uint32_t last_ts;
+    uint32_t hist[USB_TRACE_HIST_BUCKETS];
+};
+
+struct usb_trace_irq {
+    uint32_t count;
+    uint32_t max;
+    uint32_t hist[USB_TRACE_HIST_BUCKETS];
+};
+
+struct usb_trace_event {
+    uint32_t ts;
+    uint8_t type;
+    uint8_t role;
+    uint8_t busid;
+    uint8_t addr;
+    uint8_t ep;
+    uint32_t value;
+};
+
+static struct usb_trace_ep g_usb_trace_ep[CONFIG_USB_TRACE_MAX_EPS];
+static struct usb_trace_irq g_usb_trace_irq[2][CONFIG_USB_TRACE_MAX_BUS];
+static struct usb_trace_event g_usb_trace_event[CONFIG_USB_TRACE_DEPTH];
+static uint32_t g_usb_trace_event_index;
+
+__WEAK uint32_t usb_trace_get_timestamp(void)
+{
+    return 0;
+}
+
+static inline uint8_t usb_trace_bucket(uint32_t delta)
+{
+    uint8_t n = 0;
+
+    while ((delta >>= 1) && (n < (USB_TRACE_HIST_BUCKETS - 1))) {
+        n++;
+    }
+    return n;
+}
+
+/* must be called with critical section held */
+static void usb_trace_record(uint32_t ts, uint8_t type, uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, uint32_t value)
+{
+    struct usb_trace_event *event;
+
+    event = &g_usb_trace_event[g_usb_trace_event_index % CONFIG_USB_TRACE_DEPTH];
+    g_usb_trace_event_index++;
+
+    event->ts = ts;
+    event->type = type;
+    event->role = role;
+    event->busid = busid;
+    event->addr = addr;
+    event->ep = ep;
+    event->value = value;
+}
+
+/* must be called with critical section held */
+static struct usb_trace_ep *usb_trace_find_ep(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep)
+{
+    struct usb_trace_ep *free = NULL;
+
+    for (uint8_t i = 0; i < CONFIG_USB_TRACE_MAX_EPS; i++) {
+        if (!g_usb_trace_ep[i].used) {
+            if (free == NULL) {
+                free = &g_usb_trace_ep[i];
+            }
+            continue;
+        }
+        if ((g_usb_trace_ep[i].role == role) && (g_usb_trace_ep[i].busid == busid) &&
+            (g_usb_trace_ep[i].addr == addr) && (g_usb_trace_ep[i].ep == ep)) {
+            return &g_usb_trace_ep[i];
+        }
+    }
+
+    if (free) {
+        memset(free, 0, sizeof(struct usb_trace_ep));
+        free->used = 1;
+        free->role = role;
+        free->busid = busid;
+        free->addr = addr;
+        free->ep = ep;
+    }
+    return free;
+}
+
+uint32_t usb_trace_submit(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, uint32_t len)
+{
+    struct usb_trace_ep *trace;
+    uint32_t ts;
+    size_t flags;
+
+    ts = usb_trace_get_timestamp();
+
+    flags = usb_osal_enter_critical_section();
+    trace = usb_trace_find_ep(role, busid, addr, ep);
+    if (trace) {
+        trace->pending_ts = ts;
+        trace->pending = true;
+    }
+    usb_trace_record(ts, USB_TRACE_EVENT_SUBMIT, role, busid, addr, ep, len);
+    usb_osal_leave_critical_section(flags);
+
+    return ts;
+}
+
+static void usb_trace_complete_ep(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, int ret, uint32_t submit_ts, bool use_pending)
+{
+    struct usb_trace_ep *trace;
+    uint32_t ts;
+    size_t flags;
+    bool has_submit = true;
+
+    ts = usb_trace_get_timestamp();
+
+    flags = usb_osal_enter_critical_section();
+    trace = usb_trace_find_ep(role, busid, addr, ep);
+    if (trace) {
+        if (use_pending) {
+            submit_ts = trace->pending_ts;
+            has_submit = trace->pending;
+            trace->pending = false;
+        }
+
+        if (ret < 0) {
+            if (ret == -USB_ERR_NAK) {
+                trace->naks++;
+            } else {
+                trace->errors++;
+            }
+        } else {
+            if (trace->xfers == 0) {
+                trace->first_ts = has_submit ? submit_ts : ts;
+            }
+            trace->xfers++;
+            trace->bytes += ret;
+            trace->last_ts = ts;
+            /* no latency without a submit timestamp */
+            if (has_submit) {
+                trace->hist[usb_trace_bucket(ts - submit_ts)]++;
+            }
+        }
+    }
+    usb_trace_record(ts, (ret < 0) ? USB_TRACE_EVENT_ERROR : USB_TRACE_EVENT_COMPLETE, role, busid, addr, ep, (uint32_t)ret);
+    usb_osal_leave_critical_section(flags);
+}
+
+/* Complete a transfer started by usb_trace_submit, only one transfer in flight per endpoint */
+void usb_trace_complete(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, int ret)
+{
+    usb_trace_complete_ep(role, busid, addr, ep, ret, 0, true);
+}
+
+/* Complete a transfer with its own submit timestamp, for endpoints that have many urbs in flight */
+void usb_trace_complete_since(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, int ret, uint32_t submit_ts)
+{
+    usb_trace_complete_ep(role, busid, addr, ep, ret, submit_ts, false);
+}
+
+void usb_trace_irq(uint8_t role, uint8_t busid, uint32_t enter_ts)
+{
+    struct usb_trace_irq *irq;
+    uint32_t ts;
+    uint32_t delta;
+    size_t flags;
+
+    if (busid >= CONFIG_USB_TRACE_MAX_BUS) {
+        return;
+    }
+
+    ts = usb_trace_get_timestamp();
+    delta = ts - enter_ts;
+    irq = &g_usb_trace_irq[role & 0x01][busid];
+
+    flags = usb_osal_enter_critical_section();
+    irq->count++;
+    if (delta > irq->max) {
+        irq->max = delta;
+    }
+    irq->hist[usb_trace_bucket(delta)]++;
+    usb_trace_record(enter_ts, USB_TRACE_EVENT_IRQ, role, busid, 0, 0, delta);
+    usb_osal_leave_critical_section(flags);
+}
+
+static const char *usb_trace_role_str(uint8_t role)
+{
+    return (role == USB_TRACE_HOST) ? "host" : "device";
+}
+
+static void usb_trace_dump_hist(const uint32_t *hist, bool csv)
+{
+    for (uint8_t i = 0; i < USB_TRACE_HIST_BUCKETS; i++) {
+        if (csv) {
+            USB_LOG_RAW(",%u", (unsigned int)hist[i]);
+        } else if (hist[i] && (i == (USB_TRACE_HIST_BUCKETS - 1))) {
+            USB_LOG_RAW("    >=%-9u: %u\r\n", (unsigned int)(1UL << i), (unsigned int)hist[i]);
+        } else if (hist[i]) {
+            USB_LOG_RAW("    <%-10u: %u\r\n", (unsigned int)(2UL << i), (unsigned int)hist[i]);
+        }
+    }
+    if (csv) {
+        USB_LOG_RAW("\r\n");
+    }
+}
+
+/*
+ * Print counters, histograms and the event ring. csv format is for tools/usb_trace/usb_trace_plot.py:
+ *   ep,role,busid,addr,ep,xfers,bytes,errors,naks,bytes_per_sec,hist0..hist15
+ *   irq,role,busid,count,max,hist0..hist15
+ *   ev,ts,type,role,busid,addr,ep,value
+ */
+void usb_trace_dump(bool csv)
+{
+    struct usb_trace_ep trace;
+    struct usb_trace_irq irq;
+    struct usb_trace_event event;
+    uint32_t index;
+    uint32_t count;
+    uint64_t bps;
+    size_t flags;
+
+    if (csv) {
+        USB_LOG_RAW("# usb_trace v1 hz=%u buckets=%u\r\n", (unsigned int)CONFIG_USB_TRACE_TIMESTAMP_HZ, USB_TRACE_HIST_BUCKETS);
+    }
+
+    for (uint8_t i = 0; i < CONFIG_USB_TRACE_MAX_EPS; i++) {
+        flags = usb_osal_enter_critical_section();
+        memcpy(&trace, &g_usb_trace_ep[i], sizeof(struct usb_trace_ep));
+        usb_osal_leave_critical_section(flags);
+
+        if (!trace.used) {
+            continue;
+        }
+
+        bps = 0;
+        if (trace.last_ts != trace.first_ts) {
+            bps = (uint64_t)trace.bytes * CONFIG_USB_TRACE_TIMESTAMP_HZ / (uint32_t)(trace.last_ts - trace.first_ts);
+        }
+
+        if (csv) {
+            USB_LOG_RAW("ep,%s,%u,%u,0x%02x,%u,%u,%u,%u,%u", usb_trace_role_str(trace.role), trace.busid, trace.addr, trace.ep,
+                        (unsigned int)trace.xfers, (unsigned int)trace.bytes, (unsigned int)trace.errors,
+                        (unsigned int)trace.naks, (unsigned int)bps);
+        } else {
+            USB_LOG_RAW("%s bus %u addr %u ep 0x%02x: xfers %u, bytes %u, errors %u, naks %u, %u bytes/s\r\n",
+                        usb_trace_role_str(trace.role), trace.busid, trace.addr, trace.ep,
+                        (unsigned int)trace.xfers, (unsigned int)trace.bytes, (unsigned int)trace.errors,
+                        (unsigned int)trace.naks, (unsigned int)bps);
+        }
+        usb_trace_dump_hist(trace.hist, csv);
+    }
+
+    for (uint8_t role = 0; role < 2; role++) {
+        for (uint8_t busid = 0; busid < CONFIG_USB_TRACE_MAX_BUS; busid++) {
+            flags = usb_osal_enter_critical_section();
+            memcpy(&irq, &g_usb_trace_irq[role][busid], sizeof(struct usb_trace_irq));
+            usb_osal_leave_critical_section(flags);
+
+            if (irq.count == 0) {
+                continue;
+            }
+
+            if (csv) {
+                USB_LOG_RAW("irq,%s,%u,%u,%u", usb_trace_role_str(role), busid, (unsigned int)irq.count, (unsigned int)irq.max);
+            } else {
+                USB_LOG_RAW("%s bus %u irq: count %u, max %u ticks\r\n", usb_trace_role_str(role), busid,
+                            (unsigned int)irq.count, (unsigned int)irq.max);
+            }
+            usb_trace_dump_hist(irq.hist, csv);
+        }
+    }
+
+    if (!csv) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    index = g_usb_trace_event_index;
+    usb_osal_leave_critical_section(flags);
+
+    count = MIN(index, CONFIG_USB_TRACE_DEPTH);
+    for (uint32_t i = index - count; i != index; i++) {
+        flags = usb_osal_enter_critical_section();
+        memcpy(&event, &g_usb_trace_event[i % CONFIG_USB_TRACE_DEPTH], sizeof(struct usb_trace_event));
+        usb_osal_leave_critical_section(flags);
+
+        USB_LOG_RAW("ev,%u,%u,%s,%u,%u,0x%02x,%d\r\n", (unsigned int)event.ts, event.type, usb_trace_role_str(event.role),
+                    event.busid, event.addr, event.ep, (int)event.value);
+    }
+}
+
+void usb_trace_reset(void)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    memset(g_usb_trace_ep, 0, sizeof(g_usb_trace_ep));
+    memset(g_usb_trace_irq, 0, sizeof(g_usb_trace_irq));
+    g_usb_trace_event_index = 0;
+    usb_osal_leave_critical_section(flags);
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USB_TRACE_H
+#define USB_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define USB_TRACE_DEVICE          0
+#define USB_TRACE_HOST            1
+
+#define USB_TRACE_EVENT_SUBMIT    0
+#define USB_TRACE_EVENT_COMPLETE  1
+#define USB_TRACE_EVENT_ERROR     2
+#define USB_TRACE_EVENT_IRQ       3
+
+/* bucket n counts latency in [2^n, 2^(n+1)) timestamp ticks, last one takes all above */
+#define USB_TRACE_HIST_BUCKETS    16
+
+#ifdef CONFIG_USB_TRACE
+
+#ifndef CONFIG_USB_TRACE_MAX_EPS
+#define CONFIG_USB_TRACE_MAX_EPS 32
+#endif
+
+/* irq statistics are kept for bus 0 ~ CONFIG_USB_TRACE_MAX_BUS-1 of each role */
+#ifndef CONFIG_USB_TRACE_MAX_BUS
+#define CONFIG_USB_TRACE_MAX_BUS 2
+#endif
+
+#ifndef CONFIG_USB_TRACE_DEPTH
+#define CONFIG_USB_TRACE_DEPTH 128
+#endif
+
+#ifndef CONFIG_USB_TRACE_TIMESTAMP_HZ
+#define CONFIG_USB_TRACE_TIMESTAMP_HZ 1000000
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t usb_trace_get_timestamp(void);
+
+uint32_t usb_trace_submit(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, uint32_t len);
+void usb_trace_complete(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, int ret);
+void usb_trace_complete_since(uint8_t role, uint8_t busid, uint8_t addr, uint8_t ep, int ret, uint32_t submit_ts);
+void usb_trace_irq(uint8_t role, uint8_t busid, uint32_t enter_ts);
+
+void usb_trace_dump(bool csv);
+void usb_trace_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define USB_TRACE_IRQ_ENTER()            uint32_t __usb_trace_irq_ts = usb_trace_get_timestamp()
+#define USB_TRACE_IRQ_EXIT(role, busid)  usb_trace_irq(role, busid, __usb_trace_irq_ts)
+#define USB_TRACE_EP_SUBMIT(role, busid, addr, ep, len) usb_trace_submit(role, busid, addr, ep, len)
+#define USB_TRACE_EP_COMPLETE(role, busid, addr, ep, ret) usb_trace_complete(role, busid, addr, ep, ret)
+#else
+#define USB_TRACE_IRQ_ENTER()
+#define USB_TRACE_IRQ_EXIT(role, busid)
+#define USB_TRACE_EP_SUBMIT(role, busid, addr, ep, len)
+#define USB_TRACE_EP_COMPLETE(role, busid, addr, ep, ret)
+#endif
+
+#endif /* USB_TRACE_H */
@@ -4,8 +4,10 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "usbd_core.h"
-#ifdef CONFIG_USBDEV_EP0_THREAD
+#if defined(CONFIG_USBDEV_EP0_THREAD) || defined(CONFIG_USBDEV_EP_THREAD)
 #include "usb_osal.h"
+#endif
+#ifdef CONFIG_USBDEV_EP0_THREAD
 
 #define USB_EP0_STATE_SETUP 0
 #define USB_EP0_STATE_IN    1
@@ -32,6 +34,9 @@
 struct usbd_tx_rx_msg {
     uint8_t ep;
     uint8_t ep_mult;
+#ifdef CONFIG_USBDEV_EP_THREAD
+    uint8_t dispatch;
+#endif
     uint16_t ep_mps;
     uint32_t nbytes;
     usbd_endpoint_callback cb;
@@ -68,6 +73,7 @@ USB_NOCACHE_RAM_SECTION struct usbd_core_priv {
     bool remote_wakeup_support;
     bool remote_wakeup_enabled;
     bool is_suspend;
+    bool stopped; /* controller is deinitialized by usbd_controller_stop */
 #ifdef CONFIG_USBDEV_ADVANCE_DESC
     uint8_t speed;
 #endif
@@ -90,6 +96,111 @@ USB_NOCACHE_RAM_SECTION struct usbd_core_priv {
 
 struct usbd_bus g_usbdev_bus[CONFIG_USBDEV_MAX_BUS];
 
+#ifndef CONFIG_USBDEV_DESC_INDEX_CONFIGS
+#define CONFIG_USBDEV_DESC_INDEX_CONFIGS 2
+#endif
+
+#ifndef CONFIG_USBDEV_DESC_INDEX_STRINGS
+#define CONFIG_USBDEV_DESC_INDEX_STRINGS 16
+#endif
+
+#ifndef CONFIG_USBDEV_DESC_INDEX_ALTS
+#define CONFIG_USBDEV_DESC_INDEX_ALTS 32
+#endif
+
+#ifndef CONFIG_USBDEV_DESC_INDEX_EPS
+#define CONFIG_USBDEV_DESC_INDEX_EPS 32
+#endif
+
+#define USBD_ANY_INTERFACE 0xff
+
+struct usbd_alt_index {
+    const uint8_t *intf_desc;
+    uint8_t iface;
+    uint8_t alt_setting;
+    uint8_t ep_start; /* first endpoint in usbd_desc_index.ep */
+    uint8_t ep_num;
+};
+
+/* Descriptor pointers resolved once, so ep0 requests do not parse the descriptor list */
+struct usbd_desc_index {
+#ifndef CONFIG_USBDEV_ADVANCE_DESC
+    const uint8_t *device;
+    const uint8_t *config[CONFIG_USBDEV_DESC_INDEX_CONFIGS];
+    const uint8_t *string[CONFIG_USBDEV_DESC_INDEX_STRINGS];
+#ifdef CONFIG_USB_HS
+    const uint8_t *qualifier;
+    const uint8_t *other_speed[CONFIG_USBDEV_DESC_INDEX_CONFIGS];
+    uint16_t other_speed_num;
+#endif
+    /* number in descriptor list, may be larger than table size */
+    uint16_t config_num;
+    uint16_t string_num;
+#endif
+    /** Active configuration descriptor */
+    const uint8_t *config_desc;
+    /** alt and ep tables cover config_desc, false when they are too small */
+    bool alt_valid;
+    uint8_t alt_num;
+    struct usbd_alt_index alt[CONFIG_USBDEV_DESC_INDEX_ALTS];
+    const struct usb_endpoint_descriptor *ep[CONFIG_USBDEV_DESC_INDEX_EPS];
+};
+
+static struct usbd_desc_index g_usbd_desc_index[CONFIG_USBDEV_MAX_BUS];
+
+#ifdef CONFIG_USBDEV_EP_THREAD
+#ifndef CONFIG_USBDEV_EP_PRIO
+#define CONFIG_USBDEV_EP_PRIO 4
+#endif
+
+#ifndef CONFIG_USBDEV_EP_STACKSIZE
+#define CONFIG_USBDEV_EP_STACKSIZE 2048
+#endif
+
+#ifndef CONFIG_USBDEV_EP_QUEUE_DEPTH
+#define CONFIG_USBDEV_EP_QUEUE_DEPTH 32
+#endif
+
+#if (CONFIG_USBDEV_EP_QUEUE_DEPTH & (CONFIG_USBDEV_EP_QUEUE_DEPTH - 1)) != 0
+#error CONFIG_USBDEV_EP_QUEUE_DEPTH must be a power of 2
+#endif
+
+/* every ep direction has one transfer in flight, so the queue never fills */
+#if CONFIG_USBDEV_EP_QUEUE_DEPTH < (2 * CONFIG_USBDEV_EP_NUM)
+#error CONFIG_USBDEV_EP_QUEUE_DEPTH must be at least 2 * CONFIG_USBDEV_EP_NUM
+#endif
+
+#if defined(__GNUC__)
+#define usbd_ep_queue_load(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define usbd_ep_queue_store(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define usbd_ep_queue_fence()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+/* irq and ep thread are expected on the same core */
+#define usbd_ep_queue_load(ptr)       (*(volatile uint32_t *)(ptr))
+#define usbd_ep_queue_store(ptr, val) (*(volatile uint32_t *)(ptr) = (val))
+#define usbd_ep_queue_fence()
+#endif
+
+struct usbd_ep_event {
+    uint32_t nbytes;
+    uint8_t ep;
+    uint8_t gen;
+};
+
+/* Completions queued by irq (single producer) for the ep thread (single consumer) */
+struct usbd_ep_thread_priv {
+    struct usbd_ep_event queue[CONFIG_USBDEV_EP_QUEUE_DEPTH];
+    uint32_t head;
+    uint32_t tail;
+    volatile bool wakeup;
+    volatile uint8_t gen; /* changed on bus reset to drop queued completions */
+    usb_osal_sem_t sem;
+    usb_osal_thread_t thread;
+};
+
+static struct usbd_ep_thread_priv g_usbd_ep_thread[CONFIG_USBDEV_MAX_BUS];
+#endif
+
 static void usbd_class_event_notify_handler(uint8_t busid, uint8_t event, void *arg);
 
 static void usbd_print_setup(struct usb_setup_packet *setup)
@@ -295,13 +406,122 @@ static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **da
     return found;
 }
 #else
+/* Nth descriptor of a type in the raw descriptor list */
+static const uint8_t *usbd_desc_scan(uint8_t busid, uint8_t type, uint8_t index)
+{
+    const uint8_t *p = g_usbd_core[busid].descriptors;
+    uint32_t cur_index = 0U;
+
+    while (p[DESC_bLength] != 0U) {
+        if (p[DESC_bDescriptorType] == type) {
+            if (cur_index == index) {
+                return p;
+            }
+
+            cur_index++;
+        }
+
+        /* skip to next descriptor */
+        p += p[DESC_bLength];
+    }
+
+    return NULL;
+}
+
+static void usbd_desc_index_slot(const uint8_t **table, uint16_t *num, uint8_t size, const uint8_t *p)
+{
+    if (*num < size) {
+        table[*num] = p;
+    }
+    (*num)++;
+}
+
+static void usbd_desc_index_build(uint8_t busid)
+{
+    struct usbd_desc_index *index = &g_usbd_desc_index[busid];
+    const uint8_t *p = g_usbd_core[busid].descriptors;
+
+    memset(index, 0, sizeof(struct usbd_desc_index));
+
+    while (p[DESC_bLength] != 0U) {
+        switch (p[DESC_bDescriptorType]) {
+            case USB_DESCRIPTOR_TYPE_DEVICE:
+                if (index->device == NULL) {
+                    index->device = p;
+                }
+                break;
+            case USB_DESCRIPTOR_TYPE_CONFIGURATION:
+                usbd_desc_index_slot(index->config, &index->config_num, CONFIG_USBDEV_DESC_INDEX_CONFIGS, p);
+                break;
+            case USB_DESCRIPTOR_TYPE_STRING:
+                usbd_desc_index_slot(index->string, &index->string_num, CONFIG_USBDEV_DESC_INDEX_STRINGS, p);
+                break;
+#ifdef CONFIG_USB_HS
+            case USB_DESCRIPTOR_TYPE_DEVICE_QUALIFIER:
+                if (index->qualifier == NULL) {
+                    index->qualifier = p;
+                }
+                break;
+            case USB_DESCRIPTOR_TYPE_OTHER_SPEED:
+                usbd_desc_index_slot(index->other_speed, &index->other_speed_num, CONFIG_USBDEV_DESC_INDEX_CONFIGS, p);
+                break;
+#endif
+            default:
+                break;
+        }
+
+        /* skip to next descriptor */
+        p += p[DESC_bLength];
+    }
+}
+
+static const uint8_t *usbd_desc_index_find(uint8_t busid, uint8_t type, uint8_t index)
+{
+    struct usbd_desc_index *desc_index = &g_usbd_desc_index[busid];
+    const uint8_t **table;
+    uint16_t num;
+    uint8_t size;
+
+    switch (type) {
+        case USB_DESCRIPTOR_TYPE_DEVICE:
+            return (index == 0) ? desc_index->device : usbd_desc_scan(busid, type, index);
+        case USB_DESCRIPTOR_TYPE_CONFIGURATION:
+            table = desc_index->config;
+            num = desc_index->config_num;
+            size = CONFIG_USBDEV_DESC_INDEX_CONFIGS;
+            break;
+        case USB_DESCRIPTOR_TYPE_STRING:
+            table = desc_index->string;
+            num = desc_index->string_num;
+            size = CONFIG_USBDEV_DESC_INDEX_STRINGS;
+            break;
+#ifdef CONFIG_USB_HS
+        case USB_DESCRIPTOR_TYPE_DEVICE_QUALIFIER:
+            return (index == 0) ? desc_index->qualifier : usbd_desc_scan(busid, type, index);
+        case USB_DESCRIPTOR_TYPE_OTHER_SPEED:
+            table = desc_index->other_speed;
+            num = desc_index->other_speed_num;
+            size = CONFIG_USBDEV_DESC_INDEX_CONFIGS;
+            break;
+#endif
+        default:
+            return usbd_desc_scan(busid, type, index);
+    }
+
+    if (index >= num) {
+        return NULL;
+    } else if (index < size) {
+        return table[index];
+    } else {
+        return usbd_desc_scan(busid, type, index);
+    }
+}
+
 static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **data, uint32_t *len)
 {
     uint8_t type = 0U;
     uint8_t index = 0U;
     uint8_t *p = NULL;
-    uint32_t cur_index = 0U;
-    bool found = false;
 
     type = HI_BYTE(type_index);
     index = LO_BYTE(type_index);
@@ -339,25 +559,9 @@ static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **da
         return false;
     }
 
-    p = (uint8_t *)g_usbd_core[busid].descriptors;
-
-    cur_index = 0U;
-
-    while (p[DESC_bLength] != 0U) {
-        if (p[DESC_bDescriptorType] == type) {
-            if (cur_index == index) {
-                found = true;
-                break;
-            }
-
-            cur_index++;
-        }
+    p = (uint8_t *)usbd_desc_index_find(busid, type, index);
 
-        /* skip to next descriptor */
-        p += p[DESC_bLength];
-    }
-
-    if (found) {
+    if (p) {
         if ((type == USB_DESCRIPTOR_TYPE_CONFIGURATION) || ((type == USB_DESCRIPTOR_TYPE_OTHER_SPEED))) {
             /* configuration or other speed descriptor is an
              * exception, length is at offset 2 and 3
@@ -378,147 +582,161 @@ static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **da
         USB_LOG_ERR("descriptor <type:0x%02x,index:0x%02x> not found!\r\n", type, index);
     }
 
-    return found;
+    return (p != NULL);
 }
 #endif
 
-/**
- * @brief set USB configuration
- *
- * This function configures the device according to the specified configuration
- * index and alternate setting by parsing the installed USB descriptor list.
- * A configuration index of 0 unconfigures the device.
- *
- * @param [in] busid busid
- * @param [in] config_index Configuration index
- * @param [in] alt_setting  Alternate setting number
- *
- * @return true if successfully configured false if error or unconfigured
- */
-static bool usbd_set_configuration(uint8_t busid, uint8_t config_index, uint8_t alt_setting)
+/* configuration descriptor with the given bConfigurationValue */
+static const uint8_t *usbd_find_configuration(uint8_t busid, uint8_t config_index)
 {
-    uint8_t cur_alt_setting = 0xFF;
-    uint8_t cur_config = 0xFF;
-    bool found = false;
     const uint8_t *p;
-    uint32_t desc_len = 0;
-    uint32_t current_desc_len = 0;
 
 #ifdef CONFIG_USBDEV_ADVANCE_DESC
     p = g_usbd_core[busid].descriptors->config_descriptor_callback(g_usbd_core[busid].speed);
+    if (p && (p[CONF_DESC_bConfigurationValue] == config_index)) {
+        return p;
+    }
 #else
-    p = (uint8_t *)g_usbd_core[busid].descriptors;
+    for (uint16_t i = 0; i < g_usbd_desc_index[busid].config_num; i++) {
+        p = usbd_desc_index_find(busid, USB_DESCRIPTOR_TYPE_CONFIGURATION, i);
+        if (p && (p[CONF_DESC_bConfigurationValue] == config_index)) {
+            return p;
+        }
+    }
 #endif
-    /* configure endpoints for this configuration/altsetting */
-    while (p[DESC_bLength] != 0U) {
-        switch (p[DESC_bDescriptorType]) {
-            case USB_DESCRIPTOR_TYPE_CONFIGURATION:
-                /* remember current configuration index */
-                cur_config = p[CONF_DESC_bConfigurationValue];
-
-                if (cur_config == config_index) {
-                    found = true;
+    return NULL;
+}
 
-                    current_desc_len = 0;
-                    desc_len = (p[CONF_DESC_wTotalLength]) |
-                               (p[CONF_DESC_wTotalLength + 1] << 8);
-                }
+/* index interfaces and endpoints of the active configuration */
+static void usbd_alt_index_build(uint8_t busid, const uint8_t *config)
+{
+    struct usbd_desc_index *index = &g_usbd_desc_index[busid];
+    struct usbd_alt_index *alt = NULL;
+    const uint8_t *p = config;
+    uint32_t desc_len;
+    uint32_t current_desc_len = 0;
+    uint8_t ep_num = 0;
 
-                break;
+    index->config_desc = config;
+    index->alt_valid = false;
+    index->alt_num = 0;
 
-            case USB_DESCRIPTOR_TYPE_INTERFACE:
-                /* remember current alternate setting */
-                cur_alt_setting =
-                    p[INTF_DESC_bAlternateSetting];
-                break;
+    desc_len = (p[CONF_DESC_wTotalLength]) |
+               (p[CONF_DESC_wTotalLength + 1] << 8);
 
-            case USB_DESCRIPTOR_TYPE_ENDPOINT:
-                if ((cur_config != config_index) ||
-                    (cur_alt_setting != alt_setting)) {
-                    break;
-                }
+    while ((current_desc_len < desc_len) && (p[DESC_bLength] != 0U)) {
+        if (p[DESC_bDescriptorType] == USB_DESCRIPTOR_TYPE_INTERFACE) {
+            if (index->alt_num >= CONFIG_USBDEV_DESC_INDEX_ALTS) {
+                USB_LOG_WRN("Too many interfaces, please increase CONFIG_USBDEV_DESC_INDEX_ALTS\r\n");
+                return;
+            }
 
-                found = usbd_set_endpoint(busid, (struct usb_endpoint_descriptor *)p);
-                break;
+            alt = &index->alt[index->alt_num++];
+            alt->intf_desc = p;
+            alt->iface = p[INTF_DESC_bInterfaceNumber];
+            alt->alt_setting = p[INTF_DESC_bAlternateSetting];
+            alt->ep_start = ep_num;
+            alt->ep_num = 0;
+        } else if ((p[DESC_bDescriptorType] == USB_DESCRIPTOR_TYPE_ENDPOINT) && alt) {
+            if (ep_num >= CONFIG_USBDEV_DESC_INDEX_EPS) {
+                USB_LOG_WRN("Too many endpoints, please increase CONFIG_USBDEV_DESC_INDEX_EPS\r\n");
+                return;
+            }
 
-            default:
-                break;
+            index->ep[ep_num++] = (const struct usb_endpoint_descriptor *)p;
+            alt->ep_num++;
         }
 
         /* skip to next descriptor */
-        p += p[DESC_bLength];
         current_desc_len += p[DESC_bLength];
-        if (current_desc_len >= desc_len && desc_len) {
-            break;
-        }
+        p += p[DESC_bLength];
     }
 
-    return found;
+    index->alt_valid = true;
 }
 
-/**
- * @brief set USB interface
- *
- * @param [in] busid busid
- * @param [in] iface Interface index
- * @param [in] alt_setting  Alternate setting number
- *
- * @return true if successfully configured false if error or unconfigured
+/*
+ * Open the endpoints of alt_setting, or close the endpoints only used by
+ * other alt settings when switching back to alt setting 0. Endpoints of
+ * alt setting 0 stay open from set configuration.
  */
-static bool usbd_set_interface(uint8_t busid, uint8_t iface, uint8_t alt_setting)
+static bool usbd_alt_endpoint(uint8_t busid, uint8_t cur_alt_setting, const struct usb_endpoint_descriptor *ep_desc,
+                              uint8_t alt_setting, bool open, uint32_t *ep_mask)
 {
-    const uint8_t *if_desc = NULL;
-    struct usb_endpoint_descriptor *ep_desc;
-    uint8_t cur_alt_setting = 0xFF;
-    uint8_t cur_iface = 0xFF;
-    bool ret = false;
+    uint32_t ep_bit = 1UL << ((ep_desc->bEndpointAddress & 0x0f) + ((ep_desc->bEndpointAddress & 0x80) ? 16 : 0));
+
+    if (open) {
+        return (cur_alt_setting == alt_setting) ? usbd_set_endpoint(busid, ep_desc) : true;
+    }
+
+    if ((cur_alt_setting == 0) || (*ep_mask & ep_bit)) {
+        *ep_mask |= ep_bit;
+        return true;
+    }
+
+    *ep_mask |= ep_bit;
+    return usbd_reset_endpoint(busid, ep_desc);
+}
+
+/* apply alt_setting to iface, or to every interface with USBD_ANY_INTERFACE */
+static bool usbd_alt_endpoints(uint8_t busid, uint8_t iface, uint8_t alt_setting, bool open, const uint8_t **if_desc)
+{
+    struct usbd_desc_index *index = &g_usbd_desc_index[busid];
+    const uint8_t *intf_desc = NULL;
     const uint8_t *p;
-    uint32_t desc_len = 0;
+    uint32_t ep_mask = 0;
+    uint32_t desc_len;
     uint32_t current_desc_len = 0;
+    bool ret = true;
 
-#ifdef CONFIG_USBDEV_ADVANCE_DESC
-    p = g_usbd_core[busid].descriptors->config_descriptor_callback(g_usbd_core[busid].speed);
-#else
-    p = (uint8_t *)g_usbd_core[busid].descriptors;
-#endif
-    USB_LOG_DBG("iface %u alt_setting %u\r\n", iface, alt_setting);
+    if (index->config_desc == NULL) {
+        return false;
+    }
 
-    while (p[DESC_bLength] != 0U) {
-        switch (p[DESC_bDescriptorType]) {
-            case USB_DESCRIPTOR_TYPE_CONFIGURATION:
-                current_desc_len = 0;
-                desc_len = (p[CONF_DESC_wTotalLength]) |
-                           (p[CONF_DESC_wTotalLength + 1] << 8);
+    if (index->alt_valid) {
+        for (uint8_t i = 0; i < index->alt_num; i++) {
+            struct usbd_alt_index *alt = &index->alt[i];
 
-                break;
+            if ((iface != USBD_ANY_INTERFACE) && (alt->iface != iface)) {
+                continue;
+            }
 
-            case USB_DESCRIPTOR_TYPE_INTERFACE:
-                /* remember current alternate setting */
-                cur_alt_setting = p[INTF_DESC_bAlternateSetting];
-                cur_iface = p[INTF_DESC_bInterfaceNumber];
+            if ((alt->alt_setting == alt_setting) && if_desc) {
+                *if_desc = alt->intf_desc;
+            }
 
-                if (cur_iface == iface &&
-                    cur_alt_setting == alt_setting) {
-                    if_desc = (void *)p;
+            for (uint8_t j = 0; j < alt->ep_num; j++) {
+                if (!usbd_alt_endpoint(busid, alt->alt_setting, index->ep[alt->ep_start + j], alt_setting, open, &ep_mask)) {
+                    ret = false;
                 }
+            }
+        }
+        return ret;
+    }
 
-                USB_LOG_DBG("Current iface %u alt setting %u",
-                            cur_iface, cur_alt_setting);
+    /* index overflowed, parse the active configuration */
+    p = index->config_desc;
+    desc_len = (p[CONF_DESC_wTotalLength]) |
+               (p[CONF_DESC_wTotalLength + 1] << 8);
+
+    while ((current_desc_len < desc_len) && (p[DESC_bLength] != 0U)) {
+        switch (p[DESC_bDescriptorType]) {
+            case USB_DESCRIPTOR_TYPE_INTERFACE:
+                intf_desc = p;
+
+                if ((p[INTF_DESC_bInterfaceNumber] == iface) &&
+                    (p[INTF_DESC_bAlternateSetting] == alt_setting) && if_desc) {
+                    *if_desc = p;
+                }
                 break;
 
             case USB_DESCRIPTOR_TYPE_ENDPOINT:
-                if (cur_iface == iface) {
-                    ep_desc = (struct usb_endpoint_descriptor *)p;
-
-                    if (alt_setting == 0) {
-                        ret = usbd_reset_endpoint(busid, ep_desc);
-                        goto find_end;
-                    } else if (cur_alt_setting == alt_setting) {
-                        ret = usbd_set_endpoint(busid, ep_desc);
-                    } else {
+                if (intf_desc && ((iface == USBD_ANY_INTERFACE) || (intf_desc[INTF_DESC_bInterfaceNumber] == iface))) {
+                    if (!usbd_alt_endpoint(busid, intf_desc[INTF_DESC_bAlternateSetting],
+                                           (const struct usb_endpoint_descriptor *)p, alt_setting, open, &ep_mask)) {
+                        ret = false;
                     }
                 }
-
                 break;
 
             default:
@@ -526,14 +744,59 @@ static bool usbd_set_interface(uint8_t busid, uint8_t iface, uint8_t alt_setting
         }
 
         /* skip to next descriptor */
-        p += p[DESC_bLength];
         current_desc_len += p[DESC_bLength];
-        if (current_desc_len >= desc_len && desc_len) {
-            break;
-        }
+        p += p[DESC_bLength];
+    }
+
+    return ret;
+}
+
+/**
+ * @brief set USB configuration
+ *
+ * This function configures the device according to the specified configuration
+ * index and alternate setting by parsing the installed USB descriptor list.
+ * A configuration index of 0 unconfigures the device.
+ *
+ * @param [in] busid busid
+ * @param [in] config_index Configuration index
+ * @param [in] alt_setting  Alternate setting number
+ *
+ * @return true if successfully configured false if error or unconfigured
+ */
+static bool usbd_set_configuration(uint8_t busid, uint8_t config_index, uint8_t alt_setting)
+{
+    const uint8_t *config;
+
+    config = usbd_find_configuration(busid, config_index);
+    if (config == NULL) {
+        return false;
     }
 
-find_end:
+    /* configure endpoints for this configuration/altsetting */
+    usbd_alt_index_build(busid, config);
+
+    return usbd_alt_endpoints(busid, USBD_ANY_INTERFACE, alt_setting, true, NULL);
+}
+
+/**
+ * @brief set USB interface
+ *
+ * @param [in] busid busid
+ * @param [in] iface Interface index
+ * @param [in] alt_setting  Alternate setting number
+ *
+ * @return true if successfully configured false if error or unconfigured
+ */
+static bool usbd_set_interface(uint8_t busid, uint8_t iface, uint8_t alt_setting)
+{
+    const uint8_t *if_desc = NULL;
+    bool ret;
+
+    USB_LOG_DBG("iface %u alt_setting %u\r\n", iface, alt_setting);
+
+    ret = usbd_alt_endpoints(busid, iface, alt_setting, (alt_setting != 0), &if_desc);
+
     usbd_class_event_notify_handler(busid, USBD_EVENT_SET_INTERFACE, (void *)if_desc);
 
     return ret;
@@ -1122,6 +1385,10 @@ void usbd_event_reset_handler(uint8_t busid)
     g_usbd_core[busid].configuration = 0;
 #ifdef CONFIG_USBDEV_ADVANCE_DESC
     g_usbd_core[busid].speed = USB_SPEED_UNKNOWN;
+#endif
+    g_usbd_desc_index[busid].config_desc = NULL;
+#ifdef CONFIG_USBDEV_EP_THREAD
+    g_usbd_ep_thread[busid].gen++;
 #endif
     struct usb_endpoint_descriptor ep0;
 
@@ -1299,8 +1566,102 @@ static void usbd_event_ep0_out_complete_handler(uint8_t busid, uint8_t ep, uint3
     }
 }
 
+#ifdef CONFIG_USBDEV_EP_THREAD
+static void usbd_ep_queue_push(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_ep_thread_priv *priv = &g_usbd_ep_thread[busid];
+    struct usbd_ep_event *event;
+    uint32_t head = priv->head;
+
+    if ((head - usbd_ep_queue_load(&priv->tail)) >= CONFIG_USBDEV_EP_QUEUE_DEPTH) {
+        /* only stale completions left from before a bus reset can get here */
+        USB_LOG_ERR("ep queue full, drop ep:%02x\r\n", ep);
+        return;
+    }
+
+    event = &priv->queue[head & (CONFIG_USBDEV_EP_QUEUE_DEPTH - 1)];
+    event->ep = ep;
+    event->nbytes = nbytes;
+    event->gen = priv->gen;
+    usbd_ep_queue_store(&priv->head, head + 1);
+    usbd_ep_queue_fence();
+
+    /* one wakeup for all completions until the thread starts draining */
+    if (!priv->wakeup) {
+        priv->wakeup = true;
+        usb_osal_sem_give(priv->sem);
+    }
+}
+
+static void usbdev_ep_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    uint8_t busid = (uint8_t)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+    struct usbd_ep_thread_priv *priv = &g_usbd_ep_thread[busid];
+    struct usbd_ep_event event;
+    uint32_t head;
+    uint32_t tail;
+    int ret;
+
+    while (1) {
+        ret = usb_osal_sem_take(priv->sem, USB_OSAL_WAITING_FOREVER);
+        if (ret < 0) {
+            continue;
+        }
+
+        priv->wakeup = false;
+        usbd_ep_queue_fence();
+
+        tail = priv->tail;
+        head = usbd_ep_queue_load(&priv->head);
+        while (tail != head) {
+            event = priv->queue[tail & (CONFIG_USBDEV_EP_QUEUE_DEPTH - 1)];
+            tail++;
+            usbd_ep_queue_store(&priv->tail, tail);
+
+            if (event.gen == priv->gen) {
+                if (event.ep & 0x80) {
+                    if (g_usbd_core[busid].tx_msg[event.ep & 0x7f].cb) {
+                        g_usbd_core[busid].tx_msg[event.ep & 0x7f].cb(busid, event.ep, event.nbytes);
+                    }
+                } else {
+                    if (g_usbd_core[busid].rx_msg[event.ep & 0x7f].cb) {
+                        g_usbd_core[busid].rx_msg[event.ep & 0x7f].cb(busid, event.ep, event.nbytes);
+                    }
+                }
+            }
+
+            if (tail == head) {
+                head = usbd_ep_queue_load(&priv->head);
+            }
+        }
+    }
+}
+
+int usbd_ep_set_dispatch(uint8_t busid, uint8_t ep, uint8_t mode)
+{
+    if (((ep & 0x7f) == 0) || ((ep & 0x7f) >= CONFIG_USBDEV_EP_NUM)) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (ep & 0x80) {
+        g_usbd_core[busid].tx_msg[ep & 0x7f].dispatch = mode;
+    } else {
+        g_usbd_core[busid].rx_msg[ep & 0x7f].dispatch = mode;
+    }
+    return 0;
+}
+#endif
+
 void usbd_event_ep_in_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    USB_TRACE_EP_COMPLETE(USB_TRACE_DEVICE, busid, 0, ep, nbytes);
+
+#ifdef CONFIG_USBDEV_EP_THREAD
+    if (g_usbd_core[busid].tx_msg[ep & 0x7f].dispatch == USBD_EP_DISPATCH_THREAD) {
+        usbd_ep_queue_push(busid, ep, nbytes);
+        return;
+    }
+#endif
     if (g_usbd_core[busid].tx_msg[ep & 0x7f].cb) {
         g_usbd_core[busid].tx_msg[ep & 0x7f].cb(busid, ep, nbytes);
     }
@@ -1308,6 +1669,14 @@ void usbd_event_ep_in_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbyte
 
 void usbd_event_ep_out_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    USB_TRACE_EP_COMPLETE(USB_TRACE_DEVICE, busid, 0, ep, nbytes);
+
+#ifdef CONFIG_USBDEV_EP_THREAD
+    if (g_usbd_core[busid].rx_msg[ep & 0x7f].dispatch == USBD_EP_DISPATCH_THREAD) {
+        usbd_ep_queue_push(busid, ep, nbytes);
+        return;
+    }
+#endif
     if (g_usbd_core[busid].rx_msg[ep & 0x7f].cb) {
         g_usbd_core[busid].rx_msg[ep & 0x7f].cb(busid, ep, nbytes);
     }
@@ -1317,6 +1686,7 @@ void usbd_event_ep_out_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbyt
 void usbd_desc_register(uint8_t busid, const struct usb_descriptor *desc)
 {
     memset(&g_usbd_core[busid], 0, sizeof(struct usbd_core_priv));
+    memset(&g_usbd_desc_index[busid], 0, sizeof(struct usbd_desc_index));
 
     g_usbd_core[busid].descriptors = desc;
     g_usbd_core[busid].intf_offset = 0;
@@ -1332,6 +1702,7 @@ void usbd_desc_register(uint8_t busid, const uint8_t *desc)
     memset(&g_usbd_core[busid], 0, sizeof(struct usbd_core_priv));
 
     g_usbd_core[busid].descriptors = desc;
+    usbd_desc_index_build(busid);
     g_usbd_core[busid].intf_offset = 0;
 
     g_usbd_core[busid].tx_msg[0].ep = 0x80;
@@ -1496,8 +1867,23 @@ int usbd_initialize(uint8_t busid, uintptr_t reg_base, void (*event_handler)(uin
         }
     }
 #endif
+#ifdef CONFIG_USBDEV_EP_THREAD
+    g_usbd_ep_thread[busid].sem = usb_osal_sem_create(0);
+    if (g_usbd_ep_thread[busid].sem == NULL) {
+        USB_LOG_ERR("No memory to alloc for g_usbd_ep_thread[busid].sem\r\n");
+        while (1) {
+        }
+    }
+    g_usbd_ep_thread[busid].thread = usb_osal_thread_create("usbd_ep", CONFIG_USBDEV_EP_STACKSIZE, CONFIG_USBDEV_EP_PRIO, usbdev_ep_thread, (void *)(uint32_t)busid);
+    if (g_usbd_ep_thread[busid].thread == NULL) {
+        USB_LOG_ERR("No memory to alloc for g_usbd_ep_thread[busid].thread\r\n");
+        while (1) {
+        }
+    }
+#endif
 
     g_usbd_core[busid].event_handler = event_handler;
+    g_usbd_core[busid].stopped = false;
     ret = usb_dc_init(busid);
     usbd_class_event_notify_handler(busid, USBD_EVENT_INIT, NULL);
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_INIT);
@@ -1514,7 +1900,9 @@ int usbd_deinitialize(uint8_t busid)
 
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_DEINIT);
     usbd_class_event_notify_handler(busid, USBD_EVENT_DEINIT, NULL);
-    usb_dc_deinit(busid);
+    if (!g_usbd_core[busid].stopped) {
+        usb_dc_deinit(busid);
+    }
     g_usbd_core[busid].intf_offset = 0;
 #ifdef CONFIG_USBDEV_EP0_THREAD
     if (g_usbd_core[busid].usbd_ep0_mq) {
@@ -1524,6 +1912,59 @@ int usbd_deinitialize(uint8_t busid)
         usb_osal_thread_delete(g_usbd_core[busid].usbd_ep0_thread);
     }
 #endif
+#ifdef CONFIG_USBDEV_EP_THREAD
+    if (g_usbd_ep_thread[busid].thread) {
+        usb_osal_thread_delete(g_usbd_ep_thread[busid].thread);
+    }
+    if (g_usbd_ep_thread[busid].sem) {
+        usb_osal_sem_delete(g_usbd_ep_thread[busid].sem);
+    }
+    memset(&g_usbd_ep_thread[busid], 0, sizeof(struct usbd_ep_thread_priv));
+#endif
 
     return 0;
 }
+
+int usbd_controller_stop(uint8_t busid)
+{
+    if (busid >= CONFIG_USBDEV_MAX_BUS) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (g_usbd_core[busid].stopped) {
+        return 0;
+    }
+
+    usb_dc_deinit(busid);
+    g_usbd_core[busid].stopped = true;
+
+    /* same as bus reset without touching the controller, classes drop their transfers */
+    g_usbd_core[busid].device_address = 0;
+    g_usbd_core[busid].configuration = 0;
+    g_usbd_core[busid].is_suspend = false;
+#ifdef CONFIG_USBDEV_ADVANCE_DESC
+    g_usbd_core[busid].speed = USB_SPEED_UNKNOWN;
+#endif
+    g_usbd_desc_index[busid].config_desc = NULL;
+#ifdef CONFIG_USBDEV_EP_THREAD
+    g_usbd_ep_thread[busid].gen++;
+#endif
+    usbd_class_event_notify_handler(busid, USBD_EVENT_RESET, NULL);
+    g_usbd_core[busid].event_handler(busid, USBD_EVENT_DISCONNECTED);
+
+    return 0;
+}
+
+int usbd_controller_start(uint8_t busid)
+{
+    if (busid >= CONFIG_USBDEV_MAX_BUS) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (!g_usbd_core[busid].stopped) {
+        return 0;
+    }
+
+    g_usbd_core[busid].stopped = false;
+    return usb_dc_init(busid);
+}
@@ -21,6 +21,7 @@ extern "C" {
 #include "usb_def.h"
 #include "usb_list.h"
 #include "usb_log.h"
+#include "usb_trace.h"
 #include "usb_dc.h"
 #include "usb_memcpy.h"
 #include "usb_version.h"
@@ -100,6 +101,14 @@ void usbd_webusb_desc_register(uint8_t busid, struct usb_webusb_descriptor *desc
 void usbd_add_interface(uint8_t busid, struct usbd_interface *intf);
 void usbd_add_endpoint(uint8_t busid, struct usbd_endpoint *ep);
 
+#ifdef CONFIG_USBDEV_EP_THREAD
+#define USBD_EP_DISPATCH_ISR    0 /* endpoint callback runs in usb irq, default */
+#define USBD_EP_DISPATCH_THREAD 1 /* endpoint callback runs in usbd_ep thread */
+
+/* Select where the callback of a non-control endpoint runs, call after usbd_add_endpoint */
+int usbd_ep_set_dispatch(uint8_t busid, uint8_t ep, uint8_t mode);
+#endif
+
 uint16_t usbd_get_ep_mps(uint8_t busid, uint8_t ep);
 uint8_t usbd_get_ep_mult(uint8_t busid, uint8_t ep);
 bool usb_device_is_configured(uint8_t busid);
@@ -108,6 +117,9 @@ int usbd_send_remote_wakeup(uint8_t busid);
 
 int usbd_initialize(uint8_t busid, uintptr_t reg_base, void (*event_handler)(uint8_t busid, uint8_t event));
 int usbd_deinitialize(uint8_t busid);
+/* Only deinit or reinit the controller, threads and registered interfaces stay for a quick role switch */
+int usbd_controller_stop(uint8_t busid);
+int usbd_controller_start(uint8_t busid);
 
 #ifdef __cplusplus
 }
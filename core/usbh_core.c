@@ -688,6 +688,24 @@ int usbh_deinitialize(uint8_t busid)
     return 0;
 }
 
+int usbh_controller_stop(uint8_t busid)
+{
+    if (busid >= CONFIG_USBHOST_MAX_BUS) {
+        return -USB_ERR_INVAL;
+    }
+
+    return usbh_hub_stop(&g_usbhost_bus[busid]);
+}
+
+int usbh_controller_start(uint8_t busid)
+{
+    if (busid >= CONFIG_USBHOST_MAX_BUS) {
+        return -USB_ERR_INVAL;
+    }
+
+    return usbh_hub_start(&g_usbhost_bus[busid]);
+}
+
 int usbh_control_transfer(struct usbh_hubport *hport, struct usb_setup_packet *setup, uint8_t *buffer)
 {
     struct usbh_urb *urb;
@@ -954,6 +972,10 @@ int lsusb(int argc, char **argv)
         // USB_LOG_RAW("      Show only devices with the specified vendor and product ID numbers (in hexadecimal)\r\n");
         USB_LOG_RAW("  -t, --tree\r\n");
         USB_LOG_RAW("      Dump the physical USB device hierachy as a tree\r\n");
+#ifdef CONFIG_USB_TRACE
+        USB_LOG_RAW("  -T [csv|reset]\r\n");
+        USB_LOG_RAW("      Dump endpoint and irq trace statistics\r\n");
+#endif
         USB_LOG_RAW("  -V, --version\r\n");
         USB_LOG_RAW("      Show version of program\r\n");
         USB_LOG_RAW("  -h, --help\r\n");
@@ -964,6 +986,18 @@ int lsusb(int argc, char **argv)
         return 0;
     }
 
+#ifdef CONFIG_USB_TRACE
+    /* trace dump takes its own snapshots, do not hold irq off while printing */
+    if (strcmp(argv[1], "-T") == 0) {
+        if ((argc == 3) && (strcmp(argv[2], "reset") == 0)) {
+            usb_trace_reset();
+        } else {
+            usb_trace_dump((argc == 3) && (strcmp(argv[2], "csv") == 0));
+        }
+        return 0;
+    }
+#endif
+
     flags = usb_osal_enter_critical_section();
 
     if (strcmp(argv[1], "-V") == 0) {
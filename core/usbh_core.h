@@ -17,6 +17,7 @@
 #include "usb_def.h"
 #include "usb_list.h"
 #include "usb_log.h"
+#include "usb_trace.h"
 #include "usb_hc.h"
 #include "usb_osal.h"
 #include "usbh_hub.h"
@@ -168,6 +169,8 @@ struct usbh_bus {
     struct usbh_devaddr_map devgen;
     usb_osal_thread_t hub_thread;
     usb_osal_mq_t hub_mq;
+    usb_osal_sem_t hub_sem;
+    volatile bool stopped; /* controller is deinitialized by usbh_controller_stop */
 };
 
 static inline void usbh_control_urb_fill(struct usbh_urb *urb,
@@ -228,6 +231,19 @@ static inline void usbh_int_urb_fill(struct usbh_urb *urb,
     urb->interval = USBH_GET_URB_INTERVAL(ep->bInterval, hport->speed);
 }
 
+#ifdef CONFIG_USB_TRACE
+#define USBH_TRACE_URB_SUBMIT(urb)                                                                 \
+    (urb)->trace_ts = usb_trace_submit(USB_TRACE_HOST, (urb)->hport->bus->busid, (urb)->hport->dev_addr, \
+                                       (urb)->ep->bEndpointAddress, (urb)->transfer_buffer_length)
+#define USBH_TRACE_URB_COMPLETE(urb)                                                                   \
+    usb_trace_complete_since(USB_TRACE_HOST, (urb)->hport->bus->busid, (urb)->hport->dev_addr,        \
+                             (urb)->ep->bEndpointAddress,                                             \
+                             ((urb)->errorcode < 0) ? (urb)->errorcode : (int)(urb)->actual_length, (urb)->trace_ts)
+#else
+#define USBH_TRACE_URB_SUBMIT(urb)
+#define USBH_TRACE_URB_COMPLETE(urb)
+#endif
+
 extern struct usbh_bus g_usbhost_bus[];
 #ifdef USBH_IRQHandler
 #error USBH_IRQHandler is obsolete, please call USBH_IRQHandler(xxx) in your irq
@@ -275,6 +291,9 @@ int usbh_set_interface(struct usbh_hubport *hport, uint8_t intf, uint8_t altsett
 
 int usbh_initialize(uint8_t busid, uintptr_t reg_base);
 int usbh_deinitialize(uint8_t busid);
+/* Only deinit or reinit the controller, hub thread and class drivers stay for a quick role switch */
+int usbh_controller_stop(uint8_t busid);
+int usbh_controller_start(uint8_t busid);
 void *usbh_find_class_instance(const char *devname);
 struct usbh_hubport *usbh_find_hubport(uint8_t busid, uint8_t hub_index, uint8_t hub_port);
 
@@ -5,39 +5,92 @@
  */
 #include "usbotg_core.h"
 
+#ifndef CONFIG_USBOTG_DEBOUNCE_MS
+#define CONFIG_USBOTG_DEBOUNCE_MS 0
+#endif
+
 struct usbotg_core_priv {
     uint8_t busid;
     uint32_t reg_base;
+    uint8_t mode; /* current running role */
     usb_osal_sem_t change_sem;
     usb_osal_thread_t change_thread;
+#if CONFIG_USBOTG_DEBOUNCE_MS > 0
+    struct usb_osal_timer *debounce_timer;
+#endif
     bool usbh_initialized;
     bool usbd_initialized;
     int (*usbh_initialize)(uint8_t busid, uint32_t reg_base);
     int (*usbd_initialize)(uint8_t busid, uint32_t reg_base);
+    struct usbotg_switch_stat stat;
 } g_usbotg_core[CONFIG_USBHOST_MAX_BUS];
 
+__WEAK uint32_t usbotg_get_timestamp_us(void)
+{
+    return 0;
+}
+
+/*
+ * Stacks are only initialized once, a role switch just stops one controller and starts
+ * the other one, so threads, osal objects and class allocations are kept.
+ */
 static void usbotg_host_initialize(uint8_t busid)
 {
     if (g_usbotg_core[busid].usbd_initialized) {
-        g_usbotg_core[busid].usbd_initialized = false;
-        usbd_deinitialize(busid);
+        usbd_controller_stop(busid);
     }
-    if (g_usbotg_core[busid].usbh_initialize && !g_usbotg_core[busid].usbh_initialized) {
+    if (g_usbotg_core[busid].usbh_initialized) {
+        usbh_controller_start(busid);
+    } else if (g_usbotg_core[busid].usbh_initialize) {
         g_usbotg_core[busid].usbh_initialized = true;
         g_usbotg_core[busid].usbh_initialize(g_usbotg_core[busid].busid, g_usbotg_core[busid].reg_base);
     }
+    g_usbotg_core[busid].mode = USBOTG_MODE_HOST;
 }
 
 static void usbotg_device_initialize(uint8_t busid)
 {
     if (g_usbotg_core[busid].usbh_initialized) {
-        g_usbotg_core[busid].usbh_initialized = false;
-        usbh_deinitialize(busid);
+        usbh_controller_stop(busid);
     }
-    if (g_usbotg_core[busid].usbd_initialize && !g_usbotg_core[busid].usbd_initialize) {
+    if (g_usbotg_core[busid].usbd_initialized) {
+        usbd_controller_start(busid);
+    } else if (g_usbotg_core[busid].usbd_initialize) {
         g_usbotg_core[busid].usbd_initialized = true;
         g_usbotg_core[busid].usbd_initialize(g_usbotg_core[busid].busid, g_usbotg_core[busid].reg_base);
     }
+    g_usbotg_core[busid].mode = USBOTG_MODE_DEVICE;
+}
+
+static void usbotg_role_switch(uint8_t busid, uint8_t mode)
+{
+    uint32_t start;
+    uint32_t cost;
+    size_t flags;
+
+    if (mode == g_usbotg_core[busid].mode) {
+        return;
+    }
+
+    start = usbotg_get_timestamp_us();
+    if (mode == USBOTG_MODE_HOST) {
+        usbotg_host_initialize(busid);
+    } else if (mode == USBOTG_MODE_DEVICE) {
+        usbotg_device_initialize(busid);
+    } else {
+        return;
+    }
+    cost = usbotg_get_timestamp_us() - start;
+
+    flags = usb_osal_enter_critical_section();
+    g_usbotg_core[busid].stat.count++;
+    g_usbotg_core[busid].stat.last_us = cost;
+    if (cost > g_usbotg_core[busid].stat.max_us) {
+        g_usbotg_core[busid].stat.max_us = cost;
+    }
+    usb_osal_leave_critical_section(flags);
+    USB_LOG_INFO("usbotg%u switch to %s in %u us\r\n", busid,
+                 (mode == USBOTG_MODE_HOST) ? "host" : "device", (unsigned int)cost);
 }
 
 static void usbotg_rolechange_thread(void *argument)
@@ -48,15 +101,20 @@ static void usbotg_rolechange_thread(void *argument)
 
     while (1) {
         if (usb_osal_sem_take(g_usbotg_core[busid].change_sem, USB_OSAL_WAITING_FOREVER) == 0) {
-            if (usbotg_get_current_mode(busid) == USBOTG_MODE_HOST) {
-                usbotg_host_initialize(busid);
-            } else if (usbotg_get_current_mode(busid) == USBOTG_MODE_DEVICE) {
-                usbotg_device_initialize(busid);
-            }
+            usbotg_role_switch(busid, usbotg_get_current_mode(busid));
         }
     }
 }
 
+#if CONFIG_USBOTG_DEBOUNCE_MS > 0
+static void usbotg_debounce_timeout(void *argument)
+{
+    uint8_t busid = (uint8_t)(uintptr_t)argument;
+
+    usb_osal_sem_give(g_usbotg_core[busid].change_sem);
+}
+#endif
+
 int usbotg_initialize(uint8_t otg_mode, uint8_t busid, uint32_t reg_base,
                       int (*usbh_initialize)(uint8_t busid, uint32_t reg_base),
                       int (*usbd_initialize)(uint8_t busid, uint32_t reg_base))
@@ -73,6 +131,8 @@ int usbotg_initialize(uint8_t otg_mode, uint8_t busid, uint32_t reg_base,
     g_usbotg_core[busid].reg_base = reg_base;
     g_usbotg_core[busid].usbh_initialize = usbh_initialize;
     g_usbotg_core[busid].usbd_initialize = usbd_initialize;
+    g_usbotg_core[busid].mode = USBOTG_MODE_UNKNOWN;
+    memset(&g_usbotg_core[busid].stat, 0, sizeof(struct usbotg_switch_stat));
 
     if (otg_mode == USBOTG_MODE_OTG) {
         g_usbotg_core[busid].change_sem = usb_osal_sem_create(0);
@@ -81,6 +141,15 @@ int usbotg_initialize(uint8_t otg_mode, uint8_t busid, uint32_t reg_base,
             return -1;
         }
 
+#if CONFIG_USBOTG_DEBOUNCE_MS > 0
+        g_usbotg_core[busid].debounce_timer = usb_osal_timer_create("usbotg_debounce", CONFIG_USBOTG_DEBOUNCE_MS,
+                                                                    usbotg_debounce_timeout, (void *)(uintptr_t)busid, false);
+        if (g_usbotg_core[busid].debounce_timer == NULL) {
+            USB_LOG_ERR("Failed to create debounce_timer\r\n");
+            return -1;
+        }
+#endif
+
         snprintf(thread_name, 32, "usbotg%u", busid);
         g_usbotg_core[busid].change_thread = usb_osal_thread_create(thread_name, CONFIG_USBHOST_PSC_STACKSIZE, CONFIG_USBHOST_PSC_PRIO, usbotg_rolechange_thread, (void *)(uintptr_t)busid);
         if (g_usbotg_core[busid].change_thread == NULL) {
@@ -110,6 +179,13 @@ int usbotg_deinitialize(uint8_t busid, uint32_t reg_base)
         usbh_deinitialize(busid);
     }
 
+#if CONFIG_USBOTG_DEBOUNCE_MS > 0
+    if (g_usbotg_core[busid].debounce_timer) {
+        usb_osal_timer_delete(g_usbotg_core[busid].debounce_timer);
+        g_usbotg_core[busid].debounce_timer = NULL;
+    }
+#endif
+
     if (g_usbotg_core[busid].change_sem) {
         usb_otg_deinit(busid);
         usb_osal_sem_delete(g_usbotg_core[busid].change_sem);
@@ -119,12 +195,32 @@ int usbotg_deinitialize(uint8_t busid, uint32_t reg_base)
         usb_osal_thread_delete(g_usbotg_core[busid].change_thread);
     }
 
+    g_usbotg_core[busid].mode = USBOTG_MODE_UNKNOWN;
     return 0;
 }
 
 void usbotg_trigger_role_change(uint8_t busid)
 {
+#if CONFIG_USBOTG_DEBOUNCE_MS > 0
+    /* every id/vbus edge restarts the timer, role is only sampled after the line is stable */
+    usb_osal_timer_start(g_usbotg_core[busid].debounce_timer);
+#else
     usb_osal_sem_give(g_usbotg_core[busid].change_sem);
+#endif
+}
+
+int usbotg_get_switch_stat(uint8_t busid, struct usbotg_switch_stat *stat)
+{
+    size_t flags;
+
+    if (busid >= CONFIG_USBHOST_MAX_BUS || stat == NULL) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stat, &g_usbotg_core[busid].stat, sizeof(struct usbotg_switch_stat));
+    usb_osal_leave_critical_section(flags);
+    return 0;
 }
 
 void USBOTG_IRQHandler(uint8_t busid)
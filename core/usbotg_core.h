@@ -19,13 +19,22 @@ extern "C" {
 #include "usbh_core.h"
 #include "usb_otg.h"
 
+struct usbotg_switch_stat {
+    uint32_t count;   /* role switch count */
+    uint32_t last_us; /* last switch cost, needs usbotg_get_timestamp_us */
+    uint32_t max_us;
+};
+
 int usbotg_initialize(uint8_t otg_mode, uint8_t busid, uint32_t reg_base,
                       int (*usbh_initialize)(uint8_t busid, uint32_t reg_base),
                       int (*usbd_initialize)(uint8_t busid, uint32_t reg_base));
 int usbotg_deinitialize(uint8_t busid, uint32_t reg_base);
 
-/* called by user */
+/* called by user, can be called in id/vbus irq */
 void usbotg_trigger_role_change(uint8_t busid);
+int usbotg_get_switch_stat(uint8_t busid, struct usbotg_switch_stat *stat);
+/* free running microsecond counter, default returns 0 */
+uint32_t usbotg_get_timestamp_us(void);
 
 #ifdef __cplusplus
 }
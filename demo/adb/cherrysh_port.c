@@ -37,8 +37,154 @@ static TaskHandle_t task_hdl_exec = NULL;
 static EventGroupHandle_t event_hdl;
 static StaticEventGroup_t event_grp;
 
-void usbd_adb_notify_shell_read(uint8_t *data, uint32_t len)
+static volatile uint8_t shell_busid;
+static volatile uint32_t shell_localid;
+
+/*!< sync request is id(4) + length(4), SEND/DATA carry length bytes more */
+struct adb_sync_ctx {
+    uint32_t localid;
+    uint8_t hdr[8];
+    uint8_t hdr_len;
+    uint32_t skip;
+    uint8_t reply[8 + 32];
+};
+
+static struct adb_sync_ctx sync_ctx;
+
+/*!< adb forward tcp:xxx, data is echoed back */
+static chry_ringbuffer_t forward_rb;
+static uint8_t forward_mempool[1024];
+static uint8_t forward_txbuf[256];
+static volatile uint32_t forward_localid;
+
+static void adb_sync_reply(uint8_t busid, const char *id, const char *msg)
 {
+    uint32_t len = strlen(msg);
+
+    memcpy(sync_ctx.reply, id, 4);
+    sync_ctx.reply[4] = len & 0xff;
+    sync_ctx.reply[5] = (len >> 8) & 0xff;
+    sync_ctx.reply[6] = (len >> 16) & 0xff;
+    sync_ctx.reply[7] = (len >> 24) & 0xff;
+    memcpy(&sync_ctx.reply[8], msg, len);
+
+    /*!< host waits for the reply before next request, so the buffer is free */
+    usbd_abd_write(busid, sync_ctx.localid, sync_ctx.reply, 8 + len);
+}
+
+/*!< no file system here, every request is answered with FAIL so push/pull end with an error instead of hanging */
+static void adb_sync_read(uint8_t busid, uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+
+    while (len) {
+        if (sync_ctx.skip) {
+            n = MIN(len, sync_ctx.skip);
+            sync_ctx.skip -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        n = MIN(len, sizeof(sync_ctx.hdr) - sync_ctx.hdr_len);
+        memcpy(&sync_ctx.hdr[sync_ctx.hdr_len], data, n);
+        sync_ctx.hdr_len += n;
+        data += n;
+        len -= n;
+        if (sync_ctx.hdr_len < sizeof(sync_ctx.hdr)) {
+            break;
+        }
+        sync_ctx.hdr_len = 0;
+
+        if (memcmp(sync_ctx.hdr, "QUIT", 4) == 0) {
+            usbd_adb_close(busid, sync_ctx.localid);
+            sync_ctx.localid = 0;
+            return;
+        } else if (memcmp(sync_ctx.hdr, "DATA", 4) == 0) {
+            sync_ctx.skip = sync_ctx.hdr[4] | (sync_ctx.hdr[5] << 8) | (sync_ctx.hdr[6] << 16) | ((uint32_t)sync_ctx.hdr[7] << 24);
+        } else if (memcmp(sync_ctx.hdr, "SEND", 4) == 0) {
+            /*!< reply after DONE, host does not read in between */
+            sync_ctx.skip = sync_ctx.hdr[4] | (sync_ctx.hdr[5] << 8) | (sync_ctx.hdr[6] << 16) | ((uint32_t)sync_ctx.hdr[7] << 24);
+        } else if (memcmp(sync_ctx.hdr, "DONE", 4) == 0) {
+            adb_sync_reply(busid, "FAIL", "not supported");
+        } else {
+            /*!< STAT, LIST, RECV and others carry a path */
+            sync_ctx.skip = sync_ctx.hdr[4] | (sync_ctx.hdr[5] << 8) | (sync_ctx.hdr[6] << 16) | ((uint32_t)sync_ctx.hdr[7] << 24);
+            adb_sync_reply(busid, "FAIL", "not supported");
+        }
+    }
+}
+
+static void adb_forward_kick(uint8_t busid)
+{
+    uint32_t len;
+
+    if (!forward_localid || !usbd_adb_can_write(busid, forward_localid)) {
+        return;
+    }
+
+    len = chry_ringbuffer_read(&forward_rb, forward_txbuf, sizeof(forward_txbuf));
+    if (len) {
+        usbd_abd_write(busid, forward_localid, forward_txbuf, len);
+    }
+}
+
+bool usbd_adb_notify_open(uint8_t busid, uint32_t localid, const char *service)
+{
+    /* one stream of every service is served, others are refused */
+    switch (usbd_adb_service_type(service)) {
+        case USBD_ADB_SERVICE_SHELL:
+            if (shell_localid) {
+                return false;
+            }
+            shell_busid = busid;
+            shell_localid = localid;
+            return true;
+        case USBD_ADB_SERVICE_SYNC:
+            if (sync_ctx.localid) {
+                return false;
+            }
+            memset(&sync_ctx, 0, sizeof(sync_ctx));
+            sync_ctx.localid = localid;
+            return true;
+        case USBD_ADB_SERVICE_FORWARD:
+            if (forward_localid) {
+                return false;
+            }
+            chry_ringbuffer_reset(&forward_rb);
+            forward_localid = localid;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void usbd_adb_notify_close(uint8_t busid, uint32_t localid)
+{
+    (void)busid;
+
+    if (localid == shell_localid) {
+        shell_localid = 0;
+    } else if (localid == sync_ctx.localid) {
+        sync_ctx.localid = 0;
+    } else if (localid == forward_localid) {
+        forward_localid = 0;
+    }
+}
+
+void usbd_adb_notify_read(uint8_t busid, uint32_t localid, uint8_t *data, uint32_t len)
+{
+    if (localid == sync_ctx.localid) {
+        adb_sync_read(busid, data, len);
+        return;
+    } else if (localid == forward_localid) {
+        chry_ringbuffer_write(&forward_rb, data, len);
+        adb_forward_kick(busid);
+        return;
+    } else if (localid != shell_localid) {
+        return;
+    }
+
     chry_ringbuffer_write(&shell_rb, data, len);
 
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
@@ -46,8 +192,15 @@ void usbd_adb_notify_shell_read(uint8_t *data, uint32_t len)
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
-void usbd_adb_notify_write_done(void)
+void usbd_adb_notify_write_done(uint8_t busid, uint32_t localid)
 {
+    if (localid == forward_localid) {
+        adb_forward_kick(busid);
+        return;
+    } else if (localid != shell_localid) {
+        return;
+    }
+
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     xEventGroupSetBitsFromISR(event_hdl, 0x20, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
@@ -57,13 +210,14 @@ static uint16_t csh_sput_cb(chry_readline_t *rl, const void *data, uint16_t size
 {
     (void)rl;
 
-    if (!usb_device_is_configured(0)) {
+    if (!usb_device_is_configured(shell_busid)) {
         return size;
     }
 
-    if (usbd_adb_can_write() && size) {
-        usbd_abd_write(ADB_SHELL_LOALID, data, size);
-        xEventGroupWaitBits(event_hdl, 0x20, pdTRUE, pdFALSE, portMAX_DELAY);
+    if (usbd_adb_can_write(shell_busid, shell_localid) && size) {
+        if (usbd_abd_write(shell_busid, shell_localid, data, size) == 0) {
+            xEventGroupWaitBits(event_hdl, 0x20, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
     }
 
     return size;
@@ -229,6 +383,10 @@ int shell_init(bool need_login)
         return -1;
     }
 
+    if (chry_ringbuffer_init(&forward_rb, forward_mempool, sizeof(forward_mempool))) {
+        return -1;
+    }
+
     if (need_login) {
         login = false;
     } else {
@@ -315,7 +473,8 @@ static int csh_exit(int argc, char **argv)
     (void)argc;
     (void)argv;
 
-    usbd_adb_close(ADB_SHELL_LOALID);
+    usbd_adb_close(shell_busid, shell_localid);
+    shell_localid = 0;
 
     return 0;
 }
@@ -6,6 +6,12 @@
  */
 #include "bootuf2.h"
 #include "usbd_core.h"
+#ifdef CONFIG_BOOTUF2_POLLING
+#include "usb_osal.h"
+#endif
+#ifdef CONFIG_BOOTUF2_IMAGE
+#include "dfu_image.h"
+#endif
 
 char file_INFO[] = {
     "CherryUSB UF2 BOOT\r\n"
@@ -44,6 +50,44 @@ static struct bootuf2_FILE files[] = {
     [3] = { .Name = "JOIN    HTM", .Content = file_JOIN, .FileSize = sizeof(file_JOIN) - 1 },
 };
 
+#if (CONFIG_BOOTUF2_PAGE_SIZE % 32) || (CONFIG_BOOTUF2_CACHE_SIZE % CONFIG_BOOTUF2_PAGE_SIZE) || (BOOTUF2_PAGE_SLOTS < 2)
+#error "CONFIG_BOOTUF2_CACHE_SIZE must hold at least two pages of CONFIG_BOOTUF2_PAGE_SIZE"
+#endif
+
+#ifdef CONFIG_BOOTUF2_POLLING
+#define BOOTUF2_ENTER_CRITICAL()      usb_osal_enter_critical_section()
+#define BOOTUF2_LEAVE_CRITICAL(flags) usb_osal_leave_critical_section(flags)
+#else
+/*!< cache and flash are only used from msc write */
+#define BOOTUF2_ENTER_CRITICAL()      0
+#define BOOTUF2_LEAVE_CRITICAL(flags) (void)(flags)
+#endif
+
+#ifdef CONFIG_BOOTUF2_POLLING
+/*!< msc write may run in usb isr, it never programs flash, a block is refused while its pages do not fit */
+#define BOOTUF2_MSC_EVICT false
+#else
+#define BOOTUF2_MSC_EVICT true
+#endif
+
+/*!< block not taken, msc write returns -USB_ERR_BUSY and the same sectors come again */
+#define BOOTUF2_BUSY 1
+
+#define BOOTUF2_PAGE_FREE    0
+#define BOOTUF2_PAGE_FILLING 1 /*!< receiving blocks in any order */
+#define BOOTUF2_PAGE_READY   2 /*!< complete, waiting for flash writer */
+#define BOOTUF2_PAGE_WRITING 3 /*!< owned by flash writer */
+
+/*!< page is split into 32 chunks, only chunks with data are programmed */
+#define BOOTUF2_PAGE_CHUNK (CONFIG_BOOTUF2_PAGE_SIZE / 32)
+
+struct bootuf2_page {
+    uint32_t address;
+    uint32_t chunks;
+    uint32_t filled;
+    volatile uint8_t state;
+};
+
 struct bootuf2_data {
     const struct bootuf2_DBR *const DBR;
     struct bootuf2_STATE *const STATE;
@@ -52,8 +96,19 @@ struct bootuf2_data {
     size_t page_count;
     uint8_t *const cache;
     const size_t cache_size;
-    uint32_t cached_address;
-    size_t cached_bytes;
+    struct bootuf2_page page[BOOTUF2_PAGE_SLOTS];
+    uint32_t page_base;                /*!< address of erase flag 0 */
+    uint32_t page_end;                 /*!< end of image, erase ahead stops here */
+    volatile uint32_t erasing_address; /*!< page erased ahead by flash writer */
+    uint8_t error;
+#ifdef CONFIG_BOOTUF2_IMAGE
+    struct dfu_image image;
+    uint8_t image_mode;
+    uint32_t image_base;
+    uint32_t image_next;
+    uint32_t image_pending_index[CONFIG_BOOTUF2_IMAGE_PENDING];
+    volatile uint16_t image_pending_len[CONFIG_BOOTUF2_IMAGE_PENDING]; /*!< 0 means free */
+#endif
 };
 
 /*!< define DBRs */
@@ -100,7 +155,15 @@ static uint8_t __attribute__((aligned(4))) bootuf2_disk_cache[CONFIG_BOOTUF2_CAC
 static uint8_t __attribute__((aligned(4))) bootuf2_disk_fbuff[256];
 
 /*!< define erase flag buff */
-static uint8_t __attribute__((aligned(4))) bootuf2_disk_erase[BOOTUF2_DIVCEIL(CONFIG_BOOTUF2_PAGE_COUNTMAX, 8)];
+static uint8_t __attribute__((aligned(4))) bootuf2_disk_erase[BOOTUF2_DIVCEIL(BOOTUF2_PAGE_COUNT, 8)];
+
+#ifdef CONFIG_BOOTUF2_IMAGE
+/*!< define image decode window */
+static uint8_t __attribute__((aligned(4))) bootuf2_image_window[CONFIG_BOOTUF2_IMAGE_BLOCK_SIZE];
+
+/*!< define image blocks received before their turn */
+static uint8_t __attribute__((aligned(4))) bootuf2_image_pending[CONFIG_BOOTUF2_IMAGE_PENDING][476];
+#endif
 
 /*!< define disk */
 static struct bootuf2_data bootuf2_disk = {
@@ -110,6 +173,7 @@ static struct bootuf2_data bootuf2_disk = {
     .erase = bootuf2_disk_erase,
     .cache = bootuf2_disk_cache,
     .cache_size = sizeof(bootuf2_disk_cache),
+    .erasing_address = 0xffffffff,
 };
 
 static void fname_copy(char *dst, char const *src, uint16_t len)
@@ -205,47 +269,410 @@ static bool bootuf2block_state_check(struct bootuf2_STATE *STATE)
            STATE->NumberOfBlock;
 }
 
-static int bootuf2_flash_flush(struct bootuf2_data *ctx)
+static int bootuf2_page_index(struct bootuf2_data *ctx, uint32_t address)
 {
+    uint32_t index;
+
+    if (address < ctx->page_base) {
+        return -1;
+    }
+
+    index = (address - ctx->page_base) / CONFIG_BOOTUF2_PAGE_SIZE;
+    if (index >= BOOTUF2_PAGE_COUNT) {
+        return -1;
+    }
+    return index;
+}
+
+static bool bootuf2_page_is_erased(struct bootuf2_data *ctx, int index)
+{
+    return (index >= 0) && (ctx->erase[index / 8] & (1 << (index % 8)));
+}
+
+static int bootuf2_page_erase(struct bootuf2_data *ctx, uint32_t address)
+{
+    int index = bootuf2_page_index(ctx, address);
+    size_t flags;
     int err;
 
-    if (ctx->cached_bytes == 0) {
-        return 0;
+    if (index < 0) {
+        return -1;
     }
 
-    err = bootuf2_flash_write(ctx->cached_address, ctx->cache, ctx->cached_bytes);
+    if (bootuf2_page_is_erased(ctx, index)) {
+        return 0;
+    }
 
+    err = bootuf2_flash_erase(address, CONFIG_BOOTUF2_PAGE_SIZE);
     if (err) {
-        USB_LOG_ERR("UF2 slot flash write error %d at offset %08lx len %d\r\n",
-                    err, ctx->cached_address, ctx->cached_bytes);
+        USB_LOG_ERR("UF2 flash erase error %d at %08x\r\n", err, (unsigned int)address);
         return -1;
     }
 
-    ctx->cached_bytes = 0;
+    flags = BOOTUF2_ENTER_CRITICAL();
+    ctx->erase[index / 8] |= (1 << (index % 8));
+    BOOTUF2_LEAVE_CRITICAL(flags);
 
     return 0;
 }
 
-int bootuf2_flash_write_internal(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+static uint8_t *bootuf2_page_buffer(struct bootuf2_data *ctx, struct bootuf2_page *page)
 {
-    /*!< 1.cache not empty and address not continue */
-    /*!< 2.cache full */
-    if ((ctx->cached_bytes && ((ctx->cached_address + ctx->cached_bytes) != uf2->TargetAddress)) ||
-        (ctx->cached_bytes == ctx->cache_size)) {
-        int err = bootuf2_flash_flush(ctx);
-        if (err)
-            return err;
+    return ctx->cache + (page - ctx->page) * CONFIG_BOOTUF2_PAGE_SIZE;
+}
+
+static int bootuf2_page_program(struct bootuf2_data *ctx, struct bootuf2_page *page)
+{
+    uint8_t *buff = bootuf2_page_buffer(ctx, page);
+    uint32_t start;
+    uint32_t end;
+    int err;
+
+    if (bootuf2_page_erase(ctx, page->address) < 0) {
+        return -1;
     }
 
-    /*!< write len always is 256, cache_size always is a multiple of 256 */
-    memcpy(ctx->cache + ctx->cached_bytes, uf2->Data, uf2->PayloadSize);
+    /*!< program runs of received chunks, other chunks keep erased */
+    for (start = 0; start < 32; start = end) {
+        end = start + 1;
+        if ((page->chunks & (1UL << start)) == 0) {
+            continue;
+        }
 
-    ctx->cached_address = uf2->TargetAddress - ctx->cached_bytes;
-    ctx->cached_bytes += uf2->PayloadSize;
+        while ((end < 32) && (page->chunks & (1UL << end))) {
+            end++;
+        }
+
+        err = bootuf2_flash_write(page->address + start * BOOTUF2_PAGE_CHUNK,
+                                  buff + start * BOOTUF2_PAGE_CHUNK,
+                                  (end - start) * BOOTUF2_PAGE_CHUNK);
+        if (err) {
+            USB_LOG_ERR("UF2 slot flash write error %d at offset %08x len %u\r\n",
+                        err, (unsigned int)(page->address + start * BOOTUF2_PAGE_CHUNK),
+                        (unsigned int)((end - start) * BOOTUF2_PAGE_CHUNK));
+            return -1;
+        }
+    }
 
     return 0;
 }
 
+/*!< take the lowest complete page, or any page not being erased when evict */
+static struct bootuf2_page *bootuf2_page_claim(struct bootuf2_data *ctx, bool evict)
+{
+    struct bootuf2_page *page = NULL;
+    size_t flags;
+
+    flags = BOOTUF2_ENTER_CRITICAL();
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        struct bootuf2_page *p = &ctx->page[i];
+
+        if ((p->state == BOOTUF2_PAGE_READY) ||
+            (evict && (p->state == BOOTUF2_PAGE_FILLING) && (p->address != ctx->erasing_address))) {
+            if ((page == NULL) ||
+                ((page->state != BOOTUF2_PAGE_READY) && (p->state == BOOTUF2_PAGE_READY)) ||
+                ((page->state == p->state) && (p->address < page->address))) {
+                page = p;
+            }
+        }
+    }
+    if (page) {
+        page->state = BOOTUF2_PAGE_WRITING;
+    }
+    BOOTUF2_LEAVE_CRITICAL(flags);
+
+    return page;
+}
+
+static void bootuf2_page_write(struct bootuf2_data *ctx, struct bootuf2_page *page)
+{
+    if (bootuf2_page_program(ctx, page) < 0) {
+        ctx->error = 1;
+        /*!< this will cause never auto reboot */
+        ctx->STATE->NumberOfBlock = 0xffffffff;
+    }
+
+    page->chunks = 0;
+    page->filled = 0;
+    page->state = BOOTUF2_PAGE_FREE;
+}
+
+/*!< erase one page that is being received or comes next, while the host sends blocks */
+static void bootuf2_erase_ahead(struct bootuf2_data *ctx)
+{
+    uint32_t address = 0;
+    uint32_t next = 0;
+    bool found = false;
+    size_t flags;
+
+    flags = BOOTUF2_ENTER_CRITICAL();
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (ctx->page[i].state == BOOTUF2_PAGE_FILLING) {
+            if (!bootuf2_page_is_erased(ctx, bootuf2_page_index(ctx, ctx->page[i].address))) {
+                address = ctx->page[i].address;
+                found = true;
+                break;
+            }
+            next = MAX(next, ctx->page[i].address + CONFIG_BOOTUF2_PAGE_SIZE);
+        }
+    }
+
+    if (!found && next && (next < ctx->page_end)) {
+        address = next;
+        found = true;
+        for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+            if ((ctx->page[i].state != BOOTUF2_PAGE_FREE) && (ctx->page[i].address == next)) {
+                found = false;
+            }
+        }
+    }
+
+    if (found && !bootuf2_page_is_erased(ctx, bootuf2_page_index(ctx, address)) &&
+        (bootuf2_page_index(ctx, address) >= 0)) {
+        ctx->erasing_address = address;
+    } else {
+        found = false;
+    }
+    BOOTUF2_LEAVE_CRITICAL(flags);
+
+    if (found) {
+        /*!< failure is reported again when the page is programmed */
+        bootuf2_page_erase(ctx, address);
+        ctx->erasing_address = 0xffffffff;
+    }
+}
+
+static void bootuf2_flash_process(struct bootuf2_data *ctx)
+{
+    struct bootuf2_page *page;
+
+    while ((page = bootuf2_page_claim(ctx, false)) != NULL) {
+        bootuf2_page_write(ctx, page);
+    }
+
+    bootuf2_erase_ahead(ctx);
+}
+
+static struct bootuf2_page *bootuf2_page_get(struct bootuf2_data *ctx, uint32_t address, bool evict)
+{
+    struct bootuf2_page *page;
+
+    if (bootuf2_page_index(ctx, address) < 0) {
+        USB_LOG_ERR("UF2 address %08x out of range\r\n", (unsigned int)address);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if ((ctx->page[i].state == BOOTUF2_PAGE_FILLING) && (ctx->page[i].address == address)) {
+            return &ctx->page[i];
+        }
+    }
+
+    while (1) {
+        for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+            page = &ctx->page[i];
+            if (page->state == BOOTUF2_PAGE_FREE) {
+                page->address = address;
+                page->chunks = 0;
+                page->filled = 0;
+                memset(bootuf2_page_buffer(ctx, page), 0xff, CONFIG_BOOTUF2_PAGE_SIZE);
+                page->state = BOOTUF2_PAGE_FILLING;
+                return page;
+            }
+        }
+
+        /*!< flash writer falls behind, program one page here */
+        page = evict ? bootuf2_page_claim(ctx, true) : NULL;
+        if (page == NULL) {
+            return NULL;
+        }
+        bootuf2_page_write(ctx, page);
+    }
+}
+
+#ifdef CONFIG_BOOTUF2_POLLING
+/*!< pages not in cache yet must fit in free slots, slots are only freed meanwhile */
+static bool bootuf2_cache_ready(struct bootuf2_data *ctx, uint32_t address, size_t len)
+{
+    uint32_t need = 0;
+    uint32_t free = 0;
+
+    for (uint32_t page = address - (address % CONFIG_BOOTUF2_PAGE_SIZE); page < (address + len); page += CONFIG_BOOTUF2_PAGE_SIZE) {
+        need++;
+        for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+            if ((ctx->page[i].state == BOOTUF2_PAGE_FILLING) && (ctx->page[i].address == page)) {
+                need--;
+                break;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (ctx->page[i].state == BOOTUF2_PAGE_FREE) {
+            free++;
+        }
+    }
+
+    return free >= need;
+}
+#endif
+
+static int bootuf2_cache_write(struct bootuf2_data *ctx, uint32_t address, const uint8_t *data, size_t len, bool evict)
+{
+    while (len) {
+        struct bootuf2_page *page;
+        uint32_t offset = address % CONFIG_BOOTUF2_PAGE_SIZE;
+        size_t n = MIN(len, CONFIG_BOOTUF2_PAGE_SIZE - offset);
+
+        page = bootuf2_page_get(ctx, address - offset, evict);
+        if (page == NULL) {
+            ctx->error = 1;
+            ctx->STATE->NumberOfBlock = 0xffffffff;
+            return -1;
+        }
+
+        memcpy(bootuf2_page_buffer(ctx, page) + offset, data, n);
+
+        for (uint32_t i = offset / BOOTUF2_PAGE_CHUNK; i <= (offset + n - 1) / BOOTUF2_PAGE_CHUNK; i++) {
+            page->chunks |= (1UL << i);
+        }
+        page->filled += n;
+        if (page->filled >= CONFIG_BOOTUF2_PAGE_SIZE) {
+            page->state = BOOTUF2_PAGE_READY;
+        }
+
+        address += n;
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int bootuf2_flash_write_internal(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+{
+#ifdef CONFIG_BOOTUF2_POLLING
+    if (!bootuf2_cache_ready(ctx, uf2->TargetAddress, uf2->PayloadSize)) {
+        return BOOTUF2_BUSY;
+    }
+#endif
+    return bootuf2_cache_write(ctx, uf2->TargetAddress, uf2->Data, uf2->PayloadSize, BOOTUF2_MSC_EVICT);
+}
+
+#ifdef CONFIG_BOOTUF2_IMAGE
+static int bootuf2_image_output(void *arg, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    struct bootuf2_data *ctx = arg;
+
+    ctx->page_end = MAX(ctx->page_end, ctx->image_base + ctx->image.header.image_size);
+    /*!< decoded size of a block has no bound, decode only runs where flash can be programmed */
+    return bootuf2_cache_write(ctx, ctx->image_base + offset, data, len, true);
+}
+
+static int bootuf2_image_feed(struct bootuf2_data *ctx, uint32_t index, const uint8_t *data, uint32_t len)
+{
+    if (index == 0) {
+        if (!dfu_image_probe(data, len)) {
+            USB_LOG_ERR("UF2 image header error\r\n");
+            return -1;
+        }
+        dfu_image_init(&ctx->image, bootuf2_image_window, sizeof(bootuf2_image_window), bootuf2_image_output, ctx);
+        ctx->image_mode = 1;
+        ctx->image_next = 0;
+    }
+
+    ctx->image_next++;
+    return dfu_image_feed(&ctx->image, data, len);
+}
+
+/*!< keep a block until its turn, the mask makes sure each block is only kept once */
+static int bootuf2_image_pend(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+{
+    size_t flags;
+
+    for (uint32_t i = 0; i < CONFIG_BOOTUF2_IMAGE_PENDING; i++) {
+        if (ctx->image_pending_len[i] == 0) {
+            memcpy(bootuf2_image_pending[i], uf2->Data, uf2->PayloadSize);
+            flags = BOOTUF2_ENTER_CRITICAL();
+            ctx->image_pending_index[i] = uf2->BlockIndex;
+            ctx->image_pending_len[i] = uf2->PayloadSize;
+            BOOTUF2_LEAVE_CRITICAL(flags);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*!< feed kept blocks that are next now */
+static int bootuf2_image_drain(struct bootuf2_data *ctx)
+{
+    uint32_t i = 0;
+    size_t flags;
+    int ret = 0;
+
+    while ((ret == 0) && (i < CONFIG_BOOTUF2_IMAGE_PENDING)) {
+        if (ctx->image_pending_len[i] && (ctx->image_pending_index[i] == ctx->image_next)) {
+            ret = bootuf2_image_feed(ctx, ctx->image_pending_index[i], bootuf2_image_pending[i], ctx->image_pending_len[i]);
+            flags = BOOTUF2_ENTER_CRITICAL();
+            ctx->image_pending_len[i] = 0;
+            BOOTUF2_LEAVE_CRITICAL(flags);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    return ret;
+}
+
+static void bootuf2_image_error(struct bootuf2_data *ctx)
+{
+    ctx->error = 1;
+    /*!< this will cause never auto reboot */
+    ctx->STATE->NumberOfBlock = 0xffffffff;
+}
+
+/*!< compressed image blocks are decoded as a stream, block 0 carries the image header */
+static int bootuf2_image_write_internal(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+{
+    int ret = 0;
+
+    if (uf2->PayloadSize > sizeof(uf2->Data)) {
+        bootuf2_image_error(ctx);
+        return -1;
+    }
+
+    if (uf2->BlockIndex == 0) {
+        ctx->image_base = uf2->TargetAddress;
+    }
+
+#ifdef CONFIG_BOOTUF2_POLLING
+    /*!< every block is decoded in bootuf2_polling */
+    if (bootuf2_image_pend(ctx, uf2) < 0) {
+        return BOOTUF2_BUSY;
+    }
+#else
+    if ((uf2->BlockIndex == 0) || (ctx->image_mode && (uf2->BlockIndex == ctx->image_next))) {
+        ret = bootuf2_image_feed(ctx, uf2->BlockIndex, uf2->Data, uf2->PayloadSize);
+    } else if (bootuf2_image_pend(ctx, uf2) < 0) {
+        USB_LOG_ERR("UF2 image block %d too early, expect %d\r\n",
+                    uf2->BlockIndex, ctx->image_next);
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        ret = bootuf2_image_drain(ctx);
+    }
+
+    if (ret < 0) {
+        bootuf2_image_error(ctx);
+    }
+#endif
+    return ret;
+}
+#endif
+
 void bootuf2_init(void)
 {
     struct bootuf2_data *ctx;
@@ -253,9 +680,6 @@ void bootuf2_init(void)
     ctx = &bootuf2_disk;
 
     fcalculate_cluster(ctx);
-
-    ctx->cached_bytes = 0;
-    ctx->cached_address = 0;
 }
 
 int boot2uf2_read_sector(uint32_t start_sector, uint8_t *buff, uint32_t sector_count)
@@ -406,6 +830,7 @@ int boot2uf2_read_sector(uint32_t start_sector, uint8_t *buff, uint32_t sector_c
 int bootuf2_write_sector(uint32_t start_sector, const uint8_t *buff, uint32_t sector_count)
 {
     struct bootuf2_data *ctx;
+    int ret;
 
     ctx = &bootuf2_disk;
 
@@ -415,14 +840,34 @@ int bootuf2_write_sector(uint32_t start_sector, const uint8_t *buff, uint32_t se
         if (!((uf2->MagicStart0 == BOOTUF2_MAGIC_START0) &&
               (uf2->MagicStart1 == BOOTUF2_MAGIC_START1) &&
               (uf2->MagicEnd == BOOTUF2_MAGIC_END) &&
-              (uf2->Flags & BOOTUF2_FLAG_FAMILID_PRESENT) &&
-              !(uf2->Flags & BOOTUF2_FLAG_NOT_MAIN_FLASH))) {
+              (uf2->Flags & BOOTUF2_FLAG_FAMILID_PRESENT))) {
             goto next;
         }
 
+#ifndef CONFIG_BOOTUF2_IMAGE
+        if (uf2->Flags & BOOTUF2_FLAG_NOT_MAIN_FLASH) {
+            goto next;
+        }
+#endif
+
         if (uf2->FamilyID == CONFIG_BOOTUF2_FAMILYID) {
             if (bootuf2block_check_writable(ctx->STATE, uf2, CONFIG_BOOTUF2_FLASHMAX)) {
-                bootuf2_flash_write_internal(ctx, uf2);
+                if (ctx->STATE->NumberOfWritten == 0) {
+                    /*!< blocks are numbered from the start of the file, page flags count from there */
+                    ctx->page_base = uf2->TargetAddress - uf2->BlockIndex * uf2->PayloadSize;
+                    ctx->page_base -= ctx->page_base % CONFIG_BOOTUF2_PAGE_SIZE;
+                    ctx->page_end = ctx->page_base + uf2->NumberOfBlock * uf2->PayloadSize;
+                }
+#ifdef CONFIG_BOOTUF2_IMAGE
+                if (uf2->Flags & BOOTUF2_FLAG_NOT_MAIN_FLASH) {
+                    ret = bootuf2_image_write_internal(ctx, uf2);
+                } else
+#endif
+                    ret = bootuf2_flash_write_internal(ctx, uf2);
+                if (ret == BOOTUF2_BUSY) {
+                    /*!< blocks before this one are in the mask, they are skipped on retry */
+                    return -USB_ERR_BUSY;
+                }
                 bootuf2block_state_update(ctx->STATE, uf2, CONFIG_BOOTUF2_FLASHMAX);
             } else {
                 USB_LOG_DBG("UF2 block %d already written\r\n",
@@ -438,6 +883,12 @@ int bootuf2_write_sector(uint32_t start_sector, const uint8_t *buff, uint32_t se
         buff += ctx->DBR->BPB.BytesPerSector;
     }
 
+#ifndef CONFIG_BOOTUF2_POLLING
+    /*!< no other context is known to run the flash writer, so program the pages completed by this write here.
+     * Only full pages are programmed and each page is erased once, define CONFIG_BOOTUF2_POLLING to move it out.
+     */
+    bootuf2_flash_process(ctx);
+#endif
     return 0;
 }
 
@@ -451,13 +902,67 @@ uint32_t bootuf2_get_sector_count(void)
     return bootuf2_disk.DBR->BPB.SectorsOver32MB + bootuf2_disk.DBR->BPB.Sectors;
 }
 
+#ifdef CONFIG_BOOTUF2_POLLING
+void bootuf2_polling(void)
+{
+    struct bootuf2_data *ctx = &bootuf2_disk;
+
+#ifdef CONFIG_BOOTUF2_IMAGE
+    if (!ctx->error && (bootuf2_image_drain(ctx) < 0)) {
+        bootuf2_image_error(ctx);
+    }
+#endif
+    bootuf2_flash_process(ctx);
+}
+#endif
+
 bool bootuf2_is_write_done(void)
 {
-    if (bootuf2block_state_check(bootuf2_disk.STATE)) {
-        bootuf2_flash_flush(&bootuf2_disk);
-        USB_LOG_DBG("UF2 update ok\r\n");
-        return true;
-    } else {
+    struct bootuf2_data *ctx = &bootuf2_disk;
+    size_t flags;
+
+    if (!bootuf2block_state_check(ctx->STATE)) {
+        return false;
+    }
+
+#ifdef CONFIG_BOOTUF2_IMAGE
+    /*!< blocks still waiting to be decoded */
+    for (uint32_t i = 0; i < CONFIG_BOOTUF2_IMAGE_PENDING; i++) {
+        if (ctx->image_pending_len[i]) {
+            return false;
+        }
+    }
+#endif
+
+    /*!< all blocks received, program pages that are not full */
+    flags = BOOTUF2_ENTER_CRITICAL();
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (ctx->page[i].state == BOOTUF2_PAGE_FILLING) {
+            ctx->page[i].state = BOOTUF2_PAGE_READY;
+        }
+    }
+    BOOTUF2_LEAVE_CRITICAL(flags);
+
+#ifndef CONFIG_BOOTUF2_POLLING
+    bootuf2_flash_process(ctx);
+#endif
+
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (ctx->page[i].state != BOOTUF2_PAGE_FREE) {
+            return false;
+        }
+    }
+
+    if (ctx->error) {
         return false;
     }
-}
\ No newline at end of file
+
+#ifdef CONFIG_BOOTUF2_IMAGE
+    if (ctx->image_mode && (dfu_image_finish(&ctx->image) < 0)) {
+        bootuf2_image_error(ctx);
+        return false;
+    }
+#endif
+    USB_LOG_DBG("UF2 update ok\r\n");
+    return true;
+}
@@ -115,7 +115,7 @@ struct bootuf2_FILE
 #define BOOTUF2_MAGIC_SERIAL 0x251B18BDu
 #define BOOTUF2_MAGIC_END 0x0AB16F30u
 
-#define BOOTUF2_FLAG_NOT_MAIN_FLASH 0x00000001u
+#define BOOTUF2_FLAG_NOT_MAIN_FLASH 0x00000001u /* also set on compressed image blocks */
 #define BOOTUF2_FLAG_FILE_CONTAINER 0x00001000u
 #define BOOTUF2_FLAG_FAMILID_PRESENT 0x00002000u
 #define BOOTUF2_FLAG_MD5_PRESENT 0x00004000u
@@ -124,6 +124,8 @@ struct bootuf2_FILE
 #define BOOTUF2_CMD_SYNC 1
 
 #define BOOTUF2_BLOCKSMAX (((CONFIG_BOOTUF2_FLASHMAX) / 256) + (((CONFIG_BOOTUF2_FLASHMAX) % 256) ? 1 : 0))
+#define BOOTUF2_PAGE_SLOTS ((CONFIG_BOOTUF2_CACHE_SIZE) / (CONFIG_BOOTUF2_PAGE_SIZE))
+#define BOOTUF2_PAGE_COUNT (((CONFIG_BOOTUF2_FLASHMAX) / (CONFIG_BOOTUF2_PAGE_SIZE)) + (((CONFIG_BOOTUF2_FLASHMAX) % (CONFIG_BOOTUF2_PAGE_SIZE)) ? 1 : 0))
 
 #define BOOTUF2_FAMILYID_POSNUM(n) (((CONFIG_BOOTUF2_FAMILYID) / (0x10000000 >> ((n) * 4))) % 0x10)
 #define BOOTUF2_FAMILYID_ARRAY                                                                                           \
@@ -206,13 +208,20 @@ struct bootuf2_FILE
 
 void bootuf2_init(void);
 int boot2uf2_read_sector(uint32_t start_sector, uint8_t *buff, uint32_t sector_count);
+/* returns -USB_ERR_BUSY when blocks can not be taken now (polling cache full), msc writes the same sectors again */
 int bootuf2_write_sector(uint32_t start_sector, const uint8_t *buff, uint32_t sector_count);
 uint16_t bootuf2_get_sector_size(void);
 uint32_t bootuf2_get_sector_count(void);
 
 bool bootuf2_is_write_done(void);
+#ifdef CONFIG_BOOTUF2_POLLING
+void bootuf2_polling(void);
+#endif
 
 void boot2uf2_flash_init(void);
+/* size is always CONFIG_BOOTUF2_PAGE_SIZE, address is page aligned */
+int bootuf2_flash_erase(uint32_t address, size_t size);
+/* only called on erased pages */
 int bootuf2_flash_write(uint32_t address, const uint8_t *data, size_t size);
 
 #endif /*  BOOTUF2_H */
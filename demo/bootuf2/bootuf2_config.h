@@ -11,7 +11,9 @@
 #define CONFIG_BOOTUF2_INDEX_URL "https://github.com/cherry-embedded"
 #define CONFIG_BOOTUF2_JOIN_URL  "http://qm.qq.com/cgi-bin/qm/qr?_wv=1027&k=GyH2M5XfWTHQzmZis4ClpgvfdObPrvtk&authKey=LmcLhfno%2BiW51wmgVC%2F8WoYwUXqiclzWDHMU1Jy1d6S8cECJ4Q7bfJ%2FTe67RLakI&noverify=0&group_code=642693751"
 
+/* flash erase page size, cache holds CACHE_SIZE / PAGE_SIZE pages (at least 2) */
 #define CONFIG_BOOTUF2_CACHE_SIZE         4096
+#define CONFIG_BOOTUF2_PAGE_SIZE          1024
 #define CONFIG_BOOTUF2_SECTOR_SIZE        512
 #define CONFIG_BOOTUF2_SECTOR_PER_CLUSTER 2
 #define CONFIG_BOOTUF2_SECTOR_RESERVED    1
@@ -19,7 +21,21 @@
 #define CONFIG_BOOTUF2_ROOT_ENTRIES       64
 
 #define CONFIG_BOOTUF2_FAMILYID      0xFFFFFFFF
+/* image size limit, erase flags take FLASHMAX / PAGE_SIZE bits */
 #define CONFIG_BOOTUF2_FLASHMAX      0x800000
-#define CONFIG_BOOTUF2_PAGE_COUNTMAX 1024
+
+/* Accept compressed images from uf2conv.py --compress, needs class/dfu/dfu_image.c */
+// #define CONFIG_BOOTUF2_IMAGE
+#define CONFIG_BOOTUF2_IMAGE_BLOCK_SIZE 4096
+/* image blocks received out of order are kept until their turn, 476 bytes each */
+#define CONFIG_BOOTUF2_IMAGE_PENDING    8
+
+/* program flash in bootuf2_polling from while(1), msc write only copies blocks into cache.
+ * Without it flash is programmed inside msc write, in usb isr unless msc thread or polling is used.
+ * While the cache is full msc write returns -USB_ERR_BUSY, use CONFIG_USBDEV_MSC_POLLING or
+ * CONFIG_USBDEV_MSC_THREAD so the host is nak'ed until it is retried, in usb isr the host gets
+ * not ready and retries the command.
+ */
+// #define CONFIG_BOOTUF2_POLLING
 
 #endif
\ No newline at end of file
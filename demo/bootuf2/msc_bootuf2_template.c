@@ -206,8 +206,7 @@ int usbd_msc_sector_read(uint8_t busid, uint8_t lun, uint32_t sector, uint8_t *b
 
 int usbd_msc_sector_write(uint8_t busid, uint8_t lun, uint32_t sector, uint8_t *buffer, uint32_t length)
 {
-    bootuf2_write_sector(sector, buffer, length / bootuf2_get_sector_size());
-    return 0;
+    return bootuf2_write_sector(sector, buffer, length / bootuf2_get_sector_size());
 }
 
 static struct usbd_interface intf0;
@@ -229,6 +228,12 @@ void boot2uf2_flash_init(void)
 {
 }
 
+int bootuf2_flash_erase(uint32_t address, size_t size)
+{
+    USB_LOG_INFO("erase address:%08x, size:%d\n", address, size);
+    return 0;
+}
+
 int bootuf2_flash_write(uint32_t address, const uint8_t *data, size_t size)
 {
     USB_LOG_INFO("address:%08x, size:%d\n", address, size);
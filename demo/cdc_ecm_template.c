@@ -222,12 +222,15 @@ const uint8_t mac[6] = { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/pbuf.h"
+#include "dhserver.h"
+#include "dnserver.h"
 
 const ip_addr_t ipaddr = IPADDR4_INIT_BYTES(IP_ADDR0, IP_ADDR1, IP_ADDR2, IP_ADDR3);
 const ip_addr_t netmask = IPADDR4_INIT_BYTES(NETMASK_ADDR0, NETMASK_ADDR1, NETMASK_ADDR2, NETMASK_ADDR3);
 const ip_addr_t gateway = IPADDR4_INIT_BYTES(GW_ADDR0, GW_ADDR1, GW_ADDR2, GW_ADDR3);
 
 static struct netif cdc_ecm_netif; //network interface
+static uint8_t cdc_ecm_busid;
 
 /* Network interface name */
 #define IFNAME0 'E'
@@ -237,7 +240,7 @@ static err_t linkoutput_fn(struct netif *netif, struct pbuf *p)
 {
     static int ret;
 
-    ret = usbd_cdc_ecm_eth_tx(p);
+    ret = usbd_cdc_ecm_eth_tx(cdc_ecm_busid, p);
     if (ret == 0)
         return ERR_OK;
     else
@@ -263,8 +266,13 @@ err_t cdc_ecm_if_input(struct netif *netif)
     static err_t err;
     static struct pbuf *p;
 
-    p = usbd_cdc_ecm_eth_rx();
+    p = usbd_cdc_ecm_eth_rx(cdc_ecm_busid);
     if (p != NULL) {
+        /* answer dhcp and dns here, saves a trip through lwip stack */
+        if (dhserv_input(netif, p) || dnserv_input(netif, p)) {
+            pbuf_free(p);
+            return ERR_OK;
+        }
         err = netif->input(p, netif);
         if (err != ERR_OK) {
             pbuf_free(p);
@@ -295,7 +303,7 @@ void cdc_ecm_lwip_init(void)
     while (dnserv_init(&ipaddr, PORT_DNS, dns_query_proc)) {}
 }
 
-void usbd_cdc_ecm_data_recv_done(uint32_t len)
+void usbd_cdc_ecm_data_recv_done(uint8_t busid, uint32_t len)
 {
 }
 
@@ -339,6 +347,7 @@ struct usbd_interface intf1;
 */
 void cdc_ecm_init(uint8_t busid, uintptr_t reg_base)
 {
+    cdc_ecm_busid = busid;
     cdc_ecm_lwip_init();
 
 #ifdef CONFIG_USBDEV_ADVANCE_DESC
@@ -346,7 +355,7 @@ void cdc_ecm_init(uint8_t busid, uintptr_t reg_base)
 #else
     usbd_desc_register(busid, cdc_ecm_descriptor);
 #endif
-    usbd_add_interface(busid, usbd_cdc_ecm_init_intf(&intf0, CDC_INT_EP, CDC_OUT_EP, CDC_IN_EP));
-    usbd_add_interface(busid, usbd_cdc_ecm_init_intf(&intf1, CDC_INT_EP, CDC_OUT_EP, CDC_IN_EP));
+    usbd_add_interface(busid, usbd_cdc_ecm_init_intf(busid, &intf0, CDC_INT_EP, CDC_OUT_EP, CDC_IN_EP));
+    usbd_add_interface(busid, usbd_cdc_ecm_init_intf(busid, &intf1, CDC_INT_EP, CDC_OUT_EP, CDC_IN_EP));
     usbd_initialize(busid, reg_base, usbd_event_handler);
 }
\ No newline at end of file
@@ -193,6 +193,8 @@ const uint8_t mac[6] = { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
 #define GW_ADDR2 (uint8_t)123
 #define GW_ADDR3 (uint8_t)1
 
+static uint8_t rndis_busid;
+
 #ifdef RT_USING_LWIP
 #include <rtthread.h>
 #include <rtdevice.h>
@@ -230,15 +232,15 @@ static rt_err_t rt_usbd_rndis_control(rt_device_t dev, int cmd, void *args)
 
 struct pbuf *rt_usbd_rndis_eth_rx(rt_device_t dev)
 {
-    return usbd_rndis_eth_rx();
+    return usbd_rndis_eth_rx(rndis_busid);
 }
 
 rt_err_t rt_usbd_rndis_eth_tx(rt_device_t dev, struct pbuf *p)
 {
-    return usbd_rndis_eth_tx(p);
+    return usbd_rndis_eth_tx(rndis_busid, p);
 }
 
-void usbd_rndis_data_recv_done(uint32_t len)
+void usbd_rndis_data_recv_done(uint8_t busid, uint32_t len)
 {
     eth_device_ready(&rndis_dev);
 }
@@ -258,6 +260,8 @@ void rt_usbd_rndis_init(void)
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/pbuf.h"
+#include "dhserver.h"
+#include "dnserver.h"
 
 const ip_addr_t ipaddr = IPADDR4_INIT_BYTES(IP_ADDR0, IP_ADDR1, IP_ADDR2, IP_ADDR3);
 const ip_addr_t netmask = IPADDR4_INIT_BYTES(NETMASK_ADDR0, NETMASK_ADDR1, NETMASK_ADDR2, NETMASK_ADDR3);
@@ -273,7 +277,7 @@ err_t linkoutput_fn(struct netif *netif, struct pbuf *p)
 {
     static int ret;
 
-    ret = usbd_rndis_eth_tx(p);
+    ret = usbd_rndis_eth_tx(rndis_busid, p);
     if (ret == 0)
         return ERR_OK;
     else
@@ -299,8 +303,13 @@ err_t rndisif_input(struct netif *netif)
     static err_t err;
     static struct pbuf *p;
 
-    p = usbd_rndis_eth_rx();
+    p = usbd_rndis_eth_rx(rndis_busid);
     if (p != NULL) {
+        /* answer dhcp and dns here, saves a trip through lwip stack */
+        if (dhserv_input(netif, p) || dnserv_input(netif, p)) {
+            pbuf_free(p);
+            return ERR_OK;
+        }
         err = netif->input(p, netif);
         if (err != ERR_OK) {
             pbuf_free(p);
@@ -331,7 +340,7 @@ void rndis_lwip_init(void)
     while (dnserv_init(&ipaddr, PORT_DNS, dns_query_proc)) {}
 }
 
-void usbd_rndis_data_recv_done(uint32_t len)
+void usbd_rndis_data_recv_done(uint8_t busid, uint32_t len)
 {
 }
 
@@ -374,6 +383,7 @@ struct usbd_interface intf1;
 
 void cdc_rndis_init(uint8_t busid, uintptr_t reg_base)
 {
+    rndis_busid = busid;
 #ifdef RT_USING_LWIP
     rt_usbd_rndis_init();
 #else
@@ -384,7 +394,7 @@ void cdc_rndis_init(uint8_t busid, uintptr_t reg_base)
 #else
     usbd_desc_register(busid, cdc_rndis_descriptor);
 #endif
-    usbd_add_interface(busid, usbd_rndis_init_intf(&intf0, CDC_OUT_EP, CDC_IN_EP, CDC_INT_EP, mac));
-    usbd_add_interface(busid, usbd_rndis_init_intf(&intf1, CDC_OUT_EP, CDC_IN_EP, CDC_INT_EP, mac));
+    usbd_add_interface(busid, usbd_rndis_init_intf(busid, &intf0, CDC_OUT_EP, CDC_IN_EP, CDC_INT_EP, mac));
+    usbd_add_interface(busid, usbd_rndis_init_intf(busid, &intf1, CDC_OUT_EP, CDC_IN_EP, CDC_INT_EP, mac));
     usbd_initialize(busid, reg_base, usbd_event_handler);
 }
@@ -240,6 +240,6 @@ void dfu_flash_init(uint8_t busid, uintptr_t reg_base)
 #else
     usbd_desc_register(busid, dfu_flash_descriptor);
 #endif
-    usbd_add_interface(busid, usbd_dfu_init_intf(&intf0));
+    usbd_add_interface(busid, usbd_dfu_init_intf(busid, &intf0));
     usbd_initialize(busid, reg_base, usbd_event_handler);
 }
@@ -79,11 +79,41 @@ void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
     }
 }
 
-struct usb_osal_timer *dhcp_handle;
+struct usbh_lwip_netif {
+    struct netif netif;
+    struct usb_osal_timer *dhcp_handle;
+};
+
+/* keep the default route on the netif that got it first, a second adapter must not steal it */
+static void usbh_lwip_netif_set_default(struct netif *netif)
+{
+    if (netif_default == NULL) {
+        netif_set_default(netif);
+    }
+}
+
+static void usbh_lwip_netif_remove(struct netif *netif)
+{
+    struct netif *next;
+
+    netif_set_down(netif);
+    netif_remove(netif);
+
+    /* netif_remove clears the default, hand it to another adapter that is still up */
+    if (netif_default == NULL) {
+        for (next = netif_list; next != NULL; next = next->next) {
+            if (netif_is_up(next) && !((next->name[0] == 'l') && (next->name[1] == 'o'))) {
+                netif_set_default(next);
+                break;
+            }
+        }
+    }
+}
 
 static void dhcp_timeout(void *arg)
 {
-    struct netif *netif = (struct netif *)arg;
+    struct usbh_lwip_netif *lwip_netif = (struct usbh_lwip_netif *)arg;
+    struct netif *netif = &lwip_netif->netif;
 #if LWIP_DHCP
     struct dhcp *dhcp;
 #endif
@@ -97,7 +127,7 @@ static void dhcp_timeout(void *arg)
             USB_LOG_INFO("IPv4 Subnet mask : %s\r\n", ipaddr_ntoa(&netif->netmask));
             USB_LOG_INFO("IPv4 Gateway     : %s\r\n\r\n", ipaddr_ntoa(&netif->gw));
 
-            usb_osal_timer_stop(dhcp_handle);
+            usb_osal_timer_stop(lwip_netif->dhcp_handle);
 #if LWIP_DHCP
         }
 #endif
@@ -108,15 +138,15 @@ static void dhcp_timeout(void *arg)
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_ECM
 #include "usbh_cdc_ecm.h"
 
-struct netif g_cdc_ecm_netif;
+static struct usbh_lwip_netif g_cdc_ecm_netif[CONFIG_USBHOST_MAX_CDC_ECM_CLASS];
 
 static err_t usbh_cdc_ecm_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
-    (void)netif;
+    struct usbh_cdc_ecm *cdc_ecm_class = (struct usbh_cdc_ecm *)netif->state;
 
-    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf());
-    ret = usbh_cdc_ecm_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf(cdc_ecm_class));
+    ret = usbh_cdc_ecm_eth_output(cdc_ecm_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     } else {
@@ -124,9 +154,9 @@ static err_t usbh_cdc_ecm_linkoutput(struct netif *netif, struct pbuf *p)
     }
 }
 
-void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ecm_eth_input(struct usbh_cdc_ecm *cdc_ecm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(&g_cdc_ecm_netif, buf, buflen);
+    usbh_lwip_eth_input_common(&g_cdc_ecm_netif[cdc_ecm_class->minor].netif, buf, buflen);
 }
 
 static err_t usbh_cdc_ecm_if_init(struct netif *netif)
@@ -135,7 +165,6 @@ static err_t usbh_cdc_ecm_if_init(struct netif *netif)
 
     netif->mtu = 1500;
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
-    netif->state = NULL;
     netif->name[0] = 'E';
     netif->name[1] = 'X';
     netif->output = etharp_output;
@@ -145,7 +174,8 @@ static err_t usbh_cdc_ecm_if_init(struct netif *netif)
 
 void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    struct netif *netif = &g_cdc_ecm_netif;
+    struct usbh_lwip_netif *lwip_netif = &g_cdc_ecm_netif[cdc_ecm_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, cdc_ecm_class->mac, 6);
@@ -154,37 +184,36 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
-    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_cdc_ecm_if_init, tcpip_input);
-    netif_set_default(netif);
+    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, cdc_ecm_class, usbh_cdc_ecm_if_init, tcpip_input);
+    usbh_lwip_netif_set_default(netif);
     while (!netif_is_up(netif)) {
     }
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    lwip_netif->dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, lwip_netif, true);
+    if (lwip_netif->dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
 
-    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, NULL);
+    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, (void *)cdc_ecm_class);
 #if LWIP_DHCP
     dhcp_start(netif);
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(lwip_netif->dhcp_handle);
 #endif
 }
 
 void usbh_cdc_ecm_stop(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    struct netif *netif = &g_cdc_ecm_netif;
-    (void)cdc_ecm_class;
+    struct usbh_lwip_netif *lwip_netif = &g_cdc_ecm_netif[cdc_ecm_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
 #if LWIP_DHCP
     dhcp_stop(netif);
     dhcp_cleanup(netif);
-    usb_osal_timer_delete(dhcp_handle);
+    usb_osal_timer_delete(lwip_netif->dhcp_handle);
 #endif
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
 }
 #endif
 
@@ -212,15 +241,15 @@ void timer_init(struct usbh_rndis *rndis_class)
     }
 }
 
-struct netif g_rndis_netif;
+static struct usbh_lwip_netif g_rndis_netif[CONFIG_USBHOST_MAX_RNDIS_CLASS];
 
 static err_t usbh_rndis_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
-    (void)netif;
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)netif->state;
 
-    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf());
-    ret = usbh_rndis_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf(rndis_class));
+    ret = usbh_rndis_eth_output(rndis_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     } else {
@@ -228,9 +257,9 @@ static err_t usbh_rndis_linkoutput(struct netif *netif, struct pbuf *p)
     }
 }
 
-void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rndis_eth_input(struct usbh_rndis *rndis_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(&g_rndis_netif, buf, buflen);
+    usbh_lwip_eth_input_common(&g_rndis_netif[rndis_class->minor].netif, buf, buflen);
 }
 
 static err_t usbh_rndis_if_init(struct netif *netif)
@@ -239,7 +268,6 @@ static err_t usbh_rndis_if_init(struct netif *netif)
 
     netif->mtu = 1500;
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
-    netif->state = NULL;
     netif->name[0] = 'E';
     netif->name[1] = 'X';
     netif->output = etharp_output;
@@ -249,7 +277,8 @@ static err_t usbh_rndis_if_init(struct netif *netif)
 
 void usbh_rndis_run(struct usbh_rndis *rndis_class)
 {
-    struct netif *netif = &g_rndis_netif;
+    struct usbh_lwip_netif *lwip_netif = &g_rndis_netif[rndis_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, rndis_class->mac, 6);
@@ -258,40 +287,39 @@ void usbh_rndis_run(struct usbh_rndis *rndis_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
-    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_rndis_if_init, tcpip_input);
-    netif_set_default(netif);
+    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, rndis_class, usbh_rndis_if_init, tcpip_input);
+    usbh_lwip_netif_set_default(netif);
     while (!netif_is_up(netif)) {
     }
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    lwip_netif->dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, lwip_netif, true);
+    if (lwip_netif->dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
 
-    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, NULL);
+    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, (void *)rndis_class);
 
     //timer_init(rndis_class);
 
 #if LWIP_DHCP
     dhcp_start(netif);
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(lwip_netif->dhcp_handle);
 #endif
 }
 
 void usbh_rndis_stop(struct usbh_rndis *rndis_class)
 {
-    struct netif *netif = &g_rndis_netif;
-    (void)rndis_class;
+    struct usbh_lwip_netif *lwip_netif = &g_rndis_netif[rndis_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
 #if LWIP_DHCP
     dhcp_stop(netif);
     dhcp_cleanup(netif);
-    usb_osal_timer_delete(dhcp_handle);
+    usb_osal_timer_delete(lwip_netif->dhcp_handle);
 #endif
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
     // xTimerStop(timer_handle, 0);
     // xTimerDelete(timer_handle, 0);
 }
@@ -300,15 +328,15 @@ void usbh_rndis_stop(struct usbh_rndis *rndis_class)
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_NCM
 #include "usbh_cdc_ncm.h"
 
-struct netif g_cdc_ncm_netif;
+static struct usbh_lwip_netif g_cdc_ncm_netif[CONFIG_USBHOST_MAX_CDC_NCM_CLASS];
 
 static err_t usbh_cdc_ncm_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
-    (void)netif;
+    struct usbh_cdc_ncm *cdc_ncm_class = (struct usbh_cdc_ncm *)netif->state;
 
-    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf());
-    ret = usbh_cdc_ncm_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf(cdc_ncm_class));
+    ret = usbh_cdc_ncm_eth_output(cdc_ncm_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     } else {
@@ -316,9 +344,9 @@ static err_t usbh_cdc_ncm_linkoutput(struct netif *netif, struct pbuf *p)
     }
 }
 
-void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ncm_eth_input(struct usbh_cdc_ncm *cdc_ncm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(&g_cdc_ncm_netif, buf, buflen);
+    usbh_lwip_eth_input_common(&g_cdc_ncm_netif[cdc_ncm_class->minor].netif, buf, buflen);
 }
 
 static err_t usbh_cdc_ncm_if_init(struct netif *netif)
@@ -327,7 +355,6 @@ static err_t usbh_cdc_ncm_if_init(struct netif *netif)
 
     netif->mtu = 1500;
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
-    netif->state = NULL;
     netif->name[0] = 'E';
     netif->name[1] = 'X';
     netif->output = etharp_output;
@@ -337,7 +364,8 @@ static err_t usbh_cdc_ncm_if_init(struct netif *netif)
 
 void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    struct netif *netif = &g_cdc_ncm_netif;
+    struct usbh_lwip_netif *lwip_netif = &g_cdc_ncm_netif[cdc_ncm_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, cdc_ncm_class->mac, 6);
@@ -346,52 +374,51 @@ void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
-    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_cdc_ncm_if_init, tcpip_input);
-    netif_set_default(netif);
+    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, cdc_ncm_class, usbh_cdc_ncm_if_init, tcpip_input);
+    usbh_lwip_netif_set_default(netif);
     while (!netif_is_up(netif)) {
     }
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    lwip_netif->dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, lwip_netif, true);
+    if (lwip_netif->dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
 
-    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, NULL);
+    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, (void *)cdc_ncm_class);
 #if LWIP_DHCP
     dhcp_start(netif);
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(lwip_netif->dhcp_handle);
 #endif
 }
 
 void usbh_cdc_ncm_stop(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    struct netif *netif = &g_cdc_ncm_netif;
-    (void)cdc_ncm_class;
+    struct usbh_lwip_netif *lwip_netif = &g_cdc_ncm_netif[cdc_ncm_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
 #if LWIP_DHCP
     dhcp_stop(netif);
     dhcp_cleanup(netif);
-    usb_osal_timer_delete(dhcp_handle);
+    usb_osal_timer_delete(lwip_netif->dhcp_handle);
 #endif
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_ASIX
 #include "usbh_asix.h"
 
-struct netif g_asix_netif;
+static struct usbh_lwip_netif g_asix_netif[CONFIG_USBHOST_MAX_ASIX_CLASS];
 
 static err_t usbh_asix_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
-    (void)netif;
+    struct usbh_asix *asix_class = (struct usbh_asix *)netif->state;
 
-    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf());
-    ret = usbh_asix_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf(asix_class));
+    ret = usbh_asix_eth_output(asix_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     } else {
@@ -399,9 +426,9 @@ static err_t usbh_asix_linkoutput(struct netif *netif, struct pbuf *p)
     }
 }
 
-void usbh_asix_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_asix_eth_input(struct usbh_asix *asix_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(&g_asix_netif, buf, buflen);
+    usbh_lwip_eth_input_common(&g_asix_netif[asix_class->minor].netif, buf, buflen);
 }
 
 static err_t usbh_asix_if_init(struct netif *netif)
@@ -410,7 +437,6 @@ static err_t usbh_asix_if_init(struct netif *netif)
 
     netif->mtu = 1500;
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
-    netif->state = NULL;
     netif->name[0] = 'E';
     netif->name[1] = 'X';
     netif->output = etharp_output;
@@ -420,7 +446,8 @@ static err_t usbh_asix_if_init(struct netif *netif)
 
 void usbh_asix_run(struct usbh_asix *asix_class)
 {
-    struct netif *netif = &g_asix_netif;
+    struct usbh_lwip_netif *lwip_netif = &g_asix_netif[asix_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, asix_class->mac, 6);
@@ -429,52 +456,51 @@ void usbh_asix_run(struct usbh_asix *asix_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
-    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_asix_if_init, tcpip_input);
-    netif_set_default(netif);
+    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, asix_class, usbh_asix_if_init, tcpip_input);
+    usbh_lwip_netif_set_default(netif);
     while (!netif_is_up(netif)) {
     }
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    lwip_netif->dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, lwip_netif, true);
+    if (lwip_netif->dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
 
-    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, NULL);
+    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, (void *)asix_class);
 #if LWIP_DHCP
     dhcp_start(netif);
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(lwip_netif->dhcp_handle);
 #endif
 }
 
 void usbh_asix_stop(struct usbh_asix *asix_class)
 {
-    struct netif *netif = &g_asix_netif;
-    (void)asix_class;
+    struct usbh_lwip_netif *lwip_netif = &g_asix_netif[asix_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
 #if LWIP_DHCP
     dhcp_stop(netif);
     dhcp_cleanup(netif);
-    usb_osal_timer_delete(dhcp_handle);
+    usb_osal_timer_delete(lwip_netif->dhcp_handle);
 #endif
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_RTL8152
 #include "usbh_rtl8152.h"
 
-struct netif g_rtl8152_netif;
+static struct usbh_lwip_netif g_rtl8152_netif[CONFIG_USBHOST_MAX_RTL8152_CLASS];
 
 static err_t usbh_rtl8152_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
-    (void)netif;
+    struct usbh_rtl8152 *rtl8152_class = (struct usbh_rtl8152 *)netif->state;
 
-    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf());
-    ret = usbh_rtl8152_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf(rtl8152_class));
+    ret = usbh_rtl8152_eth_output(rtl8152_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     } else {
@@ -482,9 +508,36 @@ static err_t usbh_rtl8152_linkoutput(struct netif *netif, struct pbuf *p)
     }
 }
 
-void usbh_rtl8152_eth_input(uint8_t *buf, uint32_t buflen)
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+static uint16_t usbh_rtl8152_chksum_flags(struct usbh_rtl8152 *rtl8152_class, uint8_t rx_csum_ok)
 {
-    usbh_lwip_eth_input_common(&g_rtl8152_netif, buf, buflen);
+    uint16_t flags = NETIF_CHECKSUM_ENABLE_ALL;
+
+    if (rtl8152_class->tx_csum) {
+        flags &= ~NETIF_CHECKSUM_GEN_TCP;
+    }
+    if (rx_csum_ok & USBH_RTL8152_CSUM_IP) {
+        flags &= ~NETIF_CHECKSUM_CHECK_IP;
+    }
+    if (rx_csum_ok & USBH_RTL8152_CSUM_TCP) {
+        flags &= ~NETIF_CHECKSUM_CHECK_TCP;
+    }
+    if (rx_csum_ok & USBH_RTL8152_CSUM_UDP) {
+        flags &= ~NETIF_CHECKSUM_CHECK_UDP;
+    }
+    return flags;
+}
+#endif
+
+void usbh_rtl8152_eth_input(struct usbh_rtl8152 *rtl8152_class, uint8_t *buf, uint32_t buflen)
+{
+    struct netif *netif = &g_rtl8152_netif[rtl8152_class->minor].netif;
+
+#if LWIP_CHECKSUM_CTRL_PER_NETIF && LWIP_TCPIP_CORE_LOCKING_INPUT
+    /* frame is processed in this thread, check flags only matter for it, gen flags never change */
+    NETIF_SET_CHECKSUM_CTRL(netif, usbh_rtl8152_chksum_flags(rtl8152_class, rtl8152_class->rx_csum_ok));
+#endif
+    usbh_lwip_eth_input_common(netif, buf, buflen);
 }
 
 static err_t usbh_rtl8152_if_init(struct netif *netif)
@@ -493,17 +546,20 @@ static err_t usbh_rtl8152_if_init(struct netif *netif)
 
     netif->mtu = 1500;
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
-    netif->state = NULL;
     netif->name[0] = 'E';
     netif->name[1] = 'X';
     netif->output = etharp_output;
     netif->linkoutput = usbh_rtl8152_linkoutput;
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+    NETIF_SET_CHECKSUM_CTRL(netif, usbh_rtl8152_chksum_flags((struct usbh_rtl8152 *)netif->state, 0));
+#endif
     return ERR_OK;
 }
 
 void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
 {
-    struct netif *netif = &g_rtl8152_netif;
+    struct usbh_lwip_netif *lwip_netif = &g_rtl8152_netif[rtl8152_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, rtl8152_class->mac, 6);
@@ -512,44 +568,43 @@ void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
-    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_rtl8152_if_init, tcpip_input);
-    netif_set_default(netif);
+    netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, rtl8152_class, usbh_rtl8152_if_init, tcpip_input);
+    usbh_lwip_netif_set_default(netif);
     while (!netif_is_up(netif)) {
     }
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    lwip_netif->dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, lwip_netif, true);
+    if (lwip_netif->dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
 
-    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, NULL);
+    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, (void *)rtl8152_class);
 #if LWIP_DHCP
     dhcp_start(netif);
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(lwip_netif->dhcp_handle);
 #endif
 }
 
 void usbh_rtl8152_stop(struct usbh_rtl8152 *rtl8152_class)
 {
-    struct netif *netif = &g_rtl8152_netif;
-    (void)rtl8152_class;
+    struct usbh_lwip_netif *lwip_netif = &g_rtl8152_netif[rtl8152_class->minor];
+    struct netif *netif = &lwip_netif->netif;
 
 #if LWIP_DHCP
     dhcp_stop(netif);
     dhcp_cleanup(netif);
-    usb_osal_timer_delete(dhcp_handle);
+    usb_osal_timer_delete(lwip_netif->dhcp_handle);
 #endif
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_BL616
 #include "usbh_bl616.h"
 
-struct netif g_bl616_netif;
+static struct usbh_lwip_netif g_bl616_netif;
 static err_t usbh_bl616_linkoutput(struct netif *netif, struct pbuf *p)
 {
     int ret;
@@ -566,7 +621,7 @@ static err_t usbh_bl616_linkoutput(struct netif *netif, struct pbuf *p)
 
 void usbh_bl616_eth_input(uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(&g_bl616_netif, buf, buflen);
+    usbh_lwip_eth_input_common(&g_bl616_netif.netif, buf, buflen);
 }
 
 static err_t usbh_bl616_if_init(struct netif *netif)
@@ -589,25 +644,26 @@ void usbh_bl616_sta_connect_callback(void)
 
 void usbh_bl616_sta_disconnect_callback(void)
 {
-    struct netif *netif = &g_bl616_netif;
+    struct netif *netif = &g_bl616_netif.netif;
 
     netif_set_down(netif);
 }
 
 void usbh_bl616_sta_update_ip(uint8_t ip4_addr[4], uint8_t ip4_mask[4], uint8_t ip4_gw[4])
 {
-    struct netif *netif = &g_bl616_netif;
+    struct netif *netif = &g_bl616_netif.netif;
 
     IP4_ADDR(&netif->ip_addr, ip4_addr[0], ip4_addr[1], ip4_addr[2], ip4_addr[3]);
     IP4_ADDR(&netif->netmask, ip4_mask[0], ip4_mask[1], ip4_mask[2], ip4_mask[3]);
     IP4_ADDR(&netif->gw, ip4_gw[0], ip4_gw[1], ip4_gw[2], ip4_gw[3]);
 
     netif_set_up(netif);
+    usbh_lwip_netif_set_default(netif);
 }
 
 void usbh_bl616_run(struct usbh_bl616 *bl616_class)
 {
-    struct netif *netif = &g_bl616_netif;
+    struct netif *netif = &g_bl616_netif.netif;
 
     netif->hwaddr_len = 6;
     memcpy(netif->hwaddr, bl616_class->sta_mac, 6);
@@ -618,27 +674,26 @@ void usbh_bl616_run(struct usbh_bl616 *bl616_class)
 
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_bl616_if_init, tcpip_input);
     netif_set_down(netif);
-    netif_set_default(netif);
+    usbh_lwip_netif_set_default(netif);
 
-    dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, netif, true);
-    if (dhcp_handle == NULL) {
+    g_bl616_netif.dhcp_handle = usb_osal_timer_create("dhcp", 200, dhcp_timeout, &g_bl616_netif, true);
+    if (g_bl616_netif.dhcp_handle == NULL) {
         USB_LOG_ERR("timer creation failed! \r\n");
         while (1) {
         }
     }
-    usb_osal_timer_start(dhcp_handle);
+    usb_osal_timer_start(g_bl616_netif.dhcp_handle);
 
     usb_osal_thread_create("usbh_bl616", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_bl616_rx_thread, NULL);
 }
 
 void usbh_bl616_stop(struct usbh_bl616 *bl616_class)
 {
-    struct netif *netif = &g_bl616_netif;
+    struct netif *netif = &g_bl616_netif.netif;
 
     (void)bl616_class;
 
-    netif_set_down(netif);
-    netif_remove(netif);
+    usbh_lwip_netif_remove(netif);
 }
 
 // #include "shell.h"
@@ -52,24 +52,23 @@ void usbh_lwip_eth_input_common(esp_netif_t *esp_netif, uint8_t *buf, uint32_t l
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_ECM
 #include "usbh_cdc_ecm.h"
 
-static esp_netif_t *g_esp_netif = NULL;
+static esp_netif_t *g_esp_netif[CONFIG_USBHOST_MAX_CDC_ECM_CLASS];
 
-static err_t usbh_cdc_ecm_linkoutput(esp_netif_t *netif, struct pbuf *p)
+static err_t usbh_cdc_ecm_linkoutput(struct usbh_cdc_ecm *cdc_ecm_class, struct pbuf *p)
 {
     int ret;
-    (void)netif;
 
-    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf());
-    ret = usbh_cdc_ecm_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf(cdc_ecm_class));
+    ret = usbh_cdc_ecm_eth_output(cdc_ecm_class, p->tot_len);
     if (ret < 0) {
         return ERR_BUF;
     }
     return ERR_OK;
 }
 
-void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ecm_eth_input(struct usbh_cdc_ecm *cdc_ecm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_esp_netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_esp_netif[cdc_ecm_class->minor], buf, buflen);
 }
 
 static esp_err_t usb_cdc_ecm_transmit(void *h,
@@ -87,7 +86,7 @@ static esp_err_t usb_cdc_ecm_transmit(void *h,
         return ESP_FAIL;
     }
 
-    err_t ret = usbh_cdc_ecm_linkoutput(g_esp_netif, p);
+    err_t ret = usbh_cdc_ecm_linkoutput((struct usbh_cdc_ecm *)h, p);
 
     return (ret == ERR_OK) ? ESP_OK : ESP_FAIL;
 }
@@ -100,12 +99,12 @@ static void l2_free(void *h, void *buffer)
 void usbh_cdc_ecm_set_link_status(struct usbh_cdc_ecm *cdc_ecm_class)
 {
     if (cdc_ecm_class->connect_status) {
-        esp_netif_action_connected(g_esp_netif, NULL, 0, NULL);
-        esp_event_post(ETH_EVENT, ETHERNET_EVENT_CONNECTED, &g_esp_netif, sizeof(esp_netif_t *), portMAX_DELAY);
+        esp_netif_action_connected(g_esp_netif[cdc_ecm_class->minor], NULL, 0, NULL);
+        esp_event_post(ETH_EVENT, ETHERNET_EVENT_CONNECTED, &g_esp_netif[cdc_ecm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
 
     } else {
-        esp_netif_action_disconnected(g_esp_netif, NULL, 0, NULL);
-        esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif, sizeof(esp_netif_t *), portMAX_DELAY);
+        esp_netif_action_disconnected(g_esp_netif[cdc_ecm_class->minor], NULL, 0, NULL);
+        esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif[cdc_ecm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
     }
 }
 
@@ -113,6 +112,10 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
 {
     // 1) Setup a basic IP configuration (here, using all zeros as placeholders)
     esp_netif_ip_info_t ip_info = { 0 };
+    char if_key[16];
+
+    /* esp_netif needs a distinct key for every instance */
+    snprintf(if_key, sizeof(if_key), "usbh_cdc_eth%d", cdc_ecm_class->minor);
 
     // 2) Derive the inherent configuration similar to IDF's default WiFi AP/DHCP settings.
     esp_netif_inherent_config_t base_cfg = {
@@ -120,7 +123,7 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
         .ip_info = &ip_info,
         .get_ip_event = IP_EVENT_ETH_GOT_IP,
         .lost_ip_event = IP_EVENT_ETH_LOST_IP,
-        .if_key = "usbh_cdc_eth",
+        .if_key = if_key,
         .if_desc = "usb cdc ecm config device",
         .route_prio = 10,
     };
@@ -142,57 +145,57 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
     };
 
     // 5) Create the esp_netif instance.
-    g_esp_netif = esp_netif_new(&cfg);
-    if (g_esp_netif == NULL) {
+    g_esp_netif[cdc_ecm_class->minor] = esp_netif_new(&cfg);
+    if (g_esp_netif[cdc_ecm_class->minor] == NULL) {
         USB_LOG_ERR("Failed to create esp_netif instance");
         return;
     }
 
     // 6) Set the MAC address for the interface.
     // Assumes cdc_ecm_class->mac contains a valid 6-byte MAC address.
-    if (esp_netif_set_mac(g_esp_netif, cdc_ecm_class->mac) != ESP_OK) {
+    if (esp_netif_set_mac(g_esp_netif[cdc_ecm_class->minor], cdc_ecm_class->mac) != ESP_OK) {
         USB_LOG_ERR("Failed to set MAC address");
     }
 
-    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, NULL);
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_start(g_esp_netif, 0, 0, 0);
+    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, (void *)cdc_ecm_class);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif[cdc_ecm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_start(g_esp_netif[cdc_ecm_class->minor], 0, 0, 0);
 }
 
 void usbh_cdc_ecm_stop(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    if (!g_esp_netif) {
+    if (!g_esp_netif[cdc_ecm_class->minor]) {
         ESP_LOGW("CDC_ECM", "ESP-NETIF is already NULL, nothing to stop.");
         return;
     }
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif, sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif[cdc_ecm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
 
     // Bring down the ESP-NETIF interface
-    esp_netif_action_disconnected(g_esp_netif, NULL, 0, NULL);
+    esp_netif_action_disconnected(g_esp_netif[cdc_ecm_class->minor], NULL, 0, NULL);
 
     // Remove ESP-NETIF instance (so it can be reinitialized later)
-    esp_netif_destroy(g_esp_netif);
-    g_esp_netif = NULL;
+    esp_netif_destroy(g_esp_netif[cdc_ecm_class->minor]);
+    g_esp_netif[cdc_ecm_class->minor] = NULL;
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_RNDIS
 #include "usbh_rndis.h"
 
-static esp_netif_t *g_esp_netif_rndis = NULL;
+static esp_netif_t *g_esp_netif_rndis[CONFIG_USBHOST_MAX_RNDIS_CLASS];
 
-static err_t usbh_rndis_linkoutput(esp_netif_t *netif, struct pbuf *p)
+static err_t usbh_rndis_linkoutput(struct usbh_rndis *rndis_class, struct pbuf *p)
 {
     int ret;
-    (void)netif;
-    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf());
-    ret = usbh_rndis_eth_output(p->tot_len);
+
+    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf(rndis_class));
+    ret = usbh_rndis_eth_output(rndis_class, p->tot_len);
     return (ret < 0) ? ERR_BUF : ERR_OK;
 }
 
-void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rndis_eth_input(struct usbh_rndis *rndis_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_esp_netif_rndis, buf, buflen);
+    usbh_lwip_eth_input_common(g_esp_netif_rndis[rndis_class->minor], buf, buflen);
 }
 
 static esp_err_t usb_rndis_transmit(void *h, void *buffer, size_t len)
@@ -207,7 +210,7 @@ static esp_err_t usb_rndis_transmit(void *h, void *buffer, size_t len)
         pbuf_free(p);
         return ESP_FAIL;
     }
-    err_t ret = usbh_rndis_linkoutput(g_esp_netif_rndis, p);
+    err_t ret = usbh_rndis_linkoutput((struct usbh_rndis *)h, p);
     pbuf_free(p);
     return (ret == ERR_OK) ? ESP_OK : ESP_FAIL;
 }
@@ -220,12 +223,17 @@ static void rndis_l2_free(void *h, void *buffer)
 void usbh_rndis_run(struct usbh_rndis *rndis_class)
 {
     esp_netif_ip_info_t ip_info = { 0 };
+    char if_key[16];
+
+    /* esp_netif needs a distinct key for every instance */
+    snprintf(if_key, sizeof(if_key), "usbh_rndis%d", rndis_class->minor);
+
     esp_netif_inherent_config_t base_cfg = {
         .flags = ESP_NETIF_DHCP_CLIENT | ESP_NETIF_FLAG_EVENT_IP_MODIFIED | ESP_NETIF_FLAG_AUTOUP,
         .ip_info = &ip_info,
         .get_ip_event = IP_EVENT_ETH_GOT_IP,
         .lost_ip_event = IP_EVENT_ETH_LOST_IP,
-        .if_key = "usbh_rndis",
+        .if_key = if_key,
         .if_desc = "usb rndis config device",
         .route_prio = 10,
     };
@@ -243,54 +251,54 @@ void usbh_rndis_run(struct usbh_rndis *rndis_class)
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
     };
 
-    g_esp_netif_rndis = esp_netif_new(&cfg);
-    if (g_esp_netif_rndis == NULL) {
+    g_esp_netif_rndis[rndis_class->minor] = esp_netif_new(&cfg);
+    if (g_esp_netif_rndis[rndis_class->minor] == NULL) {
         USB_LOG_ERR("Failed to create esp_netif instance for RNDIS");
         return;
     }
 
-    if (esp_netif_set_mac(g_esp_netif_rndis, rndis_class->mac) != ESP_OK) {
+    if (esp_netif_set_mac(g_esp_netif_rndis[rndis_class->minor], rndis_class->mac) != ESP_OK) {
         USB_LOG_ERR("Failed to set MAC address for RNDIS");
     }
 
-    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, NULL);
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_rndis, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_start(g_esp_netif_rndis, 0, 0, 0);
+    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, (void *)rndis_class);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_rndis[rndis_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_start(g_esp_netif_rndis[rndis_class->minor], 0, 0, 0);
 #if LWIP_DHCP
-    esp_netif_dhcpc_start(g_esp_netif_rndis);
+    esp_netif_dhcpc_start(g_esp_netif_rndis[rndis_class->minor]);
 #endif
 }
 
 void usbh_rndis_stop(struct usbh_rndis *rndis_class)
 {
-    if (!g_esp_netif_rndis) {
+    if (!g_esp_netif_rndis[rndis_class->minor]) {
         USB_LOGW("RNDIS", "ESP-NETIF is already NULL, nothing to stop.");
         return;
     }
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_rndis, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_disconnected(g_esp_netif_rndis, NULL, 0, NULL);
-    esp_netif_destroy(g_esp_netif_rndis);
-    g_esp_netif_rndis = NULL;
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_rndis[rndis_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_disconnected(g_esp_netif_rndis[rndis_class->minor], NULL, 0, NULL);
+    esp_netif_destroy(g_esp_netif_rndis[rndis_class->minor]);
+    g_esp_netif_rndis[rndis_class->minor] = NULL;
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_NCM
 #include "usbh_cdc_ncm.h"
 
-static esp_netif_t *g_esp_netif_ncm = NULL;
+static esp_netif_t *g_esp_netif_ncm[CONFIG_USBHOST_MAX_CDC_NCM_CLASS];
 
-static err_t usbh_cdc_ncm_linkoutput(esp_netif_t *netif, struct pbuf *p)
+static err_t usbh_cdc_ncm_linkoutput(struct usbh_cdc_ncm *cdc_ncm_class, struct pbuf *p)
 {
     int ret;
-    (void)netif;
-    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf());
-    ret = usbh_cdc_ncm_eth_output(p->tot_len);
+
+    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf(cdc_ncm_class));
+    ret = usbh_cdc_ncm_eth_output(cdc_ncm_class, p->tot_len);
     return (ret < 0) ? ERR_BUF : ERR_OK;
 }
 
-void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ncm_eth_input(struct usbh_cdc_ncm *cdc_ncm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_esp_netif_ncm, buf, buflen);
+    usbh_lwip_eth_input_common(g_esp_netif_ncm[cdc_ncm_class->minor], buf, buflen);
 }
 
 static esp_err_t usb_cdc_ncm_transmit(void *h, void *buffer, size_t len)
@@ -305,7 +313,7 @@ static esp_err_t usb_cdc_ncm_transmit(void *h, void *buffer, size_t len)
         pbuf_free(p);
         return ESP_FAIL;
     }
-    err_t ret = usbh_cdc_ncm_linkoutput(g_esp_netif_ncm, p);
+    err_t ret = usbh_cdc_ncm_linkoutput((struct usbh_cdc_ncm *)h, p);
     pbuf_free(p);
     return (ret == ERR_OK) ? ESP_OK : ESP_FAIL;
 }
@@ -318,12 +326,17 @@ static void ncm_l2_free(void *h, void *buffer)
 void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
 {
     esp_netif_ip_info_t ip_info = { 0 };
+    char if_key[16];
+
+    /* esp_netif needs a distinct key for every instance */
+    snprintf(if_key, sizeof(if_key), "usbh_cdc_ncm%d", cdc_ncm_class->minor);
+
     esp_netif_inherent_config_t base_cfg = {
         .flags = ESP_NETIF_DHCP_CLIENT | ESP_NETIF_FLAG_EVENT_IP_MODIFIED | ESP_NETIF_FLAG_AUTOUP,
         .ip_info = &ip_info,
         .get_ip_event = IP_EVENT_ETH_GOT_IP,
         .lost_ip_event = IP_EVENT_ETH_LOST_IP,
-        .if_key = "usbh_cdc_ncm",
+        .if_key = if_key,
         .if_desc = "usb cdc ncm config device",
         .route_prio = 10,
     };
@@ -341,54 +354,54 @@ void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
     };
 
-    g_esp_netif_ncm = esp_netif_new(&cfg);
-    if (g_esp_netif_ncm == NULL) {
+    g_esp_netif_ncm[cdc_ncm_class->minor] = esp_netif_new(&cfg);
+    if (g_esp_netif_ncm[cdc_ncm_class->minor] == NULL) {
         USB_LOG_ERR("Failed to create esp_netif instance for CDC_NCM");
         return;
     }
 
-    if (esp_netif_set_mac(g_esp_netif_ncm, cdc_ncm_class->mac) != ESP_OK) {
+    if (esp_netif_set_mac(g_esp_netif_ncm[cdc_ncm_class->minor], cdc_ncm_class->mac) != ESP_OK) {
         USB_LOG_ERR("Failed to set MAC address for CDC_NCM");
     }
 
-    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, NULL);
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_ncm, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_start(g_esp_netif_ncm, 0, 0, 0);
+    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, (void *)cdc_ncm_class);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_ncm[cdc_ncm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_start(g_esp_netif_ncm[cdc_ncm_class->minor], 0, 0, 0);
 #if LWIP_DHCP
-    esp_netif_dhcpc_start(g_esp_netif_ncm);
+    esp_netif_dhcpc_start(g_esp_netif_ncm[cdc_ncm_class->minor]);
 #endif
 }
 
 void usbh_cdc_ncm_stop(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    if (!g_esp_netif_ncm) {
+    if (!g_esp_netif_ncm[cdc_ncm_class->minor]) {
         USB_LOGW("CDC_NCM", "ESP-NETIF is already NULL, nothing to stop.");
         return;
     }
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_ncm, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_disconnected(g_esp_netif_ncm, NULL, 0, NULL);
-    esp_netif_destroy(g_esp_netif_ncm);
-    g_esp_netif_ncm = NULL;
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_ncm[cdc_ncm_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_disconnected(g_esp_netif_ncm[cdc_ncm_class->minor], NULL, 0, NULL);
+    esp_netif_destroy(g_esp_netif_ncm[cdc_ncm_class->minor]);
+    g_esp_netif_ncm[cdc_ncm_class->minor] = NULL;
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_ASIX
 #include "usbh_asix.h"
 
-static esp_netif_t *g_esp_netif_asix = NULL;
+static esp_netif_t *g_esp_netif_asix[CONFIG_USBHOST_MAX_ASIX_CLASS];
 
-static err_t usbh_asix_linkoutput(esp_netif_t *netif, struct pbuf *p)
+static err_t usbh_asix_linkoutput(struct usbh_asix *asix_class, struct pbuf *p)
 {
     int ret;
-    (void)netif;
-    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf());
-    ret = usbh_asix_eth_output(p->tot_len);
+
+    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf(asix_class));
+    ret = usbh_asix_eth_output(asix_class, p->tot_len);
     return (ret < 0) ? ERR_BUF : ERR_OK;
 }
 
-void usbh_asix_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_asix_eth_input(struct usbh_asix *asix_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_esp_netif_asix, buf, buflen);
+    usbh_lwip_eth_input_common(g_esp_netif_asix[asix_class->minor], buf, buflen);
 }
 
 static esp_err_t usb_asix_transmit(void *h, void *buffer, size_t len)
@@ -403,7 +416,7 @@ static esp_err_t usb_asix_transmit(void *h, void *buffer, size_t len)
         pbuf_free(p);
         return ESP_FAIL;
     }
-    err_t ret = usbh_asix_linkoutput(g_esp_netif_asix, p);
+    err_t ret = usbh_asix_linkoutput((struct usbh_asix *)h, p);
     pbuf_free(p);
     return (ret == ERR_OK) ? ESP_OK : ESP_FAIL;
 }
@@ -416,12 +429,17 @@ static void asix_l2_free(void *h, void *buffer)
 void usbh_asix_run(struct usbh_asix *asix_class)
 {
     esp_netif_ip_info_t ip_info = { 0 };
+    char if_key[16];
+
+    /* esp_netif needs a distinct key for every instance */
+    snprintf(if_key, sizeof(if_key), "usbh_asix%d", asix_class->minor);
+
     esp_netif_inherent_config_t base_cfg = {
         .flags = ESP_NETIF_DHCP_CLIENT | ESP_NETIF_FLAG_EVENT_IP_MODIFIED | ESP_NETIF_FLAG_AUTOUP,
         .ip_info = &ip_info,
         .get_ip_event = IP_EVENT_ETH_GOT_IP,
         .lost_ip_event = IP_EVENT_ETH_LOST_IP,
-        .if_key = "usbh_asix",
+        .if_key = if_key,
         .if_desc = "usb asix config device",
         .route_prio = 10,
     };
@@ -439,54 +457,54 @@ void usbh_asix_run(struct usbh_asix *asix_class)
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
     };
 
-    g_esp_netif_asix = esp_netif_new(&cfg);
-    if (g_esp_netif_asix == NULL) {
+    g_esp_netif_asix[asix_class->minor] = esp_netif_new(&cfg);
+    if (g_esp_netif_asix[asix_class->minor] == NULL) {
         USB_LOG_ERR("Failed to create esp_netif instance for ASIX");
         return;
     }
 
-    if (esp_netif_set_mac(g_esp_netif_asix, asix_class->mac) != ESP_OK) {
+    if (esp_netif_set_mac(g_esp_netif_asix[asix_class->minor], asix_class->mac) != ESP_OK) {
         USB_LOG_ERR("Failed to set MAC address for ASIX");
     }
 
-    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, NULL);
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_asix, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_start(g_esp_netif_asix, 0, 0, 0);
+    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, (void *)asix_class);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_asix[asix_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_start(g_esp_netif_asix[asix_class->minor], 0, 0, 0);
 #if LWIP_DHCP
-    esp_netif_dhcpc_start(g_esp_netif_asix);
+    esp_netif_dhcpc_start(g_esp_netif_asix[asix_class->minor]);
 #endif
 }
 
 void usbh_asix_stop(struct usbh_asix *asix_class)
 {
-    if (!g_esp_netif_asix) {
+    if (!g_esp_netif_asix[asix_class->minor]) {
         USB_LOGW("ASIX", "ESP-NETIF is already NULL, nothing to stop.");
         return;
     }
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_asix, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_disconnected(g_esp_netif_asix, NULL, 0, NULL);
-    esp_netif_destroy(g_esp_netif_asix);
-    g_esp_netif_asix = NULL;
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_asix[asix_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_disconnected(g_esp_netif_asix[asix_class->minor], NULL, 0, NULL);
+    esp_netif_destroy(g_esp_netif_asix[asix_class->minor]);
+    g_esp_netif_asix[asix_class->minor] = NULL;
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_RTL8152
 #include "usbh_rtl8152.h"
 
-static esp_netif_t *g_esp_netif_rtl8152 = NULL;
+static esp_netif_t *g_esp_netif_rtl8152[CONFIG_USBHOST_MAX_RTL8152_CLASS];
 
-static err_t usbh_rtl8152_linkoutput(esp_netif_t *netif, struct pbuf *p)
+static err_t usbh_rtl8152_linkoutput(struct usbh_rtl8152 *rtl8152_class, struct pbuf *p)
 {
     int ret;
-    (void)netif;
-    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf());
-    ret = usbh_rtl8152_eth_output(p->tot_len);
+
+    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf(rtl8152_class));
+    ret = usbh_rtl8152_eth_output(rtl8152_class, p->tot_len);
     return (ret < 0) ? ERR_BUF : ERR_OK;
 }
 
-void usbh_rtl8152_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rtl8152_eth_input(struct usbh_rtl8152 *rtl8152_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_esp_netif_rtl8152, buf, buflen);
+    usbh_lwip_eth_input_common(g_esp_netif_rtl8152[rtl8152_class->minor], buf, buflen);
 }
 
 static esp_err_t usb_rtl8152_transmit(void *h, void *buffer, size_t len)
@@ -501,7 +519,7 @@ static esp_err_t usb_rtl8152_transmit(void *h, void *buffer, size_t len)
         pbuf_free(p);
         return ESP_FAIL;
     }
-    err_t ret = usbh_rtl8152_linkoutput(g_esp_netif_rtl8152, p);
+    err_t ret = usbh_rtl8152_linkoutput((struct usbh_rtl8152 *)h, p);
     pbuf_free(p);
     return (ret == ERR_OK) ? ESP_OK : ESP_FAIL;
 }
@@ -514,12 +532,17 @@ static void rtl8152_l2_free(void *h, void *buffer)
 void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
 {
     esp_netif_ip_info_t ip_info = { 0 };
+    char if_key[16];
+
+    /* esp_netif needs a distinct key for every instance */
+    snprintf(if_key, sizeof(if_key), "usbh_rtl8152%d", rtl8152_class->minor);
+
     esp_netif_inherent_config_t base_cfg = {
         .flags = ESP_NETIF_DHCP_CLIENT | ESP_NETIF_FLAG_EVENT_IP_MODIFIED | ESP_NETIF_FLAG_AUTOUP,
         .ip_info = &ip_info,
         .get_ip_event = IP_EVENT_ETH_GOT_IP,
         .lost_ip_event = IP_EVENT_ETH_LOST_IP,
-        .if_key = "usbh_rtl8152",
+        .if_key = if_key,
         .if_desc = "usb rtl8152 config device",
         .route_prio = 10,
     };
@@ -537,34 +560,34 @@ void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
     };
 
-    g_esp_netif_rtl8152 = esp_netif_new(&cfg);
-    if (g_esp_netif_rtl8152 == NULL) {
+    g_esp_netif_rtl8152[rtl8152_class->minor] = esp_netif_new(&cfg);
+    if (g_esp_netif_rtl8152[rtl8152_class->minor] == NULL) {
         USB_LOG_ERR("Failed to create esp_netif instance for RTL8152");
         return;
     }
 
-    if (esp_netif_set_mac(g_esp_netif_rtl8152, rtl8152_class->mac) != ESP_OK) {
+    if (esp_netif_set_mac(g_esp_netif_rtl8152[rtl8152_class->minor], rtl8152_class->mac) != ESP_OK) {
         USB_LOG_ERR("Failed to set MAC address for RTL8152");
     }
 
-    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, NULL);
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_rtl8152, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_start(g_esp_netif_rtl8152, 0, 0, 0);
+    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, (void *)rtl8152_class);
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_START, &g_esp_netif_rtl8152[rtl8152_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_start(g_esp_netif_rtl8152[rtl8152_class->minor], 0, 0, 0);
 #if LWIP_DHCP
-    esp_netif_dhcpc_start(g_esp_netif_rtl8152);
+    esp_netif_dhcpc_start(g_esp_netif_rtl8152[rtl8152_class->minor]);
 #endif
 }
 
 void usbh_rtl8152_stop(struct usbh_rtl8152 *rtl8152_class)
 {
-    if (!g_esp_netif_rtl8152) {
+    if (!g_esp_netif_rtl8152[rtl8152_class->minor]) {
         USB_LOG_WRN("RTL8152", "ESP-NETIF is already NULL, nothing to stop.");
         return;
     }
-    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_rtl8152, sizeof(esp_netif_t *), portMAX_DELAY);
-    esp_netif_action_disconnected(g_esp_netif_rtl8152, NULL, 0, NULL);
-    esp_netif_destroy(g_esp_netif_rtl8152);
-    g_esp_netif_rtl8152 = NULL;
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &g_esp_netif_rtl8152[rtl8152_class->minor], sizeof(esp_netif_t *), portMAX_DELAY);
+    esp_netif_action_disconnected(g_esp_netif_rtl8152[rtl8152_class->minor], NULL, 0, NULL);
+    esp_netif_destroy(g_esp_netif_rtl8152[rtl8152_class->minor]);
+    g_esp_netif_rtl8152[rtl8152_class->minor] = NULL;
 }
 #endif
 
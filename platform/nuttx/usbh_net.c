@@ -45,7 +45,7 @@ void usbh_net_eth_output_common(struct net_driver_s *dev, uint8_t *buf)
     usb_memcpy(buf, dev->d_buf, dev->d_len);
 }
 
-void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t len, uint8_t* (*eth_input)(void), int (*eth_output)(uint32_t buflen))
+void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t len, int (*txpoll)(struct net_driver_s *dev))
 {
     FAR struct eth_hdr_s *hdr;
 
@@ -71,8 +71,7 @@ void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t le
         ipv4_input(dev);
         if (dev->d_len > 0) {
             /* And send the packet */
-            usbh_net_eth_output_common(dev, eth_input());
-            eth_output(dev->d_len);
+            txpoll(dev);
         }
     } else
 #endif
@@ -86,8 +85,7 @@ void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t le
 
         if (dev->d_len > 0) {
             /* And send the packet */
-            usbh_net_eth_output_common(dev, eth_input());
-            eth_output(dev->d_len);
+            txpoll(dev);
         }
     } else
 #endif
@@ -97,8 +95,7 @@ void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t le
 
         arp_input(dev);
         if (dev->d_len > 0) {
-            usbh_net_eth_output_common(dev, eth_input());
-            eth_output(dev->d_len);
+            txpoll(dev);
         }
     } else
 #endif
@@ -112,35 +109,43 @@ void usbh_net_eth_input_common(struct net_driver_s *dev, uint8_t *buf, size_t le
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_RNDIS
 #include "usbh_rndis.h"
 
-struct usbh_net g_rndis_dev;
+struct usbh_net g_rndis_dev[CONFIG_USBHOST_MAX_RNDIS_CLASS];
 
 static int rndis_ifup(struct net_driver_s *dev)
 {
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)dev->d_private;
+
     printf("rndis if up\r\n");
-    g_rndis_dev.linkup = true;
-    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, NULL);
+    g_rndis_dev[rndis_class->minor].linkup = true;
+    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, (void *)rndis_class);
     return OK;
 }
 
 static int rndis_ifdown(struct net_driver_s *dev)
 {
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)dev->d_private;
+
     printf("rndis if down\r\n");
-    g_rndis_dev.linkup = false;
+    g_rndis_dev[rndis_class->minor].linkup = false;
     return OK;
 }
 
 static int rndis_txpoll(struct net_driver_s *dev)
 {
-    usbh_net_eth_output_common(&g_rndis_dev.netdev, usbh_rndis_get_eth_txbuf());
-    return usbh_rndis_eth_output(g_rndis_dev.netdev.d_len);
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)dev->d_private;
+
+    usbh_net_eth_output_common(dev, usbh_rndis_get_eth_txbuf(rndis_class));
+    return usbh_rndis_eth_output(rndis_class, dev->d_len);
 }
 
 static void rndis_txavail_work(void *arg)
 {
+    struct usbh_net *rndis_dev = (struct usbh_net *)arg;
+
     net_lock();
 
-    if (g_rndis_dev.linkup) {
-        devif_poll(&g_rndis_dev.netdev, rndis_txpoll);
+    if (rndis_dev->linkup) {
+        devif_poll(&rndis_dev->netdev, rndis_txpoll);
     } else {
     }
 
@@ -149,8 +154,11 @@ static void rndis_txavail_work(void *arg)
 
 static int rndis_txavail(struct net_driver_s *dev)
 {
-    if (work_available(&g_rndis_dev.txpollwork)) {
-        work_queue(LPWORK, &g_rndis_dev.txpollwork, rndis_txavail_work, NULL, 0);
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)dev->d_private;
+    struct usbh_net *rndis_dev = &g_rndis_dev[rndis_class->minor];
+
+    if (work_available(&rndis_dev->txpollwork)) {
+        work_queue(LPWORK, &rndis_dev->txpollwork, rndis_txavail_work, rndis_dev, 0);
     } else {
         return -1;
     }
@@ -158,24 +166,26 @@ static int rndis_txavail(struct net_driver_s *dev)
     return OK;
 }
 
-void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rndis_eth_input(struct usbh_rndis *rndis_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_net_eth_input_common(&g_rndis_dev.netdev, buf, buflen, usbh_rndis_get_eth_txbuf, usbh_rndis_eth_output);
+    usbh_net_eth_input_common(&g_rndis_dev[rndis_class->minor].netdev, buf, buflen, rndis_txpoll);
 }
 
 void usbh_rndis_run(struct usbh_rndis *rndis_class)
 {
-    memset(&g_rndis_dev.netdev, 0, sizeof(struct net_driver_s));
+    struct usbh_net *rndis_dev = &g_rndis_dev[rndis_class->minor];
+
+    memset(&rndis_dev->netdev, 0, sizeof(struct net_driver_s));
 
-    g_rndis_dev.netdev.d_ifup = rndis_ifup;
-    g_rndis_dev.netdev.d_ifdown = rndis_ifdown;
-    g_rndis_dev.netdev.d_txavail = rndis_txavail;
-    g_rndis_dev.netdev.d_private = rndis_class;
+    rndis_dev->netdev.d_ifup = rndis_ifup;
+    rndis_dev->netdev.d_ifdown = rndis_ifdown;
+    rndis_dev->netdev.d_txavail = rndis_txavail;
+    rndis_dev->netdev.d_private = rndis_class;
 
     for (uint8_t j = 0; j < 6; j++) {
-        g_rndis_dev.netdev.d_mac.ether.ether_addr_octet[j] = rndis_class->mac[j];
+        rndis_dev->netdev.d_mac.ether.ether_addr_octet[j] = rndis_class->mac[j];
     }
-    netdev_register(&g_rndis_dev.netdev, NET_LL_ETHERNET);
+    netdev_register(&rndis_dev->netdev, NET_LL_ETHERNET);
 
     netinit_bringup();
 }
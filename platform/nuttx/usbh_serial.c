@@ -3,31 +3,38 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
-#include <nuttx/kmalloc.h>
+#include <fcntl.h>
 #include <nuttx/mutex.h>
 #include <nuttx/semaphore.h>
 
 #include "usbh_core.h"
 #include "usbh_cdc_acm.h"
-
-#include <nuttx/mm/circbuf.h>
+#include "usbh_serial_engine.h"
 
 #define DEV_FORMAT "/dev/ttyACM%d"
 
+/* ring size must be power of 2, rx ring should hold more than one transfer */
 #ifndef CONFIG_USBHOST_CDCACM_RXBUFSIZE
-#define CONFIG_USBHOST_CDCACM_RXBUFSIZE 512
+#define CONFIG_USBHOST_CDCACM_RXBUFSIZE 2048
 #endif
 
 #ifndef CONFIG_USBHOST_CDCACM_TXBUFSIZE
-#define CONFIG_USBHOST_CDCACM_TXBUFSIZE 512
+#define CONFIG_USBHOST_CDCACM_TXBUFSIZE 1024
 #endif
 
+/* one slice for every bulk in urb and one for bulk out, hs max packet */
+#define USBHOST_SERIAL_XFER_SIZE USB_ALIGN_UP(512, CONFIG_USB_ALIGN_SIZE)
+
 struct usbhost_serial_s {
-    struct circbuf_s circ;
-    __attribute__((aligned(32))) uint8_t cache_rxbuffer[CONFIG_USBHOST_CDCACM_RXBUFSIZE];
-    __attribute__((aligned(32))) uint8_t cache_txbuffer[CONFIG_USBHOST_CDCACM_TXBUFSIZE];
+    struct usbh_serial engine;
+    uint8_t rx_pool[CONFIG_USBHOST_CDCACM_RXBUFSIZE];
+    uint8_t tx_pool[CONFIG_USBHOST_CDCACM_TXBUFSIZE];
 };
 
+/* engine keeps its semaphores between connections, so serial is not freed on stop */
+static struct usbhost_serial_s g_usbhost_serial[CONFIG_USBHOST_MAX_CDC_ACM_CLASS];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbhost_serial_xfer_buf[CONFIG_USBHOST_MAX_CDC_ACM_CLASS][2 * USBHOST_SERIAL_XFER_SIZE];
+
 static int nuttx_errorcode(int error)
 {
     int err = 0;
@@ -112,7 +119,7 @@ static int usbhost_open(FAR struct file *filep)
     DEBUGASSERT(inode->i_private);
     cdc_acm_class = (struct usbh_cdc_acm *)inode->i_private;
 
-    if (cdc_acm_class->hport && cdc_acm_class->hport->connected) {
+    if (cdc_acm_class->hport && cdc_acm_class->hport->connected && cdc_acm_class->user_data) {
         return OK;
     } else {
         return -ENODEV;
@@ -133,24 +140,24 @@ static ssize_t usbhost_read(FAR struct file *filep, FAR char *buffer,
     struct usbh_cdc_acm *cdc_acm_class;
     FAR struct inode *inode = filep->f_inode;
     struct usbhost_serial_s *serial;
-    __attribute__((aligned(32))) uint8_t cache_tempbuffer[512];
     int ret;
 
-    DEBUGASSERT(inode->i_private || cdc_acm_class->user_data);
+    DEBUGASSERT(inode->i_private);
     cdc_acm_class = (struct usbh_cdc_acm *)inode->i_private;
     serial = cdc_acm_class->user_data;
+    if (serial == NULL) {
+        return -ENODEV;
+    }
 
-    while (circbuf_used(&serial->circ) == 0) {
-        ret = usbh_cdc_acm_bulk_in_transfer(cdc_acm_class, cache_tempbuffer, cdc_acm_class->bulkin->wMaxPacketSize, 0xffffffff);
-        if (ret < 0) {
-            return nuttx_errorcode(ret);
-        }
-#if defined(CONFIG_ARCH_DCACHE) && !defined(CONFIG_USB_DCACHE_ENABLE)
-        up_invalidate_dcache((uintptr_t)cache_tempbuffer, (uintptr_t)(cache_tempbuffer + cdc_acm_class->bulkin->wMaxPacketSize));
-#endif
-        circbuf_overwrite(&serial->circ, cache_tempbuffer, USB_ALIGN_UP(ret, 64));
+    /* in urbs stay armed in the engine, read only drains the rx ring */
+    ret = usbh_serial_read(&serial->engine, (uint8_t *)buffer, buflen,
+                           (filep->f_oflags & O_NONBLOCK) ? 0 : USB_OSAL_WAITING_FOREVER);
+    if (ret < 0) {
+        return nuttx_errorcode(ret);
+    } else if ((ret == 0) && (buflen > 0)) {
+        return -EAGAIN;
     }
-    return circbuf_read(&serial->circ, buffer, buflen);
+    return ret;
 }
 
 static ssize_t usbhost_write(FAR struct file *filep, FAR const char *buffer,
@@ -161,57 +168,34 @@ static ssize_t usbhost_write(FAR struct file *filep, FAR const char *buffer,
     struct usbhost_serial_s *serial;
     int ret;
 
-    DEBUGASSERT(inode->i_private || cdc_acm_class->user_data);
+    DEBUGASSERT(inode->i_private);
     cdc_acm_class = (struct usbh_cdc_acm *)inode->i_private;
     serial = cdc_acm_class->user_data;
-
-#ifdef CONFIG_ARCH_DCACHE
-    uint32_t write_len = 0;
-
-    while (write_len < buflen) {
-        uint32_t len = buflen - write_len;
-        if (len > CONFIG_USBHOST_CDCACM_TXBUFSIZE) {
-            len = CONFIG_USBHOST_CDCACM_TXBUFSIZE;
-        }
-        memcpy(serial->cache_txbuffer, buffer + write_len, len);
-#ifndef CONFIG_USB_DCACHE_ENABLE
-        up_clean_dcache((uintptr_t)serial->cache_txbuffer, (uintptr_t)(serial->cache_txbuffer + USB_ALIGN_UP(len, 64)));
-#endif
-        ret = usbh_cdc_acm_bulk_out_transfer(cdc_acm_class, serial->cache_txbuffer, len, 0xffffffff);
-        if (ret < 0) {
-            return nuttx_errorcode(ret);
-        } else {
-            write_len += len;
-        }
+    if (serial == NULL) {
+        return -ENODEV;
     }
-    return buflen;
-#else
-    ret = usbh_cdc_acm_bulk_out_transfer(cdc_acm_class, (uint8_t *)buffer, buflen, 0xffffffff);
+
+    /* data is copied into tx ring, small writes are merged into one bulk out transfer */
+    ret = usbh_serial_write(&serial->engine, (const uint8_t *)buffer, buflen,
+                            (filep->f_oflags & O_NONBLOCK) ? 0 : USB_OSAL_WAITING_FOREVER);
     if (ret < 0) {
         return nuttx_errorcode(ret);
-    } else {
-        return buflen;
+    } else if ((ret == 0) && (buflen > 0)) {
+        return -EAGAIN;
     }
-#endif
+    return ret;
 }
 
 void usbh_cdc_acm_run(struct usbh_cdc_acm *cdc_acm_class)
 {
     char devname[32];
     struct usbhost_serial_s *serial;
+    struct cdc_line_coding linecoding;
+    int ret;
 
     snprintf(devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_acm_class->minor);
 
-    serial = kmm_malloc(sizeof(struct usbhost_serial_s));
-    DEBUGASSERT(serial);
-
-    memset(serial, 0, sizeof(struct usbhost_serial_s));
-
-    circbuf_init(&serial->circ, serial->cache_rxbuffer, CONFIG_USBHOST_CDCACM_RXBUFSIZE);
-
-    cdc_acm_class->user_data = serial;
-
-    struct cdc_line_coding linecoding;
+    serial = &g_usbhost_serial[cdc_acm_class->minor];
 
     linecoding.dwDTERate = 115200;
     linecoding.bDataBits = 8;
@@ -220,6 +204,16 @@ void usbh_cdc_acm_run(struct usbh_cdc_acm *cdc_acm_class)
     usbh_cdc_acm_set_line_coding(cdc_acm_class, &linecoding);
     usbh_cdc_acm_set_line_state(cdc_acm_class, true, false);
 
+    ret = usbh_serial_start(&serial->engine, cdc_acm_class->hport, cdc_acm_class->bulkin, cdc_acm_class->bulkout, USBH_SERIAL_TYPE_RAW,
+                            serial->rx_pool, sizeof(serial->rx_pool), serial->tx_pool, sizeof(serial->tx_pool),
+                            g_usbhost_serial_xfer_buf[cdc_acm_class->minor], sizeof(g_usbhost_serial_xfer_buf[0]));
+    if (ret < 0) {
+        USB_LOG_ERR("Fail to start serial engine for %s, ret:%d\r\n", devname, ret);
+        return;
+    }
+
+    cdc_acm_class->user_data = serial;
+
     register_driver(devname, &g_usbhostops, 0666, cdc_acm_class);
 }
 
@@ -228,10 +222,16 @@ void usbh_cdc_acm_stop(struct usbh_cdc_acm *cdc_acm_class)
     char devname[32];
     struct usbhost_serial_s *serial;
 
+    serial = cdc_acm_class->user_data;
+    if (serial == NULL) {
+        return;
+    }
+
+    /* wakes blocked readers and writers, they return -ENODEV */
+    usbh_serial_stop(&serial->engine);
+
     snprintf(devname, CONFIG_USBHOST_DEV_NAMELEN, DEV_FORMAT, cdc_acm_class->minor);
     unregister_driver(devname);
 
-    serial = cdc_acm_class->user_data;
-
-    kmm_free(serial);
-}
\ No newline at end of file
+    cdc_acm_class->user_data = NULL;
+}
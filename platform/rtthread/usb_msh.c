@@ -3,7 +3,26 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <string.h>
 #include "rtthread.h"
+#include "usb_config.h"
+#include "usb_trace.h"
+
+#ifdef CONFIG_USB_TRACE
+static int usb_trace(int argc, char **argv)
+{
+    if ((argc >= 2) && (strcmp(argv[1], "reset") == 0)) {
+        usb_trace_reset();
+    } else if ((argc >= 2) && (strcmp(argv[1], "csv") == 0)) {
+        usb_trace_dump(true);
+    } else {
+        usb_trace_dump(false);
+    }
+    return 0;
+}
+
+MSH_CMD_EXPORT(usb_trace, dump usb trace: usb_trace [csv|reset]);
+#endif
 
 #ifdef PKG_CHERRYUSB_HOST
 
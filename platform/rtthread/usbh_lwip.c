@@ -92,10 +92,20 @@ void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
     }
 }
 
+/* first instance keeps the plain name, the others get a minor suffix */
+static void usbh_lwip_dev_name(char *name, const char *prefix, uint8_t minor)
+{
+    if (minor == 0) {
+        rt_strncpy(name, prefix, RT_NAME_MAX);
+    } else {
+        rt_snprintf(name, RT_NAME_MAX, "%s_%d", prefix, minor);
+    }
+}
+
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_ECM
 #include "usbh_cdc_ecm.h"
 
-static struct eth_device g_cdc_ecm_dev;
+static struct eth_device g_cdc_ecm_dev[CONFIG_USBHOST_MAX_CDC_ECM_CLASS];
 
 static rt_err_t rt_usbh_cdc_ecm_control(rt_device_t dev, int cmd, void *args)
 {
@@ -122,10 +132,10 @@ static rt_err_t rt_usbh_cdc_ecm_control(rt_device_t dev, int cmd, void *args)
 static rt_err_t rt_usbh_cdc_ecm_eth_tx(rt_device_t dev, struct pbuf *p)
 {
     int ret;
-    (void)dev;
+    struct usbh_cdc_ecm *cdc_ecm_class = (struct usbh_cdc_ecm *)dev->user_data;
 
-    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf());
-    ret = usbh_cdc_ecm_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_cdc_ecm_get_eth_txbuf(cdc_ecm_class));
+    ret = usbh_cdc_ecm_eth_output(cdc_ecm_class, p->tot_len);
     if (ret < 0) {
         return -RT_ERROR;
     } else {
@@ -133,38 +143,40 @@ static rt_err_t rt_usbh_cdc_ecm_eth_tx(rt_device_t dev, struct pbuf *p)
     }
 }
 
-void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ecm_eth_input(struct usbh_cdc_ecm *cdc_ecm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_cdc_ecm_dev.netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_cdc_ecm_dev[cdc_ecm_class->minor].netif, buf, buflen);
 }
 
 void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    memset(&g_cdc_ecm_dev, 0, sizeof(struct eth_device));
+    struct eth_device *eth_dev = &g_cdc_ecm_dev[cdc_ecm_class->minor];
+    char name[RT_NAME_MAX];
+
+    memset(eth_dev, 0, sizeof(struct eth_device));
 
-    g_cdc_ecm_dev.parent.control = rt_usbh_cdc_ecm_control;
-    g_cdc_ecm_dev.eth_rx = NULL;
-    g_cdc_ecm_dev.eth_tx = rt_usbh_cdc_ecm_eth_tx;
-    g_cdc_ecm_dev.parent.user_data = cdc_ecm_class;
+    eth_dev->parent.control = rt_usbh_cdc_ecm_control;
+    eth_dev->eth_rx = NULL;
+    eth_dev->eth_tx = rt_usbh_cdc_ecm_eth_tx;
+    eth_dev->parent.user_data = cdc_ecm_class;
 
-    eth_device_init(&g_cdc_ecm_dev, "u0");
-    eth_device_linkchange(&g_cdc_ecm_dev, RT_TRUE);
+    usbh_lwip_dev_name(name, "u0", cdc_ecm_class->minor);
+    eth_device_init(eth_dev, name);
+    eth_device_linkchange(eth_dev, RT_TRUE);
 
-    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, NULL);
+    usb_osal_thread_create("usbh_cdc_ecm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ecm_rx_thread, (void *)cdc_ecm_class);
 }
 
 void usbh_cdc_ecm_stop(struct usbh_cdc_ecm *cdc_ecm_class)
 {
-    (void)cdc_ecm_class;
-
-    eth_device_deinit(&g_cdc_ecm_dev);
+    eth_device_deinit(&g_cdc_ecm_dev[cdc_ecm_class->minor]);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_RNDIS
 #include "usbh_rndis.h"
 
-static struct eth_device g_rndis_dev;
+static struct eth_device g_rndis_dev[CONFIG_USBHOST_MAX_RNDIS_CLASS];
 
 static rt_timer_t keep_timer = RT_NULL;
 
@@ -211,10 +223,10 @@ static rt_err_t rt_usbh_rndis_control(rt_device_t dev, int cmd, void *args)
 static rt_err_t rt_usbh_rndis_eth_tx(rt_device_t dev, struct pbuf *p)
 {
     int ret;
-    (void)dev;
+    struct usbh_rndis *rndis_class = (struct usbh_rndis *)dev->user_data;
 
-    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf());
-    ret = usbh_rndis_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_rndis_get_eth_txbuf(rndis_class));
+    ret = usbh_rndis_eth_output(rndis_class, p->tot_len);
     if (ret < 0) {
         return -RT_ERROR;
     } else {
@@ -222,32 +234,34 @@ static rt_err_t rt_usbh_rndis_eth_tx(rt_device_t dev, struct pbuf *p)
     }
 }
 
-void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rndis_eth_input(struct usbh_rndis *rndis_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_rndis_dev.netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_rndis_dev[rndis_class->minor].netif, buf, buflen);
 }
 
 void usbh_rndis_run(struct usbh_rndis *rndis_class)
 {
-    memset(&g_rndis_dev, 0, sizeof(struct eth_device));
+    struct eth_device *eth_dev = &g_rndis_dev[rndis_class->minor];
+    char name[RT_NAME_MAX];
+
+    memset(eth_dev, 0, sizeof(struct eth_device));
 
-    g_rndis_dev.parent.control = rt_usbh_rndis_control;
-    g_rndis_dev.eth_rx = NULL;
-    g_rndis_dev.eth_tx = rt_usbh_rndis_eth_tx;
-    g_rndis_dev.parent.user_data = rndis_class;
+    eth_dev->parent.control = rt_usbh_rndis_control;
+    eth_dev->eth_rx = NULL;
+    eth_dev->eth_tx = rt_usbh_rndis_eth_tx;
+    eth_dev->parent.user_data = rndis_class;
 
-    eth_device_init(&g_rndis_dev, "u2");
-    eth_device_linkchange(&g_rndis_dev, RT_TRUE);
+    usbh_lwip_dev_name(name, "u2", rndis_class->minor);
+    eth_device_init(eth_dev, name);
+    eth_device_linkchange(eth_dev, RT_TRUE);
 
-    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, NULL);
+    usb_osal_thread_create("usbh_rndis_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rndis_rx_thread, (void *)rndis_class);
     //timer_init(rndis_class);
 }
 
 void usbh_rndis_stop(struct usbh_rndis *rndis_class)
 {
-    (void)rndis_class;
-
-    eth_device_deinit(&g_rndis_dev);
+    eth_device_deinit(&g_rndis_dev[rndis_class->minor]);
     // rt_timer_stop(keep_timer);
     // rt_timer_delete(keep_timer);
 }
@@ -256,7 +270,7 @@ void usbh_rndis_stop(struct usbh_rndis *rndis_class)
 #ifdef CONFIG_USBHOST_PLATFORM_CDC_NCM
 #include "usbh_cdc_ncm.h"
 
-static struct eth_device g_cdc_ncm_dev;
+static struct eth_device g_cdc_ncm_dev[CONFIG_USBHOST_MAX_CDC_NCM_CLASS];
 
 static rt_err_t rt_usbh_cdc_ncm_control(rt_device_t dev, int cmd, void *args)
 {
@@ -283,10 +297,10 @@ static rt_err_t rt_usbh_cdc_ncm_control(rt_device_t dev, int cmd, void *args)
 static rt_err_t rt_usbh_cdc_ncm_eth_tx(rt_device_t dev, struct pbuf *p)
 {
     int ret;
-    (void)dev;
+    struct usbh_cdc_ncm *cdc_ncm_class = (struct usbh_cdc_ncm *)dev->user_data;
 
-    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf());
-    ret = usbh_cdc_ncm_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_cdc_ncm_get_eth_txbuf(cdc_ncm_class));
+    ret = usbh_cdc_ncm_eth_output(cdc_ncm_class, p->tot_len);
     if (ret < 0) {
         return -RT_ERROR;
     } else {
@@ -294,38 +308,40 @@ static rt_err_t rt_usbh_cdc_ncm_eth_tx(rt_device_t dev, struct pbuf *p)
     }
 }
 
-void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_cdc_ncm_eth_input(struct usbh_cdc_ncm *cdc_ncm_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_cdc_ncm_dev.netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_cdc_ncm_dev[cdc_ncm_class->minor].netif, buf, buflen);
 }
 
 void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    memset(&g_cdc_ncm_dev, 0, sizeof(struct eth_device));
+    struct eth_device *eth_dev = &g_cdc_ncm_dev[cdc_ncm_class->minor];
+    char name[RT_NAME_MAX];
+
+    memset(eth_dev, 0, sizeof(struct eth_device));
 
-    g_cdc_ncm_dev.parent.control = rt_usbh_cdc_ncm_control;
-    g_cdc_ncm_dev.eth_rx = NULL;
-    g_cdc_ncm_dev.eth_tx = rt_usbh_cdc_ncm_eth_tx;
-    g_cdc_ncm_dev.parent.user_data = cdc_ncm_class;
+    eth_dev->parent.control = rt_usbh_cdc_ncm_control;
+    eth_dev->eth_rx = NULL;
+    eth_dev->eth_tx = rt_usbh_cdc_ncm_eth_tx;
+    eth_dev->parent.user_data = cdc_ncm_class;
 
-    eth_device_init(&g_cdc_ncm_dev, "u1");
-    eth_device_linkchange(&g_cdc_ncm_dev, RT_TRUE);
+    usbh_lwip_dev_name(name, "u1", cdc_ncm_class->minor);
+    eth_device_init(eth_dev, name);
+    eth_device_linkchange(eth_dev, RT_TRUE);
 
-    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, NULL);
+    usb_osal_thread_create("usbh_cdc_ncm_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_cdc_ncm_rx_thread, (void *)cdc_ncm_class);
 }
 
 void usbh_cdc_ncm_stop(struct usbh_cdc_ncm *cdc_ncm_class)
 {
-    (void)cdc_ncm_class;
-
-    eth_device_deinit(&g_cdc_ncm_dev);
+    eth_device_deinit(&g_cdc_ncm_dev[cdc_ncm_class->minor]);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_ASIX
 #include "usbh_asix.h"
 
-static struct eth_device g_asix_dev;
+static struct eth_device g_asix_dev[CONFIG_USBHOST_MAX_ASIX_CLASS];
 
 static rt_err_t rt_usbh_asix_control(rt_device_t dev, int cmd, void *args)
 {
@@ -352,10 +368,10 @@ static rt_err_t rt_usbh_asix_control(rt_device_t dev, int cmd, void *args)
 static rt_err_t rt_usbh_asix_eth_tx(rt_device_t dev, struct pbuf *p)
 {
     int ret;
-    (void)dev;
+    struct usbh_asix *asix_class = (struct usbh_asix *)dev->user_data;
 
-    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf());
-    ret = usbh_asix_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_asix_get_eth_txbuf(asix_class));
+    ret = usbh_asix_eth_output(asix_class, p->tot_len);
     if (ret < 0) {
         return -RT_ERROR;
     } else {
@@ -363,38 +379,40 @@ static rt_err_t rt_usbh_asix_eth_tx(rt_device_t dev, struct pbuf *p)
     }
 }
 
-void usbh_asix_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_asix_eth_input(struct usbh_asix *asix_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_asix_dev.netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_asix_dev[asix_class->minor].netif, buf, buflen);
 }
 
 void usbh_asix_run(struct usbh_asix *asix_class)
 {
-    memset(&g_asix_dev, 0, sizeof(struct eth_device));
+    struct eth_device *eth_dev = &g_asix_dev[asix_class->minor];
+    char name[RT_NAME_MAX];
 
-    g_asix_dev.parent.control = rt_usbh_asix_control;
-    g_asix_dev.eth_rx = NULL;
-    g_asix_dev.eth_tx = rt_usbh_asix_eth_tx;
-    g_asix_dev.parent.user_data = asix_class;
+    memset(eth_dev, 0, sizeof(struct eth_device));
 
-    eth_device_init(&g_asix_dev, "u3");
-    eth_device_linkchange(&g_asix_dev, RT_TRUE);
+    eth_dev->parent.control = rt_usbh_asix_control;
+    eth_dev->eth_rx = NULL;
+    eth_dev->eth_tx = rt_usbh_asix_eth_tx;
+    eth_dev->parent.user_data = asix_class;
 
-    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, NULL);
+    usbh_lwip_dev_name(name, "u3", asix_class->minor);
+    eth_device_init(eth_dev, name);
+    eth_device_linkchange(eth_dev, RT_TRUE);
+
+    usb_osal_thread_create("usbh_asix_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_asix_rx_thread, (void *)asix_class);
 }
 
 void usbh_asix_stop(struct usbh_asix *asix_class)
 {
-    (void)asix_class;
-
-    eth_device_deinit(&g_asix_dev);
+    eth_device_deinit(&g_asix_dev[asix_class->minor]);
 }
 #endif
 
 #ifdef CONFIG_USBHOST_PLATFORM_RTL8152
 #include "usbh_rtl8152.h"
 
-static struct eth_device g_rtl8152_dev;
+static struct eth_device g_rtl8152_dev[CONFIG_USBHOST_MAX_RTL8152_CLASS];
 
 static rt_err_t rt_usbh_rtl8152_control(rt_device_t dev, int cmd, void *args)
 {
@@ -421,10 +439,10 @@ static rt_err_t rt_usbh_rtl8152_control(rt_device_t dev, int cmd, void *args)
 static rt_err_t rt_usbh_rtl8152_eth_tx(rt_device_t dev, struct pbuf *p)
 {
     int ret;
-    (void)dev;
+    struct usbh_rtl8152 *rtl8152_class = (struct usbh_rtl8152 *)dev->user_data;
 
-    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf());
-    ret = usbh_rtl8152_eth_output(p->tot_len);
+    usbh_lwip_eth_output_common(p, usbh_rtl8152_get_eth_txbuf(rtl8152_class));
+    ret = usbh_rtl8152_eth_output(rtl8152_class, p->tot_len);
     if (ret < 0) {
         return -RT_ERROR;
     } else {
@@ -432,30 +450,32 @@ static rt_err_t rt_usbh_rtl8152_eth_tx(rt_device_t dev, struct pbuf *p)
     }
 }
 
-void usbh_rtl8152_eth_input(uint8_t *buf, uint32_t buflen)
+void usbh_rtl8152_eth_input(struct usbh_rtl8152 *rtl8152_class, uint8_t *buf, uint32_t buflen)
 {
-    usbh_lwip_eth_input_common(g_rtl8152_dev.netif, buf, buflen);
+    usbh_lwip_eth_input_common(g_rtl8152_dev[rtl8152_class->minor].netif, buf, buflen);
 }
 
 void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
 {
-    memset(&g_rtl8152_dev, 0, sizeof(struct eth_device));
+    struct eth_device *eth_dev = &g_rtl8152_dev[rtl8152_class->minor];
+    char name[RT_NAME_MAX];
 
-    g_rtl8152_dev.parent.control = rt_usbh_rtl8152_control;
-    g_rtl8152_dev.eth_rx = NULL;
-    g_rtl8152_dev.eth_tx = rt_usbh_rtl8152_eth_tx;
-    g_rtl8152_dev.parent.user_data = rtl8152_class;
+    memset(eth_dev, 0, sizeof(struct eth_device));
 
-    eth_device_init(&g_rtl8152_dev, "u4");
-    eth_device_linkchange(&g_rtl8152_dev, RT_TRUE);
+    eth_dev->parent.control = rt_usbh_rtl8152_control;
+    eth_dev->eth_rx = NULL;
+    eth_dev->eth_tx = rt_usbh_rtl8152_eth_tx;
+    eth_dev->parent.user_data = rtl8152_class;
 
-    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, NULL);
+    usbh_lwip_dev_name(name, "u4", rtl8152_class->minor);
+    eth_device_init(eth_dev, name);
+    eth_device_linkchange(eth_dev, RT_TRUE);
+
+    usb_osal_thread_create("usbh_rtl8152_rx", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_rtl8152_rx_thread, (void *)rtl8152_class);
 }
 
 void usbh_rtl8152_stop(struct usbh_rtl8152 *rtl8152_class)
 {
-    (void)rtl8152_class;
-
-    eth_device_deinit(&g_rtl8152_dev);
+    eth_device_deinit(&g_rtl8152_dev[rtl8152_class->minor]);
 }
 #endif
@@ -905,6 +905,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
         return -4;
     }
 
+    USB_TRACE_EP_SUBMIT(USB_TRACE_DEVICE, busid, 0, ep, data_len);
     g_dwc2_udc[busid].in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_dwc2_udc[busid].in_ep[ep_idx].xfer_len = data_len;
     g_dwc2_udc[busid].in_ep[ep_idx].actual_xfer_len = 0;
@@ -978,6 +979,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
         return -4;
     }
 
+    USB_TRACE_EP_SUBMIT(USB_TRACE_DEVICE, busid, 0, ep, data_len);
     g_dwc2_udc[busid].out_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_dwc2_udc[busid].out_ep[ep_idx].xfer_len = data_len;
     g_dwc2_udc[busid].out_ep[ep_idx].actual_xfer_len = 0;
@@ -1024,11 +1026,14 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
 void USBD_IRQHandler(uint8_t busid)
 {
     uint32_t gint_status, temp, ep_idx, ep_intr, epint, read_count, daintmask;
+    USB_TRACE_IRQ_ENTER();
+
     gint_status = dwc2_get_glb_intstatus(busid);
 
     if ((USB_OTG_GLB->GINTSTS & 0x1U) == USB_OTG_MODE_DEVICE) {
         /* Avoid spurious interrupt */
         if (gint_status == 0) {
+            USB_TRACE_IRQ_EXIT(USB_TRACE_DEVICE, busid);
             return;
         }
 
@@ -1195,4 +1200,5 @@ void USBD_IRQHandler(uint8_t busid)
             USB_OTG_GLB->GOTGINT |= temp;
         }
     }
+    USB_TRACE_IRQ_EXIT(USB_TRACE_DEVICE, busid);
 }
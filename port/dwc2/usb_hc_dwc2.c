@@ -817,6 +817,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = chan;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    USBH_TRACE_URB_SUBMIT(urb);
 
     usb_osal_leave_critical_section(flags);
 
@@ -894,6 +895,8 @@ static inline void dwc2_urb_waitup(struct usbh_urb *urb)
     chan->urb = NULL;
     urb->hcpriv = NULL;
 
+    USBH_TRACE_URB_COMPLETE(urb);
+
     if (urb->timeout) {
         usb_osal_sem_give(chan->waitsem);
     } else {
@@ -1128,12 +1131,14 @@ void USBH_IRQHandler(uint8_t busid)
 {
     uint32_t gint_status, chan_int;
     struct usbh_bus *bus;
+    USB_TRACE_IRQ_ENTER();
 
     bus = &g_usbhost_bus[busid];
     gint_status = dwc2_get_glb_intstatus(bus);
     if ((USB_OTG_GLB->GINTSTS & 0x1U) == USB_OTG_MODE_HOST) {
         /* Avoid spurious interrupt */
         if (gint_status == 0) {
+            USB_TRACE_IRQ_EXIT(USB_TRACE_HOST, busid);
             return;
         }
 
@@ -1161,4 +1166,5 @@ void USBH_IRQHandler(uint8_t busid)
             USB_OTG_GLB->GINTSTS = USB_OTG_GINTSTS_HCINT;
         }
     }
+    USB_TRACE_IRQ_EXIT(USB_TRACE_HOST, busid);
 }
\ No newline at end of file
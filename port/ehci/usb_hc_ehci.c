@@ -594,6 +594,8 @@ static void ehci_urb_waitup(struct usbh_bus *bus, struct usbh_urb *urb)
 
     qh->remove_in_iaad = 0;
 
+    USBH_TRACE_URB_COMPLETE(urb);
+
     if (urb->timeout) {
         usb_osal_sem_give(qh->waitsem);
     } else {
@@ -1211,6 +1213,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = NULL;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    USBH_TRACE_URB_SUBMIT(urb);
 
     usb_osal_leave_critical_section(flags);
 
@@ -1371,6 +1374,7 @@ void USBH_IRQHandler(uint8_t busid)
 {
     uint32_t usbsts;
     struct usbh_bus *bus;
+    USB_TRACE_IRQ_ENTER();
 
     bus = &g_usbhost_bus[busid];
 
@@ -1430,4 +1434,5 @@ void USBH_IRQHandler(uint8_t busid)
 
     if (usbsts & EHCI_USBSTS_FATAL) {
     }
+    USB_TRACE_IRQ_EXIT(USB_TRACE_HOST, busid);
 }
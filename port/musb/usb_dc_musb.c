@@ -552,6 +552,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
         return -3;
     }
 
+    USB_TRACE_EP_SUBMIT(USB_TRACE_DEVICE, busid, 0, ep, data_len);
     g_musb_udc.in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_musb_udc.in_ep[ep_idx].xfer_len = data_len;
     g_musb_udc.in_ep[ep_idx].actual_xfer_len = 0;
@@ -606,6 +607,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
     old_ep_idx = musb_get_active_ep();
     musb_set_active_ep(ep_idx);
 
+    USB_TRACE_EP_SUBMIT(USB_TRACE_DEVICE, busid, 0, ep, data_len);
     g_musb_udc.out_ep[ep_idx].xfer_buf = data;
     g_musb_udc.out_ep[ep_idx].xfer_len = data_len;
     g_musb_udc.out_ep[ep_idx].actual_xfer_len = 0;
@@ -711,6 +713,7 @@ void USBD_IRQHandler(uint8_t busid)
     uint8_t old_ep_idx;
     uint8_t ep_idx;
     uint16_t write_count, read_count;
+    USB_TRACE_IRQ_ENTER();
 
     is = HWREGB(USB_BASE + MUSB_IS_OFFSET);
     txis = HWREGH(USB_BASE + MUSB_TXIS_OFFSET);
@@ -813,4 +816,5 @@ void USBD_IRQHandler(uint8_t busid)
     }
 
     musb_set_active_ep(old_ep_idx);
+    USB_TRACE_IRQ_EXIT(USB_TRACE_DEVICE, busid);
 }
@@ -706,6 +706,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = pipe;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    USBH_TRACE_URB_SUBMIT(urb);
 
     switch (USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes)) {
         case USB_ENDPOINT_TYPE_CONTROL:
@@ -788,6 +789,8 @@ static void musb_urb_waitup(struct usbh_urb *urb)
     pipe->urb = NULL;
     urb->hcpriv = NULL;
 
+    USBH_TRACE_URB_COMPLETE(urb);
+
     if (urb->timeout) {
         usb_osal_sem_give(pipe->waitsem);
     } else {
@@ -929,6 +932,7 @@ void USBH_IRQHandler(uint8_t busid)
     uint8_t old_ep_idx;
     struct usbh_bus *bus;
     uint32_t size;
+    USB_TRACE_IRQ_ENTER();
 
     bus = &g_usbhost_bus[busid];
 
@@ -1073,4 +1077,5 @@ void USBH_IRQHandler(uint8_t busid)
         }
     }
     musb_set_active_ep(bus, old_ep_idx);
+    USB_TRACE_IRQ_EXIT(USB_TRACE_HOST, busid);
 }
@@ -5,83 +5,232 @@
  */
 #include "chry_mempool.h"
 
+#define CHRY_MEMPOOL_HEAD_INDEX(head) ((head)&0xffff)
+#define CHRY_MEMPOOL_HEAD_NEXT(head, index) ((((head) + 0x10000) & 0xffff0000) | (index))
+
+#if CHRY_MEMPOOL_LOCKFREE
+/* tag changes on every update, so a head popped and pushed back in between fails the cas (aba) */
+static inline uint32_t chry_mempool_pop(struct chry_mempool *pool)
+{
+    uint32_t head;
+    uint32_t index;
+
+    head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    do {
+        index = CHRY_MEMPOOL_HEAD_INDEX(head);
+        if (index == 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, CHRY_MEMPOOL_HEAD_NEXT(head, ((volatile uint16_t *)pool->next)[index - 1]),
+                                          true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return index;
+}
+
+static inline void chry_mempool_push(struct chry_mempool *pool, uint32_t index)
+{
+    uint32_t head;
+
+    head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    do {
+        ((volatile uint16_t *)pool->next)[index - 1] = CHRY_MEMPOOL_HEAD_INDEX(head);
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, CHRY_MEMPOOL_HEAD_NEXT(head, index),
+                                          true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static inline void chry_mempool_count_alloc(struct chry_mempool *pool)
+{
+    uint32_t used;
+    uint32_t high_water;
+
+    used = __atomic_add_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+    high_water = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+    while (used > high_water) {
+        if (__atomic_compare_exchange_n(&pool->high_water, &high_water, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static inline void chry_mempool_count_free(struct chry_mempool *pool)
+{
+    __atomic_sub_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+}
+
+static inline void chry_mempool_count_fail(struct chry_mempool *pool)
+{
+    __atomic_add_fetch(&pool->fail_count, 1, __ATOMIC_RELAXED);
+}
+#else
+static inline uint32_t chry_mempool_pop(struct chry_mempool *pool)
+{
+    uint32_t index;
+    size_t flag;
+
+    flag = chry_mempool_osal_enter_critical();
+    index = CHRY_MEMPOOL_HEAD_INDEX(pool->head);
+    if (index) {
+        pool->head = CHRY_MEMPOOL_HEAD_NEXT(pool->head, pool->next[index - 1]);
+    }
+    chry_mempool_osal_leave_critical(flag);
+
+    return index;
+}
+
+static inline void chry_mempool_push(struct chry_mempool *pool, uint32_t index)
+{
+    size_t flag;
+
+    flag = chry_mempool_osal_enter_critical();
+    pool->next[index - 1] = CHRY_MEMPOOL_HEAD_INDEX(pool->head);
+    pool->head = CHRY_MEMPOOL_HEAD_NEXT(pool->head, index);
+    chry_mempool_osal_leave_critical(flag);
+}
+
+static inline void chry_mempool_count_alloc(struct chry_mempool *pool)
+{
+    size_t flag;
+
+    flag = chry_mempool_osal_enter_critical();
+    pool->used++;
+    if (pool->used > pool->high_water) {
+        pool->high_water = pool->used;
+    }
+    chry_mempool_osal_leave_critical(flag);
+}
+
+static inline void chry_mempool_count_free(struct chry_mempool *pool)
+{
+    size_t flag;
+
+    flag = chry_mempool_osal_enter_critical();
+    pool->used--;
+    chry_mempool_osal_leave_critical(flag);
+}
+
+static inline void chry_mempool_count_fail(struct chry_mempool *pool)
+{
+    size_t flag;
+
+    flag = chry_mempool_osal_enter_critical();
+    pool->fail_count++;
+    chry_mempool_osal_leave_critical(flag);
+}
+#endif
+
+static void chry_mempool_link(struct chry_mempool *pool)
+{
+    for (uint32_t i = 0; i < pool->block_count; i++) {
+        pool->next[i] = (i + 1 < pool->block_count) ? (i + 2) : 0;
+    }
+
+    pool->head = 1;
+    pool->used = 0;
+    pool->high_water = 0;
+    pool->fail_count = 0;
+}
+
+int chry_mempool_init(struct chry_mempool *pool, void *block, uint32_t block_size, uint32_t block_count, uint16_t *next)
+{
+    if ((block == NULL) || (next == NULL) || (block_size == 0) ||
+        (block_count == 0) || (block_count > CHRY_MEMPOOL_MAX_BLOCKS)) {
+        return -1;
+    }
+
+    memset(&pool->out, 0, sizeof(chry_ringbuffer_t));
+    pool->out_sem = NULL;
+    pool->block = block;
+    pool->block_size = block_size;
+    pool->block_count = block_count;
+    pool->next = next;
+    pool->dynamic = false;
+
+    chry_mempool_link(pool);
+
+    return 0;
+}
+
 int chry_mempool_create(struct chry_mempool *pool, void *block, uint32_t block_size, uint32_t block_count)
 {
-    uintptr_t addr;
-    uint8_t *ringbuf1;
-    uint8_t *ringbuf2;
+    uint16_t *next;
+    uint8_t *ringbuf;
 
-    ringbuf1 = chry_mempool_osal_malloc(sizeof(uintptr_t) * block_count);
-    if (ringbuf1 == NULL) {
+    next = chry_mempool_osal_malloc(sizeof(uint16_t) * block_count);
+    if (next == NULL) {
         return -1;
     }
-    memset(ringbuf1, 0, sizeof(uintptr_t) * block_count);
 
-    if (chry_ringbuffer_init(&pool->in, ringbuf1, sizeof(uintptr_t) * block_count) == -1) {
-        chry_mempool_osal_free(ringbuf1);
+    if (chry_mempool_init(pool, block, block_size, block_count, next) == -1) {
+        chry_mempool_osal_free(next);
         return -1;
     }
 
-    ringbuf2 = chry_mempool_osal_malloc(sizeof(uintptr_t) * block_count);
-    if (ringbuf2 == NULL) {
-        chry_mempool_osal_free(ringbuf1);
+    ringbuf = chry_mempool_osal_malloc(sizeof(uintptr_t) * block_count);
+    if (ringbuf == NULL) {
+        chry_mempool_osal_free(next);
         return -1;
     }
-    memset(ringbuf2, 0, sizeof(uintptr_t) * block_count);
+    memset(ringbuf, 0, sizeof(uintptr_t) * block_count);
 
-    if (chry_ringbuffer_init(&pool->out, ringbuf2, sizeof(uintptr_t) * block_count) == -1) {
-        chry_mempool_osal_free(ringbuf1);
-        chry_mempool_osal_free(ringbuf2);
+    if (chry_ringbuffer_init(&pool->out, ringbuf, sizeof(uintptr_t) * block_count) == -1) {
+        chry_mempool_osal_free(next);
+        chry_mempool_osal_free(ringbuf);
         return -1;
     }
 
     pool->out_sem = chry_mempool_osal_sem_create(block_count);
     if (pool->out_sem == NULL) {
-        chry_mempool_osal_free(ringbuf1);
-        chry_mempool_osal_free(ringbuf2);
+        chry_mempool_osal_free(next);
+        chry_mempool_osal_free(ringbuf);
         return -1;
     }
 
-    pool->block = block;
-    pool->block_size = block_size;
-    pool->block_count = block_count;
-
-    for (uint32_t i = 0; i < block_count; i++) {
-        addr = ((uintptr_t)block + i * block_size);
-        chry_ringbuffer_write(&pool->in, &addr, sizeof(uintptr_t));
-    }
+    pool->dynamic = true;
 
     return 0;
 }
 
 void chry_mempool_delete(struct chry_mempool *pool)
 {
+    if (!pool->dynamic) {
+        return;
+    }
+
     chry_mempool_osal_sem_delete(pool->out_sem);
-    chry_ringbuffer_reset(&pool->in);
     chry_ringbuffer_reset(&pool->out);
-    chry_mempool_osal_free(pool->in.pool);
     chry_mempool_osal_free(pool->out.pool);
+    chry_mempool_osal_free(pool->next);
+    pool->dynamic = false;
 }
 
 uintptr_t *chry_mempool_alloc(struct chry_mempool *pool)
 {
-    uintptr_t *addr;
-    uint32_t len;
+    uint32_t index;
 
-    len = chry_ringbuffer_read(&pool->in, (uintptr_t *)&addr, sizeof(uintptr_t));
-    if (len == 0) {
+    index = chry_mempool_pop(pool);
+    if (index == 0) {
+        chry_mempool_count_fail(pool);
         return NULL;
-    } else {
-        return addr;
     }
+
+    chry_mempool_count_alloc(pool);
+    return (uintptr_t *)((uintptr_t)pool->block + (index - 1) * pool->block_size);
 }
 
 int chry_mempool_free(struct chry_mempool *pool, uintptr_t *item)
 {
-    uintptr_t addr;
+    uintptr_t offset;
 
-    addr = (uintptr_t)item;
-    return chry_ringbuffer_write(&pool->in, &addr, sizeof(uintptr_t));
+    offset = (uintptr_t)item - (uintptr_t)pool->block;
+    if (((uintptr_t)item < (uintptr_t)pool->block) ||
+        (offset >= (uintptr_t)pool->block_size * pool->block_count) ||
+        (offset % pool->block_size)) {
+        return -1;
+    }
+
+    chry_mempool_count_free(pool);
+    chry_mempool_push(pool, offset / pool->block_size + 1);
+    return 0;
 }
 
 int chry_mempool_send(struct chry_mempool *pool, uintptr_t *item)
@@ -111,15 +260,50 @@ int chry_mempool_recv(struct chry_mempool *pool, uintptr_t **item, uint32_t time
     }
 }
 
+/* all blocks must be freed, not safe against concurrent alloc/free */
 void chry_mempool_reset(struct chry_mempool *pool)
 {
-    uintptr_t addr;
+    if (pool->dynamic) {
+        chry_ringbuffer_reset(&pool->out);
+    }
 
-    chry_ringbuffer_reset(&pool->in);
-    chry_ringbuffer_reset(&pool->out);
+    chry_mempool_link(pool);
+}
 
-    for (uint32_t i = 0; i < pool->block_count; i++) {
-        addr = ((uintptr_t)pool->block + i * pool->block_size);
-        chry_ringbuffer_write(&pool->in, &addr, sizeof(uintptr_t));
+void chry_mempool_get_stat(struct chry_mempool *pool, struct chry_mempool_stat *stat)
+{
+    stat->block_size = pool->block_size;
+    stat->block_count = pool->block_count;
+    stat->used = pool->used;
+    stat->high_water = pool->high_water;
+    stat->fail_count = pool->fail_count;
+}
+
+void *chry_mempool_class_alloc(const struct chry_mempool_class *cls, uint32_t size)
+{
+    uintptr_t *item;
+
+    for (uint8_t i = 0; i < cls->count; i++) {
+        if (cls->pools[i]->block_size < size) {
+            continue;
+        }
+
+        item = chry_mempool_alloc(cls->pools[i]);
+        if (item) {
+            return item;
+        }
+    }
+
+    return NULL;
+}
+
+int chry_mempool_class_free(const struct chry_mempool_class *cls, void *item)
+{
+    for (uint8_t i = 0; i < cls->count; i++) {
+        if (chry_mempool_free(cls->pools[i], item) == 0) {
+            return 0;
+        }
     }
-}
\ No newline at end of file
+
+    return -1;
+}
@@ -12,16 +12,70 @@
 
 #include "chry_ringbuffer.h"
 
+/*
+ * Free blocks are kept in an index linked stack, alloc and free are O(1) and can be called
+ * from any thread or isr. The stack head is {tag:16, index:16} and is updated with cas when
+ * the cpu has a native 32 bit cas (Cortex-M3 and above, Cortex-A, RISC-V A), otherwise in
+ * chry_mempool_osal_enter/leave_critical. Set CHRY_MEMPOOL_LOCKFREE to 0 to force the latter.
+ * The critical section must mask irq for isr use, the nonos port does it only on Cortex-M0/M0+/M23
+ * and RISC-V machine mode, other cpus without cas fail to build there.
+ */
+#ifndef CHRY_MEMPOOL_LOCKFREE
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+#define CHRY_MEMPOOL_LOCKFREE 1
+#else
+#define CHRY_MEMPOOL_LOCKFREE 0
+#endif
+#endif
+
+#define CHRY_MEMPOOL_MAX_BLOCKS 0xffff
+
+/* block size rounded up to align, so every block keeps the dma alignment of the pool memory */
+#define CHRY_MEMPOOL_BLOCK_SIZE(size, align) (((size) + (align)-1) & ~((uint32_t)(align)-1))
+
+/*
+ * Define static pool memory, attr places it, eg.
+ * CHRY_MEMPOOL_DEFINE(g_urb_pool, 512, 8, CONFIG_USB_ALIGN_SIZE, USB_NOCACHE_RAM_SECTION);
+ * then CHRY_MEMPOOL_INIT(g_urb_pool) once before use.
+ */
+#define CHRY_MEMPOOL_DEFINE(name, size, count, align, attr)                                                               \
+    static attr __attribute__((aligned(align))) uint8_t name##_block[CHRY_MEMPOOL_BLOCK_SIZE(size, align) * (count)]; \
+    static uint16_t name##_next[count];                                                                                 \
+    struct chry_mempool name
+
+#define CHRY_MEMPOOL_INIT(name) \
+    chry_mempool_init(&name, name##_block, sizeof(name##_block) / (sizeof(name##_next) / sizeof(uint16_t)), sizeof(name##_next) / sizeof(uint16_t), name##_next)
+
 typedef void *chry_mempool_osal_sem_t;
 
 struct chry_mempool {
-    chry_ringbuffer_t in;
     chry_ringbuffer_t out;
     chry_mempool_osal_sem_t out_sem;
 
     void *block;
     uint32_t block_size;
     uint32_t block_count;
+
+    uint16_t *next;         /* next free index + 1 of each block, 0 is end */
+    volatile uint32_t head; /* tag << 16 | (first free index + 1) */
+    volatile uint32_t used;
+    volatile uint32_t high_water;
+    volatile uint32_t fail_count;
+    bool dynamic;           /* next and out are allocated by chry_mempool_create */
+};
+
+struct chry_mempool_stat {
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t used;
+    uint32_t high_water; /* max used blocks since init or reset */
+    uint32_t fail_count; /* alloc failed because pool is empty */
+};
+
+/* pools with different block size, sorted by block size from small to large */
+struct chry_mempool_class {
+    struct chry_mempool **pools;
+    uint8_t count;
 };
 
 #ifdef __cplusplus
@@ -34,16 +88,26 @@ int chry_mempool_osal_sem_take(chry_mempool_osal_sem_t sem, uint32_t timeout);
 int chry_mempool_osal_sem_give(chry_mempool_osal_sem_t sem);
 void *chry_mempool_osal_malloc(size_t size);
 void chry_mempool_osal_free(void *ptr);
+size_t chry_mempool_osal_enter_critical(void);
+void chry_mempool_osal_leave_critical(size_t flag);
 
+/* static pool, no malloc and no send/recv queue */
+int chry_mempool_init(struct chry_mempool *pool, void *block, uint32_t block_size, uint32_t block_count, uint16_t *next);
 int chry_mempool_create(struct chry_mempool *pool, void *block, uint32_t block_size, uint32_t block_count);
+void chry_mempool_delete(struct chry_mempool *pool);
 uintptr_t *chry_mempool_alloc(struct chry_mempool *pool);
 int chry_mempool_free(struct chry_mempool *pool, uintptr_t *item);
 int chry_mempool_send(struct chry_mempool *pool, uintptr_t *item);
 int chry_mempool_recv(struct chry_mempool *pool, uintptr_t **item, uint32_t timeout);
 void chry_mempool_reset(struct chry_mempool *pool);
+void chry_mempool_get_stat(struct chry_mempool *pool, struct chry_mempool_stat *stat);
+
+/* alloc from the smallest pool that fits and is not empty, free to the pool that owns item */
+void *chry_mempool_class_alloc(const struct chry_mempool_class *cls, uint32_t size);
+int chry_mempool_class_free(const struct chry_mempool_class *cls, void *item);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -51,4 +51,26 @@ void *chry_mempool_osal_malloc(size_t size)
 void chry_mempool_osal_free(void *ptr)
 {
     vPortFree(ptr);
-}
\ No newline at end of file
+}
+size_t chry_mempool_osal_enter_critical(void)
+{
+    size_t ret;
+
+    if (xPortIsInsideInterrupt()) {
+        ret = taskENTER_CRITICAL_FROM_ISR();
+    } else {
+        taskENTER_CRITICAL();
+        ret = 1;
+    }
+
+    return ret;
+}
+
+void chry_mempool_osal_leave_critical(size_t flag)
+{
+    if (xPortIsInsideInterrupt()) {
+        taskEXIT_CRITICAL_FROM_ISR(flag);
+    } else {
+        taskEXIT_CRITICAL();
+    }
+}
@@ -33,4 +33,46 @@ void *chry_mempool_osal_malloc(size_t size)
 void chry_mempool_osal_free(void *ptr)
 {
     free(ptr);
-}
\ No newline at end of file
+}
+
+/* only used without native cas (Cortex-M0/M0+, RISC-V without A), mask irq so isr can alloc/free */
+#if CHRY_MEMPOOL_LOCKFREE
+size_t chry_mempool_osal_enter_critical(void)
+{
+    return 0;
+}
+
+void chry_mempool_osal_leave_critical(size_t flag)
+{
+    (void)flag;
+}
+#elif defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_8M_BASE__)
+size_t chry_mempool_osal_enter_critical(void)
+{
+    size_t primask;
+
+    __asm volatile("mrs %0, primask\n\tcpsid i" : "=r"(primask)::"memory");
+    return primask;
+}
+
+void chry_mempool_osal_leave_critical(size_t flag)
+{
+    __asm volatile("msr primask, %0" ::"r"(flag) : "memory");
+}
+#elif defined(__riscv)
+/* machine mode, mstatus.MIE */
+size_t chry_mempool_osal_enter_critical(void)
+{
+    size_t mstatus;
+
+    __asm volatile("csrrci %0, mstatus, 8" : "=r"(mstatus)::"memory");
+    return mstatus & 8;
+}
+
+void chry_mempool_osal_leave_critical(size_t flag)
+{
+    __asm volatile("csrs mstatus, %0" ::"r"(flag) : "memory");
+}
+#else
+#error chry_mempool nonos needs native cas or irq masking for this cpu, implement chry_mempool_osal_enter/leave_critical
+#endif
@@ -51,4 +51,13 @@ void *chry_mempool_osal_malloc(size_t size)
 void chry_mempool_osal_free(void *ptr)
 {
     rt_free(ptr);
-}
\ No newline at end of file
+}
+size_t chry_mempool_osal_enter_critical(void)
+{
+    return rt_hw_interrupt_disable();
+}
+
+void chry_mempool_osal_leave_critical(size_t flag)
+{
+    rt_hw_interrupt_enable(flag);
+}
@@ -7,6 +7,46 @@
 #include <string.h>
 #include "chry_ringbuffer.h"
 
+/* the other side's pointer may change at any time, never let the compiler cache it */
+#define CHRY_RB_LOAD(v)     (*(volatile uint32_t *)&(v))
+#define CHRY_RB_STORE(v, x) (*(volatile uint32_t *)&(v) = (x))
+
+/* load the read pointer in producer, slots are reused only after consumer is done with them */
+static inline uint32_t chry_ringbuffer_acquire_out(chry_ringbuffer_t *rb)
+{
+    uint32_t out = CHRY_RB_LOAD(rb->out);
+    chry_ringbuffer_barrier_acquire();
+    return out;
+}
+
+/* load the write pointer in consumer, data is visible once the pointer is */
+static inline uint32_t chry_ringbuffer_acquire_in(chry_ringbuffer_t *rb)
+{
+    uint32_t in = CHRY_RB_LOAD(rb->in);
+    chry_ringbuffer_barrier_acquire();
+    return in;
+}
+
+static inline void chry_ringbuffer_commit_in(chry_ringbuffer_t *rb, uint32_t size)
+{
+    chry_ringbuffer_barrier_release();
+    CHRY_RB_STORE(rb->in, rb->in + size);
+
+    if (size && rb->notify) {
+        rb->notify(rb->notify_arg, CHRY_RINGBUFFER_EVENT_DATA);
+    }
+}
+
+static inline void chry_ringbuffer_commit_out(chry_ringbuffer_t *rb, uint32_t size)
+{
+    chry_ringbuffer_barrier_release();
+    CHRY_RB_STORE(rb->out, rb->out + size);
+
+    if (size && rb->notify) {
+        rb->notify(rb->notify_arg, CHRY_RINGBUFFER_EVENT_SPACE);
+    }
+}
+
 /*****************************************************************************
 * @brief        init ringbuffer
 * 
@@ -35,6 +75,8 @@ int chry_ringbuffer_init(chry_ringbuffer_t *rb, void *pool, uint32_t size)
     rb->out = 0;
     rb->mask = size - 1;
     rb->pool = pool;
+    rb->notify = NULL;
+    rb->notify_arg = NULL;
 
     return 0;
 }
@@ -62,7 +104,9 @@ void chry_ringbuffer_reset(chry_ringbuffer_t *rb)
 *****************************************************************************/
 void chry_ringbuffer_reset_read(chry_ringbuffer_t *rb)
 {
-    rb->out = rb->in;
+    uint32_t in = chry_ringbuffer_acquire_in(rb);
+
+    chry_ringbuffer_commit_out(rb, in - rb->out);
 }
 
 /*****************************************************************************
@@ -86,7 +130,7 @@ uint32_t chry_ringbuffer_get_size(chry_ringbuffer_t *rb)
 *****************************************************************************/
 uint32_t chry_ringbuffer_get_used(chry_ringbuffer_t *rb)
 {
-    return rb->in - rb->out;
+    return CHRY_RB_LOAD(rb->in) - CHRY_RB_LOAD(rb->out);
 }
 
 /*****************************************************************************
@@ -98,7 +142,7 @@ uint32_t chry_ringbuffer_get_used(chry_ringbuffer_t *rb)
 *****************************************************************************/
 uint32_t chry_ringbuffer_get_free(chry_ringbuffer_t *rb)
 {
-    return (rb->mask + 1) - (rb->in - rb->out);
+    return (rb->mask + 1) - (CHRY_RB_LOAD(rb->in) - CHRY_RB_LOAD(rb->out));
 }
 
 /*****************************************************************************
@@ -124,7 +168,7 @@ bool chry_ringbuffer_check_full(chry_ringbuffer_t *rb)
 *****************************************************************************/
 bool chry_ringbuffer_check_empty(chry_ringbuffer_t *rb)
 {
-    return rb->in == rb->out;
+    return CHRY_RB_LOAD(rb->in) == CHRY_RB_LOAD(rb->out);
 }
 
 /*****************************************************************************
@@ -140,12 +184,12 @@ bool chry_ringbuffer_check_empty(chry_ringbuffer_t *rb)
 *****************************************************************************/
 bool chry_ringbuffer_write_byte(chry_ringbuffer_t *rb, uint8_t byte)
 {
-    if (chry_ringbuffer_check_full(rb)) {
+    if ((rb->in - chry_ringbuffer_acquire_out(rb)) > rb->mask) {
         return false;
     }
 
     ((uint8_t *)(rb->pool))[rb->in & rb->mask] = byte;
-    rb->in++;
+    chry_ringbuffer_commit_in(rb, 1);
     return true;
 }
 
@@ -166,7 +210,7 @@ bool chry_ringbuffer_overwrite_byte(chry_ringbuffer_t *rb, uint8_t byte)
     }
 
     ((uint8_t *)(rb->pool))[rb->in & rb->mask] = byte;
-    rb->in++;
+    chry_ringbuffer_commit_in(rb, 1);
     return true;
 }
 
@@ -183,7 +227,7 @@ bool chry_ringbuffer_overwrite_byte(chry_ringbuffer_t *rb, uint8_t byte)
 *****************************************************************************/
 bool chry_ringbuffer_peek_byte(chry_ringbuffer_t *rb, uint8_t *byte)
 {
-    if (chry_ringbuffer_check_empty(rb)) {
+    if (chry_ringbuffer_acquire_in(rb) == rb->out) {
         return false;
     }
 
@@ -206,7 +250,9 @@ bool chry_ringbuffer_read_byte(chry_ringbuffer_t *rb, uint8_t *byte)
 {
     bool ret;
     ret = chry_ringbuffer_peek_byte(rb, byte);
-    rb->out += ret;
+    if (ret) {
+        chry_ringbuffer_commit_out(rb, 1);
+    }
     return ret;
 }
 
@@ -222,11 +268,11 @@ bool chry_ringbuffer_read_byte(chry_ringbuffer_t *rb, uint8_t *byte)
 *****************************************************************************/
 bool chry_ringbuffer_drop_byte(chry_ringbuffer_t *rb)
 {
-    if (chry_ringbuffer_check_empty(rb)) {
+    if (chry_ringbuffer_acquire_in(rb) == rb->out) {
         return false;
     }
 
-    rb->out += 1;
+    chry_ringbuffer_commit_out(rb, 1);
     return true;
 }
 
@@ -247,7 +293,7 @@ uint32_t chry_ringbuffer_write(chry_ringbuffer_t *rb, void *data, uint32_t size)
     uint32_t offset;
     uint32_t remain;
 
-    unused = (rb->mask + 1) - (rb->in - rb->out);
+    unused = (rb->mask + 1) - (rb->in - chry_ringbuffer_acquire_out(rb));
 
     if (size > unused) {
         size = unused;
@@ -261,7 +307,7 @@ uint32_t chry_ringbuffer_write(chry_ringbuffer_t *rb, void *data, uint32_t size)
     memcpy(((uint8_t *)(rb->pool)) + offset, data, remain);
     memcpy(rb->pool, (uint8_t *)data + remain, size - remain);
 
-    rb->in += size;
+    chry_ringbuffer_commit_in(rb, size);
 
     return size;
 }
@@ -300,7 +346,7 @@ uint32_t chry_ringbuffer_overwrite(chry_ringbuffer_t *rb, void *data, uint32_t s
     memcpy(((uint8_t *)(rb->pool)) + offset, data, remain);
     memcpy(rb->pool, (uint8_t *)data + remain, size - remain);
 
-    rb->in += size;
+    chry_ringbuffer_commit_in(rb, size);
 
     return size;
 }
@@ -322,7 +368,7 @@ uint32_t chry_ringbuffer_peek(chry_ringbuffer_t *rb, void *data, uint32_t size)
     uint32_t offset;
     uint32_t remain;
 
-    used = rb->in - rb->out;
+    used = chry_ringbuffer_acquire_in(rb) - rb->out;
     if (size > used) {
         size = used;
     }
@@ -352,7 +398,7 @@ uint32_t chry_ringbuffer_peek(chry_ringbuffer_t *rb, void *data, uint32_t size)
 uint32_t chry_ringbuffer_read(chry_ringbuffer_t *rb, void *data, uint32_t size)
 {
     size = chry_ringbuffer_peek(rb, data, size);
-    rb->out += size;
+    chry_ringbuffer_commit_out(rb, size);
     return size;
 }
 
@@ -370,12 +416,12 @@ uint32_t chry_ringbuffer_drop(chry_ringbuffer_t *rb, uint32_t size)
 {
     uint32_t used;
 
-    used = rb->in - rb->out;
+    used = chry_ringbuffer_acquire_in(rb) - rb->out;
     if (size > used) {
         size = used;
     }
 
-    rb->out += size;
+    chry_ringbuffer_commit_out(rb, size);
     return size;
 }
 
@@ -393,7 +439,7 @@ void *chry_ringbuffer_linear_write_setup(chry_ringbuffer_t *rb, uint32_t *size)
     uint32_t offset;
     uint32_t remain;
 
-    unused = (rb->mask + 1) - (rb->in - rb->out);
+    unused = (rb->mask + 1) - (rb->in - chry_ringbuffer_acquire_out(rb));
 
     offset = rb->in & rb->mask;
 
@@ -423,7 +469,7 @@ void *chry_ringbuffer_linear_read_setup(chry_ringbuffer_t *rb, uint32_t *size)
     uint32_t offset;
     uint32_t remain;
 
-    used = rb->in - rb->out;
+    used = chry_ringbuffer_acquire_in(rb) - rb->out;
 
     offset = rb->out & rb->mask;
 
@@ -451,11 +497,11 @@ uint32_t chry_ringbuffer_linear_write_done(chry_ringbuffer_t *rb, uint32_t size)
 {
     uint32_t unused;
 
-    unused = (rb->mask + 1) - (rb->in - rb->out);
+    unused = (rb->mask + 1) - (rb->in - CHRY_RB_LOAD(rb->out));
     if (size > unused) {
         size = unused;
     }
-    rb->in += size;
+    chry_ringbuffer_commit_in(rb, size);
 
     return size;
 }
@@ -472,3 +518,83 @@ uint32_t chry_ringbuffer_linear_read_done(chry_ringbuffer_t *rb, uint32_t size)
 {
     return chry_ringbuffer_drop(rb, size);
 }
+
+/*****************************************************************************
+* @brief        iovec write setup, get all free memory as at most two
+*               linear segments, iov[1].len is 0 when it does not wrap.
+*               commit with chry_ringbuffer_linear_write_done.
+*
+* @param[in]    rb          ringbuffer instance
+* @param[out]   iov         two segments to store free memory
+*
+* @retval uint32_t          total free size in byte
+*****************************************************************************/
+uint32_t chry_ringbuffer_iovec_write_setup(chry_ringbuffer_t *rb, chry_ringbuffer_iovec_t iov[2])
+{
+    uint32_t unused;
+    uint32_t offset;
+    uint32_t remain;
+
+    unused = (rb->mask + 1) - (rb->in - chry_ringbuffer_acquire_out(rb));
+
+    offset = rb->in & rb->mask;
+
+    remain = rb->mask + 1 - offset;
+    remain = remain > unused ? unused : remain;
+
+    iov[0].base = ((uint8_t *)(rb->pool)) + offset;
+    iov[0].len = remain;
+    iov[1].base = rb->pool;
+    iov[1].len = unused - remain;
+
+    return unused;
+}
+
+/*****************************************************************************
+* @brief        iovec read setup, get all used memory as at most two
+*               linear segments, iov[1].len is 0 when it does not wrap.
+*               release with chry_ringbuffer_linear_read_done.
+*
+* @param[in]    rb          ringbuffer instance
+* @param[out]   iov         two segments to store used memory
+*
+* @retval uint32_t          total used size in byte
+*****************************************************************************/
+uint32_t chry_ringbuffer_iovec_read_setup(chry_ringbuffer_t *rb, chry_ringbuffer_iovec_t iov[2])
+{
+    uint32_t used;
+    uint32_t offset;
+    uint32_t remain;
+
+    used = chry_ringbuffer_acquire_in(rb) - rb->out;
+
+    offset = rb->out & rb->mask;
+
+    remain = rb->mask + 1 - offset;
+    remain = remain > used ? used : remain;
+
+    iov[0].base = ((uint8_t *)(rb->pool)) + offset;
+    iov[0].len = remain;
+    iov[1].base = rb->pool;
+    iov[1].len = used - remain;
+
+    return used;
+}
+
+/*****************************************************************************
+* @brief        set notify callback, called after init and before use.
+*               CHRY_RINGBUFFER_EVENT_DATA is sent in producer context
+*               when data is committed, CHRY_RINGBUFFER_EVENT_SPACE in
+*               consumer context when space is released, so it may run
+*               in isr and should only wake the other side, eg. give sem.
+*
+* @param[in]    rb          ringbuffer instance
+* @param[in]    notify      callback, NULL to disable
+* @param[in]    arg         callback argument
+*
+*****************************************************************************/
+void chry_ringbuffer_set_notify(chry_ringbuffer_t *rb, chry_ringbuffer_notify_t notify, void *arg)
+{
+    rb->notify_arg = arg;
+    rb->notify = notify;
+}
@@ -14,13 +14,53 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+/*
+ * Single producer single consumer (SPSC) lock-free mode:
+ * all write side apis (write, write_byte, linear/iovec write) only store the write pointer,
+ * all read side apis (read, peek, drop, reset_read, linear/iovec read) only store the read pointer.
+ * With one producer and one consumer, each may run in a thread or an isr, no lock is needed.
+ * Data is published with a barrier before the pointer store, and the other side's pointer
+ * is loaded before its data is touched, so this also holds on weakly ordered cpus
+ * (Cortex-A, RISC-V RVWMO, SMP). reset and overwrite store both pointers, they always need a lock.
+ */
+#ifndef chry_ringbuffer_barrier_acquire
+#if defined(__CC_ARM)
+#define chry_ringbuffer_barrier_acquire() __dmb(0xF)
+#define chry_ringbuffer_barrier_release() __dmb(0xF)
+#elif defined(__ICCARM__)
+#include <intrinsics.h>
+#define chry_ringbuffer_barrier_acquire() __DMB()
+#define chry_ringbuffer_barrier_release() __DMB()
+#elif defined(__GNUC__) || defined(__clang__)
+/* dmb on arm, fence r,rw / fence rw,w on risc-v, compiler barrier only on x86 */
+#define chry_ringbuffer_barrier_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define chry_ringbuffer_barrier_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#warning "please define chry_ringbuffer_barrier_acquire/release() for your compiler"
+#define chry_ringbuffer_barrier_acquire()
+#define chry_ringbuffer_barrier_release()
+#endif
+#endif
+
+#define CHRY_RINGBUFFER_EVENT_DATA  0 /*!< producer has committed data  */
+#define CHRY_RINGBUFFER_EVENT_SPACE 1 /*!< consumer has released space */
+
+typedef void (*chry_ringbuffer_notify_t)(void *arg, uint8_t event);
+
 typedef struct {
-    uint32_t in;   /*!< Define the write pointer.               */
-    uint32_t out;  /*!< Define the read pointer.                */
-    uint32_t mask; /*!< Define the write and read pointer mask. */
-    void *pool;    /*!< Define the memory pointer.              */
+    uint32_t in;                     /*!< Define the write pointer.               */
+    uint32_t out;                    /*!< Define the read pointer.                */
+    uint32_t mask;                   /*!< Define the write and read pointer mask. */
+    void *pool;                      /*!< Define the memory pointer.              */
+    chry_ringbuffer_notify_t notify; /*!< Define the commit notify callback.      */
+    void *notify_arg;                /*!< Define the notify callback argument.    */
 } chry_ringbuffer_t;
 
+typedef struct {
+    void *base;   /*!< Define the segment memory pointer. */
+    uint32_t len; /*!< Define the segment size in byte.   */
+} chry_ringbuffer_iovec_t;
+
 extern int chry_ringbuffer_init(chry_ringbuffer_t *rb, void *pool, uint32_t size);
 extern void chry_ringbuffer_reset(chry_ringbuffer_t *rb);
 extern void chry_ringbuffer_reset_read(chry_ringbuffer_t *rb);
@@ -49,6 +89,11 @@ extern void *chry_ringbuffer_linear_read_setup(chry_ringbuffer_t *rb, uint32_t *
 extern uint32_t chry_ringbuffer_linear_write_done(chry_ringbuffer_t *rb, uint32_t size);
 extern uint32_t chry_ringbuffer_linear_read_done(chry_ringbuffer_t *rb, uint32_t size);
 
+extern uint32_t chry_ringbuffer_iovec_write_setup(chry_ringbuffer_t *rb, chry_ringbuffer_iovec_t iov[2]);
+extern uint32_t chry_ringbuffer_iovec_read_setup(chry_ringbuffer_t *rb, chry_ringbuffer_iovec_t iov[2]);
+
+extern void chry_ringbuffer_set_notify(chry_ringbuffer_t *rb, chry_ringbuffer_notify_t notify, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2022, Egahp
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Ringbuffer micro benchmark, not built with the stack.
+ *
+ * on target: implement chry_ringbuffer_bench_get_cycle (eg. DWT->CYCCNT, mcycle)
+ *            and call chry_ringbuffer_bench().
+ * on pc:     gcc -O2 -DCHRY_RINGBUFFER_BENCH_MAIN chry_ringbuffer.c chry_ringbuffer_bench.c -lpthread
+ *            also runs a two thread spsc stress test with every api.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chry_ringbuffer.h"
+
+#define BENCH_POOL_SIZE  4096
+#define BENCH_BLOCK_SIZE 64
+#define BENCH_LOOPS      4096
+
+extern uint32_t chry_ringbuffer_bench_get_cycle(void);
+
+static chry_ringbuffer_t bench_rb;
+static uint8_t bench_pool[BENCH_POOL_SIZE];
+static uint8_t bench_block[BENCH_BLOCK_SIZE];
+
+static void bench_report(const char *name, uint32_t cycles, uint32_t ops, uint32_t bytes)
+{
+    printf("%-14s %8u ops %10u cycles %6u.%02u cycles/op %6u.%02u cycles/byte\r\n",
+           name, (unsigned int)ops, (unsigned int)cycles,
+           (unsigned int)(cycles / ops), (unsigned int)((cycles % ops) * 100 / ops),
+           (unsigned int)(cycles / bytes), (unsigned int)((uint64_t)(cycles % bytes) * 100 / bytes));
+}
+
+static void bench_byte(void)
+{
+    uint32_t start;
+    uint8_t byte;
+
+    chry_ringbuffer_reset(&bench_rb);
+    start = chry_ringbuffer_bench_get_cycle();
+    for (uint32_t i = 0; i < BENCH_LOOPS; i++) {
+        chry_ringbuffer_write_byte(&bench_rb, (uint8_t)i);
+        chry_ringbuffer_read_byte(&bench_rb, &byte);
+    }
+    bench_report("byte w+r", chry_ringbuffer_bench_get_cycle() - start, BENCH_LOOPS, BENCH_LOOPS);
+}
+
+static void bench_block_copy(void)
+{
+    uint32_t start;
+
+    chry_ringbuffer_reset(&bench_rb);
+    start = chry_ringbuffer_bench_get_cycle();
+    for (uint32_t i = 0; i < BENCH_LOOPS; i++) {
+        chry_ringbuffer_write(&bench_rb, bench_block, BENCH_BLOCK_SIZE);
+        chry_ringbuffer_read(&bench_rb, bench_block, BENCH_BLOCK_SIZE);
+    }
+    bench_report("block w+r", chry_ringbuffer_bench_get_cycle() - start, BENCH_LOOPS, BENCH_LOOPS * BENCH_BLOCK_SIZE);
+}
+
+/* zero copy: producer fills ring memory in place, like a dma or usb transfer would */
+static void bench_iovec(void)
+{
+    chry_ringbuffer_iovec_t iov[2];
+    uint32_t start;
+
+    chry_ringbuffer_reset(&bench_rb);
+    start = chry_ringbuffer_bench_get_cycle();
+    for (uint32_t i = 0; i < BENCH_LOOPS; i++) {
+        chry_ringbuffer_iovec_write_setup(&bench_rb, iov);
+        ((uint8_t *)iov[0].base)[0] = (uint8_t)i;
+        chry_ringbuffer_linear_write_done(&bench_rb, BENCH_BLOCK_SIZE);
+        chry_ringbuffer_iovec_read_setup(&bench_rb, iov);
+        chry_ringbuffer_linear_read_done(&bench_rb, iov[0].len + iov[1].len);
+    }
+    bench_report("iovec w+r", chry_ringbuffer_bench_get_cycle() - start, BENCH_LOOPS, BENCH_LOOPS * BENCH_BLOCK_SIZE);
+}
+
+void chry_ringbuffer_bench(void)
+{
+    chry_ringbuffer_init(&bench_rb, bench_pool, BENCH_POOL_SIZE);
+    memset(bench_block, 0x5a, sizeof(bench_block));
+
+    bench_byte();
+    bench_block_copy();
+    bench_iovec();
+}
+
+#ifdef CHRY_RINGBUFFER_BENCH_MAIN
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define STRESS_POOL_SIZE 256
+#define STRESS_TOTAL     (16 * 1024 * 1024)
+
+static chry_ringbuffer_t stress_rb;
+static uint8_t stress_pool[STRESS_POOL_SIZE];
+
+static uint64_t bench_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* nanosecond as cycle on pc */
+uint32_t chry_ringbuffer_bench_get_cycle(void)
+{
+    return (uint32_t)bench_get_ns();
+}
+
+/* byte sequence is i & 0xff, producer and consumer rotate through all apis */
+static void *stress_producer(void *arg)
+{
+    chry_ringbuffer_iovec_t iov[2];
+    uint8_t buf[97];
+    uint32_t seq = 0;
+    uint32_t last;
+    uint32_t len;
+
+    (void)arg;
+    while (seq < STRESS_TOTAL) {
+        last = seq;
+        switch (seq % 3) {
+            case 0:
+                seq += chry_ringbuffer_write_byte(&stress_rb, (uint8_t)seq);
+                break;
+            case 1:
+                len = (seq % sizeof(buf)) + 1;
+                for (uint32_t i = 0; i < len; i++) {
+                    buf[i] = (uint8_t)(seq + i);
+                }
+                seq += chry_ringbuffer_write(&stress_rb, buf, len);
+                break;
+            default:
+                chry_ringbuffer_iovec_write_setup(&stress_rb, iov);
+                len = 0;
+                for (uint8_t n = 0; n < 2; n++) {
+                    for (uint32_t i = 0; i < iov[n].len; i++) {
+                        ((uint8_t *)iov[n].base)[i] = (uint8_t)(seq + len++);
+                    }
+                }
+                seq += chry_ringbuffer_linear_write_done(&stress_rb, len);
+                break;
+        }
+        if (seq == last) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+    chry_ringbuffer_iovec_t iov[2];
+    uint8_t buf[61];
+    uint32_t seq = 0;
+    uint32_t last;
+    uint32_t len;
+    uint32_t errors = 0;
+    uint8_t byte;
+
+    while (seq < STRESS_TOTAL) {
+        last = seq;
+        switch (seq % 3) {
+            case 0:
+                if (chry_ringbuffer_read_byte(&stress_rb, &byte)) {
+                    errors += (byte != (uint8_t)seq);
+                    seq++;
+                }
+                break;
+            case 1:
+                len = chry_ringbuffer_read(&stress_rb, buf, (seq % sizeof(buf)) + 1);
+                for (uint32_t i = 0; i < len; i++) {
+                    errors += (buf[i] != (uint8_t)(seq + i));
+                }
+                seq += len;
+                break;
+            default:
+                chry_ringbuffer_iovec_read_setup(&stress_rb, iov);
+                len = 0;
+                for (uint8_t n = 0; n < 2; n++) {
+                    for (uint32_t i = 0; i < iov[n].len; i++) {
+                        errors += (((uint8_t *)iov[n].base)[i] != (uint8_t)(seq + len++));
+                    }
+                }
+                seq += chry_ringbuffer_linear_read_done(&stress_rb, len);
+                break;
+        }
+        if (seq == last) {
+            sched_yield();
+        }
+    }
+    *(uint32_t *)arg = errors;
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t producer;
+    pthread_t consumer;
+    uint32_t errors = 0;
+    uint64_t start;
+
+    chry_ringbuffer_bench();
+
+    chry_ringbuffer_init(&stress_rb, stress_pool, STRESS_POOL_SIZE);
+    start = bench_get_ns();
+    pthread_create(&consumer, NULL, stress_consumer, &errors);
+    pthread_create(&producer, NULL, stress_producer, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    printf("spsc stress %u bytes in %u ms, %u errors\r\n", STRESS_TOTAL,
+           (unsigned int)((bench_get_ns() - start) / 1000000), (unsigned int)errors);
+    return errors ? 1 : 0;
+}
+#endif
@@ -23,6 +23,7 @@
  */
 
 #include "dhserver.h"
+#include "lwip/inet_chksum.h"
 
 /* DHCP message type */
 #define DHCP_DISCOVER 1
@@ -92,8 +93,26 @@ DHCP_TYPE              dhcp_data;
 static struct udp_pcb *pcb    = NULL;
 static dhcp_config_t  *config = NULL;
 
+/* leases by client mac */
+static dhcp_entry_t *entry_hash[DHSERV_HASH_SIZE];
+
+/* reply options are the same for every lease except these fields, see fill_options */
+#define OPTS_MSGTYPE_OFS 2
+#define OPTS_LEASE_OFS   11
+#define OPTS_SUBNET_OFS  17
+static uint8_t opts_template[sizeof(dhcp_data.dp_options)];
+static int     opts_len;
+
+#define ETH_HLEN 14
+static uint16_t ip_id;
+
 char magic_cookie[] = { 0x63, 0x82, 0x53, 0x63 };
 
+static inline int mac_hash(const uint8_t *mac)
+{
+    return (mac[3] ^ mac[4] ^ mac[5]) & (DHSERV_HASH_SIZE - 1);
+}
+
 static dhcp_entry_t *entry_by_ip(uint32_t ip)
 {
     int i;
@@ -105,10 +124,10 @@ static dhcp_entry_t *entry_by_ip(uint32_t ip)
 
 static dhcp_entry_t *entry_by_mac(uint8_t *mac)
 {
-    int i;
-    for (i = 0; i < config->num_entry; i++)
-        if (memcmp(config->entries[i].mac, mac, 6) == 0)
-            return &config->entries[i];
+    dhcp_entry_t *entry;
+    for (entry = entry_hash[mac_hash(mac)]; entry != NULL; entry = entry->next)
+        if (memcmp(entry->mac, mac, 6) == 0)
+            return entry;
     return NULL;
 }
 
@@ -126,8 +145,24 @@ static dhcp_entry_t *vacant_address(void)
     return NULL;
 }
 
-static inline void free_entry(dhcp_entry_t *entry)
+static void bind_entry(dhcp_entry_t *entry, const uint8_t *mac)
+{
+    int h = mac_hash(mac);
+    memcpy(entry->mac, mac, 6);
+    entry->next   = entry_hash[h];
+    entry_hash[h] = entry;
+}
+
+static void free_entry(dhcp_entry_t *entry)
 {
+    dhcp_entry_t **pp;
+    for (pp = &entry_hash[mac_hash(entry->mac)]; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == entry) {
+            *pp = entry->next;
+            break;
+        }
+    }
+    entry->next = NULL;
     memset(entry->mac, 0, 6);
 }
 
@@ -210,58 +245,50 @@ int fill_options(void       *dest,
     return ptr - (uint8_t *)dest;
 }
 
-static void udp_recv_proc(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+static void fill_reply(dhcp_entry_t *entry, uint8_t msg_type)
+{
+    uint8_t *opts = dhcp_data.dp_options;
+
+    dhcp_data.dp_op                  = 2; /* reply */
+    dhcp_data.dp_secs                = 0;
+    dhcp_data.dp_flags               = 0;
+    *(uint32_t *)dhcp_data.dp_yiaddr = *(uint32_t *)entry->addr;
+    memcpy(dhcp_data.dp_magic, magic_cookie, 4);
+
+    memcpy(opts, opts_template, opts_len);
+    memset(opts + opts_len, 0, sizeof(dhcp_data.dp_options) - opts_len);
+    opts[OPTS_MSGTYPE_OFS]   = msg_type;
+    opts[OPTS_LEASE_OFS + 0] = (entry->lease >> 24) & 0xFF;
+    opts[OPTS_LEASE_OFS + 1] = (entry->lease >> 16) & 0xFF;
+    opts[OPTS_LEASE_OFS + 2] = (entry->lease >> 8) & 0xFF;
+    opts[OPTS_LEASE_OFS + 3] = (entry->lease >> 0) & 0xFF;
+    memcpy(opts + OPTS_SUBNET_OFS, entry->subnet, 4);
+}
+
+/* request is in dhcp_data, reply is built in place, returns reply length or 0 */
+static int dhserv_process(void)
 {
-    (void)arg;
-    (void)addr;
     uint8_t      *ptr;
     dhcp_entry_t *entry;
-    struct pbuf  *pp;
 
-    uint32_t n = p->len;
-    if (n > sizeof(dhcp_data))
-        n = sizeof(dhcp_data);
-    memcpy(&dhcp_data, p->payload, n);
     switch (dhcp_data.dp_options[2]) {
     case DHCP_DISCOVER:
         entry = entry_by_mac(dhcp_data.dp_chaddr);
         if (entry == NULL)
             entry = vacant_address();
         if (entry == NULL)
-            break;
+            return 0;
 
-        dhcp_data.dp_op                  = 2; /* reply */
-        dhcp_data.dp_secs                = 0;
-        dhcp_data.dp_flags               = 0;
-        *(uint32_t *)dhcp_data.dp_yiaddr = *(uint32_t *)entry->addr;
-        memcpy(dhcp_data.dp_magic, magic_cookie, 4);
-
-        memset(dhcp_data.dp_options, 0, sizeof(dhcp_data.dp_options));
-
-        fill_options(dhcp_data.dp_options,
-                     DHCP_OFFER,
-                     config->domain,
-                     *(uint32_t *)config->dns,
-                     entry->lease,
-                     *(uint32_t *)config->addr,
-                     *(uint32_t *)config->addr,
-                     *(uint32_t *)entry->subnet);
-
-        pp = pbuf_alloc(PBUF_TRANSPORT, sizeof(dhcp_data), PBUF_POOL);
-        if (pp == NULL)
-            break;
-        memcpy(pp->payload, &dhcp_data, sizeof(dhcp_data));
-        udp_sendto(upcb, pp, IP_ADDR_BROADCAST, port);
-        pbuf_free(pp);
-        break;
+        fill_reply(entry, DHCP_OFFER);
+        return sizeof(dhcp_data);
 
     case DHCP_REQUEST:
         /* 1. find requested ipaddr in option list */
         ptr = find_dhcp_option(dhcp_data.dp_options, sizeof(dhcp_data.dp_options), DHCP_IPADDRESS);
         if (ptr == NULL)
-            break;
+            return 0;
         if (ptr[1] != 4)
-            break;
+            return 0;
         ptr += 2;
 
         /* 2. does hw-address registered? */
@@ -272,48 +299,126 @@ static void udp_recv_proc(void *arg, struct udp_pcb *upcb, struct pbuf *p, const
         /* 3. find requested ipaddr */
         entry = entry_by_ip(*(uint32_t *)ptr);
         if (entry == NULL)
-            break;
+            return 0;
         if (!is_vacant(entry))
-            break;
+            return 0;
 
-        /* 4. fill struct fields */
-        memcpy(dhcp_data.dp_yiaddr, ptr, 4);
-        dhcp_data.dp_op    = 2; /* reply */
-        dhcp_data.dp_secs  = 0;
-        dhcp_data.dp_flags = 0;
-        memcpy(dhcp_data.dp_magic, magic_cookie, 4);
-
-        /* 5. fill options */
-        memset(dhcp_data.dp_options, 0, sizeof(dhcp_data.dp_options));
-
-        fill_options(dhcp_data.dp_options,
-                     DHCP_ACK,
-                     config->domain,
-                     *(uint32_t *)config->dns,
-                     entry->lease,
-                     *(uint32_t *)config->addr,
-                     *(uint32_t *)config->addr,
-                     *(uint32_t *)entry->subnet);
-
-        /* 6. send ACK */
-        pp = pbuf_alloc(PBUF_TRANSPORT, sizeof(dhcp_data), PBUF_POOL);
-        if (pp == NULL)
-            break;
-        memcpy(entry->mac, dhcp_data.dp_chaddr, 6);
-        memcpy(pp->payload, &dhcp_data, sizeof(dhcp_data));
-        udp_sendto(upcb, pp, IP_ADDR_BROADCAST, port);
-        pbuf_free(pp);
-        break;
+        /* 4. fill reply, 5. bind lease */
+        fill_reply(entry, DHCP_ACK);
+        bind_entry(entry, dhcp_data.dp_chaddr);
+        return sizeof(dhcp_data);
 
     default:
-        break;
+        return 0;
+    }
+}
+
+static void udp_recv_proc(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    (void)arg;
+    (void)addr;
+    struct pbuf *pp;
+    int          len;
+
+    uint32_t n = p->len;
+    if (n > sizeof(dhcp_data))
+        n = sizeof(dhcp_data);
+    memcpy(&dhcp_data, p->payload, n);
+
+    len = dhserv_process();
+    if (len > 0) {
+        pp = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_POOL);
+        if (pp != NULL) {
+            memcpy(pp->payload, &dhcp_data, len);
+            udp_sendto(upcb, pp, IP_ADDR_BROADCAST, port);
+            pbuf_free(pp);
+        }
     }
     pbuf_free(p);
 }
 
+bool dhserv_input(struct netif *netif, struct pbuf *p)
+{
+    uint8_t        *frame = (uint8_t *)p->payload;
+    struct ip_hdr  *iphdr;
+    struct udp_hdr *udphdr;
+    struct pbuf    *out;
+    uint16_t        hlen;
+    uint16_t        ulen;
+    uint16_t        sport;
+    int             len;
+
+    if (config == NULL || p->len != p->tot_len || p->len < ETH_HLEN + IP_HLEN + UDP_HLEN)
+        return false;
+    if (frame[12] != 0x08 || frame[13] != 0x00)
+        return false;
+
+    iphdr = (struct ip_hdr *)(frame + ETH_HLEN);
+    hlen  = IPH_HL(iphdr) * 4;
+    if (IPH_V(iphdr) != 4 || IPH_PROTO(iphdr) != IP_PROTO_UDP || hlen < IP_HLEN)
+        return false;
+    if ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0)
+        return false;
+    if (p->len < ETH_HLEN + hlen + UDP_HLEN)
+        return false;
+
+    udphdr = (struct udp_hdr *)((uint8_t *)iphdr + hlen);
+    if (udphdr->dest != lwip_htons(config->port))
+        return false;
+    ulen = lwip_ntohs(udphdr->len);
+    if (ulen < UDP_HLEN || ETH_HLEN + hlen + ulen > p->len)
+        return false;
+
+    ulen -= UDP_HLEN;
+    if (ulen > sizeof(dhcp_data))
+        ulen = sizeof(dhcp_data);
+    sport = udphdr->src;
+    memcpy(&dhcp_data, (uint8_t *)udphdr + UDP_HLEN, ulen);
+
+    len = dhserv_process();
+    if (len == 0)
+        return true;
+
+    /* client has no address yet, reply is broadcast as udp_recv_proc does */
+    out = pbuf_alloc(PBUF_RAW, ETH_HLEN + IP_HLEN + UDP_HLEN + len, PBUF_RAM);
+    if (out == NULL)
+        return true;
+    frame = (uint8_t *)out->payload;
+
+    memset(frame, 0xFF, 6);
+    memcpy(frame + 6, netif->hwaddr, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    iphdr = (struct ip_hdr *)(frame + ETH_HLEN);
+    IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+    IPH_TOS_SET(iphdr, 0);
+    IPH_LEN_SET(iphdr, lwip_htons(IP_HLEN + UDP_HLEN + len));
+    IPH_ID_SET(iphdr, lwip_htons(ip_id++));
+    IPH_OFFSET_SET(iphdr, 0);
+    IPH_TTL_SET(iphdr, 64);
+    IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+    IPH_CHKSUM_SET(iphdr, 0);
+    memcpy(&iphdr->src, config->addr, 4);
+    memset(&iphdr->dest, 0xFF, 4);
+    IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+
+    udphdr         = (struct udp_hdr *)(frame + ETH_HLEN + IP_HLEN);
+    udphdr->src    = lwip_htons(config->port);
+    udphdr->dest   = sport;
+    udphdr->len    = lwip_htons(UDP_HLEN + len);
+    udphdr->chksum = 0; /* optional for ipv4 */
+    memcpy(frame + ETH_HLEN + IP_HLEN + UDP_HLEN, &dhcp_data, len);
+
+    netif->linkoutput(netif, out);
+    pbuf_free(out);
+    return true;
+}
+
 err_t dhserv_init(dhcp_config_t *c)
 {
     err_t err;
+    int   i;
     udp_init();
     dhserv_free();
     pcb = udp_new();
@@ -326,6 +431,22 @@ err_t dhserv_init(dhcp_config_t *c)
     }
     udp_recv(pcb, udp_recv_proc, NULL);
     config = c;
+
+    /* index leases given in the config, message type, lease and subnet are patched per reply */
+    memset(entry_hash, 0, sizeof(entry_hash));
+    for (i = 0; i < c->num_entry; i++) {
+        c->entries[i].next = NULL;
+        if (!is_vacant(&c->entries[i]))
+            bind_entry(&c->entries[i], c->entries[i].mac);
+    }
+    opts_len = fill_options(opts_template,
+                            0,
+                            c->domain,
+                            *(uint32_t *)c->dns,
+                            0,
+                            *(uint32_t *)c->addr,
+                            *(uint32_t *)c->addr,
+                            0);
     return ERR_OK;
 }
 
@@ -39,11 +39,17 @@
 #include "lwip/udp.h"
 #include "netif/etharp.h"
 
+/* buckets of the lease table, keyed by client mac, must be a power of 2 */
+#ifndef DHSERV_HASH_SIZE
+#define DHSERV_HASH_SIZE 16
+#endif
+
 typedef struct dhcp_entry {
     uint8_t  mac[6];
     uint8_t  addr[4];
     uint8_t  subnet[4];
     uint32_t lease;
+    struct dhcp_entry *next; /* hash chain, managed by server */
 } dhcp_entry_t;
 
 typedef struct dhcp_config {
@@ -58,4 +64,11 @@ typedef struct dhcp_config {
 err_t dhserv_init(dhcp_config_t *config);
 void  dhserv_free(void);
 
+/*
+ * Answer a dhcp request straight from a received ethernet frame and send the reply
+ * with netif->linkoutput, call it before netif->input in the same context as lwip.
+ * Returns true when the frame was a dhcp request for this server, caller still owns p.
+ */
+bool  dhserv_input(struct netif *netif, struct pbuf *p);
+
 #endif /* DHSERVER_H */
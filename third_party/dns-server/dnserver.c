@@ -28,11 +28,18 @@
  */
 
 #include "dnserver.h"
+#include "lwip/inet_chksum.h"
 
 #define DNS_MAX_HOST_NAME_LEN 128
+#define DNS_ANSWER_LEN        16
+
+#define ETH_HLEN 14
 
 static struct udp_pcb *pcb;
 dns_query_proc_t       query_proc;
+static ip_addr_t       bind_addr;
+static uint16_t        bind_port;
+static uint16_t        ip_id;
 
 #pragma pack(push, 1)
 typedef struct {
@@ -123,46 +130,117 @@ static int parse_next_query(void *data, int size, dns_query_t *query)
     return ptr - (uint8_t *)data;
 }
 
-static void udp_recv_proc(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+#if DNSERV_CACHE_SIZE > 0
+typedef struct dns_cache {
+    uint32_t  hash; /* 0 means empty */
+    bool      found;
+    ip_addr_t addr;
+    char      name[DNS_MAX_HOST_NAME_LEN];
+} dns_cache_t;
+
+static dns_cache_t cache[DNSERV_CACHE_SIZE];
+static int         cache_next;
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u; /* fnv-1a */
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h ? h : 1;
+}
+#endif
+
+void dnserv_flush(void)
+{
+#if DNSERV_CACHE_SIZE > 0
+    memset(cache, 0, sizeof(cache));
+    cache_next = 0;
+#endif
+}
+
+/* query_proc with the answer remembered, unknown names are remembered too */
+static bool lookup(const char *name, ip_addr_t *addr)
+{
+#if DNSERV_CACHE_SIZE > 0
+    uint32_t     h = name_hash(name);
+    dns_cache_t *c;
+    int          i;
+
+    for (i = 0; i < DNSERV_CACHE_SIZE; i++) {
+        c = &cache[i];
+        if (c->hash == h && strcmp(c->name, name) == 0) {
+            *addr = c->addr;
+            return c->found;
+        }
+    }
+
+    c        = &cache[cache_next];
+    c->found = query_proc(name, &c->addr);
+    c->hash  = h;
+    strcpy(c->name, name);
+    cache_next = (cache_next + 1) % DNSERV_CACHE_SIZE;
+
+    *addr = c->addr;
+    return c->found;
+#else
+    return query_proc(name, addr);
+#endif
+}
+
+/* build the reply for query req into resp (size + DNS_ANSWER_LEN bytes), returns reply length or -1 */
+static int dnserv_process(const void *req, int size, void *resp)
 {
-    (void)arg;
     int                len;
     dns_header_t      *header;
     static dns_query_t query;
-    struct pbuf       *out;
     ip_addr_t          host_addr;
     dns_answer_t      *answer;
 
-    if (p->len <= sizeof(dns_header_t))
-        goto error;
-    header = (dns_header_t *)p->payload;
+    if (size <= (int)sizeof(dns_header_t))
+        return -1;
+    header = (dns_header_t *)req;
     if (header->flags.qr != 0)
-        goto error;
+        return -1;
     if (ntohs(header->n_record[0]) != 1)
-        goto error;
+        return -1;
 
-    len = parse_next_query(header + 1, p->len - sizeof(dns_header_t), &query);
+    len = parse_next_query((dns_header_t *)req + 1, size - sizeof(dns_header_t), &query);
     if (len < 0)
-        goto error;
-    if (!query_proc(query.name, &host_addr))
-        goto error;
+        return -1;
+    if (!lookup(query.name, &host_addr))
+        return -1;
 
     len += sizeof(dns_header_t);
-    out = pbuf_alloc(PBUF_TRANSPORT, len + 16, PBUF_POOL);
-    if (out == NULL)
-        goto error;
-
-    memcpy(out->payload, p->payload, len);
-    header              = (dns_header_t *)out->payload;
+    memmove(resp, req, len);
+    header              = (dns_header_t *)resp;
     header->flags.qr    = 1;
     header->n_record[1] = htons(1);
-    answer              = (struct dns_answer *)((uint8_t *)out->payload + len);
+    answer              = (struct dns_answer *)((uint8_t *)resp + len);
     answer->name        = htons(0xC00C);
     answer->type        = htons(1);
     answer->Class       = htons(1);
     answer->ttl         = htonl(32);
     answer->len         = htons(4);
-    answer->addr        = host_addr.addr;
+    answer->addr        = ip_2_ip4(&host_addr)->addr;
+    return len + DNS_ANSWER_LEN;
+}
+
+static void udp_recv_proc(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    (void)arg;
+    int          len;
+    struct pbuf *out;
+
+    out = pbuf_alloc(PBUF_TRANSPORT, p->len + DNS_ANSWER_LEN, PBUF_POOL);
+    if (out == NULL)
+        goto error;
+
+    len = dnserv_process(p->payload, p->len, out->payload);
+    if (len < 0) {
+        pbuf_free(out);
+        goto error;
+    }
+    pbuf_realloc(out, len);
 
     udp_sendto(upcb, out, addr, port);
     pbuf_free(out);
@@ -171,6 +249,85 @@ error:
     pbuf_free(p);
 }
 
+bool dnserv_input(struct netif *netif, struct pbuf *p)
+{
+    uint8_t        *frame = (uint8_t *)p->payload;
+    uint8_t        *reply;
+    struct ip_hdr  *iphdr;
+    struct ip_hdr  *rip;
+    struct udp_hdr *udphdr;
+    struct udp_hdr *rudp;
+    struct pbuf    *out;
+    uint16_t        hlen;
+    uint16_t        ulen;
+    int             len;
+
+    if (pcb == NULL || p->len != p->tot_len || p->len < ETH_HLEN + IP_HLEN + UDP_HLEN)
+        return false;
+    if (frame[12] != 0x08 || frame[13] != 0x00)
+        return false;
+
+    iphdr = (struct ip_hdr *)(frame + ETH_HLEN);
+    hlen  = IPH_HL(iphdr) * 4;
+    if (IPH_V(iphdr) != 4 || IPH_PROTO(iphdr) != IP_PROTO_UDP || hlen < IP_HLEN)
+        return false;
+    if ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0)
+        return false;
+    if (!ip_addr_isany(&bind_addr) && memcmp(&iphdr->dest, ip_2_ip4(&bind_addr), 4) != 0)
+        return false;
+    if (p->len < ETH_HLEN + hlen + UDP_HLEN)
+        return false;
+
+    udphdr = (struct udp_hdr *)((uint8_t *)iphdr + hlen);
+    if (udphdr->dest != lwip_htons(bind_port))
+        return false;
+    ulen = lwip_ntohs(udphdr->len);
+    if (ulen < UDP_HLEN || ETH_HLEN + hlen + ulen > p->len)
+        return false;
+    ulen -= UDP_HLEN;
+
+    out = pbuf_alloc(PBUF_RAW, ETH_HLEN + IP_HLEN + UDP_HLEN + ulen + DNS_ANSWER_LEN, PBUF_RAM);
+    if (out == NULL)
+        return true;
+    reply = (uint8_t *)out->payload;
+
+    len = dnserv_process((uint8_t *)udphdr + UDP_HLEN, ulen, reply + ETH_HLEN + IP_HLEN + UDP_HLEN);
+    if (len < 0) {
+        pbuf_free(out);
+        return true;
+    }
+    pbuf_realloc(out, ETH_HLEN + IP_HLEN + UDP_HLEN + len);
+
+    /* reply goes back to where the query came from */
+    memcpy(reply, frame + 6, 6);
+    memcpy(reply + 6, netif->hwaddr, 6);
+    reply[12] = 0x08;
+    reply[13] = 0x00;
+
+    rip = (struct ip_hdr *)(reply + ETH_HLEN);
+    IPH_VHL_SET(rip, 4, IP_HLEN / 4);
+    IPH_TOS_SET(rip, 0);
+    IPH_LEN_SET(rip, lwip_htons(IP_HLEN + UDP_HLEN + len));
+    IPH_ID_SET(rip, lwip_htons(ip_id++));
+    IPH_OFFSET_SET(rip, 0);
+    IPH_TTL_SET(rip, 64);
+    IPH_PROTO_SET(rip, IP_PROTO_UDP);
+    IPH_CHKSUM_SET(rip, 0);
+    memcpy(&rip->src, &iphdr->dest, 4);
+    memcpy(&rip->dest, &iphdr->src, 4);
+    IPH_CHKSUM_SET(rip, inet_chksum(rip, IP_HLEN));
+
+    rudp         = (struct udp_hdr *)(reply + ETH_HLEN + IP_HLEN);
+    rudp->src    = udphdr->dest;
+    rudp->dest   = udphdr->src;
+    rudp->len    = lwip_htons(UDP_HLEN + len);
+    rudp->chksum = 0; /* optional for ipv4 */
+
+    netif->linkoutput(netif, out);
+    pbuf_free(out);
+    return true;
+}
+
 err_t dnserv_init(const ip_addr_t *bind, uint16_t port, dns_query_proc_t qp)
 {
     err_t err;
@@ -186,6 +343,9 @@ err_t dnserv_init(const ip_addr_t *bind, uint16_t port, dns_query_proc_t qp)
     }
     udp_recv(pcb, udp_recv_proc, NULL);
     query_proc = qp;
+    ip_addr_copy(bind_addr, *bind);
+    bind_port = port;
+    dnserv_flush();
     return ERR_OK;
 }
 
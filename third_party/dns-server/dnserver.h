@@ -39,9 +39,24 @@
 #include "lwip/udp.h"
 #include "netif/etharp.h"
 
+/* names remembered with their query_proc result, 0 disables the cache */
+#ifndef DNSERV_CACHE_SIZE
+#define DNSERV_CACHE_SIZE 4
+#endif
+
 typedef bool (*dns_query_proc_t)(const char *name, ip_addr_t *addr);
 
 err_t dnserv_init(const ip_addr_t *bind, uint16_t port, dns_query_proc_t query_proc);
 void  dnserv_free(void);
 
+/* forget cached answers, call it when query_proc starts answering differently */
+void  dnserv_flush(void);
+
+/*
+ * Answer a dns query straight from a received ethernet frame and send the reply
+ * with netif->linkoutput, call it before netif->input in the same context as lwip.
+ * Returns true when the frame was a query for this server, caller still owns p.
+ */
+bool  dnserv_input(struct netif *netif, struct pbuf *p);
+
 #endif
@@ -34,14 +34,8 @@ static int hci_usb_frame_cb(uint8_t pkt_type, void *data)
 
 void usbh_bluetooth_hci_read_callback(uint8_t *data, uint32_t len)
 {
-    size_t remaining = len;
-    uint8_t pkt_indicator;
-
-    pkt_indicator = *data++;
-    remaining -= sizeof(pkt_indicator);
-
-    hci_h4_sm_rx(&g_hci_h4sm, &pkt_indicator, 1);
-    hci_h4_sm_rx(&g_hci_h4sm, data, remaining);
+    /* data is always one complete packet with indicator */
+    hci_h4_sm_rx(&g_hci_h4sm, data, len);
 }
 
 int ble_transport_to_ll_cmd_impl(void *buf)
@@ -7,6 +7,7 @@ import os
 import os.path
 import argparse
 import json
+import zlib
 from time import sleep
 
 
@@ -14,6 +15,16 @@ UF2_MAGIC_START0 = 0x0A324655 # "UF2\n"
 UF2_MAGIC_START1 = 0x9E5D5157 # Randomly selected
 UF2_MAGIC_END    = 0x0AB16F30 # Ditto
 
+UF2_FLAG_NOT_MAIN_FLASH = 0x00000001
+UF2_FLAG_FAMILYID       = 0x00002000
+
+# Compressed image, see class/dfu/dfu_image.h
+IMAGE_MAGIC        = 0x57465543 # "CUFW"
+IMAGE_VERSION      = 1
+IMAGE_FLAG_LZ4     = 0x0001
+IMAGE_BLOCK_STORED = 0x80000000
+IMAGE_BLOCK_SIZE   = 4096
+
 INFO_FILE = "/INFO_UF2.TXT"
 
 appstartaddr = 0x2000
@@ -117,23 +128,82 @@ def convert_to_carray(file_content):
     outp += "\n};\n"
     return bytes(outp, "utf-8")
 
-def convert_to_uf2(file_content):
+def lz4_length(outp, n):
+    while n >= 255:
+        outp.append(255)
+        n -= 255
+    outp.append(n)
+
+def lz4_sequence(outp, literals, offset, matchlen):
+    token = min(len(literals), 15) << 4
+    if offset:
+        token |= min(matchlen - 4, 15)
+    outp.append(token)
+    if len(literals) >= 15:
+        lz4_length(outp, len(literals) - 15)
+    outp += literals
+    if offset:
+        outp += struct.pack(b"<H", offset)
+        if matchlen - 4 >= 15:
+            lz4_length(outp, matchlen - 4 - 15)
+
+def lz4_compress_block(src):
+    # greedy lz4 block format, the last 5 bytes are literals and
+    # the last match starts at least 12 bytes before the end
+    outp = bytearray()
+    table = {}
+    anchor = 0
+    pos = 0
+    mflimit = len(src) - 12
+    matchlimit = len(src) - 5
+    while pos < mflimit:
+        key = src[pos:pos + 4]
+        ref = table.get(key, -1)
+        table[key] = pos
+        if ref < 0 or pos - ref > 0xffff:
+            pos += 1
+            continue
+        matchlen = 4
+        while pos + matchlen < matchlimit and src[ref + matchlen] == src[pos + matchlen]:
+            matchlen += 1
+        lz4_sequence(outp, src[anchor:pos], pos - ref, matchlen)
+        pos += matchlen
+        anchor = pos
+    lz4_sequence(outp, src[anchor:], 0, 0)
+    return bytes(outp)
+
+def make_image(file_content):
+    payload = []
+    for ptr in range(0, len(file_content), IMAGE_BLOCK_SIZE):
+        chunk = file_content[ptr:ptr + IMAGE_BLOCK_SIZE]
+        packed = lz4_compress_block(chunk)
+        if len(packed) < len(chunk):
+            payload.append(struct.pack(b"<I", len(packed)) + packed)
+        else:
+            payload.append(struct.pack(b"<I", len(chunk) | IMAGE_BLOCK_STORED) + chunk)
+    payload = b"".join(payload)
+    hd = struct.pack(b"<IHHIIII", IMAGE_MAGIC, IMAGE_VERSION, IMAGE_FLAG_LZ4, IMAGE_BLOCK_SIZE,
+                     len(file_content), len(payload), zlib.crc32(file_content))
+    hd += struct.pack(b"<I", zlib.crc32(hd))
+    return hd + payload
+
+def convert_to_uf2(file_content, payload_size=256, extra_flags=0x0):
     global familyid
     datapadding = b""
-    while len(datapadding) < 512 - 256 - 32 - 4:
+    while len(datapadding) < 512 - payload_size - 32 - 4:
         datapadding += b"\x00\x00\x00\x00"
-    numblocks = (len(file_content) + 255) // 256
+    numblocks = (len(file_content) + payload_size - 1) // payload_size
     outp = []
     for blockno in range(numblocks):
-        ptr = 256 * blockno
-        chunk = file_content[ptr:ptr + 256]
-        flags = 0x0
+        ptr = payload_size * blockno
+        chunk = file_content[ptr:ptr + payload_size]
+        flags = extra_flags
         if familyid:
-            flags |= 0x2000
+            flags |= UF2_FLAG_FAMILYID
         hd = struct.pack(b"<IIIIIIII",
             UF2_MAGIC_START0, UF2_MAGIC_START1,
-            flags, ptr + appstartaddr, 256, blockno, numblocks, familyid)
-        while len(chunk) < 256:
+            flags, ptr + appstartaddr, payload_size, blockno, numblocks, familyid)
+        while len(chunk) < payload_size:
             chunk += b"\x00"
         block = hd + chunk + datapadding + struct.pack(b"<I", UF2_MAGIC_END)
         assert len(block) == 512
@@ -297,6 +367,10 @@ def main():
                         help='convert binary file to a C array, not UF2')
     parser.add_argument('-i', '--info', action='store_true',
                         help='display header information from UF2, do not convert')
+    parser.add_argument('-z', '--compress', action='store_true',
+                        help='compress BIN into a UF2 image decoded by bootloader with CONFIG_BOOTUF2_IMAGE')
+    parser.add_argument('--image', action='store_true',
+                        help='compress BIN into an image for dfu-util and CONFIG_USBDEV_DFU_IMAGE, not UF2')
     args = parser.parse_args()
     appstartaddr = int(args.base, 0)
 
@@ -319,6 +393,8 @@ def main():
             inpbuf = f.read()
         from_uf2 = is_uf2(inpbuf)
         ext = "uf2"
+        if (args.compress or args.image) and (from_uf2 or is_hex(inpbuf)):
+            error("Compression needs BIN input")
         if args.deploy:
             outbuf = inpbuf
         elif from_uf2 and not args.info:
@@ -332,6 +408,14 @@ def main():
         elif args.carray:
             outbuf = convert_to_carray(inpbuf)
             ext = "h"
+        elif args.image:
+            outbuf = make_image(inpbuf)
+            ext = "img"
+        elif args.compress:
+            # image blocks are not flash data, bootloaders without image support skip them
+            image = make_image(inpbuf)
+            print("Compressed %d to %d bytes" % (len(inpbuf), len(image)))
+            outbuf = convert_to_uf2(image, 476, UF2_FLAG_NOT_MAIN_FLASH)
         else:
             outbuf = convert_to_uf2(inpbuf)
         if not args.deploy and not args.info:
@@ -0,0 +1,90 @@
+# Plot output of "lsusb -T csv" or "usb_trace csv" captured from the shell.
+# usage: python usb_trace_plot.py trace.txt [--no-plot]
+import sys
+
+def parse(path):
+    hz = 1000000
+    eps = []
+    irqs = []
+    events = []
+    with open(path, 'r', errors='ignore') as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('# usb_trace'):
+                for kv in line.split()[3:]:
+                    k, v = kv.split('=')
+                    if k == 'hz':
+                        hz = int(v)
+                continue
+            cols = line.split(',')
+            if cols[0] == 'ep' and len(cols) >= 10:
+                eps.append({
+                    'name': '%s bus%s addr%s ep%s' % (cols[1], cols[2], cols[3], cols[4]),
+                    'xfers': int(cols[5]), 'bytes': int(cols[6]), 'errors': int(cols[7]),
+                    'naks': int(cols[8]), 'bps': int(cols[9]),
+                    'hist': [int(x) for x in cols[10:]]})
+            elif cols[0] == 'irq' and len(cols) >= 5:
+                irqs.append({
+                    'name': '%s bus%s irq' % (cols[1], cols[2]),
+                    'count': int(cols[3]), 'max': int(cols[4]),
+                    'hist': [int(x) for x in cols[5:]]})
+            elif cols[0] == 'ev' and len(cols) >= 8:
+                events.append((int(cols[1]), int(cols[2]), cols[3], cols[6], int(cols[7])))
+    return hz, eps, irqs, events
+
+def bucket_labels(hz, n):
+    labels = []
+    for i in range(n):
+        us = (2 << i) * 1000000.0 / hz
+        labels.append('<%.3gus' % us if i < n - 1 else '>=%.3gus' % (us / 2))
+    return labels
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: python usb_trace_plot.py trace.txt [--no-plot]')
+        return
+
+    hz, eps, irqs, events = parse(sys.argv[1])
+
+    for ep in eps:
+        print('%-28s xfers %8d bytes %10d errors %4d naks %6d %10.3f KB/s' %
+              (ep['name'], ep['xfers'], ep['bytes'], ep['errors'], ep['naks'], ep['bps'] / 1024.0))
+    for irq in irqs:
+        print('%-28s count %8d max %.3f us' % (irq['name'], irq['count'], irq['max'] * 1000000.0 / hz))
+
+    if '--no-plot' in sys.argv:
+        return
+
+    try:
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print('matplotlib is not installed, only print summary')
+        return
+
+    hists = [e for e in eps + irqs if sum(e['hist'])]
+    if hists:
+        fig, axes = plt.subplots(len(hists), 1, figsize=(10, 2.5 * len(hists)), squeeze=False)
+        for ax, h in zip(axes[:, 0], hists):
+            labels = bucket_labels(hz, len(h['hist']))
+            ax.bar(range(len(h['hist'])), h['hist'])
+            ax.set_xticks(range(len(h['hist'])))
+            ax.set_xticklabels(labels, rotation=45, fontsize=7)
+            ax.set_title(h['name'] + ' latency')
+        fig.tight_layout()
+
+    if events:
+        fig, ax = plt.subplots(figsize=(10, 3))
+        names = sorted(set((e[2], e[3]) for e in events))
+        for y, name in enumerate(names):
+            ts = [e[0] * 1000.0 / hz for e in events if (e[2], e[3]) == name]
+            ax.plot(ts, [y] * len(ts), '|', markersize=12)
+        ax.set_yticks(range(len(names)))
+        ax.set_yticklabels(['%s %s' % n for n in names])
+        ax.set_xlabel('ms')
+        ax.set_title('events')
+        fig.tight_layout()
+
+    plt.show()
+
+if __name__ == '__main__':
+    main()